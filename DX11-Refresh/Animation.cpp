@@ -0,0 +1,39 @@
+#include "Animation.h"
+#include <cmath>
+#include <cstring>
+
+unsigned int Animation::FrameAt(float time, unsigned int frameCount)
+{
+	return (unsigned int)((int)std::round(fmod(time * ANIMATION_SAMPLE_RATE, frameCount)) % (int)frameCount);
+}
+
+void Animation::SamplePose(const DirectX::XMFLOAT4X4* pClip,
+	unsigned int frameCount,
+	unsigned int jointCount,
+	float time,
+	DirectX::XMFLOAT4X4* pOutPose)
+{
+	const unsigned int frame = Animation::FrameAt(time, frameCount);
+	memcpy(pOutPose, &pClip[frame * jointCount], jointCount * sizeof(DirectX::XMFLOAT4X4));
+}
+
+void Animation::BlendPoses(const DirectX::XMFLOAT4X4* pPose,
+	const DirectX::XMFLOAT4X4* pOtherPose,
+	unsigned int jointCount,
+	float otherWeight,
+	DirectX::XMFLOAT4X4* pOutPose)
+{
+	for (unsigned int i = 0; i < jointCount; ++i)
+	{
+		DirectX::XMVECTOR scale, rotation, translation;
+		DirectX::XMVECTOR other_scale, other_rotation, other_translation;
+		// Both poses are transposed for the shaders, decompose them in their regular form
+		DirectX::XMMatrixDecompose(&scale, &rotation, &translation, DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&pPose[i])));
+		DirectX::XMMatrixDecompose(&other_scale, &other_rotation, &other_translation, DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&pOtherPose[i])));
+
+		const DirectX::XMMATRIX blended = DirectX::XMMatrixScalingFromVector(DirectX::XMVectorLerp(scale, other_scale, otherWeight)) *
+			DirectX::XMMatrixRotationQuaternion(DirectX::XMQuaternionSlerp(rotation, other_rotation, otherWeight)) *
+			DirectX::XMMatrixTranslationFromVector(DirectX::XMVectorLerp(translation, other_translation, otherWeight));
+		DirectX::XMStoreFloat4x4(&pOutPose[i], DirectX::XMMatrixTranspose(blended));
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <DirectXMath.h>
+
+// Frames per second the animation clips are sampled at
+#define ANIMATION_SAMPLE_RATE 60.0f
+
+// Sampling and blending of baked animation clips.
+// A clip holds frameCount poses of jointCount joint matrices each, frame after frame, transposed the way the skinning
+// shaders read them (see FbxLoader::AnimationSet::animationData). Clips loop and are sampled at the nearest frame.
+namespace Animation
+{
+	// Index of the frame shown time seconds into a looping clip
+	unsigned int FrameAt(float time, unsigned int frameCount);
+
+	// Copies the pose of the clip at time to pOutPose
+	void SamplePose(const DirectX::XMFLOAT4X4* pClip,
+		unsigned int frameCount,
+		unsigned int jointCount,
+		float time,
+		DirectX::XMFLOAT4X4* pOutPose);
+
+	// Interpolates every joint from pPose towards pOtherPose by otherWeight, scale and translation linearly and
+	// rotation with slerp. pOutPose may be pPose
+	void BlendPoses(const DirectX::XMFLOAT4X4* pPose,
+		const DirectX::XMFLOAT4X4* pOtherPose,
+		unsigned int jointCount,
+		float otherWeight,
+		DirectX::XMFLOAT4X4* pOutPose);
+}
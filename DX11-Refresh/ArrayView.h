@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+
+// Non-owning view of a contiguous array, the memory is owned by whoever handed out the view
+template <class T>
+struct ArrayView
+{
+	T* pData = nullptr;
+	size_t count = 0;
+
+	ArrayView() = default;
+	ArrayView(T* pFirst, size_t elementCount) : pData(pFirst), count(elementCount) {}
+
+	T* data() const { return pData; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t SizeInBytes() const { return count * sizeof(T); }
+
+	T* begin() const { return pData; }
+	T* end() const { return pData + count; }
+	T& operator[](size_t index) const { return pData[index]; }
+};
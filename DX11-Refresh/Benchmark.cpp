@@ -0,0 +1,142 @@
+#include "Benchmark.h"
+#include "RenderStats.h"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	volatile uint64_t gSink = 0;
+
+	double Seconds(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+	{
+		return std::chrono::duration<double>(end - begin).count();
+	}
+
+	void WriteString(std::ofstream& file, const std::string& text)
+	{
+		file << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				file << '\\';
+			file << c;
+		}
+		file << '"';
+	}
+}
+
+BenchmarkSuite::BenchmarkSuite()
+	: mMinTime(BENCHMARK_MIN_TIME)
+{
+}
+
+void BenchmarkSuite::SetFilter(const std::string& filter)
+{
+	this->mFilter = filter;
+}
+
+void BenchmarkSuite::SetMinTime(double seconds)
+{
+	this->mMinTime = seconds;
+}
+
+bool BenchmarkSuite::IsSelected(const char* name) const
+{
+	return this->mFilter.empty() || std::string(name).find(this->mFilter) != std::string::npos;
+}
+
+void BenchmarkSuite::Run(const char* name, double itemsPerRun, double bytesPerRun, const std::function<void()>& run)
+{
+	if (!this->IsSelected(name))
+		return;
+
+	// The warm up run fills the caches and lets the job system workers wake up
+	run();
+
+	FrameTimeHistogram times;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point now = start;
+	while (times.GetCount() < BENCHMARK_MIN_RUNS || ::Seconds(start, now) < this->mMinTime)
+	{
+		const std::chrono::steady_clock::time_point begin = now;
+		run();
+		now = std::chrono::steady_clock::now();
+		times.Record(::Seconds(begin, now));
+	}
+
+	BenchmarkResult result;
+	result.name = name;
+	result.runs = times.GetCount();
+	result.mean = times.GetMean();
+	result.min = times.GetMin();
+	result.p50 = times.GetPercentile(50.0);
+	result.p95 = times.GetPercentile(95.0);
+	result.max = times.GetMax();
+	result.itemsPerRun = itemsPerRun;
+	result.bytesPerRun = bytesPerRun;
+	this->mResults.push_back(result);
+}
+
+const std::vector<BenchmarkResult>& BenchmarkSuite::GetResults() const
+{
+	return this->mResults;
+}
+
+std::string BenchmarkSuite::FormatTable() const
+{
+	std::ostringstream stream;
+	stream << std::left << std::setw(36) << "benchmark" << std::right
+		<< std::setw(10) << "runs" << std::setw(12) << "p50 ms" << std::setw(12) << "p95 ms"
+		<< std::setw(16) << "items/s" << std::setw(12) << "MB/s" << "\n";
+	stream << std::fixed;
+	for (auto& result : this->mResults)
+	{
+		stream << std::left << std::setw(36) << result.name << std::right
+			<< std::setw(10) << result.runs
+			<< std::setprecision(3) << std::setw(12) << result.p50 * 1000.0 << std::setw(12) << result.p95 * 1000.0
+			<< std::setprecision(0) << std::setw(16) << (result.p50 > 0.0 ? result.itemsPerRun / result.p50 : 0.0)
+			<< std::setprecision(1) << std::setw(12) << (result.p50 > 0.0 ? result.bytesPerRun / result.p50 / (1024.0 * 1024.0) : 0.0)
+			<< "\n";
+	}
+	return stream.str();
+}
+
+bool BenchmarkSuite::WriteJson(const char* filepath, const std::string& label) const
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+	file << "{\n\"label\":";
+	::WriteString(file, label);
+	file << ",\n\"benchmarks\":[";
+	for (size_t i = 0; i < this->mResults.size(); ++i)
+	{
+		const BenchmarkResult& result = this->mResults[i];
+		// Times in milliseconds, throughput from the median
+		file << (i > 0 ? ",\n" : "\n") << "{\"name\":";
+		::WriteString(file, result.name);
+		file << ",\"runs\":" << result.runs
+			<< ",\"meanMs\":" << result.mean * 1000.0
+			<< ",\"minMs\":" << result.min * 1000.0
+			<< ",\"p50Ms\":" << result.p50 * 1000.0
+			<< ",\"p95Ms\":" << result.p95 * 1000.0
+			<< ",\"maxMs\":" << result.max * 1000.0
+			<< ",\"itemsPerRun\":" << result.itemsPerRun
+			<< ",\"itemsPerSecond\":" << (result.p50 > 0.0 ? result.itemsPerRun / result.p50 : 0.0)
+			<< ",\"bytesPerSecond\":" << (result.p50 > 0.0 ? result.bytesPerRun / result.p50 : 0.0) << "}";
+	}
+	file << "\n]\n}\n";
+	return file.good();
+}
+
+void BenchmarkSuite::Consume(uint64_t value)
+{
+	gSink = gSink + value;
+}
+
+void BenchmarkSuite::Consume(const void* pValue)
+{
+	gSink = gSink + (uint64_t)(uintptr_t)pValue;
+}
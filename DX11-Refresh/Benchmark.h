@@ -0,0 +1,56 @@
+#pragma once
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Seconds every benchmark is repeated for at least, after the warm up run
+#define BENCHMARK_MIN_TIME 0.5
+// Runs every benchmark gets at least, however long they take
+#define BENCHMARK_MIN_RUNS 5
+
+struct BenchmarkResult
+{
+	std::string name;
+	uint64_t runs = 0;
+	double mean = 0.0;				// Seconds per run
+	double min = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double max = 0.0;
+	double itemsPerRun = 0.0;		// What the benchmark counts as an item, vertices, characters, objects...
+	double bytesPerRun = 0.0;		// Input bytes, 0 if throughput in bytes does not apply
+};
+
+// Runs CPU microbenchmarks and collects their timings.
+// Each benchmark is a function that does one run, it is called once to warm up and then until both BENCHMARK_MIN_RUNS
+// and the minimum time are reached. Run times go into a FrameTimeHistogram for the percentiles. Throughput is
+// derived from the median. WriteJson writes everything along with a label, such as the commit, so results of
+// different builds can be compared.
+class BenchmarkSuite
+{
+public:
+	BenchmarkSuite();
+
+	// Only benchmarks whose name contains filter run, an empty filter runs all of them
+	void SetFilter(const std::string& filter);
+	void SetMinTime(double seconds);
+	bool IsSelected(const char* name) const;
+
+	// Runs the benchmark unless the filter skips it
+	void Run(const char* name, double itemsPerRun, double bytesPerRun, const std::function<void()>& run);
+
+	const std::vector<BenchmarkResult>& GetResults() const;
+	// One line per benchmark, for the console
+	std::string FormatTable() const;
+	bool WriteJson(const char* filepath, const std::string& label) const;
+
+	// Keeps the compiler from dropping a result nobody reads
+	static void Consume(uint64_t value);
+	static void Consume(const void* pValue);
+
+private:
+	std::string mFilter;
+	double mMinTime;
+	std::vector<BenchmarkResult> mResults;
+};
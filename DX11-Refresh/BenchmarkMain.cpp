@@ -0,0 +1,712 @@
+// BenchmarkMain.cpp : Microbenchmarks of the CPU side of the renderer, on generated assets.
+//
+// dx11refresh_bench [-filter text] [-json file] [-label text] [-mintime seconds] [-threads count]
+// Writes benchmark_results.json unless -json names another file. -label is stored in the JSON, pass the commit to
+// track the results per commit. -h or --help prints the usage, so does any other argument, which also fails the run.
+
+#include "Animation.h"
+#include "Benchmark.h"
+#include "Bounds.h"
+#include "Bvh.h"
+#include "Camera.h"
+#include "Crowd.h"
+#include "Culling.h"
+#include "DrawKey.h"
+#include "JobSystem.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "Obj_Loader.h"
+#include "Profiler.h"
+#include "VertexFormat.h"
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Mesh the parsing, meshlet and simplifier benchmarks use, BENCHMARK_SPHERE_RINGS^2 quads
+#define BENCHMARK_SPHERE_RINGS 128
+// Polygons of the triangulation benchmark and their corner count
+#define BENCHMARK_POLYGON_COUNT 20000
+#define BENCHMARK_POLYGON_CORNERS 8
+// Animated characters and their skeleton
+#define BENCHMARK_CHARACTER_COUNT 1000
+#define BENCHMARK_JOINT_COUNT 64
+#define BENCHMARK_CLIP_FRAMES 120
+// Objects of the culling benchmarks
+#define BENCHMARK_CULL_COUNT 1000000
+#define BENCHMARK_BVH_COUNT 100000
+// Rays and overlap boxes of the BVH query benchmarks, and the half size of the overlap boxes
+#define BENCHMARK_BVH_QUERIES 10000
+#define BENCHMARK_BVH_OVERLAP_EXTENT 10.0f
+// Of those, the ones the brute force baselines test against every box, their items/s compare with the BVH queries
+#define BENCHMARK_BVH_BRUTE_FORCE_QUERIES 100
+// Draws of the render queue benchmark, and the shaders and materials their keys are spread over
+#define BENCHMARK_DRAW_COUNT 100000
+#define BENCHMARK_DRAW_SHADERS 8
+#define BENCHMARK_DRAW_MATERIALS 512
+// Zones the profiler benchmark records per run, fewer than PROFILER_RING_SIZE so a run never wraps the ring
+#define BENCHMARK_PROFILER_ZONES 10000
+// Benchmarks are deterministic, every run generates the same assets
+#define BENCHMARK_SEED 12345
+
+namespace
+{
+	struct SyntheticMesh
+	{
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT3> normals;
+		std::vector<DirectX::XMFLOAT2> uvs;
+		std::vector<unsigned int> indices;
+	};
+
+	// The vertex of the renderer's static meshes
+	struct MeshVertex
+	{
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT3 normal;
+		DirectX::XMFLOAT2 uv;
+	};
+	VERTEX_ATTRIBUTE(MeshVertexPosition, MeshVertex, position, DirectX::XMFLOAT3, "POSITION", 0);
+	VERTEX_ATTRIBUTE(MeshVertexNormal, MeshVertex, normal, DirectX::XMFLOAT3, "NORMAL", 0);
+	VERTEX_ATTRIBUTE(MeshVertexUV, MeshVertex, uv, DirectX::XMFLOAT2, "TEXCOORD", 0);
+	typedef VertexFormat::Layout<MeshVertex, MeshVertexPosition, MeshVertexNormal, MeshVertexUV> MeshVertexLayout;
+
+	// A UV sphere with a seam, like the sphere the renderer builds for the skybox
+	SyntheticMesh GenerateSphere(unsigned int rings, unsigned int segments)
+	{
+		SyntheticMesh mesh;
+		for (unsigned int ring = 0; ring <= rings; ++ring)
+		{
+			const float theta = DirectX::XM_PI * ring / rings;
+			for (unsigned int segment = 0; segment <= segments; ++segment)
+			{
+				const float phi = DirectX::XM_2PI * segment / segments;
+				const DirectX::XMFLOAT3 normal(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+				mesh.positions.push_back(normal);
+				mesh.normals.push_back(normal);
+				mesh.uvs.push_back(DirectX::XMFLOAT2((float)segment / segments, (float)ring / rings));
+			}
+		}
+		for (unsigned int ring = 0; ring < rings; ++ring)
+		{
+			for (unsigned int segment = 0; segment < segments; ++segment)
+			{
+				const unsigned int a = ring * (segments + 1) + segment;
+				const unsigned int b = a + segments + 1;
+				const unsigned int quad[6] = { a, b, a + 1, a + 1, b, b + 1 };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	std::string FormatObj(const SyntheticMesh& mesh)
+	{
+		std::ostringstream stream;
+		for (auto& p : mesh.positions)
+		{
+			stream << "v " << p.x << " " << p.y << " " << p.z << "\n";
+		}
+		for (auto& uv : mesh.uvs)
+		{
+			stream << "vt " << uv.x << " " << uv.y << "\n";
+		}
+		for (auto& n : mesh.normals)
+		{
+			stream << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+		}
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			stream << "f";
+			for (size_t corner = i; corner < i + 3; ++corner)
+			{
+				const unsigned int index = mesh.indices[corner] + 1;
+				stream << " " << index << "/" << index << "/" << index;
+			}
+			stream << "\n";
+		}
+		return stream.str();
+	}
+
+	// Convex polygons in a grid, every face has to go through the ear clipping of objl::Loader
+	std::string FormatPolygonObj(unsigned int polygonCount, unsigned int corners)
+	{
+		std::ostringstream stream;
+		const unsigned int columns = (unsigned int)std::sqrt((double)polygonCount);
+		for (unsigned int polygon = 0; polygon < polygonCount; ++polygon)
+		{
+			const float x = (float)(polygon % columns) * 2.0f;
+			const float z = (float)(polygon / columns) * 2.0f;
+			for (unsigned int corner = 0; corner < corners; ++corner)
+			{
+				const float angle = DirectX::XM_2PI * corner / corners;
+				stream << "v " << x + cosf(angle) << " 0 " << z + sinf(angle) << "\n";
+			}
+		}
+		stream << "vt 0 0\nvn 0 1 0\n";
+		for (unsigned int polygon = 0; polygon < polygonCount; ++polygon)
+		{
+			stream << "f";
+			for (unsigned int corner = 0; corner < corners; ++corner)
+			{
+				stream << " " << polygon * corners + corner + 1 << "/1/1";
+			}
+			stream << "\n";
+		}
+		return stream.str();
+	}
+
+	bool WriteFile(const char* filepath, const std::string& text)
+	{
+		std::ofstream file(filepath, std::ios::binary);
+		file << text;
+		return file.good();
+	}
+
+	// A looping clip of random joint transforms, transposed like the clips the FBX loader bakes
+	std::vector<DirectX::XMFLOAT4X4> GenerateClip(std::mt19937& random, unsigned int frameCount, unsigned int jointCount)
+	{
+		std::uniform_real_distribution<float> angle(-DirectX::XM_PI, DirectX::XM_PI);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		std::vector<DirectX::XMFLOAT4X4> clip(frameCount * jointCount);
+		for (auto& matrix : clip)
+		{
+			const DirectX::XMMATRIX transform = DirectX::XMMatrixScaling(1.0f, 1.0f, 1.0f) *
+				DirectX::XMMatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)) *
+				DirectX::XMMatrixTranslation(offset(random), offset(random), offset(random));
+			DirectX::XMStoreFloat4x4(&matrix, DirectX::XMMatrixTranspose(transform));
+		}
+		return clip;
+	}
+
+	std::vector<Bounds::Sphere> GenerateSpheres(std::mt19937& random, unsigned int count, float extent)
+	{
+		std::uniform_real_distribution<float> position(-extent, extent);
+		std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+		std::vector<Bounds::Sphere> spheres(count);
+		for (auto& sphere : spheres)
+		{
+			sphere.center = DirectX::XMFLOAT3(position(random), position(random), position(random));
+			sphere.radius = radius(random);
+		}
+		return spheres;
+	}
+
+	Bounds::AABB BoxOf(const Bounds::Sphere& sphere)
+	{
+		Bounds::AABB box;
+		box.min = DirectX::XMFLOAT3(sphere.center.x - sphere.radius, sphere.center.y - sphere.radius, sphere.center.z - sphere.radius);
+		box.max = DirectX::XMFLOAT3(sphere.center.x + sphere.radius, sphere.center.y + sphere.radius, sphere.center.z + sphere.radius);
+		return box;
+	}
+
+	// The camera of the renderer, looking into the middle of the generated objects
+	Camera* CreateCamera()
+	{
+		return new Camera(0.0f, 10.0f, -500.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, DirectX::XM_PI * 0.45f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	}
+
+	// Where the generated files go: TMPDIR, TMP or TEMP if one is set, the system default otherwise
+	std::string GetTempDirectory()
+	{
+		const char* variables[3] = { "TMPDIR", "TMP", "TEMP" };
+		for (const char* variable : variables)
+		{
+			const char* p_directory = getenv(variable);
+			if (p_directory && *p_directory)
+				return std::string(p_directory) + "/";
+		}
+#ifdef _WIN32
+		return std::string();
+#else
+		return "/tmp/";
+#endif
+	}
+
+	void BenchmarkObj(BenchmarkSuite& suite)
+	{
+		// The loader only reads files, they are written only if one of its cases runs
+		if (!suite.IsSelected("objl/parse_triangles") && !suite.IsSelected("objl/triangulate_polygons"))
+			return;
+		const SyntheticMesh sphere = ::GenerateSphere(BENCHMARK_SPHERE_RINGS, BENCHMARK_SPHERE_RINGS);
+		const std::string triangles = ::FormatObj(sphere);
+		const std::string polygons = ::FormatPolygonObj(BENCHMARK_POLYGON_COUNT, BENCHMARK_POLYGON_CORNERS);
+		const std::string directory = ::GetTempDirectory();
+		const std::string triangles_path = directory + "dx11refresh_benchmark_triangles.obj";
+		const std::string polygons_path = directory + "dx11refresh_benchmark_polygons.obj";
+		if (!::WriteFile(triangles_path.c_str(), triangles) || !::WriteFile(polygons_path.c_str(), polygons))
+		{
+			std::cerr << "Cannot write the generated OBJ files to " << (directory.empty() ? "the working directory" : directory) << "\n";
+			std::remove(triangles_path.c_str());
+			std::remove(polygons_path.c_str());
+			return;
+		}
+
+		suite.Run("objl/parse_triangles", (double)sphere.positions.size(), (double)triangles.size(), [&]()
+		{
+			objl::Loader loader;
+			loader.LoadFile(triangles_path);
+			BenchmarkSuite::Consume(loader.LoadedVertices.size());
+		});
+		suite.Run("objl/triangulate_polygons", (double)BENCHMARK_POLYGON_COUNT, (double)polygons.size(), [&]()
+		{
+			objl::Loader loader;
+			loader.LoadFile(polygons_path);
+			BenchmarkSuite::Consume(loader.LoadedIndices.size());
+		});
+		std::remove(triangles_path.c_str());
+		std::remove(polygons_path.c_str());
+	}
+
+	void BenchmarkMesh(BenchmarkSuite& suite)
+	{
+		const SyntheticMesh sphere = ::GenerateSphere(BENCHMARK_SPHERE_RINGS, BENCHMARK_SPHERE_RINGS);
+		const unsigned int vertex_count = (unsigned int)sphere.positions.size();
+		const unsigned int index_count = (unsigned int)sphere.indices.size();
+
+		suite.Run("mesh/compute_bounds", vertex_count, vertex_count * sizeof(DirectX::XMFLOAT3), [&]()
+		{
+			Bounds::MeshBounds bounds = Bounds::ComputeBounds(sphere.positions.data(), sizeof(DirectX::XMFLOAT3), vertex_count);
+			BenchmarkSuite::Consume(&bounds);
+		});
+		std::vector<MeshVertex> vertices(vertex_count);
+		suite.Run("mesh/pack_vertices", vertex_count, vertex_count * sizeof(MeshVertex), [&]()
+		{
+			MeshVertexLayout::Pack(vertices.data(), vertex_count, sphere.positions.data(), sphere.normals.data(), sphere.uvs.data());
+			BenchmarkSuite::Consume(vertices.data());
+		});
+		suite.Run("mesh/build_meshlets", index_count / 3, 0.0, [&]()
+		{
+			std::vector<Meshlets::Meshlet> meshlets;
+			Meshlets::BuildMeshlets(sphere.positions.data(), sizeof(DirectX::XMFLOAT3), vertex_count, sphere.indices.data(), index_count, &meshlets);
+			BenchmarkSuite::Consume(meshlets.size());
+		});
+		suite.Run("mesh/simplify_lod_chain", index_count / 3, 0.0, [&]()
+		{
+			MeshSimplifier::SimplifyInput input;
+			input.pPositions = sphere.positions.data();
+			input.positionStride = sizeof(DirectX::XMFLOAT3);
+			input.pNormals = sphere.normals.data();
+			input.normalStride = sizeof(DirectX::XMFLOAT3);
+			input.pUVs = sphere.uvs.data();
+			input.uvStride = sizeof(DirectX::XMFLOAT2);
+			input.vertexCount = vertex_count;
+			input.pIndices = sphere.indices.data();
+			input.indexCount = index_count;
+			std::vector<unsigned int> lod_indices;
+			std::vector<MeshSimplifier::MeshLod> lods;
+			MeshSimplifier::BuildLodChain(input, LOD_MAX_LEVELS, &lod_indices, &lods);
+			BenchmarkSuite::Consume(lod_indices.size());
+		});
+	}
+
+	void BenchmarkAnimation(BenchmarkSuite& suite)
+	{
+		std::mt19937 random(BENCHMARK_SEED);
+		const std::vector<DirectX::XMFLOAT4X4> idle = ::GenerateClip(random, BENCHMARK_CLIP_FRAMES, BENCHMARK_JOINT_COUNT);
+		const std::vector<DirectX::XMFLOAT4X4> move = ::GenerateClip(random, BENCHMARK_CLIP_FRAMES, BENCHMARK_JOINT_COUNT);
+		std::vector<DirectX::XMFLOAT4X4> poses(BENCHMARK_CHARACTER_COUNT * BENCHMARK_JOINT_COUNT);
+		std::vector<DirectX::XMFLOAT4X4> previous_pose(BENCHMARK_JOINT_COUNT);
+		// Every character at another point of the clip, like a spawned crowd
+		std::vector<float> times(BENCHMARK_CHARACTER_COUNT);
+		std::uniform_real_distribution<float> start(0.0f, BENCHMARK_CLIP_FRAMES / ANIMATION_SAMPLE_RATE);
+		for (auto& time : times)
+		{
+			time = start(random);
+		}
+		const double palette_bytes = (double)poses.size() * sizeof(DirectX::XMFLOAT4X4);
+
+		suite.Run("animation/sample", BENCHMARK_CHARACTER_COUNT, palette_bytes, [&]()
+		{
+			for (unsigned int i = 0; i < BENCHMARK_CHARACTER_COUNT; ++i)
+			{
+				Animation::SamplePose(idle.data(), BENCHMARK_CLIP_FRAMES, BENCHMARK_JOINT_COUNT, times[i], &poses[i * BENCHMARK_JOINT_COUNT]);
+			}
+			BenchmarkSuite::Consume(poses.data());
+		});
+		suite.Run("animation/blend", BENCHMARK_CHARACTER_COUNT, palette_bytes, [&]()
+		{
+			for (unsigned int i = 0; i < BENCHMARK_CHARACTER_COUNT; ++i)
+			{
+				const unsigned int frame = Animation::FrameAt(times[i], BENCHMARK_CLIP_FRAMES);
+				Animation::BlendPoses(&idle[frame * BENCHMARK_JOINT_COUNT], &move[frame * BENCHMARK_JOINT_COUNT], BENCHMARK_JOINT_COUNT, 0.5f, &poses[i * BENCHMARK_JOINT_COUNT]);
+			}
+			BenchmarkSuite::Consume(poses.data());
+		});
+		// What FbxLoader::UniqueSkeletonData::UpdateAnimation does for a character that is switching animations
+		suite.Run("animation/crossfade", BENCHMARK_CHARACTER_COUNT, palette_bytes, [&]()
+		{
+			for (unsigned int i = 0; i < BENCHMARK_CHARACTER_COUNT; ++i)
+			{
+				DirectX::XMFLOAT4X4* p_pose = &poses[i * BENCHMARK_JOINT_COUNT];
+				Animation::SamplePose(move.data(), BENCHMARK_CLIP_FRAMES, BENCHMARK_JOINT_COUNT, times[i], p_pose);
+				Animation::SamplePose(idle.data(), BENCHMARK_CLIP_FRAMES, BENCHMARK_JOINT_COUNT, times[i] + 0.25f, previous_pose.data());
+				Animation::BlendPoses(p_pose, previous_pose.data(), BENCHMARK_JOINT_COUNT, (float)i / BENCHMARK_CHARACTER_COUNT, p_pose);
+			}
+			BenchmarkSuite::Consume(poses.data());
+		});
+
+		// The sampled poses are the palettes of the crowd, in rows like SpawnCrowd places them
+		std::vector<Crowd::Character> characters(BENCHMARK_CHARACTER_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_CHARACTER_COUNT; ++i)
+		{
+			Crowd::Character& character = characters[i];
+			character.mesh = i % 4;
+			DirectX::XMStoreFloat4x4(&character.world, DirectX::XMMatrixTranslation((float)(i % 64) * 2.0f, 0.0f, (float)(i / 64) * 2.0f));
+			character.pJointMatrices = &poses[i * BENCHMARK_JOINT_COUNT];
+			character.jointCount = BENCHMARK_JOINT_COUNT;
+		}
+		std::vector<Crowd::InstanceData> instances;
+		std::vector<DirectX::XMFLOAT4X4> palette;
+		std::vector<Crowd::Batch> batches;
+		Camera* p_camera = ::CreateCamera();
+		const DirectX::XMMATRIX view_proj = p_camera->GetViewMatrix() * p_camera->GetProjectionMatrix();
+		suite.Run("crowd/pack_palette", BENCHMARK_CHARACTER_COUNT, palette_bytes, [&]()
+		{
+			Crowd::Pack(characters.data(), BENCHMARK_CHARACTER_COUNT, 4, view_proj, &instances, &palette, &batches);
+			BenchmarkSuite::Consume(palette.data());
+		});
+		delete p_camera;
+	}
+
+	void BenchmarkCulling(BenchmarkSuite& suite)
+	{
+		std::mt19937 random(BENCHMARK_SEED);
+		Camera* p_camera = ::CreateCamera();
+		DirectX::XMFLOAT4 planes[6];
+		Culling::ExtractFrustumPlanes(p_camera->GetViewMatrix() * p_camera->GetProjectionMatrix(), planes);
+
+		const std::vector<Bounds::Sphere> spheres = ::GenerateSpheres(random, BENCHMARK_CULL_COUNT, 1000.0f);
+		Culling::SphereSoA sphere_soa;
+		Culling::AABBSoA box_soa;
+		sphere_soa.Resize(BENCHMARK_CULL_COUNT);
+		box_soa.Resize(BENCHMARK_CULL_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_CULL_COUNT; ++i)
+		{
+			sphere_soa.Set(i, spheres[i]);
+			box_soa.Set(i, ::BoxOf(spheres[i]));
+		}
+		std::vector<unsigned int> visible((std::max)(sphere_soa.PaddedCount(), box_soa.PaddedCount()));
+
+		suite.Run("cull/spheres_1m", BENCHMARK_CULL_COUNT, 0.0, [&]()
+		{
+			BenchmarkSuite::Consume(Culling::CullSpheres(sphere_soa, planes, visible.data()));
+		});
+		suite.Run("cull/spheres_1m_one_thread", BENCHMARK_CULL_COUNT, 0.0, [&]()
+		{
+			BenchmarkSuite::Consume(Culling::CullSpheres(sphere_soa, planes, visible.data(), 1));
+		});
+		suite.Run("cull/aabbs_1m", BENCHMARK_CULL_COUNT, 0.0, [&]()
+		{
+			BenchmarkSuite::Consume(Culling::CullAABBs(box_soa, planes, visible.data()));
+		});
+		// The per object test the renderer used before the SoA kernels
+		suite.Run("cull/spheres_1m_scalar", BENCHMARK_CULL_COUNT, 0.0, [&]()
+		{
+			const DirectX::XMMATRIX identity = DirectX::XMMatrixIdentity();
+			unsigned int count = 0;
+			for (auto& sphere : spheres)
+			{
+				count += Bounds::IsSphereVisible(sphere, identity, planes) ? 1 : 0;
+			}
+			BenchmarkSuite::Consume(count);
+		});
+
+		// Against a tenth of the objects, the BVH pays off once most of them are outside the frustum
+		DynamicBvh bvh;
+		std::vector<uint32_t> proxies(BENCHMARK_BVH_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+		{
+			proxies[i] = bvh.Insert(::BoxOf(spheres[i]), i);
+		}
+		bvh.Rebuild();
+		std::vector<uint32_t> bvh_visible;
+		suite.Run("bvh/query_frustum_100k", BENCHMARK_BVH_COUNT, 0.0, [&]()
+		{
+			bvh_visible.clear();
+			bvh.QueryFrustum(planes, &bvh_visible);
+			BenchmarkSuite::Consume(bvh_visible.size());
+		});
+		// The same boxes through the SIMD kernel, on one thread like the query. The BVH has to beat this to be worth it
+		Culling::AABBSoA bvh_box_soa;
+		bvh_box_soa.Resize(BENCHMARK_BVH_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+		{
+			bvh_box_soa.Set(i, ::BoxOf(spheres[i]));
+		}
+		suite.Run("bvh/brute_force_frustum_100k", BENCHMARK_BVH_COUNT, 0.0, [&]()
+		{
+			BenchmarkSuite::Consume(Culling::CullAABBs(bvh_box_soa, planes, visible.data(), 1));
+		});
+
+		// Picking and neighbour queries spread over the objects
+		std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+		std::vector<Bounds::AABB> overlap_boxes(BENCHMARK_BVH_QUERIES);
+		std::vector<DynamicBvh::Ray> rays(BENCHMARK_BVH_QUERIES);
+		for (unsigned int i = 0; i < BENCHMARK_BVH_QUERIES; ++i)
+		{
+			const DirectX::XMFLOAT3 center(position(random), position(random), position(random));
+			overlap_boxes[i].min = DirectX::XMFLOAT3(center.x - BENCHMARK_BVH_OVERLAP_EXTENT, center.y - BENCHMARK_BVH_OVERLAP_EXTENT, center.z - BENCHMARK_BVH_OVERLAP_EXTENT);
+			overlap_boxes[i].max = DirectX::XMFLOAT3(center.x + BENCHMARK_BVH_OVERLAP_EXTENT, center.y + BENCHMARK_BVH_OVERLAP_EXTENT, center.z + BENCHMARK_BVH_OVERLAP_EXTENT);
+			DirectX::XMFLOAT3 ray_direction(direction(random), direction(random), direction(random));
+			DirectX::XMStoreFloat3(&ray_direction, DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&ray_direction)));
+			rays[i].origin = center;
+			rays[i].direction = ray_direction;
+			rays[i].maxDistance = 2000.0f;
+		}
+		std::vector<DynamicBvh::RayHit> hits(BENCHMARK_BVH_QUERIES);
+		suite.Run("bvh/query_overlap_10k", BENCHMARK_BVH_QUERIES, 0.0, [&]()
+		{
+			bvh_visible.clear();
+			for (auto& box : overlap_boxes)
+			{
+				bvh.QueryOverlap(box, &bvh_visible);
+			}
+			BenchmarkSuite::Consume(bvh_visible.size());
+		});
+		suite.Run("bvh/raycast_10k", BENCHMARK_BVH_QUERIES, 0.0, [&]()
+		{
+			unsigned int hit_count = 0;
+			for (unsigned int i = 0; i < BENCHMARK_BVH_QUERIES; ++i)
+			{
+				hit_count += bvh.RayCast(rays[i], &hits[i]) ? 1 : 0;
+			}
+			BenchmarkSuite::Consume(hit_count);
+		});
+		// Every box against every query, what the BVH queries save
+		std::vector<Bounds::AABB> bvh_boxes(BENCHMARK_BVH_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+		{
+			bvh_boxes[i] = ::BoxOf(spheres[i]);
+		}
+		suite.Run("bvh/brute_force_overlap_100", BENCHMARK_BVH_BRUTE_FORCE_QUERIES, 0.0, [&]()
+		{
+			bvh_visible.clear();
+			for (unsigned int q = 0; q < BENCHMARK_BVH_BRUTE_FORCE_QUERIES; ++q)
+			{
+				const Bounds::AABB& query = overlap_boxes[q];
+				for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+				{
+					const Bounds::AABB& box = bvh_boxes[i];
+					if (box.min.x <= query.max.x && box.max.x >= query.min.x &&
+						box.min.y <= query.max.y && box.max.y >= query.min.y &&
+						box.min.z <= query.max.z && box.max.z >= query.min.z)
+						bvh_visible.push_back(i);
+				}
+			}
+			BenchmarkSuite::Consume(bvh_visible.size());
+		});
+		suite.Run("bvh/brute_force_raycast_100", BENCHMARK_BVH_BRUTE_FORCE_QUERIES, 0.0, [&]()
+		{
+			unsigned int hit_count = 0;
+			for (unsigned int q = 0; q < BENCHMARK_BVH_BRUTE_FORCE_QUERIES; ++q)
+			{
+				const DynamicBvh::Ray& ray = rays[q];
+				const DirectX::XMFLOAT3 inverse_direction(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+				float nearest = ray.maxDistance;
+				bool hit = false;
+				for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+				{
+					const float enter = Bounds::RayEnter(bvh_boxes[i], ray.origin, inverse_direction, nearest);
+					if (enter != FLT_MAX)
+					{
+						nearest = enter;
+						hit = true;
+					}
+				}
+				hit_count += hit ? 1 : 0;
+			}
+			BenchmarkSuite::Consume(hit_count);
+		});
+		suite.Run("bvh/raycast_batch_10k", BENCHMARK_BVH_QUERIES, 0.0, [&]()
+		{
+			bvh.RayCastBatch(rays.data(), BENCHMARK_BVH_QUERIES, hits.data());
+			BenchmarkSuite::Consume(hits.data());
+		});
+
+		// Every object moves a little each run, back and forth so the tree does not drift apart
+		std::vector<Bounds::AABB> moved_boxes[2];
+		for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+		{
+			Bounds::AABB box = ::BoxOf(spheres[i]);
+			moved_boxes[0].push_back(box);
+			box.min.x += 0.5f;
+			box.max.x += 0.5f;
+			moved_boxes[1].push_back(box);
+		}
+		unsigned int refit_run = 0;
+		suite.Run("bvh/refit_100k", BENCHMARK_BVH_COUNT, 0.0, [&]()
+		{
+			const std::vector<Bounds::AABB>& boxes = moved_boxes[++refit_run % 2];
+			for (unsigned int i = 0; i < BENCHMARK_BVH_COUNT; ++i)
+			{
+				bvh.Refit(proxies[i], boxes[i]);
+			}
+			BenchmarkSuite::Consume((uint64_t)bvh.GetHeight());
+		});
+		suite.Run("bvh/rebuild_100k", BENCHMARK_BVH_COUNT, 0.0, [&]()
+		{
+			bvh.Rebuild();
+			BenchmarkSuite::Consume((uint64_t)bvh.GetHeight());
+		});
+		delete p_camera;
+	}
+
+	// What Renderer::DrawScene does with the keys of a frame, the draws are submitted in scene order
+	void BenchmarkRenderQueue(BenchmarkSuite& suite)
+	{
+		std::mt19937 random(BENCHMARK_SEED);
+		std::uniform_int_distribution<unsigned int> shader(0, BENCHMARK_DRAW_SHADERS - 1);
+		std::uniform_int_distribution<unsigned int> material(0, BENCHMARK_DRAW_MATERIALS - 1);
+		std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+		std::vector<uint64_t> keys(BENCHMARK_DRAW_COUNT);
+		for (unsigned int i = 0; i < BENCHMARK_DRAW_COUNT; ++i)
+		{
+			// One draw in sixteen is transparent
+			const RENDER_PASS pass = i % 16 == 0 ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+			keys[i] = DrawKey::Make(pass, shader(random), material(random), depth(random));
+		}
+
+		DrawKeyList list;
+		suite.Run("render_queue/sort_100k", BENCHMARK_DRAW_COUNT, BENCHMARK_DRAW_COUNT * sizeof(uint64_t), [&]()
+		{
+			list.Clear();
+			for (unsigned int i = 0; i < BENCHMARK_DRAW_COUNT; ++i)
+			{
+				list.Add(keys[i], i);
+			}
+			list.Sort();
+			BenchmarkSuite::Consume(list.GetKey(0));
+		});
+	}
+
+	void BenchmarkCamera(BenchmarkSuite& suite)
+	{
+		const unsigned int updates = 10000;
+		Camera* p_camera = ::CreateCamera();
+		suite.Run("camera/update_and_frustum", updates, 0.0, [&]()
+		{
+			DirectX::XMFLOAT4 planes[6];
+			for (unsigned int i = 0; i < updates; ++i)
+			{
+				const float angle = (float)i * 0.001f;
+				p_camera->SetCameraPosition(cosf(angle) * 100.0f, 10.0f, sinf(angle) * 100.0f);
+				p_camera->Update();
+				p_camera->GetFrustumPlanes(planes);
+			}
+			BenchmarkSuite::Consume(planes);
+		});
+		delete p_camera;
+	}
+
+	void BenchmarkJobs(BenchmarkSuite& suite)
+	{
+		const unsigned int count = 100000;
+		const unsigned int batch_size = 64;
+		suite.Run("jobs/parallel_for_overhead", (count + batch_size - 1) / batch_size, 0.0, [&]()
+		{
+			std::atomic<unsigned int> batches(0);
+			JobSystem::ParallelFor(count, batch_size, [&](unsigned int, unsigned int)
+			{
+				batches.fetch_add(1, std::memory_order_relaxed);
+			});
+			BenchmarkSuite::Consume(batches.load());
+		});
+	}
+
+	// What a PROFILE_ZONE costs, the bench is always built with PROFILER_ENABLED so the zones are recorded
+	void BenchmarkProfiler(BenchmarkSuite& suite)
+	{
+		suite.Run("profiler/zone", BENCHMARK_PROFILER_ZONES, 0.0, [&]()
+		{
+			for (unsigned int i = 0; i < BENCHMARK_PROFILER_ZONES; ++i)
+			{
+				PROFILE_ZONE("Benchmark");
+				BenchmarkSuite::Consume(i);
+			}
+		});
+		Profiler::Clear();
+	}
+
+	void PrintUsage(std::ostream& stream)
+	{
+		stream << "Usage: dx11refresh_bench [-filter text] [-json file] [-label text] [-mintime seconds] [-threads count]\n"
+			<< "  -filter text       only runs the benchmarks whose name contains text\n"
+			<< "  -json file         where the results go, benchmark_results.json by default\n"
+			<< "  -label text        stored with the results, such as the commit\n"
+			<< "  -mintime seconds   least time every benchmark is run for\n"
+			<< "  -threads count     job system workers including the main thread, all hardware threads by default\n"
+			<< "  -h, --help         prints this\n";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = nullptr;
+	const char* json = nullptr;
+	const char* label = nullptr;
+	const char* min_time = nullptr;
+	const char* threads = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char** pp_value = nullptr;
+		if (strcmp(argv[i], "-filter") == 0)
+			pp_value = &filter;
+		else if (strcmp(argv[i], "-json") == 0)
+			pp_value = &json;
+		else if (strcmp(argv[i], "-label") == 0)
+			pp_value = &label;
+		else if (strcmp(argv[i], "-mintime") == 0)
+			pp_value = &min_time;
+		else if (strcmp(argv[i], "-threads") == 0)
+			pp_value = &threads;
+		else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+		{
+			::PrintUsage(std::cout);
+			return 0;
+		}
+
+		if (!pp_value || i + 1 >= argc)
+		{
+			std::cerr << (pp_value ? "Missing the value of " : "Unknown argument ") << argv[i] << "\n";
+			::PrintUsage(std::cerr);
+			return 2;
+		}
+		*pp_value = argv[++i];
+	}
+
+	BenchmarkSuite suite;
+	if (filter)
+		suite.SetFilter(filter);
+	if (min_time)
+		suite.SetMinTime(atof(min_time));
+
+	JobSystem::Init(threads ? (unsigned int)atoi(threads) : 0);
+	::BenchmarkObj(suite);
+	::BenchmarkMesh(suite);
+	::BenchmarkAnimation(suite);
+	::BenchmarkCulling(suite);
+	::BenchmarkRenderQueue(suite);
+	::BenchmarkCamera(suite);
+	::BenchmarkJobs(suite);
+	::BenchmarkProfiler(suite);
+	JobSystem::Shutdown();
+
+	std::cout << suite.FormatTable();
+	const char* json_path = json ? json : "benchmark_results.json";
+	if (!suite.WriteJson(json_path, label ? label : ""))
+	{
+		std::cerr << "Cannot write " << json_path << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,193 @@
+#include "Bounds.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Anonymous namespace for Bounds
+namespace {
+	// Narrows [*pEnter, *pExit] to the distances at which the ray is between min and max on one axis, returns false if it
+	// never is. A ray parallel to the slab is inside it at every distance or at none, testing that directly also avoids
+	// 0 * inf = NaN when it starts on one of the slab planes
+	bool ClipSlab(float min, float max, float origin, float inverseDirection, float* pEnter, float* pExit)
+	{
+		if (std::isinf(inverseDirection))
+			return origin >= min && origin <= max;
+		float t1 = (min - origin) * inverseDirection;
+		float t2 = (max - origin) * inverseDirection;
+		*pEnter = (std::max)(*pEnter, (std::min)(t1, t2));
+		*pExit = (std::min)(*pExit, (std::max)(t1, t2));
+		return true;
+	}
+
+	DirectX::XMVECTOR LoadPosition(const unsigned char* pPositions, unsigned int positionStride, unsigned int index)
+	{
+		return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(pPositions + (size_t)index * positionStride));
+	}
+
+	void ExpandAABB(Bounds::AABB* pBox, DirectX::FXMVECTOR point)
+	{
+		DirectX::XMStoreFloat3(&pBox->min, DirectX::XMVectorMin(DirectX::XMLoadFloat3(&pBox->min), point));
+		DirectX::XMStoreFloat3(&pBox->max, DirectX::XMVectorMax(DirectX::XMLoadFloat3(&pBox->max), point));
+	}
+}
+
+Bounds::AABB Bounds::EmptyAABB()
+{
+	AABB box;
+	box.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	box.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	return box;
+}
+
+bool Bounds::IsEmpty(const AABB& box)
+{
+	return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+Bounds::MeshBounds Bounds::ComputeBounds(const void* pPositions, unsigned int positionStride, unsigned int vertexCount)
+{
+	MeshBounds bounds = {};
+	if (!pPositions || vertexCount == 0)
+		return bounds;
+
+	const unsigned char* p_positions = static_cast<const unsigned char*>(pPositions);
+
+	// Four independent accumulators so consecutive min/max operations do not wait on each other
+	DirectX::XMVECTOR min_pos[4], max_pos[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		min_pos[i] = max_pos[i] = ::LoadPosition(p_positions, positionStride, 0);
+	}
+	unsigned int i = 0;
+	for (; i + 3 < vertexCount; i += 4)
+	{
+		for (unsigned int j = 0; j < 4; ++j)
+		{
+			DirectX::XMVECTOR pos = ::LoadPosition(p_positions, positionStride, i + j);
+			min_pos[j] = DirectX::XMVectorMin(min_pos[j], pos);
+			max_pos[j] = DirectX::XMVectorMax(max_pos[j], pos);
+		}
+	}
+	for (; i < vertexCount; ++i)
+	{
+		DirectX::XMVECTOR pos = ::LoadPosition(p_positions, positionStride, i);
+		min_pos[0] = DirectX::XMVectorMin(min_pos[0], pos);
+		max_pos[0] = DirectX::XMVectorMax(max_pos[0], pos);
+	}
+	DirectX::XMVECTOR box_min = DirectX::XMVectorMin(DirectX::XMVectorMin(min_pos[0], min_pos[1]), DirectX::XMVectorMin(min_pos[2], min_pos[3]));
+	DirectX::XMVECTOR box_max = DirectX::XMVectorMax(DirectX::XMVectorMax(max_pos[0], max_pos[1]), DirectX::XMVectorMax(max_pos[2], max_pos[3]));
+	DirectX::XMStoreFloat3(&bounds.box.min, box_min);
+	DirectX::XMStoreFloat3(&bounds.box.max, box_max);
+
+	// Sphere centered in the middle of the box, tighter than the half diagonal for most meshes
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(box_min, box_max), 0.5f);
+	DirectX::XMVECTOR radius_sq = DirectX::XMVectorZero();
+	for (i = 0; i < vertexCount; ++i)
+	{
+		DirectX::XMVECTOR offset = DirectX::XMVectorSubtract(::LoadPosition(p_positions, positionStride, i), center);
+		radius_sq = DirectX::XMVectorMax(radius_sq, DirectX::XMVector3LengthSq(offset));
+	}
+	DirectX::XMStoreFloat3(&bounds.sphere.center, center);
+	bounds.sphere.radius = std::sqrt(DirectX::XMVectorGetX(radius_sq));
+	return bounds;
+}
+
+void Bounds::ComputeJointBounds(const void* pPositions,
+	unsigned int positionStride,
+	unsigned int vertexCount,
+	const unsigned int* pJointIndices,
+	const float* pJointWeights,
+	unsigned int influencesPerVertex,
+	unsigned int jointCount,
+	std::vector<AABB>* pOutJointBounds)
+{
+	pOutJointBounds->assign(jointCount, EmptyAABB());
+	if (!pPositions || !pJointIndices || !pJointWeights)
+		return;
+
+	const unsigned char* p_positions = static_cast<const unsigned char*>(pPositions);
+	for (unsigned int i = 0; i < vertexCount; ++i)
+	{
+		DirectX::XMVECTOR pos = ::LoadPosition(p_positions, positionStride, i);
+		for (unsigned int j = 0; j < influencesPerVertex; ++j)
+		{
+			unsigned int joint = pJointIndices[i * influencesPerVertex + j];
+			if (pJointWeights[i * influencesPerVertex + j] <= 0.0f || joint >= jointCount)
+				continue;
+			::ExpandAABB(&(*pOutJointBounds)[joint], pos);
+		}
+	}
+}
+
+Bounds::AABB Bounds::ComputeSkinnedBounds(const std::vector<AABB>& jointBounds, const DirectX::XMFLOAT4X4* pJointTransforms)
+{
+	AABB bounds = EmptyAABB();
+	for (size_t i = 0; i < jointBounds.size(); ++i)
+	{
+		if (IsEmpty(jointBounds[i]))
+			continue;
+		// The shader multiplies with the transposed matrix, undo it to transform on the CPU
+		DirectX::XMMATRIX joint_transform = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&pJointTransforms[i]));
+		AABB joint_box = TransformAABB(jointBounds[i], joint_transform);
+		::ExpandAABB(&bounds, DirectX::XMLoadFloat3(&joint_box.min));
+		::ExpandAABB(&bounds, DirectX::XMLoadFloat3(&joint_box.max));
+	}
+	return bounds;
+}
+
+Bounds::AABB Bounds::TransformAABB(const AABB& box, const DirectX::XMMATRIX& matrix)
+{
+	// Transform the center and project the extents onto the absolute matrix axes
+	DirectX::XMVECTOR box_min = DirectX::XMLoadFloat3(&box.min);
+	DirectX::XMVECTOR box_max = DirectX::XMLoadFloat3(&box.max);
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(box_min, box_max), 0.5f);
+	DirectX::XMVECTOR extents = DirectX::XMVectorScale(DirectX::XMVectorSubtract(box_max, box_min), 0.5f);
+
+	DirectX::XMVECTOR new_center = DirectX::XMVector3Transform(center, matrix);
+	DirectX::XMVECTOR new_extents = DirectX::XMVectorMultiply(DirectX::XMVectorSplatX(extents), DirectX::XMVectorAbs(matrix.r[0]));
+	new_extents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatY(extents), DirectX::XMVectorAbs(matrix.r[1]), new_extents);
+	new_extents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatZ(extents), DirectX::XMVectorAbs(matrix.r[2]), new_extents);
+
+	AABB result;
+	DirectX::XMStoreFloat3(&result.min, DirectX::XMVectorSubtract(new_center, new_extents));
+	DirectX::XMStoreFloat3(&result.max, DirectX::XMVectorAdd(new_center, new_extents));
+	return result;
+}
+
+bool Bounds::IsSphereVisible(const Sphere& sphere, const DirectX::XMMATRIX& world, const DirectX::XMFLOAT4* pFrustumPlanes)
+{
+	DirectX::XMVECTOR center = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&sphere.center), world);
+	float radius = sphere.radius * DirectX::XMVectorGetX(DirectX::XMVector3Length(world.r[0]));
+	for (int i = 0; i < 6; ++i)
+	{
+		if (DirectX::XMVectorGetX(DirectX::XMPlaneDotCoord(DirectX::XMLoadFloat4(&pFrustumPlanes[i]), center)) < -radius)
+			return false;
+	}
+	return true;
+}
+
+bool Bounds::IsAABBVisible(const AABB& box, const DirectX::XMFLOAT4* pFrustumPlanes)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		// The corner furthest along the plane normal, if even that one is behind the plane the whole box is
+		const DirectX::XMFLOAT4& plane = pFrustumPlanes[i];
+		const float x = plane.x >= 0.0f ? box.max.x : box.min.x;
+		const float y = plane.y >= 0.0f ? box.max.y : box.min.y;
+		const float z = plane.z >= 0.0f ? box.max.z : box.min.z;
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+float Bounds::RayEnter(const AABB& box, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& inverseDirection, float maxDistance)
+{
+	float enter = 0.0f;
+	float exit = maxDistance;
+	if (!::ClipSlab(box.min.x, box.max.x, origin.x, inverseDirection.x, &enter, &exit) ||
+		!::ClipSlab(box.min.y, box.max.y, origin.y, inverseDirection.y, &enter, &exit) ||
+		!::ClipSlab(box.min.z, box.max.z, origin.z, inverseDirection.z, &enter, &exit))
+		return FLT_MAX;
+	return enter <= exit ? enter : FLT_MAX;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+namespace Bounds
+{
+	struct AABB
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	struct Sphere
+	{
+		DirectX::XMFLOAT3 center;
+		float radius;
+	};
+
+	// Object space bounds of a mesh, computed once at import
+	struct MeshBounds
+	{
+		AABB box;
+		Sphere sphere;
+	};
+
+	// A box with min > max, expanding it with any point makes it valid
+	AABB EmptyAABB();
+	bool IsEmpty(const AABB& box);
+
+	// Computes the AABB and a bounding sphere of the positions with a SIMD min/max reduction.
+	// pPositions points to the first position, positionStride is the byte distance between two positions.
+	MeshBounds ComputeBounds(const void* pPositions, unsigned int positionStride, unsigned int vertexCount);
+
+	// Computes one box per joint around every bind pose vertex the joint influences.
+	// pJointIndices and pJointWeights hold influencesPerVertex entries per vertex, influences with zero weight are ignored.
+	// Joints that influence no vertex get an empty box.
+	void ComputeJointBounds(const void* pPositions,
+		unsigned int positionStride,
+		unsigned int vertexCount,
+		const unsigned int* pJointIndices,
+		const float* pJointWeights,
+		unsigned int influencesPerVertex,
+		unsigned int jointCount,
+		std::vector<AABB>* pOutJointBounds);
+
+	// Returns a box that contains the skinned mesh for the given joint transforms.
+	// Every skinned vertex is a weighted average of its joint transforms, so it lies inside
+	// the union of the transformed joint boxes. pJointTransforms are the skinning matrices as
+	// uploaded to the shader (transposed), see FbxLoader::Skeleton::frameData.
+	AABB ComputeSkinnedBounds(const std::vector<AABB>& jointBounds, const DirectX::XMFLOAT4X4* pJointTransforms);
+
+	// Returns the box that contains box after transformation with matrix
+	AABB TransformAABB(const AABB& box, const DirectX::XMMATRIX& matrix);
+
+	// Tests the sphere against the frustum planes (see Camera::GetFrustumPlanes).
+	// world is assumed to only contain uniform scale.
+	bool IsSphereVisible(const Sphere& sphere, const DirectX::XMMATRIX& world, const DirectX::XMFLOAT4* pFrustumPlanes);
+
+	// Tests a world space box against the frustum planes, it is culled when it lies completely outside one of them
+	bool IsAABBVisible(const AABB& box, const DirectX::XMFLOAT4* pFrustumPlanes);
+
+	// Distance along a ray at which it enters the box, 0 if it starts inside and FLT_MAX if it misses the box or enters it
+	// beyond maxDistance. inverseDirection is 1 / direction per component, infinite where the direction is 0.
+	float RayEnter(const AABB& box, const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& inverseDirection, float maxDistance);
+}
@@ -0,0 +1,557 @@
+#include "Bvh.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+
+// Anonymous namespace for DynamicBvh
+namespace {
+	Bounds::AABB Union(const Bounds::AABB& a, const Bounds::AABB& b)
+	{
+		Bounds::AABB box;
+		box.min = DirectX::XMFLOAT3((std::min)(a.min.x, b.min.x), (std::min)(a.min.y, b.min.y), (std::min)(a.min.z, b.min.z));
+		box.max = DirectX::XMFLOAT3((std::max)(a.max.x, b.max.x), (std::max)(a.max.y, b.max.y), (std::max)(a.max.z, b.max.z));
+		return box;
+	}
+
+	// Half the surface area, the heuristic only compares areas so the factor does not matter
+	float Area(const Bounds::AABB& box)
+	{
+		float dx = box.max.x - box.min.x;
+		float dy = box.max.y - box.min.y;
+		float dz = box.max.z - box.min.z;
+		return dx * dy + dy * dz + dz * dx;
+	}
+
+	bool Overlaps(const Bounds::AABB& a, const Bounds::AABB& b)
+	{
+		return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+			a.min.y <= b.max.y && a.max.y >= b.min.y &&
+			a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	float Component(const DirectX::XMFLOAT3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	struct FrustumEntry
+	{
+		uint32_t node;
+		unsigned int planeMask;		// Planes the node's parent straddles, the others are already known to be passed
+	};
+	const unsigned int ALL_PLANES = 0x3f;
+
+	struct RayEntry
+	{
+		uint32_t node;
+		float enter;
+	};
+}
+
+DynamicBvh::DynamicBvh()
+{
+
+}
+
+DynamicBvh::~DynamicBvh()
+{
+
+}
+
+uint32_t DynamicBvh::Insert(const Bounds::AABB& box, uint32_t userData)
+{
+	uint32_t leaf = this->AllocateNode();
+	Node& node = this->mNodes[leaf];
+	node.box = box;
+	node.child1 = BVH_NULL_NODE;
+	node.child2 = BVH_NULL_NODE;
+	node.userData = userData;
+	node.height = 0;
+	this->InsertLeaf(leaf);
+	this->mLeafCount++;
+	return leaf;
+}
+
+void DynamicBvh::Remove(uint32_t proxy)
+{
+	this->RemoveLeaf(proxy);
+	this->FreeNode(proxy);
+	this->mLeafCount--;
+}
+
+void DynamicBvh::Refit(uint32_t proxy, const Bounds::AABB& box)
+{
+	this->mNodes[proxy].box = box;
+	for (uint32_t index = this->mNodes[proxy].parent; index != BVH_NULL_NODE; index = this->mNodes[index].parent)
+	{
+		Node& node = this->mNodes[index];
+		node.box = ::Union(this->mNodes[node.child1].box, this->mNodes[node.child2].box);
+	}
+}
+
+void DynamicBvh::Rebuild()
+{
+	if (this->mLeafCount < 2)
+		return;
+
+	// Keep the leaves where they are so their proxies stay valid, only the internal nodes are recreated
+	std::vector<uint32_t> leaves;
+	leaves.reserve(this->mLeafCount);
+	std::vector<DirectX::XMFLOAT3> centroids(this->mNodes.size());
+	for (uint32_t i = 0; i < (uint32_t)this->mNodes.size(); ++i)
+	{
+		const Node& node = this->mNodes[i];
+		if (node.height == 0)
+		{
+			leaves.push_back(i);
+			centroids[i] = DirectX::XMFLOAT3((node.box.min.x + node.box.max.x) * 0.5f,
+				(node.box.min.y + node.box.max.y) * 0.5f,
+				(node.box.min.z + node.box.max.z) * 0.5f);
+		}
+		else if (node.height > 0)
+		{
+			this->FreeNode(i);
+		}
+	}
+
+	this->mRoot = this->BuildRange(leaves.data(), (unsigned int)leaves.size(), centroids.data());
+	this->mNodes[this->mRoot].parent = BVH_NULL_NODE;
+}
+
+void DynamicBvh::Clear()
+{
+	this->mNodes.clear();
+	this->mRoot = BVH_NULL_NODE;
+	this->mFreeList = BVH_NULL_NODE;
+	this->mLeafCount = 0;
+}
+
+uint32_t DynamicBvh::GetLeafCount() const
+{
+	return this->mLeafCount;
+}
+
+int DynamicBvh::GetHeight() const
+{
+	return this->mRoot == BVH_NULL_NODE ? 0 : this->mNodes[this->mRoot].height;
+}
+
+const Bounds::AABB& DynamicBvh::GetBox(uint32_t proxy) const
+{
+	return this->mNodes[proxy].box;
+}
+
+uint32_t DynamicBvh::GetUserData(uint32_t proxy) const
+{
+	return this->mNodes[proxy].userData;
+}
+
+void DynamicBvh::QueryFrustum(const DirectX::XMFLOAT4* pFrustumPlanes, std::vector<uint32_t>* pOutUserData) const
+{
+	if (this->mRoot == BVH_NULL_NODE)
+		return;
+
+	// One stack per thread, kept between queries
+	thread_local std::vector<FrustumEntry> stack;
+	stack.clear();
+	stack.push_back({ this->mRoot, ALL_PLANES });
+	while (!stack.empty())
+	{
+		FrustumEntry entry = stack.back();
+		stack.pop_back();
+		const Node& node = this->mNodes[entry.node];
+
+		unsigned int plane_mask = entry.planeMask;
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p)
+		{
+			if (!(plane_mask & (1u << p)))
+				continue;
+			const DirectX::XMFLOAT4& plane = pFrustumPlanes[p];
+			// The corners furthest along and against the plane normal
+			float far_distance = plane.w +
+				plane.x * (plane.x >= 0.0f ? node.box.max.x : node.box.min.x) +
+				plane.y * (plane.y >= 0.0f ? node.box.max.y : node.box.min.y) +
+				plane.z * (plane.z >= 0.0f ? node.box.max.z : node.box.min.z);
+			float near_distance = plane.w +
+				plane.x * (plane.x >= 0.0f ? node.box.min.x : node.box.max.x) +
+				plane.y * (plane.y >= 0.0f ? node.box.min.y : node.box.max.y) +
+				plane.z * (plane.z >= 0.0f ? node.box.min.z : node.box.max.z);
+			outside = far_distance < 0.0f;
+			if (near_distance >= 0.0f)
+				plane_mask &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+
+		if (node.height == 0)
+		{
+			pOutUserData->push_back(node.userData);
+			continue;
+		}
+		// A subtree completely inside the frustum needs no more plane tests
+		stack.push_back({ node.child1, plane_mask });
+		stack.push_back({ node.child2, plane_mask });
+	}
+}
+
+void DynamicBvh::QueryOverlap(const Bounds::AABB& box, std::vector<uint32_t>* pOutUserData) const
+{
+	if (this->mRoot == BVH_NULL_NODE)
+		return;
+
+	thread_local std::vector<uint32_t> stack;
+	stack.clear();
+	stack.push_back(this->mRoot);
+	while (!stack.empty())
+	{
+		const Node& node = this->mNodes[stack.back()];
+		stack.pop_back();
+		if (!::Overlaps(node.box, box))
+			continue;
+		if (node.height == 0)
+		{
+			pOutUserData->push_back(node.userData);
+			continue;
+		}
+		stack.push_back(node.child1);
+		stack.push_back(node.child2);
+	}
+}
+
+bool DynamicBvh::RayCast(const Ray& ray, RayHit* pOutHit) const
+{
+	pOutHit->proxy = BVH_NULL_NODE;
+	pOutHit->userData = 0;
+	pOutHit->distance = ray.maxDistance;
+	if (this->mRoot == BVH_NULL_NODE)
+		return false;
+
+	const DirectX::XMFLOAT3 inverse_direction(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+	float root_enter = Bounds::RayEnter(this->mNodes[this->mRoot].box, ray.origin, inverse_direction, ray.maxDistance);
+	if (root_enter == FLT_MAX)
+		return false;
+
+	// Nearest child first, anything entered beyond the closest hit so far is skipped
+	thread_local std::vector<RayEntry> stack;
+	stack.clear();
+	stack.push_back({ this->mRoot, root_enter });
+	while (!stack.empty())
+	{
+		RayEntry entry = stack.back();
+		stack.pop_back();
+		if (entry.enter > pOutHit->distance)
+			continue;
+		const Node& node = this->mNodes[entry.node];
+		if (node.height == 0)
+		{
+			pOutHit->proxy = entry.node;
+			pOutHit->userData = node.userData;
+			pOutHit->distance = entry.enter;
+			continue;
+		}
+
+		float enter1 = Bounds::RayEnter(this->mNodes[node.child1].box, ray.origin, inverse_direction, pOutHit->distance);
+		float enter2 = Bounds::RayEnter(this->mNodes[node.child2].box, ray.origin, inverse_direction, pOutHit->distance);
+		RayEntry near_entry = { node.child1, enter1 };
+		RayEntry far_entry = { node.child2, enter2 };
+		if (enter2 < enter1)
+			std::swap(near_entry, far_entry);
+		if (far_entry.enter != FLT_MAX)
+			stack.push_back(far_entry);
+		if (near_entry.enter != FLT_MAX)
+			stack.push_back(near_entry);
+	}
+	return pOutHit->proxy != BVH_NULL_NODE;
+}
+
+void DynamicBvh::RayCastBatch(const Ray* pRays, unsigned int rayCount, RayHit* pOutHits, unsigned int threadCount) const
+{
+	if (threadCount == 0)
+		threadCount = JobSystem::GetWorkerCount();
+	threadCount = (std::max)((std::min)(threadCount, rayCount), 1u);
+	JobSystem::ParallelFor(rayCount, (rayCount + threadCount - 1) / threadCount, [=](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			this->RayCast(pRays[i], &pOutHits[i]);
+		}
+	});
+}
+
+uint32_t DynamicBvh::AllocateNode()
+{
+	uint32_t index;
+	if (this->mFreeList != BVH_NULL_NODE)
+	{
+		index = this->mFreeList;
+		this->mFreeList = this->mNodes[index].parent;
+	}
+	else
+	{
+		index = (uint32_t)this->mNodes.size();
+		this->mNodes.push_back(Node());
+	}
+	Node& node = this->mNodes[index];
+	node.parent = BVH_NULL_NODE;
+	node.child1 = BVH_NULL_NODE;
+	node.child2 = BVH_NULL_NODE;
+	node.userData = 0;
+	node.height = 0;
+	return index;
+}
+
+void DynamicBvh::FreeNode(uint32_t node)
+{
+	this->mNodes[node].parent = this->mFreeList;
+	this->mNodes[node].height = -1;
+	this->mFreeList = node;
+}
+
+void DynamicBvh::InsertLeaf(uint32_t leaf)
+{
+	if (this->mRoot == BVH_NULL_NODE)
+	{
+		this->mRoot = leaf;
+		this->mNodes[leaf].parent = BVH_NULL_NODE;
+		return;
+	}
+
+	// Walk down towards the sibling whose union with the leaf adds the least area to the tree
+	const Bounds::AABB leaf_box = this->mNodes[leaf].box;
+	uint32_t index = this->mRoot;
+	while (this->mNodes[index].height > 0)
+	{
+		const Node& node = this->mNodes[index];
+		float area = ::Area(node.box);
+		float combined_area = ::Area(::Union(node.box, leaf_box));
+		// Cost of making the leaf a sibling of this node, and the growth every deeper choice adds to this node
+		float cost = 2.0f * combined_area;
+		float inheritance_cost = 2.0f * (combined_area - area);
+
+		float child_costs[2];
+		const uint32_t children[2] = { node.child1, node.child2 };
+		for (int c = 0; c < 2; ++c)
+		{
+			const Node& child = this->mNodes[children[c]];
+			float child_area = ::Area(::Union(child.box, leaf_box));
+			child_costs[c] = (child.height == 0 ? child_area : child_area - ::Area(child.box)) + inheritance_cost;
+		}
+		if (cost < child_costs[0] && cost < child_costs[1])
+			break;
+		index = child_costs[0] < child_costs[1] ? children[0] : children[1];
+	}
+
+	const uint32_t sibling = index;
+	const uint32_t new_parent = this->AllocateNode();
+	const uint32_t old_parent = this->mNodes[sibling].parent;
+	Node& parent = this->mNodes[new_parent];
+	parent.parent = old_parent;
+	parent.box = ::Union(leaf_box, this->mNodes[sibling].box);
+	parent.height = this->mNodes[sibling].height + 1;
+	parent.child1 = sibling;
+	parent.child2 = leaf;
+	this->mNodes[sibling].parent = new_parent;
+	this->mNodes[leaf].parent = new_parent;
+	if (old_parent == BVH_NULL_NODE)
+	{
+		this->mRoot = new_parent;
+	}
+	else if (this->mNodes[old_parent].child1 == sibling)
+	{
+		this->mNodes[old_parent].child1 = new_parent;
+	}
+	else
+	{
+		this->mNodes[old_parent].child2 = new_parent;
+	}
+
+	this->FixUpwards(old_parent);
+}
+
+void DynamicBvh::RemoveLeaf(uint32_t leaf)
+{
+	if (leaf == this->mRoot)
+	{
+		this->mRoot = BVH_NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	const uint32_t parent = this->mNodes[leaf].parent;
+	const uint32_t grand_parent = this->mNodes[parent].parent;
+	const uint32_t sibling = this->mNodes[parent].child1 == leaf ? this->mNodes[parent].child2 : this->mNodes[parent].child1;
+	this->mNodes[sibling].parent = grand_parent;
+	this->FreeNode(parent);
+	if (grand_parent == BVH_NULL_NODE)
+	{
+		this->mRoot = sibling;
+		return;
+	}
+	if (this->mNodes[grand_parent].child1 == parent)
+		this->mNodes[grand_parent].child1 = sibling;
+	else
+		this->mNodes[grand_parent].child2 = sibling;
+	this->FixUpwards(grand_parent);
+}
+
+void DynamicBvh::FixUpwards(uint32_t index)
+{
+	while (index != BVH_NULL_NODE)
+	{
+		index = this->Balance(index);
+		Node& node = this->mNodes[index];
+		const Node& child1 = this->mNodes[node.child1];
+		const Node& child2 = this->mNodes[node.child2];
+		node.height = 1 + (std::max)(child1.height, child2.height);
+		node.box = ::Union(child1.box, child2.box);
+		index = node.parent;
+	}
+}
+
+uint32_t DynamicBvh::Balance(uint32_t a)
+{
+	Node& node_a = this->mNodes[a];
+	if (node_a.height < 2)
+		return a;
+
+	// Rotates the taller child up when the heights of the children differ by more than one
+	const uint32_t b = node_a.child1;
+	const uint32_t c = node_a.child2;
+	Node& node_b = this->mNodes[b];
+	Node& node_c = this->mNodes[c];
+	const int balance = node_c.height - node_b.height;
+	if (balance >= -1 && balance <= 1)
+		return a;
+
+	// up is the child that takes the place of a, stay is the other one
+	const bool rotate_c = balance > 1;
+	const uint32_t up = rotate_c ? c : b;
+	const uint32_t stay = rotate_c ? b : c;
+	Node& node_up = this->mNodes[up];
+	Node& node_stay = this->mNodes[stay];
+	const uint32_t f = node_up.child1;
+	const uint32_t g = node_up.child2;
+	Node& node_f = this->mNodes[f];
+	Node& node_g = this->mNodes[g];
+
+	node_up.child1 = a;
+	node_up.parent = node_a.parent;
+	node_a.parent = up;
+	if (node_up.parent == BVH_NULL_NODE)
+		this->mRoot = up;
+	else if (this->mNodes[node_up.parent].child1 == a)
+		this->mNodes[node_up.parent].child1 = up;
+	else
+		this->mNodes[node_up.parent].child2 = up;
+
+	// The taller grandchild stays with up, the shorter one moves down to a in place of up
+	const uint32_t keep = node_f.height > node_g.height ? f : g;
+	const uint32_t move = node_f.height > node_g.height ? g : f;
+	Node& node_keep = this->mNodes[keep];
+	Node& node_move = this->mNodes[move];
+	node_up.child2 = keep;
+	if (rotate_c)
+		node_a.child2 = move;
+	else
+		node_a.child1 = move;
+	node_move.parent = a;
+
+	node_a.box = ::Union(node_stay.box, node_move.box);
+	node_a.height = 1 + (std::max)(node_stay.height, node_move.height);
+	node_up.box = ::Union(node_a.box, node_keep.box);
+	node_up.height = 1 + (std::max)(node_a.height, node_keep.height);
+	return up;
+}
+
+uint32_t DynamicBvh::BuildRange(uint32_t* pLeaves, unsigned int count, const DirectX::XMFLOAT3* pCentroids)
+{
+	if (count == 1)
+		return pLeaves[0];
+
+	// Split along the axis the centroids spread the most
+	Bounds::AABB centroid_box = Bounds::EmptyAABB();
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const DirectX::XMFLOAT3& centroid = pCentroids[pLeaves[i]];
+		centroid_box = ::Union(centroid_box, { centroid, centroid });
+	}
+	const float extents[3] = {
+		centroid_box.max.x - centroid_box.min.x,
+		centroid_box.max.y - centroid_box.min.y,
+		centroid_box.max.z - centroid_box.min.z
+	};
+	const int axis = extents[0] > extents[1] ? (extents[0] > extents[2] ? 0 : 2) : (extents[1] > extents[2] ? 1 : 2);
+	const float axis_min = ::Component(centroid_box.min, axis);
+	const float extent = extents[axis];
+
+	unsigned int split = count / 2;
+	if (extent > 0.0f)
+	{
+		auto bin_of = [&](uint32_t leaf)
+		{
+			int bin = (int)((::Component(pCentroids[leaf], axis) - axis_min) / extent * BVH_SAH_BINS);
+			return (std::min)(bin, BVH_SAH_BINS - 1);
+		};
+		unsigned int bin_counts[BVH_SAH_BINS] = {};
+		Bounds::AABB bin_boxes[BVH_SAH_BINS];
+		for (auto& box : bin_boxes)
+		{
+			box = Bounds::EmptyAABB();
+		}
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			int bin = bin_of(pLeaves[i]);
+			bin_counts[bin]++;
+			bin_boxes[bin] = ::Union(bin_boxes[bin], this->mNodes[pLeaves[i]].box);
+		}
+
+		// Cost of every split plane between two bins is area * count of both sides
+		float left_costs[BVH_SAH_BINS];
+		Bounds::AABB left_box = Bounds::EmptyAABB();
+		unsigned int left_count = 0;
+		for (int i = 0; i < BVH_SAH_BINS - 1; ++i)
+		{
+			left_box = ::Union(left_box, bin_boxes[i]);
+			left_count += bin_counts[i];
+			left_costs[i] = left_count > 0 ? ::Area(left_box) * left_count : FLT_MAX;
+		}
+		float best_cost = FLT_MAX;
+		int best_bin = -1;
+		Bounds::AABB right_box = Bounds::EmptyAABB();
+		unsigned int right_count = 0;
+		for (int i = BVH_SAH_BINS - 1; i > 0; --i)
+		{
+			right_box = ::Union(right_box, bin_boxes[i]);
+			right_count += bin_counts[i];
+			if (right_count == 0 || left_costs[i - 1] == FLT_MAX)
+				continue;
+			float cost = left_costs[i - 1] + ::Area(right_box) * right_count;
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_bin = i - 1;
+			}
+		}
+		if (best_bin >= 0)
+		{
+			uint32_t* p_middle = std::partition(pLeaves, pLeaves + count, [&](uint32_t leaf) { return bin_of(leaf) <= best_bin; });
+			split = (unsigned int)(p_middle - pLeaves);
+		}
+	}
+	// Identical centroids cannot be separated by a plane, split them by count instead
+	if (split == 0 || split == count)
+		split = count / 2;
+
+	const uint32_t index = this->AllocateNode();
+	const uint32_t child1 = this->BuildRange(pLeaves, split, pCentroids);
+	const uint32_t child2 = this->BuildRange(pLeaves + split, count - split, pCentroids);
+	Node& node = this->mNodes[index];
+	node.child1 = child1;
+	node.child2 = child2;
+	node.box = ::Union(this->mNodes[child1].box, this->mNodes[child2].box);
+	node.height = 1 + (std::max)(this->mNodes[child1].height, this->mNodes[child2].height);
+	this->mNodes[child1].parent = index;
+	this->mNodes[child2].parent = index;
+	return index;
+}
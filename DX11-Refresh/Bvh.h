@@ -0,0 +1,86 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "Bounds.h"
+
+// Index of no node, also returned for rays that hit nothing
+#define BVH_NULL_NODE 0xffffffffu
+// Centroid bins per axis tried by the SAH rebuild
+#define BVH_SAH_BINS 12
+
+// Bounding volume hierarchy over scene objects that can change while it is in use.
+// Insert picks the sibling that grows the tree the least and rotations keep it balanced, Refit moves a leaf without
+// changing the structure and Rebuild recreates the internal nodes with the surface area heuristic once the tree has
+// degraded. Leaves are identified by their proxy, which stays valid until the leaf is removed, Rebuild included.
+// The queries only read the tree, any number of them can run at the same time on different threads.
+class DynamicBvh
+{
+public:
+	struct Ray
+	{
+		DirectX::XMFLOAT3 origin;
+		DirectX::XMFLOAT3 direction;
+		float maxDistance;
+	};
+
+	struct RayHit
+	{
+		uint32_t proxy;			// BVH_NULL_NODE if no box was hit
+		uint32_t userData;
+		float distance;			// Distance along the ray, in units of the direction's length
+	};
+
+	DynamicBvh();
+	~DynamicBvh();
+
+	// Adds a leaf and returns its proxy
+	uint32_t Insert(const Bounds::AABB& box, uint32_t userData);
+	void Remove(uint32_t proxy);
+	// Replaces the box of a leaf and updates its ancestors, the structure of the tree stays the same
+	void Refit(uint32_t proxy, const Bounds::AABB& box);
+	// Rebuilds every internal node top down with a binned SAH, the proxies are kept
+	void Rebuild();
+	void Clear();
+
+	uint32_t GetLeafCount() const;
+	// Longest path from the root to a leaf, 0 for a single leaf
+	int GetHeight() const;
+	const Bounds::AABB& GetBox(uint32_t proxy) const;
+	uint32_t GetUserData(uint32_t proxy) const;
+
+	// Appends the user data of every leaf whose box intersects the frustum (see Culling::ExtractFrustumPlanes)
+	void QueryFrustum(const DirectX::XMFLOAT4* pFrustumPlanes, std::vector<uint32_t>* pOutUserData) const;
+	// Appends the user data of every leaf whose box overlaps box
+	void QueryOverlap(const Bounds::AABB& box, std::vector<uint32_t>* pOutUserData) const;
+	// Finds the leaf box the ray enters first, returns false if it hits none within ray.maxDistance
+	bool RayCast(const Ray& ray, RayHit* pOutHit) const;
+	// Casts every ray, split into threadCount jobs (0 picks one per JobSystem worker)
+	void RayCastBatch(const Ray* pRays, unsigned int rayCount, RayHit* pOutHits, unsigned int threadCount = 0) const;
+
+private:
+	struct Node
+	{
+		Bounds::AABB box;
+		uint32_t parent;
+		uint32_t child1;		// BVH_NULL_NODE for leaves
+		uint32_t child2;
+		uint32_t userData;
+		int height;				// 0 for leaves, -1 for free nodes
+	};
+
+	std::vector<Node> mNodes;
+	uint32_t mRoot = BVH_NULL_NODE;
+	// Free nodes are chained through their parent index
+	uint32_t mFreeList = BVH_NULL_NODE;
+	uint32_t mLeafCount = 0;
+
+	uint32_t AllocateNode();
+	void FreeNode(uint32_t node);
+	void InsertLeaf(uint32_t leaf);
+	void RemoveLeaf(uint32_t leaf);
+	// Walks from node to the root, fixing boxes and heights and rotating unbalanced nodes
+	void FixUpwards(uint32_t node);
+	uint32_t Balance(uint32_t node);
+	uint32_t BuildRange(uint32_t* pLeaves, unsigned int count, const DirectX::XMFLOAT3* pCentroids);
+};
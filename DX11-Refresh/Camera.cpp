@@ -1,4 +1,5 @@
 #include "Camera.h"
+#include "Culling.h"
 
 Camera::Camera(const DirectX::XMVECTOR& r_position,
 	const DirectX::XMVECTOR& r_up_vector,
@@ -410,6 +411,11 @@ DirectX::XMMATRIX Camera::GetTransposedProjectionMatrix() const
 	return DirectX::XMMatrixTranspose(this->mProjMatrix);
 }
 
+void Camera::GetFrustumPlanes(DirectX::XMFLOAT4* pOutPlanes) const
+{
+	Culling::ExtractFrustumPlanes(DirectX::XMMatrixMultiply(this->mViewMatrix, this->mProjMatrix), pOutPlanes);
+}
+
 PROJECTION_MODE Camera::GetProjectionMode() const
 {
 	return this->mProjectionMode;
@@ -1,5 +1,9 @@
 #pragma once
 #include <DirectXMath.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 enum LOOK_MODE {
 	LOOK_AT = 0,
@@ -67,12 +71,21 @@ public:
 
 	void* operator new(size_t i) // To make sure it is 16 bit aligned
 	{
+#ifdef _WIN32
 		return _aligned_malloc(i, 16);
+#else
+		void* p = nullptr;
+		return posix_memalign(&p, 16, i) == 0 ? p : nullptr;
+#endif
 	}
 
 	void operator delete(void* p)
 	{
+#ifdef _WIN32
 		_aligned_free(p);
+#else
+		free(p);
+#endif
 	}
 
 	// MoveCamera takes a direction vector and a magnitude to move along that vector.
@@ -129,6 +142,9 @@ public:
 
 	DirectX::XMMATRIX GetProjectionMatrix() const;
 	DirectX::XMMATRIX GetTransposedProjectionMatrix() const;
+	// Writes the six frustum planes (left, right, bottom, top, near, far) to pOutPlanes.
+	// The plane normals point into the frustum and are normalized.
+	void GetFrustumPlanes(DirectX::XMFLOAT4* pOutPlanes) const;
 	PROJECTION_MODE GetProjectionMode() const;
 
 	bool SetViewWidth(const float new_view_width); // Not used in PERSPECTIVE mode
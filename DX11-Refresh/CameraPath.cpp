@@ -0,0 +1,138 @@
+#include "CameraPath.h"
+#include "Camera.h"
+#include <algorithm>
+#include <fstream>
+#include <math.h>
+#include <sstream>
+#include <string>
+
+using namespace DirectX;
+
+CameraPath::CameraPath()
+	: mDuration(CAMERA_PATH_DEFAULT_DURATION)
+{
+}
+
+void CameraPath::AddKey(const XMFLOAT3& position, const XMFLOAT3& target)
+{
+	CameraKey key;
+	key.position = position;
+	key.target = target;
+	this->mKeys.push_back(key);
+}
+
+void CameraPath::Clear()
+{
+	this->mKeys.clear();
+}
+
+size_t CameraPath::GetKeyCount() const
+{
+	return this->mKeys.size();
+}
+
+const std::vector<CameraKey>& CameraPath::GetKeys() const
+{
+	return this->mKeys;
+}
+
+void CameraPath::SetDuration(float seconds)
+{
+	if (seconds > 0.0f)
+		this->mDuration = seconds;
+}
+
+float CameraPath::GetDuration() const
+{
+	return this->mDuration;
+}
+
+void CameraPath::Evaluate(double time, XMFLOAT3* pPosition, XMFLOAT3* pLook) const
+{
+	const size_t key_count = this->mKeys.size();
+	if (key_count == 0)
+		return;
+
+	// The time wraps in double precision, a float would lose the fraction after a few hours
+	double loop_time = fmod(time, (double)this->mDuration);
+	if (loop_time < 0.0)
+		loop_time += this->mDuration;
+	const double segment_time = loop_time / this->mDuration * key_count;
+	const size_t segment = (std::min)((size_t)segment_time, key_count - 1);
+	const float t = (float)(segment_time - segment);
+
+	const CameraKey& key_0 = this->mKeys[(segment + key_count - 1) % key_count];
+	const CameraKey& key_1 = this->mKeys[segment];
+	const CameraKey& key_2 = this->mKeys[(segment + 1) % key_count];
+	const CameraKey& key_3 = this->mKeys[(segment + 2) % key_count];
+	const XMVECTOR position = XMVectorCatmullRom(XMLoadFloat3(&key_0.position), XMLoadFloat3(&key_1.position),
+		XMLoadFloat3(&key_2.position), XMLoadFloat3(&key_3.position), t);
+	const XMVECTOR target = XMVectorCatmullRom(XMLoadFloat3(&key_0.target), XMLoadFloat3(&key_1.target),
+		XMLoadFloat3(&key_2.target), XMLoadFloat3(&key_3.target), t);
+
+	XMStoreFloat3(pPosition, position);
+	XMVECTOR look = XMVectorSubtract(target, position);
+	// Looking at a point the camera is on leaves the direction undefined, look along +z instead
+	if (XMVectorGetX(XMVector3LengthSq(look)) < 1e-8f)
+		look = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+	XMStoreFloat3(pLook, XMVector3Normalize(look));
+}
+
+void CameraPath::Apply(double time, Camera* pCamera) const
+{
+	if (this->mKeys.empty())
+		return;
+	XMFLOAT3 position;
+	XMFLOAT3 look;
+	this->Evaluate(time, &position, &look);
+	pCamera->SetCameraPosition(position);
+	pCamera->SetLookVector(look);
+}
+
+bool CameraPath::LoadFromFile(const char* filepath)
+{
+	std::ifstream file(filepath);
+	if (!file.is_open())
+		return false;
+
+	std::vector<CameraKey> keys;
+	float duration = this->mDuration;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		std::istringstream stream(line);
+		std::string first;
+		if (!(stream >> first))
+			continue;
+		if (first == "duration")
+		{
+			stream >> duration;
+			continue;
+		}
+		CameraKey key;
+		std::istringstream values(line);
+		if (values >> key.position.x >> key.position.y >> key.position.z >> key.target.x >> key.target.y >> key.target.z)
+			keys.push_back(key);
+	}
+	if (keys.size() < 2)
+		return false;
+	this->mKeys = keys;
+	this->SetDuration(duration);
+	return true;
+}
+
+CameraPath CameraPath::CreateOrbit(const XMFLOAT3& center, float radius, float height, unsigned int keyCount, float duration)
+{
+	CameraPath path;
+	path.SetDuration(duration);
+	for (unsigned int i = 0; i < keyCount; ++i)
+	{
+		const float angle = XM_2PI * i / keyCount;
+		const float key_height = (i % 2 == 0) ? height : height * 0.5f;
+		path.AddKey(XMFLOAT3(center.x + radius * sinf(angle), center.y + key_height, center.z - radius * cosf(angle)), center);
+	}
+	return path;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+class Camera;
+
+// Seconds one loop of a camera path takes unless it says otherwise
+#define CAMERA_PATH_DEFAULT_DURATION 20.0f
+
+// One control point of a camera path, the camera at position looks at target
+struct CameraKey
+{
+	DirectX::XMFLOAT3 position;
+	DirectX::XMFLOAT3 target;
+};
+
+// A scripted camera flight, a closed Catmull-Rom spline through the keys for both the position and the point looked at.
+// Every key gets the same share of the duration and the path loops, so the camera only depends on the time and a run
+// with a fixed step sees the same views every time.
+// Files hold one key per line as "px py pz tx ty tz", an optional "duration seconds" line and # comments.
+class CameraPath
+{
+public:
+	CameraPath();
+
+	void AddKey(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& target);
+	void Clear();
+	size_t GetKeyCount() const;
+	const std::vector<CameraKey>& GetKeys() const;
+
+	// Seconds of one loop through all the keys
+	void SetDuration(float seconds);
+	float GetDuration() const;
+
+	// Position and normalized look to direction time seconds into the path, does nothing without keys
+	void Evaluate(double time, DirectX::XMFLOAT3* pPosition, DirectX::XMFLOAT3* pLook) const;
+	// Moves the camera with SetCameraPosition and SetLookVector, for cameras in LOOK_TO mode
+	void Apply(double time, Camera* pCamera) const;
+
+	// Replaces the keys with the ones of the file, returns false if it cannot be read or has fewer than two keys
+	bool LoadFromFile(const char* filepath);
+
+	// keyCount keys on a circle of radius around center, alternating between height and half of it above the center,
+	// all looking at the center
+	static CameraPath CreateOrbit(const DirectX::XMFLOAT3& center, float radius, float height, unsigned int keyCount, float duration);
+
+private:
+	std::vector<CameraKey> mKeys;
+	float mDuration;
+};
@@ -0,0 +1,363 @@
+#include "CommandStream.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+// ------ CommandBuffer ------
+
+CommandBuffer::CommandBuffer()
+{
+}
+
+CommandBuffer::~CommandBuffer()
+{
+}
+
+void CommandBuffer::Clear()
+{
+	this->mUsedWords = 0;
+	this->mCommandCount = 0;
+}
+
+const unsigned char* CommandBuffer::GetData() const
+{
+	return reinterpret_cast<const unsigned char*>(this->mData.data());
+}
+
+size_t CommandBuffer::GetSize() const
+{
+	return this->mUsedWords * sizeof(uint64_t);
+}
+
+unsigned int CommandBuffer::GetCommandCount() const
+{
+	return this->mCommandCount;
+}
+
+template <class T>
+T* CommandBuffer::Append(COMMAND_TYPE type, size_t extraBytes)
+{
+	const size_t words = (sizeof(T) + extraBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	if (this->mUsedWords + words > this->mData.size())
+	{
+		size_t capacity = (std::max)(this->mData.size() * 2, (size_t)COMMAND_BUFFER_INITIAL_SIZE / sizeof(uint64_t));
+		this->mData.resize((std::max)(capacity, this->mUsedWords + words));
+	}
+	T* p_command = new (&this->mData[this->mUsedWords]) T();
+	p_command->header.type = type;
+	p_command->header.size = (uint16_t)(words * sizeof(uint64_t));
+	this->mUsedWords += words;
+	this->mCommandCount++;
+	return p_command;
+}
+
+void CommandBuffer::IASetInputLayout(ID3D11InputLayout* pInputLayout)
+{
+	this->Append<Commands::SetInputLayout>(COMMAND_SET_INPUT_LAYOUT)->pInputLayout = pInputLayout;
+}
+
+void CommandBuffer::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	this->Append<Commands::SetTopology>(COMMAND_SET_TOPOLOGY)->topology = topology;
+}
+
+void CommandBuffer::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+	for (UINT i = 0; i < numBuffers; ++i)
+	{
+		Commands::SetVertexBuffer* p_command = this->Append<Commands::SetVertexBuffer>(COMMAND_SET_VERTEX_BUFFER);
+		p_command->slot = startSlot + i;
+		p_command->pBuffer = ppVertexBuffers[i];
+		p_command->stride = pStrides[i];
+		p_command->offset = pOffsets[i];
+	}
+}
+
+void CommandBuffer::IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset)
+{
+	Commands::SetIndexBuffer* p_command = this->Append<Commands::SetIndexBuffer>(COMMAND_SET_INDEX_BUFFER);
+	p_command->pBuffer = pIndexBuffer;
+	p_command->format = format;
+	p_command->offset = offset;
+}
+
+void CommandBuffer::VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const*, UINT)
+{
+	this->Append<Commands::SetVertexShader>(COMMAND_SET_VERTEX_SHADER)->pShader = pVertexShader;
+}
+
+void CommandBuffer::PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const*, UINT)
+{
+	this->Append<Commands::SetPixelShader>(COMMAND_SET_PIXEL_SHADER)->pShader = pPixelShader;
+}
+
+void CommandBuffer::VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	for (UINT i = 0; i < numBuffers; ++i)
+	{
+		Commands::SetConstantBuffer* p_command = this->Append<Commands::SetConstantBuffer>(COMMAND_SET_VS_CONSTANT_BUFFER);
+		p_command->slot = startSlot + i;
+		p_command->pBuffer = ppConstantBuffers ? ppConstantBuffers[i] : nullptr;
+	}
+}
+
+void CommandBuffer::VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	for (UINT i = 0; i < numBuffers; ++i)
+	{
+		Commands::SetConstantBufferRange* p_command = this->Append<Commands::SetConstantBufferRange>(COMMAND_SET_VS_CONSTANT_BUFFER_RANGE);
+		p_command->slot = startSlot + i;
+		p_command->pBuffer = ppConstantBuffers[i];
+		p_command->firstConstant = pFirstConstant[i];
+		p_command->numConstants = pNumConstants[i];
+	}
+}
+
+void CommandBuffer::PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	for (UINT i = 0; i < numBuffers; ++i)
+	{
+		Commands::SetConstantBuffer* p_command = this->Append<Commands::SetConstantBuffer>(COMMAND_SET_PS_CONSTANT_BUFFER);
+		p_command->slot = startSlot + i;
+		p_command->pBuffer = ppConstantBuffers ? ppConstantBuffers[i] : nullptr;
+	}
+}
+
+void CommandBuffer::VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	for (UINT i = 0; i < numViews; ++i)
+	{
+		Commands::SetShaderResource* p_command = this->Append<Commands::SetShaderResource>(COMMAND_SET_VS_SHADER_RESOURCE);
+		p_command->slot = startSlot + i;
+		p_command->pView = ppShaderResourceViews ? ppShaderResourceViews[i] : nullptr;
+	}
+}
+
+void CommandBuffer::PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	for (UINT i = 0; i < numViews; ++i)
+	{
+		Commands::SetShaderResource* p_command = this->Append<Commands::SetShaderResource>(COMMAND_SET_PS_SHADER_RESOURCE);
+		p_command->slot = startSlot + i;
+		p_command->pView = ppShaderResourceViews ? ppShaderResourceViews[i] : nullptr;
+	}
+}
+
+void CommandBuffer::PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	for (UINT i = 0; i < numSamplers; ++i)
+	{
+		Commands::SetSampler* p_command = this->Append<Commands::SetSampler>(COMMAND_SET_PS_SAMPLER);
+		p_command->slot = startSlot + i;
+		p_command->pSampler = ppSamplers ? ppSamplers[i] : nullptr;
+	}
+}
+
+void CommandBuffer::RSSetState(ID3D11RasterizerState* pRasterizerState)
+{
+	this->Append<Commands::SetRasterizerState>(COMMAND_SET_RASTERIZER_STATE)->pState = pRasterizerState;
+}
+
+void CommandBuffer::RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports)
+{
+	numViewports = (std::min)(numViewports, (UINT)COMMAND_MAX_VIEWPORTS);
+	Commands::SetViewports* p_command = this->Append<Commands::SetViewports>(COMMAND_SET_VIEWPORTS, numViewports * sizeof(D3D11_VIEWPORT));
+	p_command->numViewports = numViewports;
+	if (numViewports > 0)
+		memcpy(p_command + 1, pViewports, numViewports * sizeof(D3D11_VIEWPORT));
+}
+
+void CommandBuffer::OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef)
+{
+	Commands::SetDepthStencilState* p_command = this->Append<Commands::SetDepthStencilState>(COMMAND_SET_DEPTH_STENCIL_STATE);
+	p_command->pState = pDepthStencilState;
+	p_command->stencilRef = stencilRef;
+}
+
+void CommandBuffer::OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask)
+{
+	Commands::SetBlendState* p_command = this->Append<Commands::SetBlendState>(COMMAND_SET_BLEND_STATE);
+	p_command->pState = pBlendState;
+	p_command->sampleMask = sampleMask;
+	// A null blend factor means { 1, 1, 1, 1 }
+	for (int i = 0; i < 4; ++i)
+	{
+		p_command->blendFactor[i] = blendFactor ? blendFactor[i] : 1.0f;
+	}
+}
+
+void CommandBuffer::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView)
+{
+	numViews = (std::min)(numViews, (UINT)COMMAND_MAX_RENDER_TARGETS);
+	Commands::SetRenderTargets* p_command = this->Append<Commands::SetRenderTargets>(COMMAND_SET_RENDER_TARGETS, numViews * sizeof(ID3D11RenderTargetView*));
+	p_command->numViews = numViews;
+	p_command->pDepthStencilView = pDepthStencilView;
+	ID3D11RenderTargetView** pp_views = reinterpret_cast<ID3D11RenderTargetView**>(p_command + 1);
+	for (UINT i = 0; i < numViews; ++i)
+	{
+		pp_views[i] = ppRenderTargetViews ? ppRenderTargetViews[i] : nullptr;
+	}
+}
+
+void CommandBuffer::DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	Commands::DrawIndexed* p_command = this->Append<Commands::DrawIndexed>(COMMAND_DRAW_INDEXED);
+	p_command->indexCount = indexCount;
+	p_command->startIndex = startIndex;
+	p_command->baseVertex = baseVertex;
+}
+
+void CommandBuffer::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+{
+	Commands::DrawIndexedInstanced* p_command = this->Append<Commands::DrawIndexedInstanced>(COMMAND_DRAW_INDEXED_INSTANCED);
+	p_command->indexCountPerInstance = indexCountPerInstance;
+	p_command->instanceCount = instanceCount;
+	p_command->startIndex = startIndex;
+	p_command->baseVertex = baseVertex;
+	p_command->startInstance = startInstance;
+}
+
+// ------ NullCommandContext ------
+
+NullCommandContext::NullCommandContext()
+{
+}
+
+NullCommandContext::~NullCommandContext()
+{
+}
+
+void NullCommandContext::Reset()
+{
+	this->mStats = {};
+	this->mpInputLayout = nullptr;
+	this->mpVertexBuffer = nullptr;
+	this->mpIndexBuffer = nullptr;
+	this->mpVertexShader = nullptr;
+	this->mpPixelShader = nullptr;
+	this->mRenderTargetBound = false;
+}
+
+const NullCommandStats& NullCommandContext::GetStats() const
+{
+	return this->mStats;
+}
+
+void NullCommandContext::IASetInputLayout(ID3D11InputLayout* pInputLayout)
+{
+	this->mStats.commands[COMMAND_SET_INPUT_LAYOUT]++;
+	this->mpInputLayout = pInputLayout;
+}
+
+void NullCommandContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY)
+{
+	this->mStats.commands[COMMAND_SET_TOPOLOGY]++;
+}
+
+void NullCommandContext::IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT*, const UINT*)
+{
+	this->mStats.commands[COMMAND_SET_VERTEX_BUFFER] += numBuffers;
+	if (startSlot == 0 && numBuffers > 0)
+		this->mpVertexBuffer = ppVertexBuffers[0];
+}
+
+void NullCommandContext::IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT, UINT)
+{
+	this->mStats.commands[COMMAND_SET_INDEX_BUFFER]++;
+	this->mpIndexBuffer = pIndexBuffer;
+}
+
+void NullCommandContext::VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const*, UINT)
+{
+	this->mStats.commands[COMMAND_SET_VERTEX_SHADER]++;
+	this->mpVertexShader = pVertexShader;
+}
+
+void NullCommandContext::PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const*, UINT)
+{
+	this->mStats.commands[COMMAND_SET_PIXEL_SHADER]++;
+	this->mpPixelShader = pPixelShader;
+}
+
+void NullCommandContext::VSSetConstantBuffers(UINT, UINT numBuffers, ID3D11Buffer* const*)
+{
+	this->mStats.commands[COMMAND_SET_VS_CONSTANT_BUFFER] += numBuffers;
+}
+
+void NullCommandContext::VSSetConstantBuffers1(UINT, UINT numBuffers, ID3D11Buffer* const*, const UINT*, const UINT*)
+{
+	this->mStats.commands[COMMAND_SET_VS_CONSTANT_BUFFER_RANGE] += numBuffers;
+}
+
+void NullCommandContext::PSSetConstantBuffers(UINT, UINT numBuffers, ID3D11Buffer* const*)
+{
+	this->mStats.commands[COMMAND_SET_PS_CONSTANT_BUFFER] += numBuffers;
+}
+
+void NullCommandContext::VSSetShaderResources(UINT, UINT numViews, ID3D11ShaderResourceView* const*)
+{
+	this->mStats.commands[COMMAND_SET_VS_SHADER_RESOURCE] += numViews;
+}
+
+void NullCommandContext::PSSetShaderResources(UINT, UINT numViews, ID3D11ShaderResourceView* const*)
+{
+	this->mStats.commands[COMMAND_SET_PS_SHADER_RESOURCE] += numViews;
+}
+
+void NullCommandContext::PSSetSamplers(UINT, UINT numSamplers, ID3D11SamplerState* const*)
+{
+	this->mStats.commands[COMMAND_SET_PS_SAMPLER] += numSamplers;
+}
+
+void NullCommandContext::RSSetState(ID3D11RasterizerState*)
+{
+	this->mStats.commands[COMMAND_SET_RASTERIZER_STATE]++;
+}
+
+void NullCommandContext::RSSetViewports(UINT, const D3D11_VIEWPORT*)
+{
+	this->mStats.commands[COMMAND_SET_VIEWPORTS]++;
+}
+
+void NullCommandContext::OMSetDepthStencilState(ID3D11DepthStencilState*, UINT)
+{
+	this->mStats.commands[COMMAND_SET_DEPTH_STENCIL_STATE]++;
+}
+
+void NullCommandContext::OMSetBlendState(ID3D11BlendState*, const FLOAT[4], UINT)
+{
+	this->mStats.commands[COMMAND_SET_BLEND_STATE]++;
+}
+
+void NullCommandContext::OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView)
+{
+	this->mStats.commands[COMMAND_SET_RENDER_TARGETS]++;
+	// A depth only pass has no render target views
+	this->mRenderTargetBound = pDepthStencilView != nullptr;
+	for (UINT i = 0; i < numViews && ppRenderTargetViews && !this->mRenderTargetBound; ++i)
+	{
+		this->mRenderTargetBound = ppRenderTargetViews[i] != nullptr;
+	}
+}
+
+void NullCommandContext::DrawIndexed(UINT indexCount, UINT, INT)
+{
+	this->mStats.commands[COMMAND_DRAW_INDEXED]++;
+	this->CountDraw(indexCount, 1);
+}
+
+void NullCommandContext::DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT, INT, UINT)
+{
+	this->mStats.commands[COMMAND_DRAW_INDEXED_INSTANCED]++;
+	this->CountDraw(indexCountPerInstance, instanceCount);
+}
+
+void NullCommandContext::CountDraw(UINT indexCount, UINT instanceCount)
+{
+	this->mStats.draws++;
+	this->mStats.instances += instanceCount;
+	this->mStats.indices += (uint64_t)indexCount * instanceCount;
+	if (!this->mpInputLayout || !this->mpVertexBuffer || !this->mpIndexBuffer ||
+		!this->mpVertexShader || !this->mpPixelShader || !this->mRenderTargetBound)
+		this->mStats.invalidDraws++;
+}
@@ -0,0 +1,460 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "D3D11Types.h"
+
+// Most render targets a SET_RENDER_TARGETS command binds, the D3D11 limit
+#define COMMAND_MAX_RENDER_TARGETS 8
+// Most viewports a SET_VIEWPORTS command binds, the D3D11 limit
+#define COMMAND_MAX_VIEWPORTS 16
+// Draws a recording job gets at least, shorter draw lists are recorded by fewer jobs
+#define COMMAND_MIN_DRAWS_PER_SLICE 128
+// Most buffers the draw list is split into, and most deferred contexts D3D11DeferredCommandBackend creates
+#define COMMAND_MAX_SLICES 16
+// Bytes a command buffer reserves the first time something is recorded into it
+#define COMMAND_BUFFER_INITIAL_SIZE (16 * 1024)
+
+// Every command starts with a Commands::Header holding one of these
+enum COMMAND_TYPE : uint16_t {
+	COMMAND_SET_TOPOLOGY = 0,
+	COMMAND_SET_INPUT_LAYOUT = 1,
+	COMMAND_SET_VERTEX_BUFFER = 2,
+	COMMAND_SET_INDEX_BUFFER = 3,
+	COMMAND_SET_VERTEX_SHADER = 4,
+	COMMAND_SET_PIXEL_SHADER = 5,
+	COMMAND_SET_VS_CONSTANT_BUFFER = 6,
+	COMMAND_SET_VS_CONSTANT_BUFFER_RANGE = 7,
+	COMMAND_SET_PS_CONSTANT_BUFFER = 8,
+	COMMAND_SET_VS_SHADER_RESOURCE = 9,
+	COMMAND_SET_PS_SHADER_RESOURCE = 10,
+	COMMAND_SET_PS_SAMPLER = 11,
+	COMMAND_SET_RASTERIZER_STATE = 12,
+	COMMAND_SET_VIEWPORTS = 13,
+	COMMAND_SET_DEPTH_STENCIL_STATE = 14,
+	COMMAND_SET_BLEND_STATE = 15,
+	COMMAND_SET_RENDER_TARGETS = 16,
+	COMMAND_DRAW_INDEXED = 17,
+	COMMAND_DRAW_INDEXED_INSTANCED = 18,
+	COMMAND_TYPE_COUNT = 19
+};
+
+// The commands are plain structs stored back to back, each padded to a multiple of 8 bytes.
+// Calls that bind several slots are stored as one command per slot.
+namespace Commands
+{
+	struct Header
+	{
+		uint16_t type;		// COMMAND_TYPE
+		uint16_t size;		// Bytes up to the next command, including the header and the padding
+	};
+
+	struct SetTopology
+	{
+		Header header;
+		D3D11_PRIMITIVE_TOPOLOGY topology;
+	};
+
+	struct SetInputLayout
+	{
+		Header header;
+		ID3D11InputLayout* pInputLayout;
+	};
+
+	struct SetVertexBuffer
+	{
+		Header header;
+		UINT slot;
+		ID3D11Buffer* pBuffer;
+		UINT stride;
+		UINT offset;
+	};
+
+	struct SetIndexBuffer
+	{
+		Header header;
+		DXGI_FORMAT format;
+		ID3D11Buffer* pBuffer;
+		UINT offset;
+	};
+
+	struct SetVertexShader
+	{
+		Header header;
+		ID3D11VertexShader* pShader;
+	};
+
+	struct SetPixelShader
+	{
+		Header header;
+		ID3D11PixelShader* pShader;
+	};
+
+	// COMMAND_SET_VS_CONSTANT_BUFFER and COMMAND_SET_PS_CONSTANT_BUFFER
+	struct SetConstantBuffer
+	{
+		Header header;
+		UINT slot;
+		ID3D11Buffer* pBuffer;
+	};
+
+	// First and count are in 16 byte constants
+	struct SetConstantBufferRange
+	{
+		Header header;
+		UINT slot;
+		ID3D11Buffer* pBuffer;
+		UINT firstConstant;
+		UINT numConstants;
+	};
+
+	// COMMAND_SET_VS_SHADER_RESOURCE and COMMAND_SET_PS_SHADER_RESOURCE
+	struct SetShaderResource
+	{
+		Header header;
+		UINT slot;
+		ID3D11ShaderResourceView* pView;
+	};
+
+	struct SetSampler
+	{
+		Header header;
+		UINT slot;
+		ID3D11SamplerState* pSampler;
+	};
+
+	struct SetRasterizerState
+	{
+		Header header;
+		ID3D11RasterizerState* pState;
+	};
+
+	// Followed by numViewports D3D11_VIEWPORTs
+	struct SetViewports
+	{
+		Header header;
+		UINT numViewports;
+	};
+
+	struct SetDepthStencilState
+	{
+		Header header;
+		UINT stencilRef;
+		ID3D11DepthStencilState* pState;
+	};
+
+	struct SetBlendState
+	{
+		Header header;
+		UINT sampleMask;
+		ID3D11BlendState* pState;
+		FLOAT blendFactor[4];
+	};
+
+	// Followed by numViews ID3D11RenderTargetView pointers
+	struct SetRenderTargets
+	{
+		Header header;
+		UINT numViews;
+		ID3D11DepthStencilView* pDepthStencilView;
+	};
+
+	struct DrawIndexed
+	{
+		Header header;
+		UINT indexCount;
+		UINT startIndex;
+		INT baseVertex;
+	};
+
+	struct DrawIndexedInstanced
+	{
+		Header header;
+		UINT indexCountPerInstance;
+		UINT instanceCount;
+		UINT startIndex;
+		INT baseVertex;
+		UINT startInstance;
+	};
+
+	// Returns the command at pHeader if it is at least as large as T
+	template <class T>
+	const T* Get(const Header* pHeader)
+	{
+		return pHeader->size >= sizeof(T) ? reinterpret_cast<const T*>(pHeader) : nullptr;
+	}
+}
+
+// Records the context calls of a draw list as compact commands instead of issuing them.
+// It has the methods of ID3D11DeviceContext1 the renderer draws with, so it can stand in for the context,
+// usually behind a StateCache<CommandBuffer> so that redundant state is never recorded. Nothing is AddRef'd,
+// the recorded objects have to outlive the playback. Every thread records into its own buffer.
+class CommandBuffer
+{
+public:
+	CommandBuffer();
+	~CommandBuffer();
+
+	// Forgets the commands, the memory is kept for the next recording
+	void Clear();
+
+	const unsigned char* GetData() const;
+	// Bytes of recorded commands
+	size_t GetSize() const;
+	unsigned int GetCommandCount() const;
+
+	// ------ Input assembler ------
+	void IASetInputLayout(ID3D11InputLayout* pInputLayout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets);
+	void IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset);
+
+	// ------ Shaders ------
+	// Class instances are not recorded
+	void VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances);
+	void PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances);
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers);
+	void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers);
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews);
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews);
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers);
+
+	// ------ Rasterizer ------
+	void RSSetState(ID3D11RasterizerState* pRasterizerState);
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports);
+
+	// ------ Output merger ------
+	void OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef);
+	void OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask);
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView);
+
+	// ------ Draws ------
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex);
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance);
+
+private:
+	// 8 byte words so that every command is aligned
+	std::vector<uint64_t> mData;
+	size_t mUsedWords = 0;
+	unsigned int mCommandCount = 0;
+
+	// Reserves a command of type T followed by extraBytes and fills in its header
+	template <class T>
+	T* Append(COMMAND_TYPE type, size_t extraBytes = 0);
+};
+
+namespace Commands
+{
+	// Issues the commands of buffer on pContext in the order they were recorded.
+	// ContextT is ID3D11DeviceContext1, StateCache<ID3D11DeviceContext1>, NullCommandContext or any class with
+	// the same methods. Returns false at the first command that is unknown or cut short.
+	template <class ContextT>
+	bool Replay(const CommandBuffer& buffer, ContextT* pContext)
+	{
+		const unsigned char* p_command = buffer.GetData();
+		const unsigned char* p_end = p_command + buffer.GetSize();
+		while (p_command < p_end)
+		{
+			const Header* p_header = reinterpret_cast<const Header*>(p_command);
+			if (p_header->size < sizeof(Header) || p_header->size > (size_t)(p_end - p_command))
+				return false;
+
+			switch (p_header->type)
+			{
+			case COMMAND_SET_TOPOLOGY:
+			{
+				const SetTopology* p = Get<SetTopology>(p_header);
+				if (!p) return false;
+				pContext->IASetPrimitiveTopology(p->topology);
+				break;
+			}
+			case COMMAND_SET_INPUT_LAYOUT:
+			{
+				const SetInputLayout* p = Get<SetInputLayout>(p_header);
+				if (!p) return false;
+				pContext->IASetInputLayout(p->pInputLayout);
+				break;
+			}
+			case COMMAND_SET_VERTEX_BUFFER:
+			{
+				const SetVertexBuffer* p = Get<SetVertexBuffer>(p_header);
+				if (!p) return false;
+				pContext->IASetVertexBuffers(p->slot, 1, &p->pBuffer, &p->stride, &p->offset);
+				break;
+			}
+			case COMMAND_SET_INDEX_BUFFER:
+			{
+				const SetIndexBuffer* p = Get<SetIndexBuffer>(p_header);
+				if (!p) return false;
+				pContext->IASetIndexBuffer(p->pBuffer, p->format, p->offset);
+				break;
+			}
+			case COMMAND_SET_VERTEX_SHADER:
+			{
+				const SetVertexShader* p = Get<SetVertexShader>(p_header);
+				if (!p) return false;
+				pContext->VSSetShader(p->pShader, nullptr, 0);
+				break;
+			}
+			case COMMAND_SET_PIXEL_SHADER:
+			{
+				const SetPixelShader* p = Get<SetPixelShader>(p_header);
+				if (!p) return false;
+				pContext->PSSetShader(p->pShader, nullptr, 0);
+				break;
+			}
+			case COMMAND_SET_VS_CONSTANT_BUFFER:
+			{
+				const SetConstantBuffer* p = Get<SetConstantBuffer>(p_header);
+				if (!p) return false;
+				pContext->VSSetConstantBuffers(p->slot, 1, &p->pBuffer);
+				break;
+			}
+			case COMMAND_SET_VS_CONSTANT_BUFFER_RANGE:
+			{
+				const SetConstantBufferRange* p = Get<SetConstantBufferRange>(p_header);
+				if (!p) return false;
+				pContext->VSSetConstantBuffers1(p->slot, 1, &p->pBuffer, &p->firstConstant, &p->numConstants);
+				break;
+			}
+			case COMMAND_SET_PS_CONSTANT_BUFFER:
+			{
+				const SetConstantBuffer* p = Get<SetConstantBuffer>(p_header);
+				if (!p) return false;
+				pContext->PSSetConstantBuffers(p->slot, 1, &p->pBuffer);
+				break;
+			}
+			case COMMAND_SET_VS_SHADER_RESOURCE:
+			{
+				const SetShaderResource* p = Get<SetShaderResource>(p_header);
+				if (!p) return false;
+				pContext->VSSetShaderResources(p->slot, 1, &p->pView);
+				break;
+			}
+			case COMMAND_SET_PS_SHADER_RESOURCE:
+			{
+				const SetShaderResource* p = Get<SetShaderResource>(p_header);
+				if (!p) return false;
+				pContext->PSSetShaderResources(p->slot, 1, &p->pView);
+				break;
+			}
+			case COMMAND_SET_PS_SAMPLER:
+			{
+				const SetSampler* p = Get<SetSampler>(p_header);
+				if (!p) return false;
+				pContext->PSSetSamplers(p->slot, 1, &p->pSampler);
+				break;
+			}
+			case COMMAND_SET_RASTERIZER_STATE:
+			{
+				const SetRasterizerState* p = Get<SetRasterizerState>(p_header);
+				if (!p) return false;
+				pContext->RSSetState(p->pState);
+				break;
+			}
+			case COMMAND_SET_VIEWPORTS:
+			{
+				const SetViewports* p = Get<SetViewports>(p_header);
+				if (!p || p_header->size < sizeof(SetViewports) + p->numViewports * sizeof(D3D11_VIEWPORT))
+					return false;
+				pContext->RSSetViewports(p->numViewports, reinterpret_cast<const D3D11_VIEWPORT*>(p + 1));
+				break;
+			}
+			case COMMAND_SET_DEPTH_STENCIL_STATE:
+			{
+				const SetDepthStencilState* p = Get<SetDepthStencilState>(p_header);
+				if (!p) return false;
+				pContext->OMSetDepthStencilState(p->pState, p->stencilRef);
+				break;
+			}
+			case COMMAND_SET_BLEND_STATE:
+			{
+				const SetBlendState* p = Get<SetBlendState>(p_header);
+				if (!p) return false;
+				pContext->OMSetBlendState(p->pState, p->blendFactor, p->sampleMask);
+				break;
+			}
+			case COMMAND_SET_RENDER_TARGETS:
+			{
+				const SetRenderTargets* p = Get<SetRenderTargets>(p_header);
+				if (!p || p_header->size < sizeof(SetRenderTargets) + p->numViews * sizeof(ID3D11RenderTargetView*))
+					return false;
+				pContext->OMSetRenderTargets(p->numViews, reinterpret_cast<ID3D11RenderTargetView* const*>(p + 1), p->pDepthStencilView);
+				break;
+			}
+			case COMMAND_DRAW_INDEXED:
+			{
+				const DrawIndexed* p = Get<DrawIndexed>(p_header);
+				if (!p) return false;
+				pContext->DrawIndexed(p->indexCount, p->startIndex, p->baseVertex);
+				break;
+			}
+			case COMMAND_DRAW_INDEXED_INSTANCED:
+			{
+				const DrawIndexedInstanced* p = Get<DrawIndexedInstanced>(p_header);
+				if (!p) return false;
+				pContext->DrawIndexedInstanced(p->indexCountPerInstance, p->instanceCount, p->startIndex, p->baseVertex, p->startInstance);
+				break;
+			}
+			default:
+				return false;
+			}
+			p_command += p_header->size;
+		}
+		return true;
+	}
+}
+
+struct NullCommandStats
+{
+	unsigned int commands[COMMAND_TYPE_COUNT];	// Calls of every kind, one per slot for calls that bind several slots
+	unsigned int draws;
+	uint64_t instances;			// Every non instanced draw counts as one instance
+	uint64_t indices;			// Summed over all instances
+	unsigned int invalidDraws;	// Draws without an input layout, a vertex buffer in slot 0, an index buffer, both shaders or a render target
+};
+
+// Context that draws nothing, it only counts the calls and checks that every draw has what it needs bound.
+// It has the same methods as CommandBuffer, so command buffers can be replayed into it on any platform.
+class NullCommandContext
+{
+public:
+	NullCommandContext();
+	~NullCommandContext();
+
+	// Unbinds everything and clears the stats
+	void Reset();
+	const NullCommandStats& GetStats() const;
+
+	void IASetInputLayout(ID3D11InputLayout* pInputLayout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets);
+	void IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset);
+	void VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances);
+	void PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances);
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers);
+	void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers);
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews);
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews);
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers);
+	void RSSetState(ID3D11RasterizerState* pRasterizerState);
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef);
+	void OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask);
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView);
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex);
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance);
+
+private:
+	NullCommandStats mStats = {};
+	ID3D11InputLayout* mpInputLayout = nullptr;
+	ID3D11Buffer* mpVertexBuffer = nullptr;
+	ID3D11Buffer* mpIndexBuffer = nullptr;
+	ID3D11VertexShader* mpVertexShader = nullptr;
+	ID3D11PixelShader* mpPixelShader = nullptr;
+	bool mRenderTargetBound = false;
+
+	void CountDraw(UINT indexCount, UINT instanceCount);
+};
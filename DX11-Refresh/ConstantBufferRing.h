@@ -0,0 +1,161 @@
+#pragma once
+#include <stdint.h>
+
+// Constant buffer offsets have to be multiples of 16 constants of 16 bytes
+#define CONSTANT_BUFFER_ALIGNMENT 256
+// Size of the ring buffer all per frame and per object constants are allocated from
+#define CONSTANT_BUFFER_RING_SIZE (4 * 1024 * 1024)
+// Frames the CPU can run ahead of the GPU before it has to wait for the oldest one
+#define CONSTANT_BUFFER_RING_MAX_FRAME_LAG 3
+
+struct ConstantBufferRingStats
+{
+	uint32_t allocatedBytes = 0;	// Bytes handed out this frame, including alignment and skipped bytes at the end of the buffer
+	uint32_t waits = 0;				// Times the CPU had to wait for the GPU this frame
+};
+
+// Hands out CONSTANT_BUFFER_ALIGNMENT aligned slices of one large dynamic constant buffer.
+// The buffer is mapped with WRITE_NO_OVERWRITE, the slices of the frames the GPU might still be reading are
+// protected by a fence per frame. The slices are bound with offsets (VSSetConstantBuffers1), which needs a device
+// that reports ConstantBufferOffsetting, see Renderer::CreateDeviceAndSwapChain.
+//
+// The ring itself only does the bookkeeping, BackendT maps the buffer and tracks the fences, see
+// D3D11ConstantRingBackend. It provides
+//   void* Map(bool discard);					// Maps the whole buffer, WRITE_DISCARD if discard is true
+//   void Unmap();
+//   void SignalFrame(uint64_t frame);			// Called when the commands of the frame have been submitted
+//   bool IsFrameComplete(uint64_t frame);		// True once the GPU has finished the frame
+//   void WaitForFrame(uint64_t frame);			// Blocks until the GPU has finished the frame
+// so a fake backend can stand in for the GPU.
+template <class BackendT>
+class ConstantBufferRing
+{
+public:
+	struct Slice
+	{
+		void* pData;			// Where to write the constants, valid until Unmap
+		uint32_t offset;		// Offset in bytes from the start of the buffer
+		uint32_t size;		// Size in bytes, a multiple of CONSTANT_BUFFER_ALIGNMENT
+
+		uint32_t FirstConstant() const { return this->offset / 16; }
+		uint32_t ConstantCount() const { return this->size / 16; }
+	};
+
+	void Init(BackendT* pBackend, uint32_t size)
+	{
+		this->mpBackend = pBackend;
+		this->mSize = size - size % CONSTANT_BUFFER_ALIGNMENT;
+		this->mHead = 0;
+		this->mTail = 0;
+		this->mFenceCount = 0;
+		this->mFirstMap = true;
+	}
+
+	// Frees the slices of every frame the GPU has finished
+	void BeginFrame(uint64_t frame)
+	{
+		this->mFrame = frame;
+		this->mStats = ConstantBufferRingStats();
+		while (this->mFenceCount > 0 && this->mpBackend->IsFrameComplete(this->mFences[0].frame))
+		{
+			this->RetireOldestFence();
+		}
+	}
+
+	// Signals the fence of the frame, waits for the oldest frame if the CPU is too far ahead
+	void EndFrame()
+	{
+		if (this->mFenceCount == CONSTANT_BUFFER_RING_MAX_FRAME_LAG)
+		{
+			this->mpBackend->WaitForFrame(this->mFences[0].frame);
+			this->mStats.waits++;
+			this->RetireOldestFence();
+		}
+		this->mpBackend->SignalFrame(this->mFrame);
+		this->mFences[this->mFenceCount++] = { this->mFrame, this->mHead };
+	}
+
+	bool Map()
+	{
+		// The first map of a dynamic buffer has to discard
+		this->mpMapped = static_cast<unsigned char*>(this->mpBackend->Map(this->mFirstMap));
+		this->mFirstMap = false;
+		return this->mpMapped != nullptr;
+	}
+
+	void Unmap()
+	{
+		this->mpBackend->Unmap();
+		this->mpMapped = nullptr;
+	}
+
+	// Allocates size bytes from the mapped buffer. Wraps to the start of the buffer when the end is reached and waits
+	// for the GPU if that would overwrite a frame in flight. Returns false if the current frame alone does not fit.
+	bool Allocate(uint32_t size, Slice* pOutSlice)
+	{
+		const uint32_t aligned_size = (size + CONSTANT_BUFFER_ALIGNMENT - 1) & ~(uint32_t)(CONSTANT_BUFFER_ALIGNMENT - 1);
+		if (!this->mpMapped || aligned_size == 0 || aligned_size > this->mSize)
+			return false;
+
+		// Slices never straddle the end of the buffer, the remainder is skipped
+		uint64_t start = this->mHead;
+		const uint32_t offset = (uint32_t)(start % this->mSize);
+		if (offset + aligned_size > this->mSize)
+			start += this->mSize - offset;
+
+		while (start + aligned_size - this->mTail > this->mSize)
+		{
+			if (this->mFenceCount == 0)
+				return false;
+			this->mpBackend->WaitForFrame(this->mFences[0].frame);
+			this->mStats.waits++;
+			this->RetireOldestFence();
+		}
+
+		this->mStats.allocatedBytes += (uint32_t)(start + aligned_size - this->mHead);
+		this->mHead = start + aligned_size;
+		pOutSlice->offset = (uint32_t)(start % this->mSize);
+		pOutSlice->size = aligned_size;
+		pOutSlice->pData = this->mpMapped + pOutSlice->offset;
+		return true;
+	}
+
+	const ConstantBufferRingStats& GetStats() const
+	{
+		return this->mStats;
+	}
+
+	uint32_t GetSize() const
+	{
+		return this->mSize;
+	}
+
+private:
+	struct Fence
+	{
+		uint64_t frame;
+		uint64_t end;		// Head position when the frame ended
+	};
+
+	BackendT* mpBackend = nullptr;
+	unsigned char* mpMapped = nullptr;
+	bool mFirstMap = true;
+	uint32_t mSize = 0;
+	// Total bytes allocated since Init, the slices between tail and head may still be read by the GPU
+	uint64_t mHead = 0;
+	uint64_t mTail = 0;
+	uint64_t mFrame = 0;
+	Fence mFences[CONSTANT_BUFFER_RING_MAX_FRAME_LAG];
+	unsigned int mFenceCount = 0;
+	ConstantBufferRingStats mStats;
+
+	void RetireOldestFence()
+	{
+		this->mTail = this->mFences[0].end;
+		for (unsigned int i = 1; i < this->mFenceCount; ++i)
+		{
+			this->mFences[i - 1] = this->mFences[i];
+		}
+		this->mFenceCount--;
+	}
+};
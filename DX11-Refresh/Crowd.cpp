@@ -0,0 +1,86 @@
+#include "Crowd.h"
+#include "FrameArena.h"
+#include <climits>
+#include <cstring>
+
+void Crowd::Pack(const Character* pCharacters,
+	unsigned int characterCount,
+	unsigned int meshCount,
+	const DirectX::XMMATRIX& viewProj,
+	std::vector<InstanceData>* pOutInstances,
+	std::vector<DirectX::XMFLOAT4X4>* pOutPalette,
+	std::vector<Batch>* pOutBatches)
+{
+	pOutBatches->clear();
+
+	// Count the characters and joint matrices of every mesh to find where each mesh starts
+	FrameVector<unsigned int> first_instance(meshCount + 1, 0);
+	unsigned int matrix_count = 0;
+	for (unsigned int i = 0; i < characterCount; ++i)
+	{
+		first_instance[pCharacters[i].mesh + 1]++;
+		matrix_count += pCharacters[i].jointCount;
+	}
+	for (unsigned int mesh = 0; mesh < meshCount; ++mesh)
+	{
+		if (first_instance[mesh + 1] > 0)
+			pOutBatches->push_back({ mesh, first_instance[mesh], first_instance[mesh + 1] });
+		first_instance[mesh + 1] += first_instance[mesh];
+	}
+
+	pOutInstances->resize(characterCount);
+	pOutPalette->resize(matrix_count);
+	InstanceData* p_instances = pOutInstances->data();
+	DirectX::XMFLOAT4X4* p_palette = pOutPalette->data();
+
+	// Palettes are appended in character order, instances are placed in their mesh's range
+	unsigned int palette_offset = 0;
+	for (unsigned int i = 0; i < characterCount; ++i)
+	{
+		const Character& character = pCharacters[i];
+		memcpy(p_palette + palette_offset, character.pJointMatrices, character.jointCount * sizeof(DirectX::XMFLOAT4X4));
+
+		DirectX::XMMATRIX world_view_proj = DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&character.world), viewProj);
+		InstanceData& instance = p_instances[first_instance[character.mesh]++];
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow0, world_view_proj.r[0]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow1, world_view_proj.r[1]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow2, world_view_proj.r[2]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow3, world_view_proj.r[3]);
+		instance.paletteOffset = DirectX::XMUINT4(palette_offset, 0, 0, 0);
+		palette_offset += character.jointCount;
+	}
+}
+
+void Crowd::ApplyViewProj(const InstanceData* pInstances, unsigned int instanceCount, const DirectX::XMMATRIX& viewProj, InstanceData* pOutInstances)
+{
+	for (unsigned int i = 0; i < instanceCount; ++i)
+	{
+		const InstanceData& source = pInstances[i];
+		DirectX::XMMATRIX world;
+		world.r[0] = DirectX::XMLoadFloat4(&source.worldViewProjRow0);
+		world.r[1] = DirectX::XMLoadFloat4(&source.worldViewProjRow1);
+		world.r[2] = DirectX::XMLoadFloat4(&source.worldViewProjRow2);
+		world.r[3] = DirectX::XMLoadFloat4(&source.worldViewProjRow3);
+		DirectX::XMMATRIX world_view_proj = DirectX::XMMatrixMultiply(world, viewProj);
+		InstanceData& instance = pOutInstances[i];
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow0, world_view_proj.r[0]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow1, world_view_proj.r[1]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow2, world_view_proj.r[2]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow3, world_view_proj.r[3]);
+		instance.paletteOffset = source.paletteOffset;
+	}
+}
+
+unsigned int Crowd::GrowCapacity(unsigned int capacity, unsigned int required)
+{
+	if (capacity == 0)
+		capacity = 1;
+	while (capacity < required)
+	{
+		// Doubling would wrap around, take exactly what is required
+		if (capacity > UINT_MAX / 2)
+			return required;
+		capacity *= 2;
+	}
+	return capacity;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "VertexFormat.h"
+
+namespace Crowd
+{
+	// One animated character of a crowd
+	struct Character
+	{
+		unsigned int mesh;							// Characters of the same mesh are drawn with one instanced draw
+		DirectX::XMFLOAT4X4 world;
+		const DirectX::XMFLOAT4X4* pJointMatrices;	// Skinning matrices as uploaded to the shader (transposed), see FbxLoader::UniqueSkeletonData::frameData
+		unsigned int jointCount;
+	};
+
+	// Per instance vertex data of a crowd draw
+	struct InstanceData
+	{
+		DirectX::XMFLOAT4 worldViewProjRow0;
+		DirectX::XMFLOAT4 worldViewProjRow1;
+		DirectX::XMFLOAT4 worldViewProjRow2;
+		DirectX::XMFLOAT4 worldViewProjRow3;
+		DirectX::XMUINT4 paletteOffset;				// x is the index of the first joint matrix of the instance in the palette buffer
+	};
+
+	// The instances of one mesh, contiguous in the instance buffer
+	struct Batch
+	{
+		unsigned int mesh;
+		unsigned int firstInstance;
+		unsigned int instanceCount;
+	};
+
+	// Packs the joint matrices of every character back to back into one palette, writes the instance data
+	// grouped by mesh and returns one batch per mesh that has characters, in mesh order.
+	// The output vectors are overwritten, their capacity is reused between frames.
+	void Pack(const Character* pCharacters,
+		unsigned int characterCount,
+		unsigned int meshCount,
+		const DirectX::XMMATRIX& viewProj,
+		std::vector<InstanceData>* pOutInstances,
+		std::vector<DirectX::XMFLOAT4X4>* pOutPalette,
+		std::vector<Batch>* pOutBatches);
+
+	// Writes the instances to pOutInstances with their matrices multiplied by viewProj. Instances packed with an
+	// identity viewProj hold the world matrices, this adds the camera once it is known. pOutInstances is only
+	// written, it can be a mapped buffer
+	void ApplyViewProj(const InstanceData* pInstances, unsigned int instanceCount, const DirectX::XMMATRIX& viewProj, InstanceData* pOutInstances);
+
+	// Returns the capacity to create a buffer with so that it can hold required elements,
+	// grows in powers of two so that a growing crowd only recreates its buffers a few times. Never 0, even for an empty crowd
+	unsigned int GrowCapacity(unsigned int capacity, unsigned int required);
+}
+
+VERTEX_ATTRIBUTE(CrowdWorldViewProjRow0, Crowd::InstanceData, worldViewProjRow0, DirectX::XMFLOAT4, "INSTANCE_WVP", 0);
+VERTEX_ATTRIBUTE(CrowdWorldViewProjRow1, Crowd::InstanceData, worldViewProjRow1, DirectX::XMFLOAT4, "INSTANCE_WVP", 1);
+VERTEX_ATTRIBUTE(CrowdWorldViewProjRow2, Crowd::InstanceData, worldViewProjRow2, DirectX::XMFLOAT4, "INSTANCE_WVP", 2);
+VERTEX_ATTRIBUTE(CrowdWorldViewProjRow3, Crowd::InstanceData, worldViewProjRow3, DirectX::XMFLOAT4, "INSTANCE_WVP", 3);
+VERTEX_ATTRIBUTE(CrowdPaletteOffset, Crowd::InstanceData, paletteOffset, DirectX::XMUINT4, "PALETTE_OFFSET", 0);
+typedef VertexFormat::Layout<Crowd::InstanceData,
+	CrowdWorldViewProjRow0,
+	CrowdWorldViewProjRow1,
+	CrowdWorldViewProjRow2,
+	CrowdWorldViewProjRow3,
+	CrowdPaletteOffset> CrowdInstanceLayout;
@@ -0,0 +1,61 @@
+static const int MAX_AFFECTING_BONES = 4;
+
+// Joint matrices of every character in the crowd, packed back to back
+struct PaletteMatrix
+{
+	column_major float4x4 transform;
+};
+StructuredBuffer<PaletteMatrix> gPalette : register(t0);
+
+struct CROWD_VSIn
+{
+	float3 Pos	 : POSITION;
+	float3 Normal : NORMAL;
+	float2 UV		: TEXCOORD;
+	float3 blendWeights : BLENDWEIGHT0;
+	min16int4 blendIndices : BLENDINDICES0;
+	// Rows of the world * view * projection matrix of the instance
+	float4 wvp0 : INSTANCE_WVP0;
+	float4 wvp1 : INSTANCE_WVP1;
+	float4 wvp2 : INSTANCE_WVP2;
+	float4 wvp3 : INSTANCE_WVP3;
+	// x is where the joint matrices of the instance start in gPalette
+	uint4 paletteOffset : PALETTE_OFFSET0;
+};
+
+struct VSOut
+{
+	float4 Pos	 : SV_POSITION;
+	float4 Color : COLOR;
+	float2 UV	 : TEXCOORD0;
+	float3 worldPos : POSITION0;
+};
+
+
+VSOut CROWD_VS(CROWD_VSIn input)
+{
+	VSOut output = (VSOut)0;
+
+	float lastWeight = 1.0f;
+	float4 v = float4(0.0f, 0.0f, 0.0f, 1.0f);
+	float3 norm = float3(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < MAX_AFFECTING_BONES - 1; ++i)
+	{
+		float4x4 bone = gPalette[input.paletteOffset.x + input.blendIndices[i]].transform;
+		v		+= input.blendWeights[i] * mul(float4(input.Pos, 1.0f), bone);
+		norm	+= (input.blendWeights[i] * mul(float4(input.Normal, 1.0f), bone)).xyz;
+		lastWeight -= input.blendWeights[i];
+	}
+	// Apply last weight
+	float4x4 lastBone = gPalette[input.paletteOffset.x + input.blendIndices[MAX_AFFECTING_BONES - 1]].transform;
+	v += lastWeight * mul(float4(input.Pos, 1.0f), lastBone);
+	norm += (lastWeight * mul(float4(input.Normal, 1.0f), lastBone)).xyz;
+	v.w = 1.0f;
+	float4x4 worldViewProj = float4x4(input.wvp0, input.wvp1, input.wvp2, input.wvp3);
+	output.Pos = mul(v, worldViewProj);
+	output.UV = input.UV;
+	output.Color = float4(input.Normal, 1.0f);
+	// Used for normal testing purposes to assign colour in the pixel shader
+	output.worldPos = norm;
+	return output;
+}
@@ -0,0 +1,242 @@
+#include "Culling.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// Anonymous namespace for Culling
+namespace {
+	// Every component of a plane replicated over all lanes, so one plane is tested against CULL_SIMD_WIDTH objects
+	struct SplatPlane
+	{
+		DirectX::XMVECTOR x;
+		DirectX::XMVECTOR y;
+		DirectX::XMVECTOR z;
+		DirectX::XMVECTOR w;
+	};
+
+	void SplatPlanes(const DirectX::XMFLOAT4* pFrustumPlanes, SplatPlane* pOutPlanes)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			pOutPlanes[i].x = DirectX::XMVectorReplicate(pFrustumPlanes[i].x);
+			pOutPlanes[i].y = DirectX::XMVectorReplicate(pFrustumPlanes[i].y);
+			pOutPlanes[i].z = DirectX::XMVectorReplicate(pFrustumPlanes[i].z);
+			pOutPlanes[i].w = DirectX::XMVectorReplicate(pFrustumPlanes[i].w);
+		}
+	}
+
+	DirectX::XMVECTOR Load(const std::vector<float>& values, unsigned int index)
+	{
+		return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(&values[index]));
+	}
+
+	// Signed distances of CULL_SIMD_WIDTH points to a plane
+	DirectX::XMVECTOR PlaneDistance(const SplatPlane& plane, DirectX::FXMVECTOR x, DirectX::FXMVECTOR y, DirectX::FXMVECTOR z)
+	{
+		return DirectX::XMVectorMultiplyAdd(x, plane.x,
+			DirectX::XMVectorMultiplyAdd(y, plane.y,
+				DirectX::XMVectorMultiplyAdd(z, plane.z, plane.w)));
+	}
+
+	// Appends the lanes of first..first + 3 that are not outside, without branches
+	unsigned int Compact(DirectX::FXMVECTOR outside, unsigned int first, unsigned int* pOutVisible)
+	{
+		DirectX::XMUINT4 mask;
+		DirectX::XMStoreUInt4(&mask, outside);
+		unsigned int count = 0;
+		pOutVisible[count] = first;
+		count += mask.x == 0 ? 1 : 0;
+		pOutVisible[count] = first + 1;
+		count += mask.y == 0 ? 1 : 0;
+		pOutVisible[count] = first + 2;
+		count += mask.z == 0 ? 1 : 0;
+		pOutVisible[count] = first + 3;
+		count += mask.w == 0 ? 1 : 0;
+		return count;
+	}
+
+	// begin and end are multiples of CULL_SIMD_WIDTH, the visible indices are written from pOutVisible on
+	unsigned int CullSphereRange(const Culling::SphereSoA& spheres, const SplatPlane* pPlanes,
+		unsigned int begin, unsigned int end, unsigned int* pOutVisible)
+	{
+		unsigned int visible_count = 0;
+		for (unsigned int i = begin; i < end; i += CULL_SIMD_WIDTH)
+		{
+			DirectX::XMVECTOR x = ::Load(spheres.x, i);
+			DirectX::XMVECTOR y = ::Load(spheres.y, i);
+			DirectX::XMVECTOR z = ::Load(spheres.z, i);
+			DirectX::XMVECTOR negative_radius = DirectX::XMVectorNegate(::Load(spheres.radius, i));
+			DirectX::XMVECTOR outside = DirectX::XMVectorFalseInt();
+			for (int p = 0; p < 6; ++p)
+			{
+				outside = DirectX::XMVectorOrInt(outside,
+					DirectX::XMVectorLess(::PlaneDistance(pPlanes[p], x, y, z), negative_radius));
+			}
+			visible_count += ::Compact(outside, i, pOutVisible + visible_count);
+		}
+		return visible_count;
+	}
+
+	unsigned int CullAABBRange(const Culling::AABBSoA& boxes, const SplatPlane* pPlanes, const DirectX::XMFLOAT4* pFrustumPlanes,
+		unsigned int begin, unsigned int end, unsigned int* pOutVisible)
+	{
+		unsigned int visible_count = 0;
+		for (unsigned int i = begin; i < end; i += CULL_SIMD_WIDTH)
+		{
+			DirectX::XMVECTOR min_x = ::Load(boxes.minX, i);
+			DirectX::XMVECTOR min_y = ::Load(boxes.minY, i);
+			DirectX::XMVECTOR min_z = ::Load(boxes.minZ, i);
+			DirectX::XMVECTOR max_x = ::Load(boxes.maxX, i);
+			DirectX::XMVECTOR max_y = ::Load(boxes.maxY, i);
+			DirectX::XMVECTOR max_z = ::Load(boxes.maxZ, i);
+			DirectX::XMVECTOR outside = DirectX::XMVectorFalseInt();
+			for (int p = 0; p < 6; ++p)
+			{
+				// The corner furthest along the plane normal is the same for every lane
+				const DirectX::XMFLOAT4& plane = pFrustumPlanes[p];
+				DirectX::XMVECTOR distance = ::PlaneDistance(pPlanes[p],
+					plane.x >= 0.0f ? max_x : min_x,
+					plane.y >= 0.0f ? max_y : min_y,
+					plane.z >= 0.0f ? max_z : min_z);
+				outside = DirectX::XMVectorOrInt(outside, DirectX::XMVectorLess(distance, DirectX::XMVectorZero()));
+			}
+			visible_count += ::Compact(outside, i, pOutVisible + visible_count);
+		}
+		return visible_count;
+	}
+
+	unsigned int PadCount(unsigned int count)
+	{
+		return (count + CULL_SIMD_WIDTH - 1) / CULL_SIMD_WIDTH * CULL_SIMD_WIDTH;
+	}
+
+	// Runs cullRange(begin, end, pOut) over chunks of [0, paddedCount) as jobs and packs the results of the chunks
+	// together in order
+	template <class CullRangeT>
+	unsigned int CullParallel(unsigned int paddedCount, unsigned int threadCount, unsigned int* pOutVisible, CullRangeT cullRange)
+	{
+		if (threadCount == 0)
+			threadCount = (std::min)(JobSystem::GetWorkerCount(), paddedCount / CULL_MIN_OBJECTS_PER_THREAD);
+		threadCount = (std::min)(threadCount, (unsigned int)CULL_MAX_CHUNKS);
+		if (threadCount <= 1)
+			return cullRange(0, paddedCount, pOutVisible);
+
+		// Every chunk writes its visible indices at its own start, they are moved down afterwards
+		const unsigned int chunk_size = ::PadCount((paddedCount + threadCount - 1) / threadCount);
+		unsigned int chunk_counts[CULL_MAX_CHUNKS] = {};
+		JobSystem::ParallelFor(threadCount, 1, [&](unsigned int chunk, unsigned int)
+		{
+			unsigned int begin = (std::min)(chunk * chunk_size, paddedCount);
+			unsigned int end = (std::min)(begin + chunk_size, paddedCount);
+			chunk_counts[chunk] = cullRange(begin, end, pOutVisible + begin);
+		});
+
+		unsigned int visible_count = chunk_counts[0];
+		for (unsigned int t = 1; t < threadCount; ++t)
+		{
+			unsigned int begin = (std::min)(t * chunk_size, paddedCount);
+			memmove(pOutVisible + visible_count, pOutVisible + begin, chunk_counts[t] * sizeof(unsigned int));
+			visible_count += chunk_counts[t];
+		}
+		return visible_count;
+	}
+}
+
+void Culling::SphereSoA::Resize(unsigned int newCount)
+{
+	unsigned int padded_count = ::PadCount(newCount);
+	this->x.resize(padded_count, 0.0f);
+	this->y.resize(padded_count, 0.0f);
+	this->z.resize(padded_count, 0.0f);
+	this->radius.resize(padded_count, 0.0f);
+	// A negative radius puts the padding outside of every plane
+	std::fill(this->radius.begin() + newCount, this->radius.end(), -FLT_MAX);
+	this->count = newCount;
+}
+
+void Culling::SphereSoA::Set(unsigned int index, const Bounds::Sphere& sphere)
+{
+	this->x[index] = sphere.center.x;
+	this->y[index] = sphere.center.y;
+	this->z[index] = sphere.center.z;
+	this->radius[index] = sphere.radius;
+}
+
+unsigned int Culling::SphereSoA::PaddedCount() const
+{
+	return (unsigned int)this->x.size();
+}
+
+void Culling::AABBSoA::Resize(unsigned int newCount)
+{
+	unsigned int padded_count = ::PadCount(newCount);
+	this->minX.resize(padded_count);
+	this->minY.resize(padded_count);
+	this->minZ.resize(padded_count);
+	this->maxX.resize(padded_count);
+	this->maxY.resize(padded_count);
+	this->maxZ.resize(padded_count);
+	for (unsigned int i = newCount; i < padded_count; ++i)
+	{
+		this->Set(i, Bounds::EmptyAABB());
+	}
+	this->count = newCount;
+}
+
+void Culling::AABBSoA::Set(unsigned int index, const Bounds::AABB& box)
+{
+	this->minX[index] = box.min.x;
+	this->minY[index] = box.min.y;
+	this->minZ[index] = box.min.z;
+	this->maxX[index] = box.max.x;
+	this->maxY[index] = box.max.y;
+	this->maxZ[index] = box.max.z;
+}
+
+unsigned int Culling::AABBSoA::PaddedCount() const
+{
+	return (unsigned int)this->minX.size();
+}
+
+void Culling::ExtractFrustumPlanes(const DirectX::XMMATRIX& viewProj, DirectX::XMFLOAT4* pOutPlanes)
+{
+	// The rows of the transposed view projection matrix are the columns used for clip space x, y, z and w
+	DirectX::XMMATRIX columns = DirectX::XMMatrixTranspose(viewProj);
+
+	DirectX::XMVECTOR planes[6] = {
+		DirectX::XMVectorAdd(columns.r[3], columns.r[0]),		// Left
+		DirectX::XMVectorSubtract(columns.r[3], columns.r[0]),	// Right
+		DirectX::XMVectorAdd(columns.r[3], columns.r[1]),		// Bottom
+		DirectX::XMVectorSubtract(columns.r[3], columns.r[1]),	// Top
+		columns.r[2],											// Near, clip space z starts at 0
+		DirectX::XMVectorSubtract(columns.r[3], columns.r[2])	// Far
+	};
+
+	for (int i = 0; i < 6; ++i)
+	{
+		DirectX::XMStoreFloat4(&pOutPlanes[i], DirectX::XMPlaneNormalize(planes[i]));
+	}
+}
+
+unsigned int Culling::CullSpheres(const SphereSoA& spheres,
+	const DirectX::XMFLOAT4* pFrustumPlanes,
+	unsigned int* pOutVisible,
+	unsigned int threadCount)
+{
+	SplatPlane planes[6];
+	::SplatPlanes(pFrustumPlanes, planes);
+	return ::CullParallel(spheres.PaddedCount(), threadCount, pOutVisible,
+		[&](unsigned int begin, unsigned int end, unsigned int* pOut) { return ::CullSphereRange(spheres, planes, begin, end, pOut); });
+}
+
+unsigned int Culling::CullAABBs(const AABBSoA& boxes,
+	const DirectX::XMFLOAT4* pFrustumPlanes,
+	unsigned int* pOutVisible,
+	unsigned int threadCount)
+{
+	SplatPlane planes[6];
+	::SplatPlanes(pFrustumPlanes, planes);
+	return ::CullParallel(boxes.PaddedCount(), threadCount, pOutVisible,
+		[&](unsigned int begin, unsigned int end, unsigned int* pOut) { return ::CullAABBRange(boxes, planes, pFrustumPlanes, begin, end, pOut); });
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include "Bounds.h"
+
+// Objects tested per iteration of the culling kernels, one per lane of an XMVECTOR
+#define CULL_SIMD_WIDTH 4
+// Below this many objects per job the work is not split
+#define CULL_MIN_OBJECTS_PER_THREAD 65536
+// Most jobs a cull is split into
+#define CULL_MAX_CHUNKS 64
+
+namespace Culling
+{
+	// World space bounding spheres, one array per component so that CULL_SIMD_WIDTH spheres load into one vector.
+	// The arrays are padded to a multiple of CULL_SIMD_WIDTH with spheres that are never visible.
+	struct SphereSoA
+	{
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+		unsigned int count = 0;
+
+		void Resize(unsigned int newCount);
+		void Set(unsigned int index, const Bounds::Sphere& sphere);
+		// Size of the arrays including the padding, the visible list passed to CullSpheres needs room for this many
+		unsigned int PaddedCount() const;
+	};
+
+	// World space axis aligned boxes, stored like SphereSoA. The padding boxes are empty and never visible.
+	struct AABBSoA
+	{
+		std::vector<float> minX;
+		std::vector<float> minY;
+		std::vector<float> minZ;
+		std::vector<float> maxX;
+		std::vector<float> maxY;
+		std::vector<float> maxZ;
+		unsigned int count = 0;
+
+		void Resize(unsigned int newCount);
+		void Set(unsigned int index, const Bounds::AABB& box);
+		unsigned int PaddedCount() const;
+	};
+
+	// Writes the six normalized planes of the frustum of viewProj, pointing inwards.
+	// Order: left, right, bottom, top, near, far
+	void ExtractFrustumPlanes(const DirectX::XMMATRIX& viewProj, DirectX::XMFLOAT4* pOutPlanes);
+
+	// Writes the indices of the spheres that intersect the frustum to pOutVisible in ascending order and returns how many
+	// there are. pOutVisible needs room for spheres.PaddedCount() indices. threadCount is the number of jobs the work is
+	// split into, 0 picks one per JobSystem worker once there are enough spheres and 1 culls on the calling thread only.
+	unsigned int CullSpheres(const SphereSoA& spheres,
+		const DirectX::XMFLOAT4* pFrustumPlanes,
+		unsigned int* pOutVisible,
+		unsigned int threadCount = 0);
+
+	// Same as CullSpheres for boxes, a box is culled when it lies completely outside one of the planes
+	unsigned int CullAABBs(const AABBSoA& boxes,
+		const DirectX::XMFLOAT4* pFrustumPlanes,
+		unsigned int* pOutVisible,
+		unsigned int threadCount = 0);
+}
@@ -0,0 +1,94 @@
+#include "D3D11ConstantRingBackend.h"
+
+D3D11ConstantRingBackend::D3D11ConstantRingBackend()
+{
+}
+
+D3D11ConstantRingBackend::~D3D11ConstantRingBackend()
+{
+	this->Release();
+}
+
+HRESULT D3D11ConstantRingBackend::Init(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, UINT size)
+{
+	this->Release();
+	this->mpContext = pContext;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = size;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	HRESULT hr = pDevice->CreateBuffer(&desc, nullptr, &this->mpBuffer);
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_QUERY_DESC query_desc = {};
+	query_desc.Query = D3D11_QUERY_EVENT;
+	for (int i = 0; i < CONSTANT_BUFFER_RING_MAX_FRAME_LAG; ++i)
+	{
+		hr = pDevice->CreateQuery(&query_desc, &this->mpQueries[i]);
+		if (FAILED(hr))
+			return hr;
+	}
+	return S_OK;
+}
+
+void D3D11ConstantRingBackend::Release()
+{
+	if (this->mpBuffer)
+	{
+		this->mpBuffer->Release();
+		this->mpBuffer = nullptr;
+	}
+	for (int i = 0; i < CONSTANT_BUFFER_RING_MAX_FRAME_LAG; ++i)
+	{
+		if (this->mpQueries[i])
+		{
+			this->mpQueries[i]->Release();
+			this->mpQueries[i] = nullptr;
+		}
+	}
+}
+
+ID3D11Buffer* D3D11ConstantRingBackend::GetBuffer() const
+{
+	return this->mpBuffer;
+}
+
+void* D3D11ConstantRingBackend::Map(bool discard)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(this->mpContext->Map(this->mpBuffer, 0, discard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mapped)))
+		return nullptr;
+	return mapped.pData;
+}
+
+void D3D11ConstantRingBackend::Unmap()
+{
+	this->mpContext->Unmap(this->mpBuffer, 0);
+}
+
+void D3D11ConstantRingBackend::SignalFrame(uint64_t frame)
+{
+	this->mpContext->End(this->mpQueries[frame % CONSTANT_BUFFER_RING_MAX_FRAME_LAG]);
+}
+
+bool D3D11ConstantRingBackend::IsFrameComplete(uint64_t frame)
+{
+	BOOL done = FALSE;
+	return this->mpContext->GetData(this->mpQueries[frame % CONSTANT_BUFFER_RING_MAX_FRAME_LAG],
+		&done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK && done;
+}
+
+void D3D11ConstantRingBackend::WaitForFrame(uint64_t frame)
+{
+	// GetData without DONOTFLUSH makes sure the query is submitted so the loop terminates
+	BOOL done = FALSE;
+	for (;;)
+	{
+		const HRESULT hr = this->mpContext->GetData(this->mpQueries[frame % CONSTANT_BUFFER_RING_MAX_FRAME_LAG], &done, sizeof(done), 0);
+		if (FAILED(hr) || (hr == S_OK && done))
+			return;
+	}
+}
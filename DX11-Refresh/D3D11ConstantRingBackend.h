@@ -0,0 +1,30 @@
+#pragma once
+#include <d3d11_1.h>
+#include "ConstantBufferRing.h"
+
+// Backend for ConstantBufferRing that owns the D3D11 constant buffer and uses event queries as fences
+class D3D11ConstantRingBackend
+{
+public:
+	D3D11ConstantRingBackend();
+	~D3D11ConstantRingBackend();
+
+	HRESULT Init(ID3D11Device* pDevice, ID3D11DeviceContext* pContext, UINT size);
+	void Release();
+	ID3D11Buffer* GetBuffer() const;
+
+	void* Map(bool discard);
+	void Unmap();
+	void SignalFrame(uint64_t frame);
+	bool IsFrameComplete(uint64_t frame);
+	// Also returns if the query fails, such as after the device was removed, a lost device never finishes the frame
+	void WaitForFrame(uint64_t frame);
+
+private:
+	ID3D11DeviceContext* mpContext = nullptr;
+	ID3D11Buffer* mpBuffer = nullptr;
+	// One query per frame in flight, frame n uses query n % CONSTANT_BUFFER_RING_MAX_FRAME_LAG
+	ID3D11Query* mpQueries[CONSTANT_BUFFER_RING_MAX_FRAME_LAG] = {};
+};
+
+typedef ConstantBufferRing<D3D11ConstantRingBackend> D3D11ConstantRing;
@@ -0,0 +1,86 @@
+#include "D3D11DeferredCommandBackend.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <atomic>
+
+D3D11DeferredCommandBackend::D3D11DeferredCommandBackend()
+{
+}
+
+D3D11DeferredCommandBackend::~D3D11DeferredCommandBackend()
+{
+	this->Release();
+}
+
+HRESULT D3D11DeferredCommandBackend::Init(ID3D11Device* pDevice, unsigned int contextCount)
+{
+	this->Release();
+	contextCount = (std::min)(contextCount, (unsigned int)COMMAND_MAX_SLICES);
+	for (unsigned int i = 0; i < contextCount; ++i)
+	{
+		ID3D11DeviceContext* p_context = nullptr;
+		HRESULT hr = pDevice->CreateDeferredContext(0, &p_context);
+		if (FAILED(hr))
+			return hr;
+		// The constant buffer ranges need the D3D11.1 interface
+		ID3D11DeviceContext1* p_context1 = nullptr;
+		hr = p_context->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&p_context1));
+		p_context->Release();
+		if (FAILED(hr))
+			return hr;
+		this->mContexts.push_back(p_context1);
+	}
+	this->mCommandLists.resize(contextCount, nullptr);
+	return S_OK;
+}
+
+void D3D11DeferredCommandBackend::Release()
+{
+	for (ID3D11CommandList*& p_command_list : this->mCommandLists)
+	{
+		if (p_command_list)
+			p_command_list->Release();
+	}
+	for (ID3D11DeviceContext1* p_context : this->mContexts)
+	{
+		p_context->Release();
+	}
+	this->mCommandLists.clear();
+	this->mContexts.clear();
+}
+
+unsigned int D3D11DeferredCommandBackend::GetContextCount() const
+{
+	return (unsigned int)this->mContexts.size();
+}
+
+bool D3D11DeferredCommandBackend::Execute(const CommandBuffer* pBuffers, unsigned int bufferCount, ID3D11DeviceContext* pImmediateContext)
+{
+	bufferCount = (std::min)(bufferCount, this->GetContextCount());
+	std::atomic<bool> failed(false);
+	// Every job owns one deferred context, nothing else is shared
+	JobSystem::ParallelFor(bufferCount, 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			if (!Commands::Replay(pBuffers[i], this->mContexts[i]))
+				failed = true;
+			// Finishing also resets the deferred context to the default state for the next frame
+			if (FAILED(this->mContexts[i]->FinishCommandList(FALSE, &this->mCommandLists[i])))
+			{
+				this->mCommandLists[i] = nullptr;
+				failed = true;
+			}
+		}
+	});
+
+	for (unsigned int i = 0; i < bufferCount; ++i)
+	{
+		if (!this->mCommandLists[i])
+			continue;
+		pImmediateContext->ExecuteCommandList(this->mCommandLists[i], TRUE);
+		this->mCommandLists[i]->Release();
+		this->mCommandLists[i] = nullptr;
+	}
+	return !failed;
+}
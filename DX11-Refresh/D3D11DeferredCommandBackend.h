@@ -0,0 +1,29 @@
+#pragma once
+#include <d3d11_1.h>
+#include <vector>
+#include "CommandStream.h"
+
+// Plays command buffers back on D3D11 deferred contexts, one context per buffer, all of them at once on the
+// job system. The command lists are then executed on the immediate context in order. Deferred contexts start
+// from the default state, so every buffer has to bind all the state it draws with. The state of the immediate
+// context is restored after every command list, which keeps a StateCache on it valid.
+class D3D11DeferredCommandBackend
+{
+public:
+	D3D11DeferredCommandBackend();
+	~D3D11DeferredCommandBackend();
+
+	// Creates contextCount deferred contexts, at most COMMAND_MAX_SLICES
+	HRESULT Init(ID3D11Device* pDevice, unsigned int contextCount);
+	void Release();
+	unsigned int GetContextCount() const;
+
+	// Replays buffer i on deferred context i and executes the command lists on pImmediateContext in order.
+	// bufferCount must not exceed GetContextCount. Returns false if a buffer could not be replayed or finished,
+	// the command lists that were finished are executed regardless.
+	bool Execute(const CommandBuffer* pBuffers, unsigned int bufferCount, ID3D11DeviceContext* pImmediateContext);
+
+private:
+	std::vector<ID3D11DeviceContext1*> mContexts;
+	std::vector<ID3D11CommandList*> mCommandLists;
+};
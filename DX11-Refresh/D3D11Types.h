@@ -0,0 +1,52 @@
+#pragma once
+#ifdef _WIN32
+#include <d3d11_1.h>
+#else
+#include <stdint.h>
+
+// The Direct3D 11 types the state cache and the command stream pass around, for the portable core library.
+// They only hold and compare the pointers, so the interfaces are left incomplete and the enums only list the
+// values the CPU code uses, with the values of the Windows SDK so recordings mean the same on every platform.
+
+typedef uint32_t UINT;
+typedef int32_t INT;
+typedef float FLOAT;
+
+struct ID3D11InputLayout;
+struct ID3D11Buffer;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11ClassInstance;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11RasterizerState;
+struct ID3D11DepthStencilState;
+struct ID3D11BlendState;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+
+enum DXGI_FORMAT {
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32_UINT = 42,
+	DXGI_FORMAT_R16_UINT = 57
+};
+
+enum D3D11_PRIMITIVE_TOPOLOGY {
+	D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	D3D11_PRIMITIVE_TOPOLOGY_POINTLIST = 1,
+	D3D11_PRIMITIVE_TOPOLOGY_LINELIST = 2,
+	D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP = 3,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP = 5
+};
+
+struct D3D11_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+};
+#endif
@@ -5,11 +5,17 @@
 #include <windowsx.h>
 #include <Windows.h>
 #include "Renderer.h"
+#include "JobSystem.h"
+#include "FrameScheduler.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "Flythrough.h"
 #include "DX11-Refresh.h"
 #include <iostream>
 #include <shobjidl.h>
 #include <shlobj.h>
 #include <shlwapi.h>
+#include <shellapi.h>
 #include <strsafe.h>
 #include <propvarutil.h>
 #include "MeshObject.h"
@@ -26,6 +32,10 @@
 #define windowWidth 1200
 #define windowHeight 800
 #define MAX_LOADSTRING 100
+// Longest wait for a message while the render on demand mode is idle
+#define IDLE_WAIT_MILLISECONDS 100
+// Frames per second the main loop paces to without -fps when the display does not report its refresh rate
+#define DEFAULT_FRAME_RATE 60
 
 // Global Variables:
 HINSTANCE hInst;                                // current instance
@@ -41,6 +51,8 @@ ATOM                MyRegisterClass(HINSTANCE hInstance);
 BOOL                InitInstance(HINSTANCE, int);
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK    About(HWND, UINT, WPARAM, LPARAM);
+int                 RunBenchmark(LPWSTR lpCmdLine);
+std::string         GetArgument(LPWSTR lpCmdLine, const wchar_t* name);
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
                      _In_opt_ HINSTANCE hPrevInstance,
@@ -51,7 +63,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     UNREFERENCED_PARAMETER(lpCmdLine);
 
     // TODO: Place code here.
-
+	// -benchmark flies through the scenes without a window and exits, see RunBenchmark
+	if (wcsstr(lpCmdLine, L"-benchmark"))
+		return RunBenchmark(lpCmdLine);
 
 	// Initialize global strings
 	LoadStringW(hInstance, IDS_APP_TITLE, szTitle, MAX_LOADSTRING);
@@ -66,6 +80,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
 	
 
+	// Before the renderer, mesh import already hands work to the job system
+	JobSystem::Init();
+	PROFILE_THREAD("Main");
 	mRenderer = new Renderer();
 
 	// Add menu item for obj file browser
@@ -77,38 +94,228 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_DX11REFRESH));
 
-    MSG msg;
-	UINT_PTR timerId = 1;
-
-	SetTimer(GetActiveWindow(),
-		timerId,
-		6,
-		(TIMERPROC)NULL
-	);
-
+    // Input, camera and animation run in fixed steps, the rendering runs as often as the pacing allows.
+	// The frames are paced to the refresh rate of the display, -fps N paces them to N per second instead and -fps 0
+	// draws as fast as it can. -ondemand stops drawing while nothing happens.
+	// -pipeline moves the fixed steps to a simulation thread, the main thread then only draws what it publishes.
+	// -trace writes the profiler zones to trace.json on exit, for chrome://tracing.
+	// -stats shows the render stats in the window title and writes render_stats.csv and render_stats.json on exit,
+	// along with memory_report.txt. The memory report also goes to the debugger output.
+	// -record file writes the input, step times, frames and loads of the session to file, -benchmark -replay file
+	// plays it back without a window.
+	FrameSchedulerSettings schedulerSettings;
+	// Present does not wait for the vertical blank, without a target the loop would spin
+	DEVMODEW displayMode = {};
+	displayMode.dmSize = sizeof(displayMode);
+	int frameRate = DEFAULT_FRAME_RATE;
+	if (EnumDisplaySettingsW(nullptr, ENUM_CURRENT_SETTINGS, &displayMode) && displayMode.dmDisplayFrequency > 1)
+		frameRate = (int)displayMode.dmDisplayFrequency;
+	const wchar_t* fpsArgument = wcsstr(lpCmdLine, L"-fps ");
+	if (fpsArgument)
+		frameRate = _wtoi(fpsArgument + 5);
+	schedulerSettings.targetFrameTime = frameRate > 0 ? 1.0 / frameRate : 0.0;
+	schedulerSettings.renderOnDemand = wcsstr(lpCmdLine, L"-ondemand") != nullptr;
+	SystemFrameClock frameClock;
+	FrameScheduler<SystemFrameClock> frameScheduler;
+	frameScheduler.Init(&frameClock, schedulerSettings);
+	const bool stats = wcsstr(lpCmdLine, L"-stats") != nullptr;
+	mRenderer->SetStatsOverlay(stats);
+	// Opened before the simulation thread starts, so it records the first step as well, and after the overlay is set
+	// so the replay starts with it
+	InputRecorder inputRecorder;
+	const std::string recordPath = GetArgument(lpCmdLine, L"-record");
+	if (!recordPath.empty() && inputRecorder.Open(recordPath.c_str(), mRenderer->GetInputSessionState()))
+		mRenderer->SetInputRecorder(&inputRecorder);
+	if (wcsstr(lpCmdLine, L"-pipeline"))
+		mRenderer->SetPipelineMode(FRAME_PIPELINE_THREADED);
+	const bool pipelined = mRenderer->GetPipelineMode() == FRAME_PIPELINE_THREADED;
+
+    MSG msg = {};
+	bool running = true;
 
     // Main message loop:
-    while (GetMessage(&msg, nullptr, 0, 0))
+    while (running)
     {
-		mRenderer->Frame();
-		/*auto kb = m_keyboard->GetState();
-		if (kb.Escape)
+		// Nothing to draw, sleep until the next message. Queued main thread jobs still run now and then.
+		if (frameScheduler.IsIdle())
+			MsgWaitForMultipleObjects(0, nullptr, FALSE, IDLE_WAIT_MILLISECONDS, QS_ALLINPUT);
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
 		{
-			MessageBox(0, L"Escape pressed.", 0, 0);
-		}*/
-        if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
-
+			if (msg.message == WM_QUIT)
+			{
+				running = false;
+				break;
+			}
+			if (!TranslateAccelerator(msg.hwnd, hAccelTable, &msg))
+			{
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+			frameScheduler.RequestRender();
+		}
+		if (!running)
+			break;
+
+		PROFILE_ZONE("Frame");
+		JobSystem::RunMainThreadJobs();
+		const double frameStart = frameClock.Now();
+		FrameTick tick = frameScheduler.BeginFrame();
+		if (!pipelined)
+		{
+			for (unsigned int step = 0; step < tick.steps; ++step)
+			{
+				mRenderer->Update(tick.stepTime);
+			}
+			if (tick.steps > 0)
+				mRenderer->PublishFrame();
+		}
+		if (tick.render)
+		{
+			if (pipelined)
+				mRenderer->RenderLatest();
+			else
+				mRenderer->Render(tick.alpha);
+			mRenderer->EndFrame(frameClock.Now() - frameStart);
+			if (mRenderer->IsAnimating())
+				frameScheduler.RequestRender();
+		}
+		frameScheduler.EndFrame();
     }
+	if (stats)
+	{
+		mRenderer->GetRenderStats().WriteCsv("render_stats.csv");
+		mRenderer->GetRenderStats().WriteJson("render_stats.json");
+	}
 	delete mRenderer;
+	JobSystem::Shutdown();
+	if (wcsstr(lpCmdLine, L"-trace"))
+		Profiler::WriteChromeTrace("trace.json");
+	// Tagged memory that is still outstanding now has leaked
+	OutputDebugStringA(MemoryTracker::FormatReport().c_str());
+	if (stats)
+		MemoryTracker::WriteReport("memory_report.txt");
     return (int) msg.wParam;
 }
 
 
 
+//
+//  FUNCTION: RunBenchmark(LPWSTR)
+//
+//  PURPOSE: Times a scripted camera flight through the scenes, without a window or input
+//
+//  COMMENTS:
+//
+//        -scene file       .obj or .fbx to load, can be given more than once
+//        -forest N         also scatters N instanced trees over the floor, see Renderer::LoadForest
+//        -path file        camera path to fly instead of the default orbit, see CameraPath
+//        -frames N         frames to measure, after -warmup N frames
+//        -backend name     hardware, warp or null
+//        -label text       stored with the results, such as the commit
+//        -json file        where the results go, flythrough.json by default
+//        -replay file      plays back a session recorded with -record instead of the scenes and the path
+//        -csv file         also writes one row per measured frame
+//        -trace            also writes the profiler zones to trace.json
+//        -budget MB        most megabytes the OBJ and FBX imports may each hold at once, see MemoryTracker::SetBudget
+//
+//        Returns the exit code of Flythrough::Run, or 3 if an import went over the budget. A budget needs a build
+//        with MEMORY_TRACKING_ENABLED, other builds return 3 without running.
+//
+int RunBenchmark(LPWSTR lpCmdLine)
+{
+	FlythroughSettings settings;
+	settings.renderer.width = windowWidth;
+	settings.renderer.height = windowHeight;
+	int argumentCount = 0;
+	LPWSTR* arguments = CommandLineToArgvW(lpCmdLine, &argumentCount);
+	for (int i = 0; arguments != nullptr && i + 1 < argumentCount; ++i)
+	{
+		const std::wstring name = arguments[i];
+		const std::wstring value = arguments[i + 1];
+		const std::string narrowValue(value.begin(), value.end());
+		if (name == L"-scene")
+			settings.scenes.push_back(narrowValue);
+		else if (name == L"-forest" && _wtoi(value.c_str()) > 0)
+			settings.forestTrees = _wtoi(value.c_str());
+		else if (name == L"-path")
+			settings.pathFile = narrowValue;
+		else if (name == L"-frames" && _wtoi(value.c_str()) > 0)
+			settings.frames = _wtoi(value.c_str());
+		else if (name == L"-warmup")
+			settings.warmupFrames = (std::max)(_wtoi(value.c_str()), 0);
+		else if (name == L"-label")
+			settings.label = narrowValue;
+		else if (name == L"-json")
+			settings.output = narrowValue;
+		else if (name == L"-replay")
+			settings.replayFile = narrowValue;
+		else if (name == L"-csv")
+			settings.csvOutput = narrowValue;
+		else if (name == L"-backend" && value == L"warp")
+			settings.renderer.backend = RENDER_BACKEND_WARP;
+		else if (name == L"-backend" && value == L"null")
+			settings.renderer.backend = RENDER_BACKEND_NULL;
+		else
+			continue;
+		++i;
+	}
+	LocalFree(arguments);
+
+	const MEMORY_CATEGORY importCategories[2] = { MEMORY_CATEGORY_OBJ_IMPORT, MEMORY_CATEGORY_FBX_IMPORT };
+	const std::string budget = GetArgument(lpCmdLine, L"-budget");
+	if (!budget.empty())
+	{
+		for (MEMORY_CATEGORY category : importCategories)
+		{
+			// A budget nothing checks would pass every run
+			if (!MemoryTracker::SetBudget(category, (size_t)atoi(budget.c_str()) * 1024 * 1024))
+			{
+				OutputDebugStringA("Benchmark: -budget needs a build with MEMORY_TRACKING_ENABLED\n");
+				return 3;
+			}
+		}
+	}
+
+	JobSystem::Init();
+	PROFILE_THREAD("Main");
+	int result = Flythrough::Run(settings);
+	JobSystem::Shutdown();
+	if (wcsstr(lpCmdLine, L"-trace"))
+		Profiler::WriteChromeTrace("trace.json");
+	for (MEMORY_CATEGORY category : importCategories)
+	{
+		if (result == 0 && MemoryTracker::IsOverBudget(category))
+		{
+			OutputDebugStringA(MemoryTracker::FormatReport().c_str());
+			result = 3;
+		}
+	}
+	return result;
+}
+
+//
+//  FUNCTION: GetArgument(LPWSTR, const wchar_t*)
+//
+//  PURPOSE: Returns the value following the argument name on the command line, or an empty string
+//
+std::string GetArgument(LPWSTR lpCmdLine, const wchar_t* name)
+{
+	std::string result;
+	int argumentCount = 0;
+	LPWSTR* arguments = CommandLineToArgvW(lpCmdLine, &argumentCount);
+	for (int i = 0; arguments != nullptr && i + 1 < argumentCount; ++i)
+	{
+		if (wcscmp(arguments[i], name) == 0)
+		{
+			const std::wstring value = arguments[i + 1];
+			result = std::string(value.begin(), value.end());
+			break;
+		}
+	}
+	LocalFree(arguments);
+	return result;
+}
+
 //
 //  FUNCTION: MyRegisterClass()
 //
@@ -0,0 +1,121 @@
+#include "DrawKey.h"
+#include <algorithm>
+#include <cstring>
+
+// Anonymous namespace for DrawKey
+namespace {
+	// The key is sorted 8 bits at a time, least significant byte first
+	const unsigned int RADIX_BITS = 8;
+	const unsigned int RADIX_BUCKETS = 1 << RADIX_BITS;
+	const unsigned int RADIX_PASSES = 64 / RADIX_BITS;
+
+	uint64_t MaxValue(unsigned int bits)
+	{
+		return (uint64_t(1) << bits) - 1;
+	}
+
+	// The bit pattern of a non negative float grows with its value, so it can be compared as an integer
+	uint32_t DepthBits(float depth)
+	{
+		if (!(depth > 0.0f))
+			return 0;
+		uint32_t bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		return bits;
+	}
+}
+
+uint64_t DrawKey::Make(RENDER_PASS pass, unsigned int shader, unsigned int material, float depth)
+{
+	uint64_t depth_bits = ::DepthBits(depth);
+	if (pass == RENDER_PASS_TRANSPARENT)
+		depth_bits = ~depth_bits & ::MaxValue(DRAW_KEY_DEPTH_BITS);
+
+	uint64_t key = (uint64_t)pass & ::MaxValue(DRAW_KEY_PASS_BITS);
+	key = (key << DRAW_KEY_SHADER_BITS) | ((uint64_t)shader & ::MaxValue(DRAW_KEY_SHADER_BITS));
+	key = (key << DRAW_KEY_MATERIAL_BITS) | ((uint64_t)material & ::MaxValue(DRAW_KEY_MATERIAL_BITS));
+	key = (key << DRAW_KEY_DEPTH_BITS) | depth_bits;
+	return key;
+}
+
+DrawKeyList::DrawKeyList()
+{
+
+}
+
+DrawKeyList::~DrawKeyList()
+{
+
+}
+
+void DrawKeyList::Clear()
+{
+	this->mEntries.clear();
+}
+
+void DrawKeyList::Add(uint64_t key, size_t index)
+{
+	this->mEntries.push_back({ key, index });
+}
+
+void DrawKeyList::Sort()
+{
+	const size_t count = this->mEntries.size();
+	if (count < 2)
+		return;
+	this->mScratch.resize(count);
+
+	// Count the digits of every pass in one go
+	size_t histograms[RADIX_PASSES][RADIX_BUCKETS] = {};
+	for (const SortEntry& entry : this->mEntries)
+	{
+		for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+		{
+			histograms[pass][(entry.key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+		}
+	}
+
+	SortEntry* p_source = this->mEntries.data();
+	SortEntry* p_destination = this->mScratch.data();
+	for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+	{
+		size_t* p_histogram = histograms[pass];
+		const unsigned int shift = pass * RADIX_BITS;
+
+		// Every key has the same digit in this pass, so it would not change the order.
+		// Usually true for most of the pass, shader and material bytes.
+		if (p_histogram[(p_source[0].key >> shift) & (RADIX_BUCKETS - 1)] == count)
+			continue;
+
+		size_t offset = 0;
+		for (unsigned int bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+		{
+			size_t bucket_count = p_histogram[bucket];
+			p_histogram[bucket] = offset;
+			offset += bucket_count;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			p_destination[p_histogram[(p_source[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = p_source[i];
+		}
+		std::swap(p_source, p_destination);
+	}
+
+	if (p_source != this->mEntries.data())
+		this->mEntries.swap(this->mScratch);
+}
+
+size_t DrawKeyList::GetCount() const
+{
+	return this->mEntries.size();
+}
+
+uint64_t DrawKeyList::GetKey(size_t i) const
+{
+	return this->mEntries[i].key;
+}
+
+size_t DrawKeyList::GetIndex(size_t i) const
+{
+	return this->mEntries[i].index;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Bit layout of a draw key, from the most significant bits down: pass, shader, material, depth
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_SHADER_BITS 12
+#define DRAW_KEY_MATERIAL_BITS 16
+#define DRAW_KEY_DEPTH_BITS 32
+
+// Passes are executed in this order
+enum RENDER_PASS {
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_SKY = 1,
+	RENDER_PASS_TRANSPARENT = 2
+};
+
+namespace DrawKey
+{
+	// Builds a key, depth is the view space distance of the draw.
+	// Draws in the transparent pass are ordered back to front, every other pass front to back.
+	uint64_t Make(RENDER_PASS pass, unsigned int shader, unsigned int material, float depth);
+}
+
+// The keys of a frame's draws, each with the index of the draw it belongs to, radix sorted so the draws can be
+// executed in key order. Holds no draw data itself, so the sort does not depend on the graphics API.
+class DrawKeyList
+{
+public:
+	DrawKeyList();
+	~DrawKeyList();
+
+	void Clear();
+	void Add(uint64_t key, size_t index);
+	// Radix sorts the keys, equal keys keep the order they were added in
+	void Sort();
+
+	size_t GetCount() const;
+	// Key and draw index at position i, after sorting
+	uint64_t GetKey(size_t i) const;
+	size_t GetIndex(size_t i) const;
+
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		size_t index;
+	};
+
+	std::vector<SortEntry> mEntries;
+	// Ping-pong buffer for the radix sort, kept to avoid reallocating every frame
+	std::vector<SortEntry> mScratch;
+};
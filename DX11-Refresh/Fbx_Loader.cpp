@@ -1,4 +1,6 @@
 #include "Fbx_Loader.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
 
 // Anonymous namespace for Fbx_Loader
 namespace {
@@ -52,7 +54,9 @@ namespace {
 		}
 	}
 
-	void LoadUV(fbxsdk::FbxMesh* pMesh, std::vector<DirectX::XMFLOAT2>* pOutUVVector)
+	// Returns the UV element mapped per control point, converting it if it is mapped per polygon vertex.
+	// Returns nullptr if the mesh has no UVs in a supported mapping mode
+	fbxsdk::FbxGeometryElementUV* PrepareUV(fbxsdk::FbxMesh* pMesh)
 	{
 		fbxsdk::FbxStringList uv_set_name_list;
 		pMesh->GetUVSetNames(uv_set_name_list);
@@ -63,18 +67,17 @@ namespace {
 
 		// if no UV found
 		if (!uv_element)
-			return;
+			return nullptr;
 
 		// only support mapping mode eByPolygonVertex and eByControlPoint
 		if (uv_element->GetMappingMode() != FbxGeometryElement::eByPolygonVertex &&
 			uv_element->GetMappingMode() != FbxGeometryElement::eByControlPoint)
-			return;
+			return nullptr;
 		// if mode is not direct, it is index based
 		const bool use_index = uv_element->GetReferenceMode() != FbxGeometryElement::eDirect;
 		const int index_count = (use_index) ? uv_element->GetIndexArray().GetCount() : 0;
 
 		const int poly_count = pMesh->GetPolygonCount();
-		DirectX::XMFLOAT2 uv;
 
 		// If uvs are stored per polygon vertex we need to convert them to per control point
 		if (uv_element->GetMappingMode() == FbxGeometryElement::eByPolygonVertex)
@@ -125,31 +128,33 @@ namespace {
 			}
 			uv_element->GetDirectArray().Release((void**)&direct_array);
 		}
-		// Process UVs
-		if (uv_element->GetMappingMode() == FbxGeometryElement::eByControlPoint)
-		{
+		return uv_element;
+	}
 
-			for (int i = 0; i < pMesh->GetControlPointsCount(); ++i)
+	// Writes one UV per control point to pOutUVs, pUVElement comes from PrepareUV
+	void LoadUV(fbxsdk::FbxMesh* pMesh, fbxsdk::FbxGeometryElementUV* pUVElement, DirectX::XMFLOAT2* pOutUVs)
+	{
+		DirectX::XMFLOAT2 uv;
+		for (int i = 0; i < pMesh->GetControlPointsCount(); ++i)
+		{
+			// Different type of indexing in vector based on reference mode
+			switch (pUVElement->GetReferenceMode())
 			{
-				// Different type of indexing in vector based on reference mode
-				switch (uv_element->GetReferenceMode())
-				{
-				case FbxGeometryElement::eDirect:
-					uv.x = (float)uv_element->GetDirectArray().GetAt(i).mData[0];
-					uv.y = (float)uv_element->GetDirectArray().GetAt(i).mData[1];
-					break;
-				case FbxGeometryElement::eIndexToDirect:
-				{
-					int index = uv_element->GetIndexArray().GetAt(i);
-					uv.x = (float)uv_element->GetDirectArray().GetAt(index).mData[0];
-					uv.y = (float)uv_element->GetDirectArray().GetAt(index).mData[1];
-					break;
-				}
-				default:
-					throw std::exception("Invalid Fbx UV Reference");
-				}
-				pOutUVVector->push_back(uv);
+			case FbxGeometryElement::eDirect:
+				uv.x = (float)pUVElement->GetDirectArray().GetAt(i).mData[0];
+				uv.y = (float)pUVElement->GetDirectArray().GetAt(i).mData[1];
+				break;
+			case FbxGeometryElement::eIndexToDirect:
+			{
+				int index = pUVElement->GetIndexArray().GetAt(i);
+				uv.x = (float)pUVElement->GetDirectArray().GetAt(index).mData[0];
+				uv.y = (float)pUVElement->GetDirectArray().GetAt(index).mData[1];
+				break;
 			}
+			default:
+				throw std::exception("Invalid Fbx UV Reference");
+			}
+			pOutUVs[i] = uv;
 		}
 	}
 
@@ -179,8 +184,8 @@ namespace {
 		}
 	}
 
-	void CheckSumOfWeights(std::vector<FbxLoader::ControlPointInfo>* jointData) {
-		for (auto it = jointData->begin(); it != jointData->end(); ++it)
+	void CheckSumOfWeights(const FbxLoader::ControlPointInfo* jointData, unsigned int count) {
+		for (const FbxLoader::ControlPointInfo* it = jointData; it != jointData + count; ++it)
 		{
 			double sum_of_weights = 0.0;
 			for (unsigned int i = 0; i < 4; ++i)
@@ -194,8 +199,10 @@ namespace {
 		}
 	}
 
-	void ProcessJointsAndAnimations(FbxNode* inNode, FbxLoader::Skeleton* skeleton, std::vector<FbxLoader::ControlPointInfo>* jointData)
+	// jointData has room for one ControlPointInfo per control point of the mesh
+	void ProcessJointsAndAnimations(FbxNode* inNode, FbxLoader::Skeleton* skeleton, FbxLoader::ControlPointInfo* jointData)
 	{
+		PROFILE_ZONE("FbxLoader::ProcessJointsAndAnimations");
 		FbxMesh* curr_mesh = inNode->GetMesh();
 		if (curr_mesh)
 		{
@@ -208,7 +215,7 @@ namespace {
 			// not all modeling programs provide this
 			// including it for safety because I don't know if blender does or not
 			//FbxAMatrix geometry_transform = GetGeometryTransformation(inNode);
-			std::vector<std::vector<FbxLoader::IndexWeightPair>> temp(jointData->size(), std::vector<FbxLoader::IndexWeightPair>());
+			std::vector<std::vector<FbxLoader::IndexWeightPair>> temp(curr_mesh->GetControlPointsCount(), std::vector<FbxLoader::IndexWeightPair>());
 
 			//unsigned long long animation_length = 0;
 
@@ -393,7 +400,10 @@ namespace {
 					}
 
 					// Fill the Animation Set with the collected data
-					tempAnimSet.animationData = new DirectX::XMFLOAT4X4[animation_length * num_of_clusters];
+					{
+						MEMORY_SCOPE(MEMORY_CATEGORY_ANIMATION);
+						tempAnimSet.animationData = new DirectX::XMFLOAT4X4[animation_length * num_of_clusters];
+					}
 					for (unsigned int frame_index = 0; frame_index < (unsigned int)animation_length; ++frame_index)
 					{
 						for (unsigned int joint_index = 0; joint_index < num_of_clusters; ++joint_index)
@@ -406,36 +416,44 @@ namespace {
 				// Save the processed animation data in the skeleton
 				for (int i = 0; i < tempAnimationSetsVector.size(); ++i)
 				{
+					// A skeleton shared by several meshes gets its animations again
+					delete[] skeleton->animations[i].animationData;
 					skeleton->animations[i] = tempAnimationSetsVector[i];
 					skeleton->animationFlags[i] = 0;
 				}
 			}
 			skeleton->jointCount = (unsigned int)skeleton->joints.size();
-			skeleton->frameData = new DirectX::XMFLOAT4X4[skeleton->jointCount];
+			{
+				MEMORY_SCOPE(MEMORY_CATEGORY_ANIMATION);
+				delete[] skeleton->frameData;
+				skeleton->frameData = new DirectX::XMFLOAT4X4[skeleton->jointCount];
+			}
 			// Check if any vertex has more than 4 weights assigned
 			for (unsigned int i = 0; i < temp.size(); ++i)
 			{
+				// The output is uninitialized memory, unused pairs stay at joint 0 with weight 0
+				jointData[i] = FbxLoader::ControlPointInfo();
 				for (unsigned int frame_index = 0; frame_index < temp[i].size(); ++frame_index)
 				{
-					(*jointData)[i].weightPairs[frame_index] = temp[i][frame_index];
 					if (frame_index >= MAX_NUM_WEIGHTS_PER_VERTEX)
 					{
 						throw std::exception("Mesh contains vertices with more than 4 bone weights. The engine does not support this.");
 					}
+					jointData[i].weightPairs[frame_index] = temp[i][frame_index];
 				}
 			}
 			// Check so that the vertex weights add up to one
-			CheckSumOfWeights(jointData);
+			CheckSumOfWeights(jointData, (unsigned int)temp.size());
 		}
 	}
 }
 
-HRESULT FbxLoader::LoadFBX(const std::string& fileName, std::vector<DirectX::XMFLOAT3>* pOutVertexPosVector, std::vector<int>* pOutIndexVector,
-	std::vector<DirectX::XMFLOAT3>* pOutNormalVector, std::vector<DirectX::XMFLOAT2>* pOutUVVector, FbxLoader::Skeleton* pOutSkeleton, std::vector<FbxLoader::ControlPointInfo>* pOutCPInfoVector)
+HRESULT FbxLoader::LoadFBX(const std::string& fileName, const std::function<MeshOutput(const MeshCounts&)>& allocateOutput, FbxLoader::Skeleton* pOutSkeleton)
 {
-	if (!pOutVertexPosVector || !pOutIndexVector || !pOutNormalVector || !pOutUVVector || !pOutSkeleton || !pOutCPInfoVector)
+	PROFILE_ZONE("FbxLoader::LoadFBX");
+	if (!allocateOutput || !pOutSkeleton)
 	{
-		throw std::exception("One or more input vectors to LoadFBX were nullptr.");
+		throw std::exception("The output callback or skeleton passed to LoadFBX was empty.");
 	}
 	// Create the FbxManager if it does not already exist
 	if (gpFbxSdkManager == nullptr)
@@ -488,7 +506,10 @@ HRESULT FbxLoader::LoadFBX(const std::string& fileName, std::vector<DirectX::XMF
 		return E_FAIL;;
 	}
 
-	b_success = p_importer->Import(p_fbx_scene.get());
+	{
+		PROFILE_ZONE("FbxImporter::Import");
+		b_success = p_importer->Import(p_fbx_scene.get());
+	}
 	if (!b_success) return E_FAIL;
 
 	// Importer is no longer needed, remove from memory
@@ -513,41 +534,52 @@ HRESULT FbxLoader::LoadFBX(const std::string& fileName, std::vector<DirectX::XMF
 			}
 
 			FbxVector4* p_vertices = p_mesh->GetControlPoints();
-
-			// Populate the returned index vector
 			int* p_indices = p_mesh->GetPolygonVertices();
-			int index_count = p_mesh->GetPolygonVertexCount();
-			pOutIndexVector->insert(pOutIndexVector->end(), &p_indices[0], &p_indices[index_count]);
-
-			// Load UVs and populate the returned UV vector
-			::LoadUV(p_mesh, pOutUVVector);
-			// Transform the mesh using the appropriate root transformation matrix
+			fbxsdk::FbxGeometryElementUV* p_uv_element = ::PrepareUV(p_mesh);
+
+			// Everything is sized from the scene before a single value is written
+			MeshCounts counts;
+			counts.vertexCount = (unsigned int)p_mesh->GetControlPointsCount();
+			counts.indexCount = (unsigned int)p_mesh->GetPolygonVertexCount();
+			counts.hasUVs = p_uv_element != nullptr;
+			counts.hasSkinning = pOutSkeleton->joints.size() > 0;
+			counts.jointCount = (unsigned int)pOutSkeleton->joints.size();
+			const MeshOutput output = allocateOutput(counts);
+			if (!output.pPositions || !output.pIndices || !output.pNormals)
+				return E_OUTOFMEMORY;
+
+			// Populate the indices and flip the winding order
+			for (unsigned int i = 0; i + 2 < counts.indexCount; i += 3)
+			{
+				output.pIndices[i] = (unsigned int)p_indices[i + 2];
+				output.pIndices[i + 1] = (unsigned int)p_indices[i + 1];
+				output.pIndices[i + 2] = (unsigned int)p_indices[i];
+			}
 
+			// Load UVs
+			if (p_uv_element && output.pUVs)
+				::LoadUV(p_mesh, p_uv_element, output.pUVs);
 
-			for (int j = 0; j < p_mesh->GetControlPointsCount(); ++j)
+			// If the mesh normals are not in "per vertex" mode, re-generate them to be useable by this parser
+			if (p_mesh->GetElementNormal(0)->GetMappingMode() != FbxGeometryElement::eByControlPoint)
 			{
-				FbxAMatrix conversion_transform = FbxAMatrix(FbxVector4(0.0f, 0.0f, 0.0f), FbxVector4(-90.0f, 0.0f, 0.0f), FbxVector4(1.0f, -1.0f, 1.0f));
-				DirectX::XMFLOAT3 vertex_pos;
-				FbxVector4 fbx_vertex = p_vertices[j];
-				fbx_vertex = conversion_transform.MultT(p_vertices[j]);
-				vertex_pos.x = (float)fbx_vertex.mData[0];
-				vertex_pos.y = (float)fbx_vertex.mData[1];
-				vertex_pos.z = (float)fbx_vertex.mData[2];
-				pOutVertexPosVector->push_back(vertex_pos);
-
+				p_mesh->GenerateNormals(true, true, true);
+			}
+			// Only allowing one normal per element currently
+			fbxsdk::FbxGeometryElementNormal* le_normal = p_mesh->GetElementNormal(0);
 
-				// Save to control point info map 
-				//control_points_info[j].ctrlPoint = p_mesh->GetControlPointAt(j);
+			// Transform the mesh using the appropriate root transformation matrix
+			const FbxAMatrix position_transform = FbxAMatrix(FbxVector4(0.0f, 0.0f, 0.0f), FbxVector4(-90.0f, 0.0f, 0.0f), FbxVector4(1.0f, -1.0f, 1.0f));
+			// Slightly different transform for normals to correct them
+			const FbxAMatrix normal_transform = FbxAMatrix(FbxVector4(0.0f, 0.0f, 0.0f), FbxVector4(-90.0f, 0.0f, 0.0f), FbxVector4(-1.0f, 1.0f, -1.0f));
+			for (unsigned int j = 0; j < counts.vertexCount; ++j)
+			{
+				const FbxVector4 fbx_vertex = position_transform.MultT(p_vertices[j]);
+				output.pPositions[j].x = (float)fbx_vertex.mData[0];
+				output.pPositions[j].y = (float)fbx_vertex.mData[1];
+				output.pPositions[j].z = (float)fbx_vertex.mData[2];
 
 				fbxsdk::FbxVector4 normal;
-				// If the mesh normals are not in "per vertex" mode, re-generate them to be useable by this parser
-				if (p_mesh->GetElementNormal(0)->GetMappingMode() != FbxGeometryElement::eByControlPoint)
-				{
-					p_mesh->GenerateNormals(true, true, true);
-				}
-				// Only allowing one normal per element currently
-				fbxsdk::FbxGeometryElementNormal* le_normal = p_mesh->GetElementNormal(0);
-
 				switch (le_normal->GetReferenceMode())
 				{
 				case FbxGeometryElement::eDirect:
@@ -562,31 +594,19 @@ HRESULT FbxLoader::LoadFBX(const std::string& fileName, std::vector<DirectX::XMF
 				default:
 					throw std::exception("Invalid Fbx Normal Reference");
 				}
-				DirectX::XMFLOAT3 vertex_normal;
 
 				// Transform the normals in the same manner as the vertices
-				// Slightly different transform for normals to correct them
-				conversion_transform = FbxAMatrix(FbxVector4(0.0f, 0.0f, 0.0f), FbxVector4(-90.0f, 0.0f, 0.0f), FbxVector4(-1.0f, 1.0f, -1.0f));
-				normal = conversion_transform.MultT(normal);
+				normal = normal_transform.MultT(normal);
 				normal.Normalize();
-				vertex_normal.x = (float)normal.mData[0];
-				vertex_normal.y = (float)normal.mData[1];
-				vertex_normal.z = (float)normal.mData[2];
-				pOutNormalVector->push_back(vertex_normal);
-
-			}
-			// Flip the winding order
-			for (unsigned int i = 0, count = (unsigned int)pOutIndexVector->size(); i < count - 2; i += 3)
-			{
-				std::swap((*pOutIndexVector)[i], (*pOutIndexVector)[i + 2]);
+				output.pNormals[j].x = (float)normal.mData[0];
+				output.pNormals[j].y = (float)normal.mData[1];
+				output.pNormals[j].z = (float)normal.mData[2];
 			}
 
-			if (pOutSkeleton->joints.size() > 0)
+			if (counts.hasSkinning && output.pControlPoints)
 			{
 				// In progress, very likely to break
-				// Prepare the vector with ControlPointInfo objects to be written to in any order
-				pOutCPInfoVector->resize(p_mesh->GetControlPointsCount());
-				::ProcessJointsAndAnimations(p_mesh->GetNode(), pOutSkeleton, pOutCPInfoVector);
+				::ProcessJointsAndAnimations(p_mesh->GetNode(), pOutSkeleton, output.pControlPoints);
 			}
 
 		}
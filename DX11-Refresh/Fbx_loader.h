@@ -8,8 +8,12 @@
 #include <unordered_map>
 #include <DirectXMath.h>
 #include <memory>
+#include <functional>
 #include <algorithm>
 #include <locale>
+#include <random>
+#include "Animation.h"
+#include "FrameArena.h"
 
 #define MAX_NUM_WEIGHTS_PER_VERTEX 4
 #define ANIMATION_CROSSFADE_DURATION 1.0f
@@ -79,7 +83,7 @@ namespace FbxLoader
 
 	struct AnimationSet
 	{
-		DirectX::XMFLOAT4X4* animationData;
+		DirectX::XMFLOAT4X4* animationData = nullptr; // Owned by the skeleton the set is stored in
 		unsigned int frameCount;
 		unsigned int activeFrame = 0;
 		std::string animationName;
@@ -93,8 +97,8 @@ namespace FbxLoader
 
 	public:
 		std::vector<Joint> joints;
-		DirectX::XMFLOAT4X4* animationData; // LEGACY, please use UpdateAnimation and frameData instead
-		DirectX::XMFLOAT4X4* frameData;
+		DirectX::XMFLOAT4X4* animationData = nullptr; // LEGACY, please use UpdateAnimation and frameData instead
+		DirectX::XMFLOAT4X4* frameData = nullptr;
 		unsigned int jointCount = 0;
 		unsigned int frameCount = 0;
 		AnimationSet animations[ANIMATION_COUNT];
@@ -106,6 +110,17 @@ namespace FbxLoader
 			// Initialize the animation flags with -1 for missing animation
 			std::fill(animationFlags, animationFlags + ANIMATION_COUNT, -1);
 		}
+		// animationData only points into the animation sets
+		~Skeleton()
+		{
+			for (int i = 0; i < ANIMATION_COUNT; ++i)
+			{
+				delete[] this->animations[i].animationData;
+			}
+			delete[] this->frameData;
+		}
+		Skeleton(const Skeleton&) = delete;
+		Skeleton& operator=(const Skeleton&) = delete;
 		// Currently does not blend animations, simply updates the global animationData with info from the first enabled animation.
 		void UpdateAnimation(float dtInSeconds)
 		{
@@ -117,9 +132,7 @@ namespace FbxLoader
 					this->animationData = animations[i].animationData;
 					this->frameCount = animations[i].frameCount;
 					this->mCurrentTime = this->mCurrentTime + dtInSeconds;
-					int frame_to_set = (int)std::round(fmod(this->mCurrentTime * 60.0f, this->frameCount)) % this->frameCount;
-					// Get frame data from animationData vector
-					memcpy(this->frameData, &animations[i].animationData[frame_to_set * this->jointCount], this->jointCount * sizeof(DirectX::XMFLOAT4X4));
+					Animation::SamplePose(animations[i].animationData, this->frameCount, this->jointCount, this->mCurrentTime, this->frameData);
 					break; // This break will disappear when animation blending is implemented
 				}
 			}
@@ -163,6 +176,8 @@ namespace FbxLoader
 		int mPrevAnimation = -1;
 
 		float mPrevAnimTransitionTime = -1.0f;
+		// Every character draws its own start times, so they do not depend on which thread animates it
+		std::minstd_rand mRandom;
 	public:
 
 		Skeleton* parentSkeleton;
@@ -174,11 +189,13 @@ namespace FbxLoader
 		}
 		void ResetFrameCount()
 		{
-			this->mCurrentTime = 0.0f + static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+			this->mCurrentTime = std::uniform_real_distribution<float>(0.0f, 1.0f)(this->mRandom);
 		}
-		void Init(Skeleton* parentSkeleton)
+		// randomSeed seeds the start times ResetFrameCount picks
+		void Init(Skeleton* parentSkeleton, unsigned int randomSeed)
 		{
 			this->parentSkeleton = parentSkeleton;
+			this->mRandom.seed(randomSeed);
 			this->frameData = new DirectX::XMFLOAT4X4[parentSkeleton->jointCount];
 			for (int i = 0; i < ANIMATION_COUNT; ++i)
 			{
@@ -205,56 +222,24 @@ namespace FbxLoader
 
 			if (this->animationFlags[animType] != -1)
 			{
-				int frame_count = this->parentSkeleton->animations[animType].frameCount;
-				int joint_count = this->parentSkeleton->jointCount;
+				const AnimationSet& animation = this->parentSkeleton->animations[animType];
 				this->mCurrentTime = this->mCurrentTime + dtInSeconds;
-				int frame_to_set = (int)std::round(fmod(this->mCurrentTime * 60.0f, frame_count)) % frame_count;
-				// Get frame data from animationData vector
-				memcpy(this->frameData, &this->parentSkeleton->animations[animType].animationData[frame_to_set * joint_count], joint_count * sizeof(DirectX::XMFLOAT4X4));
+				Animation::SamplePose(animation.animationData, animation.frameCount, this->parentSkeleton->jointCount, this->mCurrentTime, this->frameData);
 
 				// If we are currently transitioning between two animations
 				if (mPrevAnimTransitionTime >= 0.0f)
 				{
 					mPrevTime += dtInSeconds;
 					float prev_weight = mPrevAnimTransitionTime / ANIMATION_CROSSFADE_DURATION;
-					//float current_weight = 1.0f - prev_weight;
-					int prev_frame_count = this->parentSkeleton->animations[mPrevAnimation].frameCount;
-					DirectX::XMFLOAT4X4* prevFrameData = new DirectX::XMFLOAT4X4[parentSkeleton->jointCount];
-					int prev_frame_to_set = (int)std::round(fmod(this->mPrevTime * 60.0f, prev_frame_count)) % prev_frame_count;
-					// Get frame data from animationData vector for the PREVIOUS animation
+					const AnimationSet& prev_animation = this->parentSkeleton->animations[mPrevAnimation];
+					// Scratch for this call only, taken from the frame arena of the calling thread
+					DirectX::XMFLOAT4X4* prevFrameData = FrameArena::ThreadLocal().Allocate<DirectX::XMFLOAT4X4>(parentSkeleton->jointCount);
 					// Same procedure as current animation
-					memcpy(prevFrameData,
-						&this->parentSkeleton->animations[mPrevAnimation].animationData[prev_frame_to_set * joint_count],
-						joint_count * sizeof(DirectX::XMFLOAT4X4));
-					// For each joint, decompose the two animation matrices and interpolate them, combine to a "final" animation matrix
-					for (unsigned int i = 0; i < this->parentSkeleton->jointCount; ++i)
-					{
-						DirectX::XMVECTOR current_frame_scale, current_frame_rot, current_frame_trans;
-						DirectX::XMVECTOR prev_frame_scale, prev_frame_rot, prev_frame_trans;
-						DirectX::XMVECTOR new_frame_scale, new_frame_rot, new_frame_trans;
-						// Transposing both matrices as they are currently in shader-readable format
-						DirectX::XMMATRIX current_frame_matrix = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&this->frameData[i]));
-						DirectX::XMMATRIX prev_frame_matrix = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&prevFrameData[i]));
-						// Decompose the matrix in order to be able to interpolate the components
-						DirectX::XMMatrixDecompose(&current_frame_scale, &current_frame_rot, &current_frame_trans, current_frame_matrix);
-						DirectX::XMMatrixDecompose(&prev_frame_scale, &prev_frame_rot, &prev_frame_trans, prev_frame_matrix);
-
-						// Calculate the interpolated components of the new matrix
-						new_frame_rot = DirectX::XMQuaternionSlerp(current_frame_rot, prev_frame_rot, prev_weight);
-						new_frame_scale = DirectX::XMVectorLerp(current_frame_scale, prev_frame_scale, prev_weight);
-						new_frame_trans = DirectX::XMVectorLerp(current_frame_trans, prev_frame_trans, prev_weight);
-
-						// Transposing the new matrix to convert it back to shader readable format
-						DirectX::XMMATRIX new_frame_matrix = DirectX::XMMatrixTranspose(
-							DirectX::XMMatrixScalingFromVector(new_frame_scale) *
-							DirectX::XMMatrixRotationQuaternion(new_frame_rot) *
-							DirectX::XMMatrixTranslationFromVector(new_frame_trans));
-						// Store the new matrix in framedata
-						XMStoreFloat4x4(&this->frameData[i], new_frame_matrix);
-					}
+					Animation::SamplePose(prev_animation.animationData, prev_animation.frameCount, this->parentSkeleton->jointCount, this->mPrevTime, prevFrameData);
+					// Interpolate the joints of the two animations, the previous one fades out over the transition
+					Animation::BlendPoses(this->frameData, prevFrameData, this->parentSkeleton->jointCount, prev_weight, this->frameData);
 					// Reduce the transition timer
 					mPrevAnimTransitionTime -= dtInSeconds;
-					delete[] prevFrameData;
 				}
 			}
 		}
@@ -343,11 +328,31 @@ namespace FbxLoader
 		}
 	};
 
+	// Sizes of the mesh in an imported scene, known before any of it is converted
+	struct MeshCounts
+	{
+		unsigned int vertexCount = 0;
+		unsigned int indexCount = 0;
+		unsigned int jointCount = 0;
+		bool hasUVs = false;
+		bool hasSkinning = false;
+	};
+
+	// Where LoadFBX writes the mesh. Positions, normals, UVs and control points hold vertexCount elements,
+	// indices indexCount. pUVs and pControlPoints may be nullptr when the counts say there are none
+	struct MeshOutput
+	{
+		DirectX::XMFLOAT3* pPositions = nullptr;
+		unsigned int* pIndices = nullptr;
+		DirectX::XMFLOAT3* pNormals = nullptr;
+		DirectX::XMFLOAT2* pUVs = nullptr;
+		ControlPointInfo* pControlPoints = nullptr;
+	};
+
 	// Used for loading the very basics of an FBX
-	// Input: std::string file name of FBX file, pointers to std::vectors to append the data to
-	// Output: Appends data to the provided vectors, returns HRESULT
-	HRESULT LoadFBX(const std::string& fileName, std::vector<DirectX::XMFLOAT3>* pOutVertexPosVector, std::vector<int>* pOutIndexVector,
-		std::vector<DirectX::XMFLOAT3>* pOutNormalVector, std::vector<DirectX::XMFLOAT2>* pOutUVVector, Skeleton* pOutSkeleton, std::vector<FbxLoader::ControlPointInfo>* pOutCPInfoVector);
+	// Input: std::string file name of FBX file, a callback that is given the counts of the mesh and returns where to write it
+	// Output: Writes the mesh to the returned MeshOutput and the skeleton to pOutSkeleton, returns HRESULT
+	HRESULT LoadFBX(const std::string& fileName, const std::function<MeshOutput(const MeshCounts&)>& allocateOutput, Skeleton* pOutSkeleton);
 
 
 
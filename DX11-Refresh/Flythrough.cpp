@@ -0,0 +1,312 @@
+#include "Flythrough.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+namespace
+{
+	// Where the measured frames spent their time, the renderer keeps the frame times themselves
+	struct PhaseTimes
+	{
+		FrameTimeHistogram update;
+		FrameTimeHistogram publish;
+		FrameTimeHistogram render;
+		unsigned int loads = 0;
+		double loadSeconds = 0.0;
+		double seconds = 0.0;		// From the first measured frame to the end
+	};
+
+	const char* GetBackendName(RENDER_BACKEND backend)
+	{
+		switch (backend)
+		{
+		case RENDER_BACKEND_WARP:
+			return "warp";
+		case RENDER_BACKEND_NULL:
+			return "null";
+		default:
+			return "hardware";
+		}
+	}
+
+	bool FileExists(const std::string& filepath)
+	{
+		std::ifstream file(filepath);
+		return file.is_open();
+	}
+
+	// A recording names the files as they were on the machine it was made on, if one is not there it is looked for
+	// next to the recording. Returns an empty string if it is in neither place
+	std::string ResolveLoadPath(const std::string& filepath, const std::string& recording)
+	{
+		if (::FileExists(filepath))
+			return filepath;
+		const size_t nameStart = filepath.find_last_of("/\\");
+		const size_t directoryEnd = recording.find_last_of("/\\");
+		const std::string name = nameStart == std::string::npos ? filepath : filepath.substr(nameStart + 1);
+		const std::string candidate = (directoryEnd == std::string::npos ? std::string() : recording.substr(0, directoryEnd + 1)) + name;
+		return ::FileExists(candidate) ? candidate : std::string();
+	}
+
+	void LoadScene(Renderer* pRenderer, std::string filepath, bool fbx)
+	{
+		if (fbx)
+			pRenderer->LoadMesh(filepath, true);
+		else
+			pRenderer->LoadMesh(filepath);
+	}
+
+	bool IsFbx(const std::string& filepath)
+	{
+		std::string fileType = filepath.substr(filepath.length() - (std::min)(filepath.length(), (size_t)4));
+		std::transform(fileType.begin(), fileType.end(), fileType.begin(), ::tolower);
+		return fileType == ".fbx";
+	}
+
+	void WriteString(std::ofstream& file, const std::string& text)
+	{
+		file << '"';
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				file << '\\';
+			file << c;
+		}
+		file << '"';
+	}
+
+	// In milliseconds, like RenderStats::WriteJson
+	void WritePercentiles(std::ofstream& file, const FrameTimeHistogram& histogram)
+	{
+		file << "{\"min\":" << histogram.GetMin() * 1000.0
+			<< ",\"mean\":" << histogram.GetMean() * 1000.0
+			<< ",\"p50\":" << histogram.GetPercentile(50.0) * 1000.0
+			<< ",\"p90\":" << histogram.GetPercentile(90.0) * 1000.0
+			<< ",\"p95\":" << histogram.GetPercentile(95.0) * 1000.0
+			<< ",\"p99\":" << histogram.GetPercentile(99.0) * 1000.0
+			<< ",\"max\":" << histogram.GetMax() * 1000.0 << "}";
+	}
+
+	// Loads the scenes and flies the camera path, one step per frame
+	int FlyPath(const FlythroughSettings& settings, Renderer* pRenderer, PhaseTimes* pTimes)
+	{
+		CameraPath path;
+		if (settings.pathFile.empty())
+		{
+			path = CameraPath::CreateOrbit(XMFLOAT3(0.0f, 0.0f, 0.0f), FLYTHROUGH_ORBIT_RADIUS, FLYTHROUGH_ORBIT_HEIGHT,
+				FLYTHROUGH_ORBIT_KEYS, CAMERA_PATH_DEFAULT_DURATION);
+		}
+		else if (!path.LoadFromFile(settings.pathFile.c_str()))
+		{
+			OutputDebugStringA(("Flythrough: cannot read the camera path " + settings.pathFile + "\n").c_str());
+			return 1;
+		}
+
+		for (auto& scene : settings.scenes)
+		{
+			// The renderer does not report failed imports, a missing file is at least caught here
+			if (!::FileExists(scene))
+			{
+				OutputDebugStringA(("Flythrough: cannot read the scene " + scene + "\n").c_str());
+				return 1;
+			}
+			::LoadScene(pRenderer, scene, ::IsFbx(scene));
+		}
+		if (settings.forestTrees > 0)
+		{
+			if (!::FileExists(FOREST_MODEL_PATH))
+			{
+				OutputDebugStringA("Flythrough: cannot read the forest model " FOREST_MODEL_PATH "\n");
+				return 1;
+			}
+			pRenderer->LoadForest(settings.forestTrees);
+		}
+		pRenderer->SetCameraPath(&path);
+
+		SystemFrameClock clock;
+		double measureStart = clock.Now();
+		const unsigned int frameCount = settings.warmupFrames + settings.frames;
+		for (unsigned int frame = 0; frame < frameCount; ++frame)
+		{
+			if (frame == settings.warmupFrames)
+			{
+				// Measured runs start on the same view however many warm up frames there were
+				pRenderer->SetCameraPath(&path);
+				pRenderer->ResetStats();
+				Profiler::Clear();
+				pTimes->update.Reset();
+				pTimes->publish.Reset();
+				pTimes->render.Reset();
+				measureStart = clock.Now();
+			}
+
+			PROFILE_ZONE("Frame");
+			JobSystem::RunMainThreadJobs();
+			const double frameStart = clock.Now();
+			pRenderer->Update(settings.stepTime);
+			const double updateEnd = clock.Now();
+			pRenderer->PublishFrame();
+			const double publishEnd = clock.Now();
+			pRenderer->Render(1.0f);
+			const double renderEnd = clock.Now();
+			pRenderer->EndFrame(renderEnd - frameStart);
+
+			pTimes->update.Record(updateEnd - frameStart);
+			pTimes->publish.Record(publishEnd - updateEnd);
+			pTimes->render.Record(renderEnd - publishEnd);
+		}
+		pRenderer->SetCameraPath(nullptr);
+		pTimes->seconds = clock.Now() - measureStart;
+		return 0;
+	}
+
+	// Plays a recording back in order: steps are simulated with their recorded input and step time, loads are
+	// repeated and every recorded frame publishes the steps since the one before and renders with its alpha
+	int Replay(const FlythroughSettings& settings, Renderer* pRenderer, PhaseTimes* pTimes)
+	{
+		InputPlayback playback;
+		if (!playback.Open(settings.replayFile.c_str()))
+		{
+			OutputDebugStringA(("Flythrough: cannot read the recording " + settings.replayFile + "\n").c_str());
+			return 1;
+		}
+		pRenderer->SetInputSessionState(playback.GetSessionState());
+
+		SystemFrameClock clock;
+		const double replayStart = clock.Now();
+		double frameStart = replayStart;
+		double updateTime = 0.0;
+		unsigned int steps = 0;
+		InputEvent event;
+		while (playback.Next(&event))
+		{
+			switch (event.type)
+			{
+			case INPUT_EVENT_STEP:
+			{
+				const double stepStart = clock.Now();
+				pRenderer->Update(event.dt, event.input);
+				updateTime += clock.Now() - stepStart;
+				steps++;
+				break;
+			}
+			case INPUT_EVENT_LOAD:
+			{
+				const std::string filepath = ::ResolveLoadPath(event.filepath, settings.replayFile);
+				if (filepath.empty())
+				{
+					OutputDebugStringA(("Flythrough: cannot find " + event.filepath + " of the recording\n").c_str());
+					return 1;
+				}
+				// Loads happen between the frames of the main loop, they are not part of the frame time there either
+				const double loadStart = clock.Now();
+				::LoadScene(pRenderer, filepath, event.fbx);
+				frameStart = clock.Now();
+				pTimes->loads++;
+				pTimes->loadSeconds += frameStart - loadStart;
+				break;
+			}
+			case INPUT_EVENT_FRAME:
+			{
+				PROFILE_ZONE("Frame");
+				JobSystem::RunMainThreadJobs();
+				const double publishStart = clock.Now();
+				if (steps > 0)
+					pRenderer->PublishFrame();
+				const double publishEnd = clock.Now();
+				pRenderer->Render(event.alpha);
+				const double renderEnd = clock.Now();
+				pRenderer->EndFrame(renderEnd - frameStart);
+
+				pTimes->update.Record(updateTime);
+				pTimes->publish.Record(publishEnd - publishStart);
+				pTimes->render.Record(renderEnd - publishEnd);
+				frameStart = renderEnd;
+				updateTime = 0.0;
+				steps = 0;
+				break;
+			}
+			}
+		}
+		pTimes->seconds = clock.Now() - replayStart;
+		return 0;
+	}
+}
+
+int Flythrough::Run(const FlythroughSettings& settings)
+{
+	RendererSettings rendererSettings = settings.renderer;
+	rendererSettings.headless = true;
+	std::unique_ptr<Renderer> renderer(new Renderer(rendererSettings));
+
+	PhaseTimes times;
+	const bool replay = !settings.replayFile.empty();
+	const int result = replay ? ::Replay(settings, renderer.get(), &times) : ::FlyPath(settings, renderer.get(), &times);
+	if (result != 0)
+		return result;
+
+	std::vector<Profiler::ZoneSummary> zones;
+	Profiler::SummarizeZones(&zones);
+	const RenderStats& stats = renderer->GetRenderStats();
+	const RenderFrameStats average = stats.GetAverage();
+	if (!settings.csvOutput.empty() && !stats.WriteCsv(settings.csvOutput.c_str()))
+		return 2;
+
+	std::ofstream file(settings.output);
+	if (!file.is_open())
+		return 2;
+	file << "{\n\"label\":";
+	::WriteString(file, settings.label);
+	file << ",\n\"replay\":";
+	::WriteString(file, settings.replayFile);
+	file << ",\n\"scenes\":[";
+	for (size_t i = 0; i < settings.scenes.size() && !replay; ++i)
+	{
+		file << (i > 0 ? "," : "");
+		::WriteString(file, settings.scenes[i]);
+	}
+	file << "],\n\"forestTrees\":" << (replay ? 0 : settings.forestTrees)
+		<< ",\n\"backend\":\"" << ::GetBackendName(rendererSettings.backend) << "\""
+		<< ",\n\"width\":" << rendererSettings.width
+		<< ",\n\"height\":" << rendererSettings.height
+		<< ",\n\"workers\":" << JobSystem::GetWorkerCount()
+		<< ",\n\"frames\":" << stats.GetFrameCount()
+		<< ",\n\"warmupFrames\":" << (replay ? 0 : settings.warmupFrames)
+		<< ",\n\"stepTime\":" << (replay ? 0.0f : settings.stepTime)
+		<< ",\n\"seconds\":" << times.seconds
+		<< ",\n\"loads\":" << times.loads
+		<< ",\n\"loadMs\":" << times.loadSeconds * 1000.0
+		<< ",\n\"frameTimeMs\":";
+	::WritePercentiles(file, stats.GetFrameTimes());
+	file << ",\n\"subsystemsMs\":{\"update\":";
+	::WritePercentiles(file, times.update);
+	file << ",\n\"publish\":";
+	::WritePercentiles(file, times.publish);
+	file << ",\n\"render\":";
+	::WritePercentiles(file, times.render);
+	file << "},\n\"average\":{\"draws\":" << average.draws
+		<< ",\"instances\":" << average.instances
+		<< ",\"indices\":" << average.indices
+		<< ",\"stateChanges\":" << average.stateChanges
+		<< ",\"constantBytes\":" << average.constantBytes
+		<< ",\"paletteBytes\":" << average.paletteBytes
+		<< ",\"jobs\":" << average.jobs << "}"
+		<< ",\n\"profilerEnabled\":" << (PROFILER_ENABLED ? "true" : "false")
+		<< ",\n\"zones\":[";
+	// Totals per measured frame, so runs with different frame counts compare
+	const double frames = (double)(std::max)(stats.GetFrameCount(), (uint64_t)1);
+	for (size_t i = 0; i < zones.size(); ++i)
+	{
+		file << (i > 0 ? ",\n" : "\n") << "{\"name\":";
+		::WriteString(file, zones[i].name);
+		file << ",\"count\":" << zones[i].count
+			<< ",\"msPerFrame\":" << zones[i].totalSeconds * 1000.0 / frames
+			<< ",\"maxMs\":" << zones[i].maxSeconds * 1000.0 << "}";
+	}
+	file << "\n]\n}\n";
+	if (!file.good())
+		return 2;
+
+	OutputDebugStringA(("Flythrough: " + stats.FormatSummary() + "\n").c_str());
+	return 0;
+}
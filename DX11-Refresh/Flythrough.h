@@ -0,0 +1,52 @@
+#pragma once
+#include "Renderer.h"
+#include <string>
+#include <vector>
+
+// Frames measured by a flythrough unless the settings ask for more or fewer
+#define FLYTHROUGH_DEFAULT_FRAMES 1000
+// Frames run before the measurement starts, they fill the caches and let the job system workers wake up
+#define FLYTHROUGH_WARMUP_FRAMES 60
+// The default path orbits the origin, where the meshes are loaded
+#define FLYTHROUGH_ORBIT_RADIUS 15.0f
+#define FLYTHROUGH_ORBIT_HEIGHT 8.0f
+#define FLYTHROUGH_ORBIT_KEYS 8
+
+struct FlythroughSettings
+{
+	// Always run headless, the backend and size are taken from here
+	RendererSettings renderer;
+	// .obj and .fbx files loaded before the first frame
+	std::vector<std::string> scenes;
+	// Trees scattered over the floor with the scenes, see Renderer::LoadForest. No forest if 0
+	unsigned int forestTrees = 0;
+	// Camera path file, see CameraPath, the default orbit if empty
+	std::string pathFile;
+	unsigned int frames = FLYTHROUGH_DEFAULT_FRAMES;
+	unsigned int warmupFrames = FLYTHROUGH_WARMUP_FRAMES;
+	float stepTime = (float)FRAME_SCHEDULER_DEFAULT_STEP;
+	// Recording of InputRecorder to play back instead of the scenes and the camera path. Every frame of it is
+	// measured, the frame counts and the step time above do not apply
+	std::string replayFile;
+	// Written to the results to tell runs apart, such as the commit
+	std::string label;
+	std::string output = "flythrough.json";
+	// One row per measured frame, up to the last RENDER_STATS_HISTORY, see RenderStats::WriteCsv. Not written if empty
+	std::string csvOutput;
+};
+
+// Times whole frames of the renderer on a scripted camera flight, without a window or input.
+// Every frame simulates exactly one step of stepTime, publishes it and renders it, and the camera follows a CameraPath
+// that only depends on the simulated time, so every run of a build draws the same frames and two builds can be
+// compared on the same machine. The path starts over when the measurement starts after the warm up frames.
+// A replay feeds a recorded session through Renderer::Update step by step instead, with the recorded input and step
+// times, repeats its loads and renders wherever it rendered. The steps of a frame are published together, so a session
+// recorded with the simulation thread is replayed as if it had run serially.
+// The results are the frame time percentiles, the times of Update, PublishFrame and Render, the average render
+// counters and, when PROFILER_ENABLED, the time of every profiler zone.
+namespace Flythrough
+{
+	// Returns 0 on success, 1 if a scene, the forest model, the camera path, the recording or a file it loads cannot be read and 2 if the
+	// results cannot be written
+	int Run(const FlythroughSettings& settings);
+}
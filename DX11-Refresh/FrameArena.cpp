@@ -0,0 +1,134 @@
+#include "FrameArena.h"
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <cstdlib>
+
+// Anonymous namespace for FrameArena
+namespace {
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+FrameArena::FrameArena(size_t bufferSize)
+	: mBufferSize(bufferSize)
+{
+	for (auto& buffer : this->mBuffers)
+	{
+		buffer.pMemory = static_cast<unsigned char*>(malloc(bufferSize));
+	}
+	this->mpCurrent = &this->mBuffers[0];
+}
+
+FrameArena::~FrameArena()
+{
+	for (auto& buffer : this->mBuffers)
+	{
+		// The current frame was never recorded
+		if (&buffer != this->mpCurrent)
+			MemoryTracker::RecordFree(MEMORY_CATEGORY_RENDER_TRANSIENT, buffer.recordedBytes, buffer.allocations);
+		for (void* p_block : buffer.overflow)
+		{
+			free(p_block);
+		}
+		free(buffer.pMemory);
+	}
+}
+
+FrameArena& FrameArena::ThreadLocal()
+{
+	thread_local FrameArena arena;
+	return arena;
+}
+
+void FrameArena::BeginFrame()
+{
+	this->mFrame++;
+	if (this->mpCurrent->allocations > 0)
+	{
+		this->mpCurrent->recordedBytes = this->mStats.usedBytes;
+		MemoryTracker::RecordAllocation(MEMORY_CATEGORY_RENDER_TRANSIENT, this->mpCurrent->recordedBytes, this->mpCurrent->allocations);
+	}
+	this->mpCurrent = &this->mBuffers[this->mFrame % FRAME_ARENA_BUFFER_COUNT];
+	MemoryTracker::RecordFree(MEMORY_CATEGORY_RENDER_TRANSIENT, this->mpCurrent->recordedBytes, this->mpCurrent->allocations);
+	this->mpCurrent->recordedBytes = 0;
+	this->mpCurrent->allocations = 0;
+	this->mpCurrent->used = 0;
+	for (void* p_block : this->mpCurrent->overflow)
+	{
+		free(p_block);
+	}
+	this->mpCurrent->overflow.clear();
+
+	size_t high_water_mark = this->mStats.highWaterMark;
+	this->mStats = FrameArenaStats();
+	this->mStats.highWaterMark = high_water_mark;
+}
+
+uint64_t FrameArena::GetFrame() const
+{
+	return this->mFrame;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	Buffer& buffer = *this->mpCurrent;
+
+	size_t base = reinterpret_cast<size_t>(buffer.pMemory);
+	size_t offset = ::AlignUp(base + buffer.used, alignment) - base;
+	if (buffer.pMemory && offset + size <= this->mBufferSize)
+	{
+		this->mStats.usedBytes += offset + size - buffer.used;
+		buffer.used = offset + size;
+		buffer.allocations++;
+		this->mStats.highWaterMark = (std::max)(this->mStats.highWaterMark, this->mStats.usedBytes);
+		return buffer.pMemory + offset;
+	}
+
+	// Too big for what is left of the buffer, take it from the heap until the buffer is reset
+	void* p_block = malloc(size + alignment);
+	if (!p_block)
+		return nullptr;
+	buffer.overflow.push_back(p_block);
+	buffer.allocations++;
+	this->mStats.usedBytes += size;
+	this->mStats.overflowBytes += size;
+	this->mStats.overflowCount++;
+	this->mStats.highWaterMark = (std::max)(this->mStats.highWaterMark, this->mStats.usedBytes);
+	return reinterpret_cast<void*>(::AlignUp(reinterpret_cast<size_t>(p_block), alignment));
+}
+
+FrameArena::Marker FrameArena::GetMarker() const
+{
+	Marker marker;
+	marker.frame = this->mFrame;
+	marker.used = this->mpCurrent->used;
+	marker.overflowBlocks = this->mpCurrent->overflow.size();
+	marker.allocations = this->mpCurrent->allocations;
+	marker.stats = this->mStats;
+	return marker;
+}
+
+void FrameArena::Rewind(const Marker& marker)
+{
+	Buffer& buffer = *this->mpCurrent;
+	if (marker.frame != this->mFrame || marker.used > buffer.used || marker.overflowBlocks > buffer.overflow.size())
+		return;
+	for (size_t i = marker.overflowBlocks; i < buffer.overflow.size(); ++i)
+	{
+		free(buffer.overflow[i]);
+	}
+	buffer.overflow.resize(marker.overflowBlocks);
+	buffer.used = marker.used;
+	buffer.allocations = marker.allocations;
+	// The high water mark keeps what the rewound allocations needed
+	const size_t high_water_mark = this->mStats.highWaterMark;
+	this->mStats = marker.stats;
+	this->mStats.highWaterMark = high_water_mark;
+}
+
+const FrameArenaStats& FrameArena::GetStats() const
+{
+	return this->mStats;
+}
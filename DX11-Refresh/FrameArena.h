@@ -0,0 +1,133 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+// Bytes in each buffer of a thread's arena, allocations beyond this fall back to the heap for the frame
+#define FRAME_ARENA_SIZE (4 * 1024 * 1024)
+// Memory allocated in frame n of an arena stays valid until its frame n + FRAME_ARENA_BUFFER_COUNT begins
+#define FRAME_ARENA_BUFFER_COUNT 2
+
+struct FrameArenaStats
+{
+	size_t usedBytes = 0;			// Bytes handed out this frame, including alignment and overflow
+	size_t highWaterMark = 0;		// Most bytes any frame so far has needed, raise FRAME_ARENA_SIZE if it exceeds it
+	size_t overflowBytes = 0;		// Bytes this frame that did not fit into the buffer
+	unsigned int overflowCount = 0;	// Heap allocations this frame because the buffer was full
+};
+
+// Bump allocator for data that only lives for the current frame.
+// Every thread has its own arena (ThreadLocal), so workers never contend. Each arena counts its own frames: the
+// thread that owns a frame loop calls BeginFrame on its arena, the render thread once per rendered frame and the
+// simulation once per step, so neither resets memory on the other's schedule. Each arena has
+// FRAME_ARENA_BUFFER_COUNT buffers and BeginFrame moves on to the next one and resets it.
+// Jobs have no frames, the job system rewinds the arena of the thread a job ran on to where it was before the job,
+// so worker arenas never grow and memory a job allocates is only valid until the job returns.
+// Nothing is freed individually, so destructors of objects placed in the arena are never run.
+// The MemoryTracker sees a frame's allocations as render transient memory once the arena moves on to the next
+// frame, all of them in one go, so allocating stays free of atomics.
+class FrameArena
+{
+public:
+	// Where an arena was, see GetMarker
+	struct Marker
+	{
+		uint64_t frame;
+		size_t used;
+		size_t overflowBlocks;
+		unsigned int allocations;
+		FrameArenaStats stats;
+	};
+
+	explicit FrameArena(size_t bufferSize = FRAME_ARENA_SIZE);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	// The arena of the calling thread, created on its first use
+	static FrameArena& ThreadLocal();
+
+	// Starts the next frame of this arena, from the thread it belongs to
+	void BeginFrame();
+	// Frames begun so far
+	uint64_t GetFrame() const;
+
+	void* Allocate(size_t size, size_t alignment);
+	template <class T>
+	T* Allocate(size_t count)
+	{
+		return static_cast<T*>(this->Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Everything allocated after GetMarker is given back by Rewind, in stack order. Does nothing if a frame
+	// began in between
+	Marker GetMarker() const;
+	void Rewind(const Marker& marker);
+
+	// Statistics of the current frame of this arena
+	const FrameArenaStats& GetStats() const;
+
+private:
+	struct Buffer
+	{
+		unsigned char* pMemory = nullptr;
+		size_t used = 0;
+		// Heap blocks of the allocations that did not fit, freed when the buffer is reset
+		std::vector<void*> overflow;
+		unsigned int allocations = 0;
+		// Bytes of the frame the buffer was last used for, counted as render transient memory until the buffer is reset
+		size_t recordedBytes = 0;
+	};
+
+	size_t mBufferSize;
+	Buffer mBuffers[FRAME_ARENA_BUFFER_COUNT];
+	Buffer* mpCurrent = nullptr;
+	uint64_t mFrame = 0;
+	FrameArenaStats mStats;
+};
+
+// STL allocator that allocates from a FrameArena, deallocate does nothing
+template <class T>
+class FrameAllocator
+{
+public:
+	typedef T value_type;
+
+	FrameAllocator() : mpArena(&FrameArena::ThreadLocal()) {}
+	explicit FrameAllocator(FrameArena* pArena) : mpArena(pArena) {}
+	template <class U>
+	FrameAllocator(const FrameAllocator<U>& other) : mpArena(other.GetArena()) {}
+
+	T* allocate(size_t count)
+	{
+		return this->mpArena->template Allocate<T>(count);
+	}
+
+	void deallocate(T*, size_t)
+	{
+	}
+
+	FrameArena* GetArena() const
+	{
+		return this->mpArena;
+	}
+
+private:
+	FrameArena* mpArena;
+};
+
+template <class T, class U>
+bool operator==(const FrameAllocator<T>& a, const FrameAllocator<U>& b)
+{
+	return a.GetArena() == b.GetArena();
+}
+
+template <class T, class U>
+bool operator!=(const FrameAllocator<T>& a, const FrameAllocator<U>& b)
+{
+	return a.GetArena() != b.GetArena();
+}
+
+// Vector for frame transient data, reserve up front since every growth leaves the old block behind in the arena
+template <class T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,38 @@
+#include "FrameScheduler.h"
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
+#include <Windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+SystemFrameClock::SystemFrameClock()
+{
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif
+}
+
+SystemFrameClock::~SystemFrameClock()
+{
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+double SystemFrameClock::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SystemFrameClock::SleepFor(double seconds)
+{
+	if (seconds > 0.0)
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+}
+
+void SystemFrameClock::YieldSlice()
+{
+	std::this_thread::yield();
+}
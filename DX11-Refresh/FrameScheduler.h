@@ -0,0 +1,254 @@
+#pragma once
+#include <stdint.h>
+
+// Seconds simulated by one fixed step
+#define FRAME_SCHEDULER_DEFAULT_STEP (1.0 / 60.0)
+// Longer frames are clamped to this many seconds, so a breakpoint or a modal dialog is not simulated afterwards
+#define FRAME_SCHEDULER_MAX_FRAME_TIME 0.25
+// Most fixed steps taken in one frame, the time beyond them is dropped so a slow frame cannot snowball
+#define FRAME_SCHEDULER_MAX_STEPS 8
+// The last part of a wait is spent yielding instead of sleeping, sleeps can overshoot by about this much
+#define FRAME_SCHEDULER_SPIN_TIME 0.002
+// Seconds without RequestRender before the render on demand mode goes idle
+#define FRAME_SCHEDULER_IDLE_DELAY 0.5
+
+struct FrameSchedulerSettings
+{
+	double fixedStep = FRAME_SCHEDULER_DEFAULT_STEP;
+	double targetFrameTime = 0.0;		// Seconds per frame EndFrame paces to, 0 does not wait at all
+	double maxFrameTime = FRAME_SCHEDULER_MAX_FRAME_TIME;
+	unsigned int maxStepsPerFrame = FRAME_SCHEDULER_MAX_STEPS;
+	double spinTime = FRAME_SCHEDULER_SPIN_TIME;
+	bool renderOnDemand = false;		// Only simulate and render for a while after RequestRender
+	double idleDelay = FRAME_SCHEDULER_IDLE_DELAY;
+};
+
+// What to do this frame, returned by BeginFrame
+struct FrameTick
+{
+	unsigned int steps;		// Fixed steps to simulate before rendering
+	float stepTime;			// Seconds simulated by every step
+	float alpha;			// How far the render is between the last two simulated states, in [0, 1)
+	double frameTime;		// Seconds since the last BeginFrame, after clamping
+	bool render;			// False while idle
+};
+
+struct FrameSchedulerStats
+{
+	uint64_t frames = 0;			// Rendered frames
+	uint64_t steps = 0;
+	uint64_t droppedSteps = 0;		// Over maxStepsPerFrame, never simulated
+	double sleptSeconds = 0.0;		// Spent in ClockT::SleepFor by EndFrame
+	double spunSeconds = 0.0;		// Spent yielding by EndFrame
+};
+
+// Splits the main loop into fixed simulation steps and variable rate rendering.
+// BeginFrame adds the time since the last frame to an accumulator and returns how many fixed steps it holds.
+// The remainder is returned as alpha, the render interpolates between the last two simulated states with it.
+// EndFrame sleeps and then yields until the target frame time is reached, the deadlines advance by the target
+// frame time so the pacing does not drift. In render on demand mode the scheduler goes idle when RequestRender
+// has not been called for idleDelay seconds, the caller can then block until something happens.
+//
+// ClockT provides
+//   double Now();					// Seconds from any fixed point, never decreasing
+//   void SleepFor(double seconds);	// Blocks for about seconds, may return early or late
+//   void YieldSlice();				// Gives up the rest of the time slice
+// so a virtual clock can stand in for the real one, see VirtualFrameClock.
+template <class ClockT>
+class FrameScheduler
+{
+public:
+	void Init(ClockT* pClock, const FrameSchedulerSettings& settings)
+	{
+		this->mpClock = pClock;
+		this->mSettings = settings;
+		if (this->mSettings.fixedStep <= 0.0)
+			this->mSettings.fixedStep = FRAME_SCHEDULER_DEFAULT_STEP;
+		if (this->mSettings.maxStepsPerFrame == 0)
+			this->mSettings.maxStepsPerFrame = 1;
+		this->mLastTime = pClock->Now();
+		this->mDeadline = this->mLastTime;
+		this->mLastRequest = this->mLastTime;
+		this->mAccumulator = 0.0;
+		this->mIdle = false;
+		this->mStats = FrameSchedulerStats();
+	}
+
+	const FrameSchedulerSettings& GetSettings() const
+	{
+		return this->mSettings;
+	}
+
+	void SetTargetFrameTime(double seconds)
+	{
+		this->mSettings.targetFrameTime = seconds;
+		this->mDeadline = this->mpClock->Now();
+	}
+
+	void SetRenderOnDemand(bool renderOnDemand)
+	{
+		this->mSettings.renderOnDemand = renderOnDemand;
+		this->RequestRender();
+	}
+
+	// Keeps the render on demand mode awake for another idleDelay seconds
+	void RequestRender()
+	{
+		this->mLastRequest = this->mpClock->Now();
+		// Time spent idle is not simulated
+		if (this->mIdle)
+		{
+			this->mIdle = false;
+			this->mLastTime = this->mLastRequest;
+			this->mDeadline = this->mLastRequest;
+		}
+	}
+
+	// True if there is nothing to do until the next RequestRender
+	bool IsIdle() const
+	{
+		return this->mIdle;
+	}
+
+	FrameTick BeginFrame()
+	{
+		const double now = this->mpClock->Now();
+		FrameTick tick = {};
+		tick.stepTime = (float)this->mSettings.fixedStep;
+		if (this->mSettings.renderOnDemand && now - this->mLastRequest > this->mSettings.idleDelay)
+			this->mIdle = true;
+		if (this->mIdle)
+		{
+			this->mLastTime = now;
+			return tick;
+		}
+
+		tick.frameTime = now - this->mLastTime;
+		if (tick.frameTime > this->mSettings.maxFrameTime)
+			tick.frameTime = this->mSettings.maxFrameTime;
+		this->mLastTime = now;
+
+		this->mAccumulator += tick.frameTime;
+		uint64_t steps = (uint64_t)(this->mAccumulator / this->mSettings.fixedStep);
+		if (steps > this->mSettings.maxStepsPerFrame)
+		{
+			this->mStats.droppedSteps += steps - this->mSettings.maxStepsPerFrame;
+			steps = this->mSettings.maxStepsPerFrame;
+			// Keep the fraction so alpha stays continuous
+			this->mAccumulator -= (uint64_t)(this->mAccumulator / this->mSettings.fixedStep) * this->mSettings.fixedStep;
+		}
+		else
+		{
+			this->mAccumulator -= steps * this->mSettings.fixedStep;
+		}
+		if (this->mAccumulator < 0.0)
+			this->mAccumulator = 0.0;
+
+		tick.steps = (unsigned int)steps;
+		tick.alpha = (float)(this->mAccumulator / this->mSettings.fixedStep);
+		if (tick.alpha >= 1.0f)
+			tick.alpha = 0.0f;
+		tick.render = true;
+		this->mStats.steps += steps;
+		this->mStats.frames++;
+		return tick;
+	}
+
+	// Waits for the end of the frame if a target frame time is set
+	void EndFrame()
+	{
+		if (this->mIdle || this->mSettings.targetFrameTime <= 0.0)
+			return;
+		double now = this->mpClock->Now();
+		this->mDeadline += this->mSettings.targetFrameTime;
+		// More than a frame behind, start over from now instead of rushing the next frames
+		if (now > this->mDeadline + this->mSettings.targetFrameTime)
+			this->mDeadline = now;
+
+		double remaining = this->mDeadline - now;
+		if (remaining > this->mSettings.spinTime)
+		{
+			this->mpClock->SleepFor(remaining - this->mSettings.spinTime);
+			const double slept_until = this->mpClock->Now();
+			this->mStats.sleptSeconds += slept_until - now;
+			now = slept_until;
+		}
+		const double spin_start = now;
+		while (now < this->mDeadline)
+		{
+			this->mpClock->YieldSlice();
+			now = this->mpClock->Now();
+		}
+		this->mStats.spunSeconds += now - spin_start;
+	}
+
+	const FrameSchedulerStats& GetStats() const
+	{
+		return this->mStats;
+	}
+
+private:
+	ClockT* mpClock = nullptr;
+	FrameSchedulerSettings mSettings;
+	double mLastTime = 0.0;
+	double mDeadline = 0.0;
+	double mLastRequest = 0.0;
+	double mAccumulator = 0.0;
+	bool mIdle = false;
+	FrameSchedulerStats mStats;
+};
+
+// Monotonic wall clock. On Windows it also raises the timer resolution to 1 ms while it exists, so SleepFor
+// overshoots by less than FRAME_SCHEDULER_SPIN_TIME.
+class SystemFrameClock
+{
+public:
+	SystemFrameClock();
+	~SystemFrameClock();
+
+	double Now();
+	void SleepFor(double seconds);
+	void YieldSlice();
+};
+
+// Clock that only moves when told to, for driving a FrameScheduler deterministically
+class VirtualFrameClock
+{
+public:
+	double Now()
+	{
+		return this->mTime;
+	}
+
+	void SleepFor(double seconds)
+	{
+		if (seconds > 0.0)
+			this->mTime += seconds + this->mSleepOvershoot;
+	}
+
+	void YieldSlice()
+	{
+		this->mTime += this->mYieldTime;
+	}
+
+	void Advance(double seconds)
+	{
+		this->mTime += seconds;
+	}
+
+	// Every SleepFor takes this much longer than asked, like a real sleep would
+	void SetSleepOvershoot(double seconds)
+	{
+		this->mSleepOvershoot = seconds;
+	}
+
+	void SetYieldTime(double seconds)
+	{
+		this->mYieldTime = seconds;
+	}
+
+private:
+	double mTime = 0.0;
+	double mSleepOvershoot = 0.0;
+	double mYieldTime = 0.0001;
+};
@@ -0,0 +1,261 @@
+#include "InputRecording.h"
+#include <cstring>
+
+// The keyboard is stored as it is, one bit per virtual key
+static_assert(sizeof(DirectX::Keyboard::State) == 32, "Keyboard::State is expected to hold 256 key bits");
+
+namespace
+{
+	// Which parts of the input a step record carries
+	const uint8_t STEP_KEYBOARD = 1 << 0;
+	const uint8_t STEP_MOUSE = 1 << 1;
+
+	// Buttons and position mode in one byte, followed by x, y and the scroll wheel
+	struct PackedMouse
+	{
+		uint8_t flags;
+		int32_t x;
+		int32_t y;
+		int32_t scrollWheelValue;
+	};
+
+	PackedMouse PackMouse(const DirectX::Mouse::State& mouse)
+	{
+		PackedMouse packed;
+		packed.flags = (mouse.leftButton ? 1 << 0 : 0) |
+			(mouse.middleButton ? 1 << 1 : 0) |
+			(mouse.rightButton ? 1 << 2 : 0) |
+			(mouse.xButton1 ? 1 << 3 : 0) |
+			(mouse.xButton2 ? 1 << 4 : 0) |
+			(mouse.positionMode == DirectX::Mouse::MODE_RELATIVE ? 1 << 5 : 0);
+		packed.x = mouse.x;
+		packed.y = mouse.y;
+		packed.scrollWheelValue = mouse.scrollWheelValue;
+		return packed;
+	}
+
+	DirectX::Mouse::State UnpackMouse(const PackedMouse& packed)
+	{
+		DirectX::Mouse::State mouse = {};
+		mouse.leftButton = (packed.flags & (1 << 0)) != 0;
+		mouse.middleButton = (packed.flags & (1 << 1)) != 0;
+		mouse.rightButton = (packed.flags & (1 << 2)) != 0;
+		mouse.xButton1 = (packed.flags & (1 << 3)) != 0;
+		mouse.xButton2 = (packed.flags & (1 << 4)) != 0;
+		mouse.positionMode = (packed.flags & (1 << 5)) ? DirectX::Mouse::MODE_RELATIVE : DirectX::Mouse::MODE_ABSOLUTE;
+		mouse.x = packed.x;
+		mouse.y = packed.y;
+		mouse.scrollWheelValue = packed.scrollWheelValue;
+		return mouse;
+	}
+
+	bool operator==(const PackedMouse& a, const PackedMouse& b)
+	{
+		return a.flags == b.flags && a.x == b.x && a.y == b.y && a.scrollWheelValue == b.scrollWheelValue;
+	}
+
+	// The session state as floats, in the order they are written
+	const size_t SESSION_FLOAT_COUNT = 13;
+}
+
+InputRecorder::InputRecorder()
+{
+}
+
+InputRecorder::~InputRecorder()
+{
+	this->Close();
+}
+
+bool InputRecorder::Open(const char* filepath, const InputSessionState& state)
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (this->mFile.is_open())
+		this->mFile.close();
+	this->mFile.open(filepath, std::ios::binary | std::ios::trunc);
+	if (!this->mFile.is_open())
+		return false;
+	this->mLast = InputSnapshot();
+	this->mStats = InputRecorderStats();
+
+	const uint32_t header[2] = { INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION };
+	this->Write(header, sizeof(header));
+	const float values[SESSION_FLOAT_COUNT] = {
+		state.cameraPosition.x, state.cameraPosition.y, state.cameraPosition.z, state.cameraPosition.w,
+		state.cameraLook.x, state.cameraLook.y, state.cameraLook.z, state.cameraLook.w,
+		state.pitch, state.yaw, state.meshScale, state.meshRotation, state.lastScroll
+	};
+	this->Write(values, sizeof(values));
+	const uint8_t flags = (state.useDeferredContexts ? 1 << 0 : 0) | (state.showStatsOverlay ? 1 << 1 : 0);
+	this->Write(&flags, sizeof(flags));
+	this->Write(&state.randomSeed, sizeof(state.randomSeed));
+	return this->mFile.good();
+}
+
+void InputRecorder::Close()
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (this->mFile.is_open())
+		this->mFile.close();
+}
+
+bool InputRecorder::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	return this->mFile.is_open();
+}
+
+void InputRecorder::RecordStep(float dt, const InputSnapshot& input)
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (!this->mFile.is_open())
+		return;
+	const PackedMouse mouse = ::PackMouse(input.mouse);
+	uint8_t changed = 0;
+	if (memcmp(&input.keyboard, &this->mLast.keyboard, sizeof(input.keyboard)) != 0)
+		changed |= STEP_KEYBOARD;
+	if (!(mouse == ::PackMouse(this->mLast.mouse)))
+		changed |= STEP_MOUSE;
+
+	const uint8_t type = INPUT_EVENT_STEP;
+	this->Write(&type, sizeof(type));
+	this->Write(&dt, sizeof(dt));
+	this->Write(&changed, sizeof(changed));
+	if (changed & STEP_KEYBOARD)
+		this->Write(&input.keyboard, sizeof(input.keyboard));
+	if (changed & STEP_MOUSE)
+	{
+		this->Write(&mouse.flags, sizeof(mouse.flags));
+		this->Write(&mouse.x, sizeof(mouse.x));
+		this->Write(&mouse.y, sizeof(mouse.y));
+		this->Write(&mouse.scrollWheelValue, sizeof(mouse.scrollWheelValue));
+	}
+	this->mLast = input;
+	this->mStats.steps++;
+}
+
+void InputRecorder::RecordFrame(float alpha)
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (!this->mFile.is_open())
+		return;
+	const uint8_t type = INPUT_EVENT_FRAME;
+	this->Write(&type, sizeof(type));
+	this->Write(&alpha, sizeof(alpha));
+	this->mStats.frames++;
+}
+
+void InputRecorder::RecordLoad(const std::string& filepath, bool fbx)
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	if (!this->mFile.is_open())
+		return;
+	const uint8_t type = INPUT_EVENT_LOAD;
+	const uint8_t is_fbx = fbx ? 1 : 0;
+	const uint32_t length = (uint32_t)filepath.size();
+	this->Write(&type, sizeof(type));
+	this->Write(&is_fbx, sizeof(is_fbx));
+	this->Write(&length, sizeof(length));
+	this->Write(filepath.data(), length);
+	// Loads are rare and the recording is most useful up to them, so they are not left in the buffer
+	this->mFile.flush();
+	this->mStats.loads++;
+}
+
+InputRecorderStats InputRecorder::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(this->mMutex);
+	return this->mStats;
+}
+
+void InputRecorder::Write(const void* pData, size_t size)
+{
+	this->mFile.write((const char*)pData, size);
+	this->mStats.bytes += size;
+}
+
+bool InputPlayback::Open(const char* filepath)
+{
+	if (this->mFile.is_open())
+		this->mFile.close();
+	this->mFile.open(filepath, std::ios::binary);
+	if (!this->mFile.is_open())
+		return false;
+	this->mLast = InputSnapshot();
+
+	uint32_t header[2] = {};
+	float values[SESSION_FLOAT_COUNT] = {};
+	uint8_t flags = 0;
+	if (!this->Read(header, sizeof(header)) || header[0] != INPUT_RECORDING_MAGIC || header[1] != INPUT_RECORDING_VERSION)
+		return false;
+	if (!this->Read(values, sizeof(values)) || !this->Read(&flags, sizeof(flags)) ||
+		!this->Read(&this->mState.randomSeed, sizeof(this->mState.randomSeed)))
+		return false;
+	this->mState.cameraPosition = DirectX::XMFLOAT4(values[0], values[1], values[2], values[3]);
+	this->mState.cameraLook = DirectX::XMFLOAT4(values[4], values[5], values[6], values[7]);
+	this->mState.pitch = values[8];
+	this->mState.yaw = values[9];
+	this->mState.meshScale = values[10];
+	this->mState.meshRotation = values[11];
+	this->mState.lastScroll = values[12];
+	this->mState.useDeferredContexts = (flags & (1 << 0)) != 0;
+	this->mState.showStatsOverlay = (flags & (1 << 1)) != 0;
+	return true;
+}
+
+const InputSessionState& InputPlayback::GetSessionState() const
+{
+	return this->mState;
+}
+
+bool InputPlayback::Next(InputEvent* pEvent)
+{
+	uint8_t type = 0;
+	if (!this->Read(&type, sizeof(type)))
+		return false;
+	pEvent->type = (INPUT_EVENT_TYPE)type;
+	switch (type)
+	{
+	case INPUT_EVENT_STEP:
+	{
+		uint8_t changed = 0;
+		if (!this->Read(&pEvent->dt, sizeof(pEvent->dt)) || !this->Read(&changed, sizeof(changed)))
+			return false;
+		if ((changed & STEP_KEYBOARD) && !this->Read(&this->mLast.keyboard, sizeof(this->mLast.keyboard)))
+			return false;
+		if (changed & STEP_MOUSE)
+		{
+			PackedMouse mouse;
+			if (!this->Read(&mouse.flags, sizeof(mouse.flags)) ||
+				!this->Read(&mouse.x, sizeof(mouse.x)) ||
+				!this->Read(&mouse.y, sizeof(mouse.y)) ||
+				!this->Read(&mouse.scrollWheelValue, sizeof(mouse.scrollWheelValue)))
+				return false;
+			this->mLast.mouse = ::UnpackMouse(mouse);
+		}
+		pEvent->input = this->mLast;
+		return true;
+	}
+	case INPUT_EVENT_FRAME:
+		return this->Read(&pEvent->alpha, sizeof(pEvent->alpha));
+	case INPUT_EVENT_LOAD:
+	{
+		uint8_t is_fbx = 0;
+		uint32_t length = 0;
+		if (!this->Read(&is_fbx, sizeof(is_fbx)) || !this->Read(&length, sizeof(length)) || length > INPUT_RECORDING_MAX_PATH_LENGTH)
+			return false;
+		pEvent->fbx = is_fbx != 0;
+		pEvent->filepath.resize(length);
+		return length == 0 || this->Read(&pEvent->filepath[0], length);
+	}
+	default:
+		// Not written by this version, the rest cannot be trusted
+		return false;
+	}
+}
+
+bool InputPlayback::Read(void* pData, size_t size)
+{
+	this->mFile.read((char*)pData, size);
+	return (size_t)this->mFile.gcount() == size;
+}
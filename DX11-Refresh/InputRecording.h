@@ -0,0 +1,113 @@
+#pragma once
+#include <DirectXMath.h>
+#include <fstream>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include "Keyboard.h"
+#include "Mouse.h"
+
+// First bytes of a recording, "DXRI"
+#define INPUT_RECORDING_MAGIC 0x49525844
+// Changes whenever the layout of the records changes, older recordings are not read
+#define INPUT_RECORDING_VERSION 2
+// Longest mesh path a load record may carry, a longer one means the recording is damaged
+#define INPUT_RECORDING_MAX_PATH_LENGTH 4096
+
+// What HandleInput reads in one simulation step
+struct InputSnapshot
+{
+	DirectX::Keyboard::State keyboard = {};
+	DirectX::Mouse::State mouse = {};
+};
+
+// The state the input acts on, recorded first so a replay starts from where the recording did
+struct InputSessionState
+{
+	DirectX::XMFLOAT4 cameraPosition;
+	DirectX::XMFLOAT4 cameraLook;
+	float pitch = 0.0f;
+	float yaw = 0.0f;
+	// Scaled and rotated by the scroll wheel with Ctrl and Alt held
+	float meshScale = 1.0f;
+	float meshRotation = 0.0f;
+	float lastScroll = 0.0f;
+	bool useDeferredContexts = false;
+	bool showStatsOverlay = false;
+	// Seeds the random choices of the simulation, like where a crowd faces and where its animations start
+	uint32_t randomSeed = 0;
+};
+
+enum INPUT_EVENT_TYPE {
+	INPUT_EVENT_STEP = 0,		// One call of Renderer::Update, with its step time and input
+	INPUT_EVENT_FRAME = 1,		// A rendered frame, with the alpha it was drawn with
+	INPUT_EVENT_LOAD = 2		// A mesh file loaded through Renderer::LoadMesh
+};
+
+struct InputEvent
+{
+	INPUT_EVENT_TYPE type = INPUT_EVENT_STEP;
+	float dt = 0.0f;			// INPUT_EVENT_STEP
+	InputSnapshot input;		// INPUT_EVENT_STEP
+	float alpha = 0.0f;			// INPUT_EVENT_FRAME
+	std::string filepath;		// INPUT_EVENT_LOAD
+	bool fbx = false;			// INPUT_EVENT_LOAD
+};
+
+struct InputRecorderStats
+{
+	uint64_t steps = 0;
+	uint64_t frames = 0;
+	uint64_t loads = 0;
+	uint64_t bytes = 0;			// Written to the file, header included
+};
+
+// Writes everything that goes into the simulation to a file, so a session can be played back step by step.
+// A recording is a header with the InputSessionState followed by one record per event, in the order they happened.
+// Step records keep the step time bit for bit and only carry the keyboard and the mouse when they changed since the
+// step before, an idle step is six bytes. The recorder takes a lock per event, so the simulation thread can record
+// steps while the main thread records loads and frames.
+class InputRecorder
+{
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	// Starts a new recording, returns false if the file cannot be created
+	bool Open(const char* filepath, const InputSessionState& state);
+	void Close();
+	bool IsOpen() const;
+
+	void RecordStep(float dt, const InputSnapshot& input);
+	void RecordFrame(float alpha);
+	void RecordLoad(const std::string& filepath, bool fbx);
+
+	InputRecorderStats GetStats() const;
+
+private:
+	void Write(const void* pData, size_t size);
+
+	mutable std::mutex mMutex;
+	std::ofstream mFile;
+	// The snapshot of the last step, the next one only writes what differs
+	InputSnapshot mLast;
+	InputRecorderStats mStats;
+};
+
+// Reads a recording of InputRecorder back, one event at a time
+class InputPlayback
+{
+public:
+	// Returns false if the file cannot be read or is not a recording of this version
+	bool Open(const char* filepath);
+	const InputSessionState& GetSessionState() const;
+	// Reads the next event, false at the end of the recording, where it was cut off or where it is damaged
+	bool Next(InputEvent* pEvent);
+
+private:
+	bool Read(void* pData, size_t size);
+
+	std::ifstream mFile;
+	InputSessionState mState;
+	InputSnapshot mLast;
+};
@@ -0,0 +1,31 @@
+struct INSTANCED_VSIn
+{
+	float3 Pos	 : POSITION;
+	float3 Normal : NORMAL;
+	float2 UV		: TEXCOORD;
+	// Rows of the world * view * projection matrix of the instance
+	float4 wvp0 : INSTANCE_WVP0;
+	float4 wvp1 : INSTANCE_WVP1;
+	float4 wvp2 : INSTANCE_WVP2;
+	float4 wvp3 : INSTANCE_WVP3;
+};
+
+struct VSOut
+{
+	float4 Pos	 : SV_POSITION;
+	float4 Color : COLOR;
+	float2 UV	 : TEXCOORD0;
+	float3 worldPos : POSITION0;
+};
+
+VSOut INSTANCED_VS(INSTANCED_VSIn input)
+{
+	VSOut output;
+	float4x4 worldViewProj = float4x4(input.wvp0, input.wvp1, input.wvp2, input.wvp3);
+	output.Pos = mul(float4(input.Pos, 1.0f), worldViewProj);
+	output.Color = float4(0.83f, 0.83f, 0.83f, 1.0f);
+	output.UV = input.UV;
+	// Used for normal testing purposes to assign colour in the pixel shader
+	output.worldPos = input.Normal;
+	return output;
+}
@@ -0,0 +1,62 @@
+#include "Instancing.h"
+
+unsigned int Instancing::BuildInstances(const DirectX::XMFLOAT4X4* pWorlds,
+	unsigned int worldCount,
+	const DirectX::XMMATRIX& viewProj,
+	const Bounds::Sphere& sphere,
+	const DirectX::XMFLOAT4* pFrustumPlanes,
+	InstanceData* pOutInstances)
+{
+	DirectX::XMVECTOR planes[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		planes[i] = DirectX::XMLoadFloat4(&pFrustumPlanes[i]);
+	}
+	const DirectX::XMVECTOR center = DirectX::XMLoadFloat3(&sphere.center);
+
+	unsigned int visible_count = 0;
+	uint32_t visible[INSTANCE_BATCH_SIZE];
+	for (unsigned int batch = 0; batch < worldCount; batch += INSTANCE_BATCH_SIZE)
+	{
+		const unsigned int batch_end = (std::min)(worldCount, batch + INSTANCE_BATCH_SIZE);
+
+		// Cull the batch first so the transform loop below has no branches
+		unsigned int batch_visible = 0;
+		for (unsigned int i = batch; i < batch_end; ++i)
+		{
+			DirectX::XMMATRIX world = DirectX::XMLoadFloat4x4(&pWorlds[i]);
+			DirectX::XMVECTOR world_center = DirectX::XMVector3TransformCoord(center, world);
+			DirectX::XMVECTOR negative_radius = DirectX::XMVectorNegate(
+				DirectX::XMVectorScale(DirectX::XMVector3Length(world.r[0]), sphere.radius));
+			DirectX::XMVECTOR outside = DirectX::XMVectorFalseInt();
+			for (int p = 0; p < 6; ++p)
+			{
+				outside = DirectX::XMVectorOrInt(outside,
+					DirectX::XMVectorLess(DirectX::XMPlaneDotCoord(planes[p], world_center), negative_radius));
+			}
+			visible[batch_visible] = i;
+			batch_visible += DirectX::XMVectorGetIntX(outside) == 0 ? 1 : 0;
+		}
+
+		Instancing::TransformInstances(pWorlds, visible, batch_visible, viewProj, pOutInstances + visible_count);
+		visible_count += batch_visible;
+	}
+	return visible_count;
+}
+
+void Instancing::TransformInstances(const DirectX::XMFLOAT4X4* pWorlds,
+	const uint32_t* pIndices,
+	unsigned int indexCount,
+	const DirectX::XMMATRIX& viewProj,
+	InstanceData* pOutInstances)
+{
+	for (unsigned int i = 0; i < indexCount; ++i)
+	{
+		DirectX::XMMATRIX world_view_proj = DirectX::XMMatrixMultiply(DirectX::XMLoadFloat4x4(&pWorlds[pIndices[i]]), viewProj);
+		InstanceData& instance = pOutInstances[i];
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow0, world_view_proj.r[0]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow1, world_view_proj.r[1]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow2, world_view_proj.r[2]);
+		DirectX::XMStoreFloat4(&instance.worldViewProjRow3, world_view_proj.r[3]);
+	}
+}
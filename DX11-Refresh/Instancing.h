@@ -0,0 +1,50 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include "Bounds.h"
+#include "VertexFormat.h"
+
+// Instances are transformed in batches of this size, a batch is culled first and the visible
+// instances of the batch are then transformed back to back
+#define INSTANCE_BATCH_SIZE 64
+
+namespace Instancing
+{
+	// Per instance vertex data, the rows of world * view * projection of one instance.
+	// Bound as four float4 attributes the shader builds the matrix from, so it is stored untransposed.
+	struct InstanceData
+	{
+		DirectX::XMFLOAT4 worldViewProjRow0;
+		DirectX::XMFLOAT4 worldViewProjRow1;
+		DirectX::XMFLOAT4 worldViewProjRow2;
+		DirectX::XMFLOAT4 worldViewProjRow3;
+	};
+
+	// Writes the instance data of every placement whose bounding sphere is inside the frustum (see Camera::GetFrustumPlanes)
+	// and returns how many were written. pOutInstances needs room for worldCount instances.
+	// sphere is the object space bounding sphere of the instanced mesh, the worlds are assumed to only contain uniform scale.
+	unsigned int BuildInstances(const DirectX::XMFLOAT4X4* pWorlds,
+		unsigned int worldCount,
+		const DirectX::XMMATRIX& viewProj,
+		const Bounds::Sphere& sphere,
+		const DirectX::XMFLOAT4* pFrustumPlanes,
+		InstanceData* pOutInstances);
+
+	// Writes the instance data of the placements pIndices points to, for visibility computed elsewhere (see DynamicBvh::QueryFrustum).
+	// pOutInstances needs room for indexCount instances.
+	void TransformInstances(const DirectX::XMFLOAT4X4* pWorlds,
+		const uint32_t* pIndices,
+		unsigned int indexCount,
+		const DirectX::XMMATRIX& viewProj,
+		InstanceData* pOutInstances);
+}
+
+VERTEX_ATTRIBUTE(InstanceWorldViewProjRow0, Instancing::InstanceData, worldViewProjRow0, DirectX::XMFLOAT4, "INSTANCE_WVP", 0);
+VERTEX_ATTRIBUTE(InstanceWorldViewProjRow1, Instancing::InstanceData, worldViewProjRow1, DirectX::XMFLOAT4, "INSTANCE_WVP", 1);
+VERTEX_ATTRIBUTE(InstanceWorldViewProjRow2, Instancing::InstanceData, worldViewProjRow2, DirectX::XMFLOAT4, "INSTANCE_WVP", 2);
+VERTEX_ATTRIBUTE(InstanceWorldViewProjRow3, Instancing::InstanceData, worldViewProjRow3, DirectX::XMFLOAT4, "INSTANCE_WVP", 3);
+typedef VertexFormat::Layout<Instancing::InstanceData,
+	InstanceWorldViewProjRow0,
+	InstanceWorldViewProjRow1,
+	InstanceWorldViewProjRow2,
+	InstanceWorldViewProjRow3> InstanceLayout;
@@ -0,0 +1,385 @@
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+// Anonymous namespace for JobSystem
+namespace {
+	struct Job
+	{
+		JobFunction function;
+		void* pData;
+		JobCounter* pCounter;
+	};
+
+	// Chase-Lev deque. Only the owner pushes and pops at the bottom, any thread may steal from the top.
+	// The slots are atomic so that a thief reading a slot the owner is reusing is not a data race, the thief's
+	// compare exchange on top fails in that case and the value it read is dropped.
+	class WorkStealingDeque
+	{
+	public:
+		bool Push(const Job& job)
+		{
+			int64_t bottom = this->mBottom.load(std::memory_order_relaxed);
+			int64_t top = this->mTop.load(std::memory_order_acquire);
+			if (bottom - top >= JOB_DEQUE_CAPACITY)
+				return false;
+			this->Store(bottom, job);
+			std::atomic_thread_fence(std::memory_order_release);
+			this->mBottom.store(bottom + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		bool Pop(Job* pOutJob)
+		{
+			int64_t bottom = this->mBottom.load(std::memory_order_relaxed) - 1;
+			this->mBottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t top = this->mTop.load(std::memory_order_relaxed);
+			if (top > bottom)
+			{
+				this->mBottom.store(bottom + 1, std::memory_order_relaxed);
+				return false;
+			}
+			*pOutJob = this->Load(bottom);
+			if (top < bottom)
+				return true;
+			// Last job, race the thieves for it
+			bool won = this->mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			this->mBottom.store(bottom + 1, std::memory_order_relaxed);
+			return won;
+		}
+
+		bool Steal(Job* pOutJob)
+		{
+			int64_t top = this->mTop.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t bottom = this->mBottom.load(std::memory_order_acquire);
+			if (top >= bottom)
+				return false;
+			*pOutJob = this->Load(top);
+			return this->mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		bool IsEmpty() const
+		{
+			return this->mTop.load(std::memory_order_relaxed) >= this->mBottom.load(std::memory_order_relaxed);
+		}
+
+	private:
+		struct Slot
+		{
+			std::atomic<JobFunction> function;
+			std::atomic<void*> pData;
+			std::atomic<JobCounter*> pCounter;
+		};
+
+		std::atomic<int64_t> mTop{ 0 };
+		std::atomic<int64_t> mBottom{ 0 };
+		Slot mSlots[JOB_DEQUE_CAPACITY];
+
+		void Store(int64_t index, const Job& job)
+		{
+			Slot& slot = this->mSlots[index & (JOB_DEQUE_CAPACITY - 1)];
+			slot.function.store(job.function, std::memory_order_relaxed);
+			slot.pData.store(job.pData, std::memory_order_relaxed);
+			slot.pCounter.store(job.pCounter, std::memory_order_relaxed);
+		}
+
+		Job Load(int64_t index) const
+		{
+			const Slot& slot = this->mSlots[index & (JOB_DEQUE_CAPACITY - 1)];
+			return { slot.function.load(std::memory_order_relaxed), slot.pData.load(std::memory_order_relaxed), slot.pCounter.load(std::memory_order_relaxed) };
+		}
+	};
+
+	struct Worker
+	{
+		WorkStealingDeque deque;
+		std::thread thread;
+		std::atomic<uint64_t> executedJobs{ 0 };
+		std::atomic<uint64_t> stolenJobs{ 0 };
+		std::atomic<uint64_t> inlineJobs{ 0 };
+	};
+
+	std::vector<std::unique_ptr<Worker>> gWorkers;
+	unsigned int gWorkerCount = 1;
+	std::atomic<bool> gQuit(false);
+	// Index of the worker running on this thread, -1 on threads that are not workers
+	thread_local int tWorkerIndex = -1;
+
+	// Jobs from threads that are not workers
+	std::mutex gSharedMutex;
+	std::deque<Job> gSharedJobs;
+	std::atomic<unsigned int> gSharedJobCount(0);
+
+	std::mutex gMainThreadMutex;
+	std::deque<Job> gMainThreadJobs;
+	std::atomic<unsigned int> gMainThreadJobCount(0);
+
+	// Jobs counted on threads that are not workers
+	std::atomic<uint64_t> gExternalExecutedJobs(0);
+	std::atomic<uint64_t> gExternalInlineJobs(0);
+
+	// Idle workers sleep until the epoch moves on, it is bumped whenever a job is queued
+	std::mutex gSleepMutex;
+	std::condition_variable gWakeCondition;
+	std::atomic<unsigned int> gEpoch(0);
+	std::atomic<int> gSleepingWorkers(0);
+
+	void Execute(const Job& job)
+	{
+		// Jobs have no frames of their own, what one takes from the frame arena is given back when it returns
+		FrameArena& arena = FrameArena::ThreadLocal();
+		const FrameArena::Marker marker = arena.GetMarker();
+		job.function(job.pData);
+		arena.Rewind(marker);
+		if (tWorkerIndex >= 0)
+			gWorkers[tWorkerIndex]->executedJobs.fetch_add(1, std::memory_order_relaxed);
+		else
+			gExternalExecutedJobs.fetch_add(1, std::memory_order_relaxed);
+		// Last, the waiting thread may move on as soon as the counter drops
+		if (job.pCounter)
+			job.pCounter->value.fetch_sub(1, std::memory_order_release);
+	}
+
+	void WakeWorkers()
+	{
+		gEpoch.fetch_add(1);
+		if (gSleepingWorkers.load() > 0)
+		{
+			// Taking the lock makes sure a worker between its last check and its wait does not miss the notify
+			{
+				std::lock_guard<std::mutex> lock(gSleepMutex);
+			}
+			gWakeCondition.notify_one();
+		}
+	}
+
+	bool PopQueue(std::mutex& mutex, std::deque<Job>& jobs, std::atomic<unsigned int>& jobCount, Job* pOutJob)
+	{
+		if (jobCount.load(std::memory_order_relaxed) == 0)
+			return false;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.empty())
+			return false;
+		*pOutJob = jobs.front();
+		jobs.pop_front();
+		jobCount.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void PushQueue(std::mutex& mutex, std::deque<Job>& jobs, std::atomic<unsigned int>& jobCount, const Job& job)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(job);
+		jobCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Own deque first, then the main thread queue on the main thread, the shared queue and finally the other workers
+	bool FindJob(Job* pOutJob)
+	{
+		const int index = tWorkerIndex;
+		if (index >= 0 && gWorkers[index]->deque.Pop(pOutJob))
+			return true;
+		if (index == 0 && ::PopQueue(gMainThreadMutex, gMainThreadJobs, gMainThreadJobCount, pOutJob))
+			return true;
+		if (::PopQueue(gSharedMutex, gSharedJobs, gSharedJobCount, pOutJob))
+			return true;
+
+		// Start after this worker so the thieves spread over the victims
+		const unsigned int first = index >= 0 ? (unsigned int)index + 1 : 0;
+		for (unsigned int i = 0; i < gWorkerCount; ++i)
+		{
+			unsigned int victim = (first + i) % gWorkerCount;
+			if ((int)victim == index || gWorkers[victim]->deque.IsEmpty())
+				continue;
+			if (gWorkers[victim]->deque.Steal(pOutJob))
+			{
+				if (index >= 0)
+					gWorkers[index]->stolenJobs.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void PinThread(std::thread::native_handle_type handle, unsigned int core)
+	{
+#ifdef _WIN32
+		SetThreadAffinityMask(handle, (DWORD_PTR)1 << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(core % CPU_SETSIZE, &cpus);
+		pthread_setaffinity_np(handle, sizeof(cpus), &cpus);
+#else
+		(void)handle;
+		(void)core;
+#endif
+	}
+
+	void WorkerLoop(int index)
+	{
+		tWorkerIndex = index;
+		PROFILE_THREAD("Job worker");
+		while (!gQuit.load(std::memory_order_relaxed))
+		{
+			unsigned int epoch = gEpoch.load();
+			Job job;
+			if (::FindJob(&job))
+			{
+				::Execute(job);
+				continue;
+			}
+
+			// Nothing to do, sleep until a job is queued. The timeout covers jobs pushed to a deque by a worker
+			// whose wake up went to a worker that found nothing.
+			std::unique_lock<std::mutex> lock(gSleepMutex);
+			gSleepingWorkers.fetch_add(1);
+			gWakeCondition.wait_for(lock, std::chrono::milliseconds(1), [epoch]() { return gEpoch.load() != epoch || gQuit.load(); });
+			gSleepingWorkers.fetch_sub(1);
+		}
+		tWorkerIndex = -1;
+	}
+}
+
+void JobSystem::Init(unsigned int workerCount, bool pinThreads)
+{
+	if (workerCount == 0)
+		workerCount = (std::max)(std::thread::hardware_concurrency(), 1u);
+	workerCount = (std::min)(workerCount, (unsigned int)JOB_SYSTEM_MAX_WORKERS);
+
+	gQuit = false;
+	gWorkers.clear();
+	for (unsigned int i = 0; i < workerCount; ++i)
+	{
+		gWorkers.emplace_back(new Worker());
+	}
+	gWorkerCount = workerCount;
+	tWorkerIndex = 0;
+	const unsigned int core_count = (std::max)(std::thread::hardware_concurrency(), 1u);
+	if (pinThreads)
+	{
+		::PinThread(
+#ifdef _WIN32
+			GetCurrentThread(),
+#else
+			pthread_self(),
+#endif
+			0);
+	}
+	for (unsigned int i = 1; i < workerCount; ++i)
+	{
+		gWorkers[i]->thread = std::thread(::WorkerLoop, (int)i);
+		if (pinThreads)
+			::PinThread(gWorkers[i]->thread.native_handle(), i % core_count);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(gSleepMutex);
+		gQuit = true;
+	}
+	gWakeCondition.notify_all();
+	for (unsigned int i = 1; i < gWorkerCount; ++i)
+	{
+		gWorkers[i]->thread.join();
+	}
+	gWorkers.clear();
+	gWorkerCount = 1;
+	tWorkerIndex = -1;
+	gSharedJobs.clear();
+	gSharedJobCount = 0;
+	gMainThreadJobs.clear();
+	gMainThreadJobCount = 0;
+}
+
+unsigned int JobSystem::GetWorkerCount()
+{
+	return gWorkerCount;
+}
+
+void JobSystem::Run(JobFunction function, void* pData, JobCounter* pCounter)
+{
+	if (pCounter)
+		pCounter->value.fetch_add(1, std::memory_order_relaxed);
+	Job job = { function, pData, pCounter };
+
+	const int index = tWorkerIndex;
+	if (gWorkers.empty() || (index >= 0 && !gWorkers[index]->deque.Push(job)))
+	{
+		// No workers to hand it to or no room left, the caller would only wait for it anyway
+		if (index >= 0)
+			gWorkers[index]->inlineJobs.fetch_add(1, std::memory_order_relaxed);
+		else
+			gExternalInlineJobs.fetch_add(1, std::memory_order_relaxed);
+		::Execute(job);
+		return;
+	}
+	if (index < 0)
+		::PushQueue(gSharedMutex, gSharedJobs, gSharedJobCount, job);
+	::WakeWorkers();
+}
+
+void JobSystem::RunOnMainThread(JobFunction function, void* pData, JobCounter* pCounter)
+{
+	if (pCounter)
+		pCounter->value.fetch_add(1, std::memory_order_relaxed);
+	Job job = { function, pData, pCounter };
+	if (tWorkerIndex == 0 || gWorkers.empty())
+	{
+		::Execute(job);
+		return;
+	}
+	::PushQueue(gMainThreadMutex, gMainThreadJobs, gMainThreadJobCount, job);
+}
+
+void JobSystem::Wait(JobCounter* pCounter)
+{
+	while (pCounter->value.load(std::memory_order_acquire) > 0)
+	{
+		Job job;
+		if (::FindJob(&job))
+			::Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+	Job job;
+	while (::PopQueue(gMainThreadMutex, gMainThreadJobs, gMainThreadJobCount, &job))
+	{
+		::Execute(job);
+	}
+}
+
+JobSystemStats JobSystem::GetStats()
+{
+	JobSystemStats stats = {};
+	stats.executedJobs = gExternalExecutedJobs.load(std::memory_order_relaxed);
+	stats.inlineJobs = gExternalInlineJobs.load(std::memory_order_relaxed);
+	for (auto& worker : gWorkers)
+	{
+		stats.executedJobs += worker->executedJobs.load(std::memory_order_relaxed);
+		stats.stolenJobs += worker->stolenJobs.load(std::memory_order_relaxed);
+		stats.inlineJobs += worker->inlineJobs.load(std::memory_order_relaxed);
+	}
+	return stats;
+}
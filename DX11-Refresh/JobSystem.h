@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+// Most threads the job system runs on, the main thread included
+#define JOB_SYSTEM_MAX_WORKERS 64
+// Jobs a worker can have queued at once, a power of two. Run executes a job in place when the deque of its thread is full.
+#define JOB_DEQUE_CAPACITY 4096
+
+typedef void (*JobFunction)(void* pData);
+
+// Counts the unfinished jobs started with it, Wait returns once it is back at zero.
+// A job that needs the results of others waits on their counter, so dependencies are expressed as counters.
+struct JobCounter
+{
+	std::atomic<int> value{ 0 };
+};
+
+struct JobSystemStats
+{
+	uint64_t executedJobs;		// By any thread, including the ones run in place
+	uint64_t stolenJobs;		// Taken from the deque of another worker
+	uint64_t inlineJobs;		// Run in place because the job system has no workers or the deque was full
+};
+
+// Work stealing job scheduler.
+// The thread that calls Init becomes worker 0, the main thread, and Init starts the other workers. Every worker
+// pushes and pops its own jobs at the bottom of its deque and steals from the top of the others when it runs dry.
+// Threads that are not workers hand their jobs to a shared queue. Jobs from RunOnMainThread only ever run on the
+// main thread, in Wait or RunMainThreadJobs. Without Init every job runs in place on the calling thread.
+namespace JobSystem
+{
+	// workerCount 0 picks the hardware thread count. With pinThreads worker i only runs on core i.
+	void Init(unsigned int workerCount = 0, bool pinThreads = false);
+	// Stops the workers, jobs still queued are not run
+	void Shutdown();
+	// Workers including the main thread, 1 without Init
+	unsigned int GetWorkerCount();
+
+	// Queues the job, pCounter may be nullptr
+	void Run(JobFunction function, void* pData, JobCounter* pCounter);
+	void RunOnMainThread(JobFunction function, void* pData, JobCounter* pCounter);
+	// Runs other jobs until the counter reaches zero
+	void Wait(JobCounter* pCounter);
+	// Runs every queued main thread job, call from the main thread once per frame
+	void RunMainThreadJobs();
+
+	JobSystemStats GetStats();
+
+	namespace Detail
+	{
+		template <class FunctionT>
+		struct ParallelForRange
+		{
+			FunctionT* pFunction;
+			unsigned int begin;
+			unsigned int end;
+			unsigned int batchSize;
+		};
+
+		// Hands the upper half of the range to the job system and splits the lower half further, so thieves
+		// take the largest pieces. The halves live on this stack frame until Wait returns.
+		template <class FunctionT>
+		void RunParallelForRange(void* pData)
+		{
+			const ParallelForRange<FunctionT>& range = *static_cast<const ParallelForRange<FunctionT>*>(pData);
+			if (range.end - range.begin <= range.batchSize)
+			{
+				(*range.pFunction)(range.begin, range.end);
+				return;
+			}
+			// Split on a batch boundary so every call but the last gets exactly batchSize items
+			unsigned int batches = (range.end - range.begin + range.batchSize - 1) / range.batchSize;
+			unsigned int middle = range.begin + batches / 2 * range.batchSize;
+			ParallelForRange<FunctionT> upper = { range.pFunction, middle, range.end, range.batchSize };
+			ParallelForRange<FunctionT> lower = { range.pFunction, range.begin, middle, range.batchSize };
+			JobCounter counter;
+			Run(&RunParallelForRange<FunctionT>, &upper, &counter);
+			RunParallelForRange<FunctionT>(&lower);
+			Wait(&counter);
+		}
+	}
+
+	// Calls function(begin, end) over [0, count) in ranges of batchSize items starting on multiples of batchSize
+	// and returns once all of them are done
+	template <class FunctionT>
+	void ParallelFor(unsigned int count, unsigned int batchSize, FunctionT function)
+	{
+		if (count == 0)
+			return;
+		if (batchSize == 0)
+			batchSize = 1;
+		if (GetWorkerCount() <= 1)
+		{
+			for (unsigned int begin = 0; begin < count; begin += batchSize)
+			{
+				function(begin, count - begin < batchSize ? count : begin + batchSize);
+			}
+			return;
+		}
+		Detail::ParallelForRange<FunctionT> range = { &function, 0, count, batchSize };
+		Detail::RunParallelForRange<FunctionT>(&range);
+	}
+}
@@ -0,0 +1,313 @@
+#include "MemoryTracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <sstream>
+
+// Anonymous namespace for MemoryTracker
+namespace
+{
+	// Everything here is zero or constant initialized, operator new can run before any dynamic initializer
+	struct CategoryCounters
+	{
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> frees;
+		std::atomic<size_t> currentBytes;
+		std::atomic<size_t> peakBytes;
+		std::atomic<uint64_t> totalBytes;
+		std::atomic<size_t> budgetBytes;
+		std::atomic<uint64_t> overBudgetCount;
+	};
+
+	const char* CATEGORY_NAMES[MEMORY_CATEGORY_COUNT] = {
+		"Untagged",
+		"OBJ import",
+		"FBX import",
+		"Animation",
+		"Render transient",
+	};
+
+	CategoryCounters gCounters[MEMORY_CATEGORY_COUNT];
+	thread_local MEMORY_CATEGORY tCategory = MEMORY_CATEGORY_UNTAGGED;
+
+	void AddBytes(MEMORY_CATEGORY category, size_t size, uint64_t count)
+	{
+		CategoryCounters& counters = gCounters[category];
+		counters.allocations.fetch_add(count, std::memory_order_relaxed);
+		counters.totalBytes.fetch_add(size, std::memory_order_relaxed);
+		const size_t current = counters.currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+		size_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+		while (current > peak && !counters.peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+		{
+		}
+		const size_t budget = counters.budgetBytes.load(std::memory_order_relaxed);
+		if (budget != 0 && current > budget && current - size <= budget)
+			counters.overBudgetCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void SubtractBytes(MEMORY_CATEGORY category, size_t size, uint64_t count)
+	{
+		CategoryCounters& counters = gCounters[category];
+		counters.frees.fetch_add(count, std::memory_order_relaxed);
+		counters.currentBytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+#if MEMORY_TRACKING_ENABLED
+	// In front of every block, a multiple of 16 bytes so the blocks keep the alignment malloc gives them
+	struct alignas(16) BlockHeader
+	{
+		BlockHeader* pPrev;
+		BlockHeader* pNext;
+		size_t size;
+		uint32_t category;
+		// Order of the tagged allocations, the same in every run that loads the same assets
+		uint32_t sequence;
+	};
+
+	// Guards the list of tagged blocks. Only locked inside a MEMORY_SCOPE, which is after static initialization
+	std::mutex gBlockMutex;
+	BlockHeader* gpFirstBlock = nullptr;
+	size_t gBlockCount = 0;
+	uint32_t gNextSequence = 0;
+
+	void* Allocate(size_t size)
+	{
+		BlockHeader* p_header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+		if (!p_header)
+			return nullptr;
+		const MEMORY_CATEGORY category = tCategory;
+		p_header->pPrev = nullptr;
+		p_header->pNext = nullptr;
+		p_header->size = size;
+		p_header->category = (uint32_t)category;
+		p_header->sequence = 0;
+		if (category != MEMORY_CATEGORY_UNTAGGED)
+		{
+			std::lock_guard<std::mutex> lock(gBlockMutex);
+			p_header->sequence = gNextSequence++;
+			p_header->pNext = gpFirstBlock;
+			if (gpFirstBlock)
+				gpFirstBlock->pPrev = p_header;
+			gpFirstBlock = p_header;
+			gBlockCount++;
+		}
+		::AddBytes(category, size, 1);
+		return p_header + 1;
+	}
+
+	void Free(void* pMemory)
+	{
+		if (!pMemory)
+			return;
+		BlockHeader* p_header = static_cast<BlockHeader*>(pMemory) - 1;
+		const MEMORY_CATEGORY category = (MEMORY_CATEGORY)p_header->category;
+		if (category != MEMORY_CATEGORY_UNTAGGED)
+		{
+			std::lock_guard<std::mutex> lock(gBlockMutex);
+			if (p_header->pPrev)
+				p_header->pPrev->pNext = p_header->pNext;
+			else
+				gpFirstBlock = p_header->pNext;
+			if (p_header->pNext)
+				p_header->pNext->pPrev = p_header->pPrev;
+			gBlockCount--;
+		}
+		::SubtractBytes(category, p_header->size, 1);
+		free(p_header);
+	}
+
+	void* AllocateOrThrow(size_t size)
+	{
+		void* p_memory = ::Allocate(size);
+		if (!p_memory)
+			throw std::bad_alloc();
+		return p_memory;
+	}
+#endif
+}
+
+#if MEMORY_TRACKING_ENABLED
+// Replacing these is enough for every new and delete expression of the program, the aligned overloads are left alone
+void* operator new(size_t size)
+{
+	return ::AllocateOrThrow(size);
+}
+
+void* operator new[](size_t size)
+{
+	return ::AllocateOrThrow(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return ::Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return ::Allocate(size);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	::Free(pMemory);
+}
+
+void operator delete[](void* pMemory) noexcept
+{
+	::Free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t) noexcept
+{
+	::Free(pMemory);
+}
+
+void operator delete[](void* pMemory, size_t) noexcept
+{
+	::Free(pMemory);
+}
+
+void operator delete(void* pMemory, const std::nothrow_t&) noexcept
+{
+	::Free(pMemory);
+}
+
+void operator delete[](void* pMemory, const std::nothrow_t&) noexcept
+{
+	::Free(pMemory);
+}
+#endif
+
+const char* MemoryTracker::GetCategoryName(MEMORY_CATEGORY category)
+{
+	return category < MEMORY_CATEGORY_COUNT ? CATEGORY_NAMES[category] : "Unknown";
+}
+
+MEMORY_CATEGORY MemoryTracker::GetThreadCategory()
+{
+	return tCategory;
+}
+
+MEMORY_CATEGORY MemoryTracker::SetThreadCategory(MEMORY_CATEGORY category)
+{
+	const MEMORY_CATEGORY previous = tCategory;
+	tCategory = category;
+	return previous;
+}
+
+void MemoryTracker::RecordAllocation(MEMORY_CATEGORY category, size_t size, uint64_t count)
+{
+	::AddBytes(category, size, count);
+}
+
+void MemoryTracker::RecordFree(MEMORY_CATEGORY category, size_t size, uint64_t count)
+{
+	::SubtractBytes(category, size, count);
+}
+
+bool MemoryTracker::SetBudget(MEMORY_CATEGORY category, size_t bytes)
+{
+#if !MEMORY_TRACKING_ENABLED
+	// Only the frame arenas still count their memory
+	if (category != MEMORY_CATEGORY_RENDER_TRANSIENT && bytes != 0)
+		return false;
+#endif
+	gCounters[category].budgetBytes.store(bytes, std::memory_order_relaxed);
+	return true;
+}
+
+bool MemoryTracker::IsOverBudget(MEMORY_CATEGORY category)
+{
+	const size_t budget = gCounters[category].budgetBytes.load(std::memory_order_relaxed);
+	return budget != 0 && gCounters[category].peakBytes.load(std::memory_order_relaxed) > budget;
+}
+
+void MemoryTracker::ResetPeak(MEMORY_CATEGORY category)
+{
+	gCounters[category].peakBytes.store(gCounters[category].currentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+MemoryCategoryStats MemoryTracker::GetStats(MEMORY_CATEGORY category)
+{
+	const CategoryCounters& counters = gCounters[category];
+	MemoryCategoryStats stats;
+	stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+	stats.frees = counters.frees.load(std::memory_order_relaxed);
+	stats.currentBytes = counters.currentBytes.load(std::memory_order_relaxed);
+	stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+	stats.totalBytes = counters.totalBytes.load(std::memory_order_relaxed);
+	stats.budgetBytes = counters.budgetBytes.load(std::memory_order_relaxed);
+	stats.overBudgetCount = counters.overBudgetCount.load(std::memory_order_relaxed);
+	return stats;
+}
+
+size_t MemoryTracker::GetOutstandingBlockCount()
+{
+#if MEMORY_TRACKING_ENABLED
+	std::lock_guard<std::mutex> lock(gBlockMutex);
+	return gBlockCount;
+#else
+	return 0;
+#endif
+}
+
+std::string MemoryTracker::FormatReport()
+{
+	std::ostringstream stream;
+	stream << std::left << std::setw(18) << "Category" << std::right
+		<< std::setw(12) << "current KB" << std::setw(12) << "peak KB" << std::setw(14) << "total KB"
+		<< std::setw(12) << "allocs" << std::setw(12) << "frees" << std::setw(12) << "budget KB" << "\n";
+	for (int i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
+	{
+		const MemoryCategoryStats stats = MemoryTracker::GetStats((MEMORY_CATEGORY)i);
+		stream << std::left << std::setw(18) << CATEGORY_NAMES[i] << std::right
+			<< std::setw(12) << stats.currentBytes / 1024 << std::setw(12) << stats.peakBytes / 1024
+			<< std::setw(14) << stats.totalBytes / 1024 << std::setw(12) << stats.allocations
+			<< std::setw(12) << stats.frees << std::setw(12) << stats.budgetBytes / 1024;
+		if (stats.overBudgetCount > 0)
+			stream << "  over budget " << stats.overBudgetCount << " times";
+		stream << "\n";
+	}
+
+#if MEMORY_TRACKING_ENABLED
+	// Copied out first, formatting allocates and a scope on this thread would need the lock for that
+	struct BlockInfo
+	{
+		size_t size;
+		uint32_t category;
+		uint32_t sequence;
+	};
+	BlockInfo blocks[MEMORY_TRACKER_REPORT_LIMIT];
+	size_t listed = 0;
+	size_t outstanding = 0;
+	{
+		std::lock_guard<std::mutex> lock(gBlockMutex);
+		outstanding = gBlockCount;
+		for (const BlockHeader* p_header = gpFirstBlock; p_header && listed < MEMORY_TRACKER_REPORT_LIMIT; p_header = p_header->pNext)
+		{
+			blocks[listed++] = { p_header->size, p_header->category, p_header->sequence };
+		}
+	}
+	stream << outstanding << " tagged blocks outstanding\n";
+	for (size_t i = 0; i < listed; ++i)
+	{
+		stream << "  #" << blocks[i].sequence << " " << CATEGORY_NAMES[blocks[i].category] << ", " << blocks[i].size << " bytes\n";
+	}
+	if (outstanding > listed)
+		stream << "  and " << outstanding - listed << " more\n";
+#endif
+	return stream.str();
+}
+
+bool MemoryTracker::WriteReport(const char* filepath)
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+	file << MemoryTracker::FormatReport();
+	return file.good();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// Heap allocations are tagged and counted unless MEMORY_TRACKING_ENABLED is 0, which is the default for release builds
+// (NDEBUG). Define it as 1 for builds that enforce the asset memory budgets
+#ifndef MEMORY_TRACKING_ENABLED
+#ifdef NDEBUG
+#define MEMORY_TRACKING_ENABLED 0
+#else
+#define MEMORY_TRACKING_ENABLED 1
+#endif
+#endif
+// Outstanding blocks listed by the report, the per-category totals always cover all of them
+#define MEMORY_TRACKER_REPORT_LIMIT 32
+
+enum MEMORY_CATEGORY
+{
+	MEMORY_CATEGORY_UNTAGGED,			// Everything allocated outside of a MEMORY_SCOPE
+	MEMORY_CATEGORY_OBJ_IMPORT,
+	MEMORY_CATEGORY_FBX_IMPORT,
+	MEMORY_CATEGORY_ANIMATION,
+	MEMORY_CATEGORY_RENDER_TRANSIENT,	// Handed out by the frame arenas
+	MEMORY_CATEGORY_COUNT
+};
+
+struct MemoryCategoryStats
+{
+	uint64_t allocations = 0;		// Since the start
+	uint64_t frees = 0;
+	size_t currentBytes = 0;		// Allocated and not freed yet
+	size_t peakBytes = 0;			// Most currentBytes since the start or the last ResetPeak
+	uint64_t totalBytes = 0;		// Allocated since the start
+	size_t budgetBytes = 0;			// 0 if the category has no budget
+	uint64_t overBudgetCount = 0;	// Allocations that took currentBytes over the budget
+};
+
+// Tagged allocation tracking, to see what an import or a frame costs and to find what is never freed.
+// With tracking enabled the global operator new and delete are replaced: every block gets a small header with its
+// size and category, and the category counters are updated with atomics. The category is the one of the innermost
+// MEMORY_SCOPE on the allocating thread, the block keeps it until it is freed, wherever that happens. Blocks of any
+// category but MEMORY_CATEGORY_UNTAGGED are also linked into a list under a lock, which is what the leak report walks,
+// so scopes belong around loading code and not around per-frame code.
+// Memory the tracker does not allocate itself, like the frame arenas, is counted with RecordAllocation and RecordFree.
+namespace MemoryTracker
+{
+	const char* GetCategoryName(MEMORY_CATEGORY category);
+
+	// Category the calling thread tags its allocations with, SetThreadCategory returns the previous one
+	MEMORY_CATEGORY GetThreadCategory();
+	MEMORY_CATEGORY SetThreadCategory(MEMORY_CATEGORY category);
+
+	// Counts memory that is allocated elsewhere, size is the sum of count allocations
+	void RecordAllocation(MEMORY_CATEGORY category, size_t size, uint64_t count = 1);
+	void RecordFree(MEMORY_CATEGORY category, size_t size, uint64_t count = 1);
+
+	// Bytes a category may hold at once, 0 removes the budget. Without MEMORY_TRACKING_ENABLED only the categories
+	// counted with RecordAllocation are counted at all, a budget for any other one returns false and is not set
+	bool SetBudget(MEMORY_CATEGORY category, size_t bytes);
+	// True if the peak of the category has gone over its budget. Reset the peak before an import and check this after
+	// it to find out whether that import alone went over
+	bool IsOverBudget(MEMORY_CATEGORY category);
+	void ResetPeak(MEMORY_CATEGORY category);
+	MemoryCategoryStats GetStats(MEMORY_CATEGORY category);
+
+	// Tagged blocks that have not been freed yet
+	size_t GetOutstandingBlockCount();
+	// A table of the categories followed by the outstanding tagged blocks, which are leaks when this is called at
+	// shutdown. WriteReport returns false if the file cannot be written
+	std::string FormatReport();
+	bool WriteReport(const char* filepath);
+
+	// Tags the allocations of the calling thread with category for the rest of the enclosing scope
+	class Scope
+	{
+	public:
+		explicit Scope(MEMORY_CATEGORY category) : mPrevious(SetThreadCategory(category))
+		{
+		}
+
+		~Scope()
+		{
+			SetThreadCategory(this->mPrevious);
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		MEMORY_CATEGORY mPrevious;
+	};
+}
+
+#if MEMORY_TRACKING_ENABLED
+#define MEMORY_TRACKER_CONCAT_INNER(a, b) a##b
+#define MEMORY_TRACKER_CONCAT(a, b) MEMORY_TRACKER_CONCAT_INNER(a, b)
+#define MEMORY_SCOPE(category) MemoryTracker::Scope MEMORY_TRACKER_CONCAT(memoryScope, __LINE__)(category)
+#else
+#define MEMORY_SCOPE(category) ((void)0)
+#endif
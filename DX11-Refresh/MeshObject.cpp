@@ -1,4 +1,41 @@
 #include "MeshObject.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+
+// Anonymous namespace for MeshObject
+namespace {
+	// Every array in the storage block starts on this alignment
+	const size_t STORAGE_ALIGNMENT = 16;
+
+	size_t AlignUp(size_t size)
+	{
+		return (size + STORAGE_ALIGNMENT - 1) & ~(STORAGE_ALIGNMENT - 1);
+	}
+
+	// Reserves count elements in the storage block at *pOffset and advances the offset
+	template <class T>
+	ArrayView<T> ReserveInStorage(unsigned char* pStorage, size_t* pOffset, size_t count)
+	{
+		if (count == 0)
+			return ArrayView<T>();
+		T* p_destination = reinterpret_cast<T*>(pStorage + *pOffset);
+		*pOffset += AlignUp(count * sizeof(T));
+		return ArrayView<T>(p_destination, count);
+	}
+
+	template <class T>
+	ArrayView<const T> ConstView(const ArrayView<T>& view)
+	{
+		return ArrayView<const T>(view.data(), view.size());
+	}
+
+	template <class T>
+	ArrayView<const T> ConstView(const std::vector<T>& vector)
+	{
+		return ArrayView<const T>(vector.data(), vector.size());
+	}
+}
+
 // Running this constructor implies you want an empty mesh object
 MeshObject::MeshObject()
 {
@@ -7,122 +44,262 @@ MeshObject::MeshObject()
 
 MeshObject::~MeshObject()
 {
-	delete mpVertexPosVector;
-	delete mpIndexVector;
-	delete mpNormalVector;
-	delete mpUVVector;
+
 }
 
-HRESULT MeshObject::LoadFBX(const std::string& filePath)
+MeshObject::MeshObject(MeshObject&& other)
 {
-	if (!this->mpIndexVector || !this->mpVertexPosVector || !this->mpNormalVector || !this->mpUVVector)
+	*this = std::move(other);
+}
+
+MeshObject& MeshObject::operator=(MeshObject&& other)
+{
+	if (this != &other)
 	{
-		this->mpIndexVector = new std::vector<int>;
-		this->mpVertexPosVector = new std::vector<DirectX::XMFLOAT3>;
-		this->mpNormalVector = new std::vector<DirectX::XMFLOAT3>;
-		this->mpUVVector = new std::vector<DirectX::XMFLOAT2>;
-		this->mpSkeleton = new FbxLoader::Skeleton();
-		this->mpSkinningWeights = new std::vector<FbxLoader::ControlPointInfo>;
+		// The views point into the heap block, they stay valid when the block changes owner
+		this->mpStorage = std::move(other.mpStorage);
+		this->mStorageSize = other.mStorageSize;
+		this->mPositions = other.mPositions;
+		this->mIndices = other.mIndices;
+		this->mNormals = other.mNormals;
+		this->mUVs = other.mUVs;
+		this->mLodIndices = std::move(other.mLodIndices);
+		this->mMeshlets = std::move(other.mMeshlets);
+		this->mLods = std::move(other.mLods);
+		this->mBounds = other.mBounds;
+		this->mpSkeleton = std::move(other.mpSkeleton);
+		this->mSkinningWeights = other.mSkinningWeights;
+		this->mJointBounds = std::move(other.mJointBounds);
+		other.Clear();
 	}
+	return *this;
+}
+
+void MeshObject::Clear()
+{
+	this->mpStorage.reset();
+	this->mStorageSize = 0;
+	this->mPositions = ArrayView<DirectX::XMFLOAT3>();
+	this->mIndices = ArrayView<unsigned int>();
+	this->mNormals = ArrayView<DirectX::XMFLOAT3>();
+	this->mUVs = ArrayView<DirectX::XMFLOAT2>();
+	this->mLodIndices.clear();
+	this->mMeshlets.clear();
+	this->mLods.clear();
+	this->mBounds = {};
+	this->mpSkeleton.reset();
+	this->mSkinningWeights = ArrayView<FbxLoader::ControlPointInfo>();
+	this->mJointBounds.clear();
+}
+
+HRESULT MeshObject::LoadFBX(const std::string& filePath)
+{
+	PROFILE_ZONE("MeshObject::LoadFBX");
+	MEMORY_SCOPE(MEMORY_CATEGORY_FBX_IMPORT);
+	this->Clear();
+
+	// The loader reports the counts first, the block is sized once from them and the loader writes into it
+	auto allocate_output = [this](const FbxLoader::MeshCounts& counts)
+	{
+		size_t storage_size = AlignUp(counts.vertexCount * sizeof(DirectX::XMFLOAT3))
+			+ AlignUp(counts.indexCount * sizeof(unsigned int))
+			+ AlignUp(counts.vertexCount * sizeof(DirectX::XMFLOAT3));
+		if (counts.hasUVs)
+			storage_size += AlignUp(counts.vertexCount * sizeof(DirectX::XMFLOAT2));
+		if (counts.hasSkinning)
+			storage_size += AlignUp(counts.vertexCount * sizeof(FbxLoader::ControlPointInfo));
+
+		this->mpStorage.reset(new unsigned char[storage_size]);
+		this->mStorageSize = storage_size;
+		unsigned char* p_storage = this->mpStorage.get();
+		size_t offset = 0;
+		this->mPositions = ::ReserveInStorage<DirectX::XMFLOAT3>(p_storage, &offset, counts.vertexCount);
+		this->mIndices = ::ReserveInStorage<unsigned int>(p_storage, &offset, counts.indexCount);
+		this->mNormals = ::ReserveInStorage<DirectX::XMFLOAT3>(p_storage, &offset, counts.vertexCount);
+		if (counts.hasUVs)
+			this->mUVs = ::ReserveInStorage<DirectX::XMFLOAT2>(p_storage, &offset, counts.vertexCount);
+		if (counts.hasSkinning)
+			this->mSkinningWeights = ::ReserveInStorage<FbxLoader::ControlPointInfo>(p_storage, &offset, counts.vertexCount);
+
+		FbxLoader::MeshOutput output;
+		output.pPositions = this->mPositions.data();
+		output.pIndices = this->mIndices.data();
+		output.pNormals = this->mNormals.data();
+		output.pUVs = this->mUVs.data();
+		output.pControlPoints = this->mSkinningWeights.data();
+		return output;
+	};
+	std::unique_ptr<FbxLoader::Skeleton> skeleton(new FbxLoader::Skeleton());
+
 	HRESULT hr = E_FAIL;
 	try
 	{
-		hr = FbxLoader::LoadFBX(filePath, this->mpVertexPosVector, this->mpIndexVector, this->mpNormalVector, this->mpUVVector, this->mpSkeleton, this->mpSkinningWeights);
+		hr = FbxLoader::LoadFBX(filePath, allocate_output, skeleton.get());
 	}
 	catch (std::exception e)
 	{
 		MessageBoxA(NULL, e.what(), "Error in FBX Loader.", MB_OK);
 	}
-	
-	if (SUCCEEDED(hr))
+
+	if (FAILED(hr) || this->mPositions.empty())
 	{
-		// Assume UVs and normals exist
-		this->mHasUvs = true;
-		this->mHasNormals = true;
-		this->mHasSkeleton = true;
-		if (this->mpNormalVector->size() <= 0)
-		{
-			delete mpNormalVector;
-			mpNormalVector = nullptr;
-			this->mHasNormals = false;
-		}
-		if (this->mpUVVector->size() <= 0)
-		{
-			delete mpUVVector;
-			mpUVVector = nullptr;
-			this->mHasUvs = false;
-		}
-		if (this->mpSkeleton->joints.size() <= 0)
+		this->Clear();
+		return FAILED(hr) ? hr : E_FAIL;
+	}
+
+	const DirectX::XMFLOAT3* p_positions = this->mPositions.data();
+	const unsigned int vertex_count = (unsigned int)this->mPositions.size();
+	const unsigned int* p_indices = this->mIndices.data();
+	const unsigned int index_count = (unsigned int)this->mIndices.size();
+	const ArrayView<FbxLoader::ControlPointInfo> skinning_weights = this->mSkinningWeights;
+
+	this->mBounds = Bounds::ComputeBounds(p_positions, sizeof(DirectX::XMFLOAT3), vertex_count);
+	if (!skinning_weights.empty())
+	{
+		std::vector<unsigned int> joint_indices(skinning_weights.size() * MAX_NUM_WEIGHTS_PER_VERTEX);
+		std::vector<float> joint_weights(joint_indices.size());
+		for (size_t i = 0; i < skinning_weights.size(); ++i)
 		{
-			delete this->mpSkeleton;
-			delete this->mpSkinningWeights;
-			this->mpSkinningWeights = nullptr;
-			mpSkeleton = nullptr;
-			this->mHasSkeleton = false;
+			for (int j = 0; j < MAX_NUM_WEIGHTS_PER_VERTEX; ++j)
+			{
+				joint_indices[i * MAX_NUM_WEIGHTS_PER_VERTEX + j] = skinning_weights[i].weightPairs[j].index;
+				joint_weights[i * MAX_NUM_WEIGHTS_PER_VERTEX + j] = (float)skinning_weights[i].weightPairs[j].weight;
+			}
 		}
+		Bounds::ComputeJointBounds(p_positions,
+			sizeof(DirectX::XMFLOAT3),
+			vertex_count,
+			joint_indices.data(),
+			joint_weights.data(),
+			MAX_NUM_WEIGHTS_PER_VERTEX,
+			(unsigned int)skeleton->joints.size(),
+			&this->mJointBounds);
 	}
-	else
+
+	// Partition the mesh into meshlets for cluster culling
+	Meshlets::BuildMeshlets(p_positions,
+		sizeof(DirectX::XMFLOAT3),
+		vertex_count,
+		p_indices,
+		index_count,
+		&this->mMeshlets);
+
+	// Generate the LOD chain, skinned vertices are grouped by their most influential joint
+	// so that no collapse moves a vertex across a skinning weight boundary
+	std::vector<unsigned int> vertex_groups;
+	MeshSimplifier::SimplifyInput simplify_input;
+	simplify_input.pPositions = p_positions;
+	simplify_input.positionStride = sizeof(DirectX::XMFLOAT3);
+	simplify_input.pNormals = this->mNormals.data();
+	simplify_input.normalStride = sizeof(DirectX::XMFLOAT3);
+	if (!this->mUVs.empty())
 	{
-		delete mpVertexPosVector;
-		delete mpIndexVector;
-		delete mpNormalVector;
-		delete mpUVVector;
-		delete mpSkinningWeights;
-		delete mpSkeleton;
-		mpVertexPosVector = nullptr;
-		mpUVVector = nullptr;
-		mpNormalVector = nullptr;
-		mpIndexVector = nullptr;
-		mpSkinningWeights = nullptr;
-		mpSkeleton = nullptr;
+		simplify_input.pUVs = this->mUVs.data();
+		simplify_input.uvStride = sizeof(DirectX::XMFLOAT2);
 	}
-	
+	if (!skinning_weights.empty())
+	{
+		vertex_groups.resize(skinning_weights.size());
+		for (size_t i = 0; i < vertex_groups.size(); ++i)
+		{
+			const FbxLoader::IndexWeightPair* p_pairs = skinning_weights[i].weightPairs;
+			int dominant = 0;
+			for (int j = 1; j < MAX_NUM_WEIGHTS_PER_VERTEX; ++j)
+			{
+				if (p_pairs[j].weight > p_pairs[dominant].weight)
+					dominant = j;
+			}
+			vertex_groups[i] = p_pairs[dominant].index;
+		}
+		simplify_input.pVertexGroups = vertex_groups.data();
+	}
+	simplify_input.vertexCount = vertex_count;
+	simplify_input.pIndices = p_indices;
+	simplify_input.indexCount = index_count;
+	MeshSimplifier::BuildLodChain(simplify_input, LOD_MAX_LEVELS, &this->mLodIndices, &this->mLods);
+
+	if (!skinning_weights.empty())
+		this->mpSkeleton = std::move(skeleton);
+
 	return hr;
-	
 }
 
-std::vector<DirectX::XMFLOAT3>* MeshObject::GetVertexPositionVector()
+ArrayView<const DirectX::XMFLOAT3> MeshObject::GetVertexPositions() const
+{
+	return ::ConstView(this->mPositions);
+}
+
+ArrayView<const unsigned int> MeshObject::GetIndices() const
 {
-	return this->mpVertexPosVector;
+	return ::ConstView(this->mIndices);
 }
 
-std::vector<int>* MeshObject::GetIndexVector()
+ArrayView<const unsigned int> MeshObject::GetLodIndices() const
 {
-	return this->mpIndexVector;
+	return ::ConstView(this->mLodIndices);
 }
 
-std::vector<DirectX::XMFLOAT3>* MeshObject::GetNormalVector()
+ArrayView<const DirectX::XMFLOAT3> MeshObject::GetNormals() const
 {
-	return this->mpNormalVector;
+	return ::ConstView(this->mNormals);
 }
 
-std::vector<DirectX::XMFLOAT2>* MeshObject::GetUVVector()
+ArrayView<const DirectX::XMFLOAT2> MeshObject::GetUVs() const
 {
-	return this->mpUVVector;
+	return ::ConstView(this->mUVs);
+}
+
+ArrayView<const Meshlets::Meshlet> MeshObject::GetMeshlets() const
+{
+	return ::ConstView(this->mMeshlets);
+}
+
+ArrayView<const MeshSimplifier::MeshLod> MeshObject::GetLods() const
+{
+	return ::ConstView(this->mLods);
+}
+
+const Bounds::MeshBounds& MeshObject::GetBounds() const
+{
+	return this->mBounds;
 }
 
 FbxLoader::Skeleton* MeshObject::GetSkeleton()
 {
-	return this->mpSkeleton;
+	return this->mpSkeleton.get();
 }
 
-std::vector<FbxLoader::ControlPointInfo>* MeshObject::GetSkinningWeights()
+std::unique_ptr<FbxLoader::Skeleton> MeshObject::ReleaseSkeleton()
 {
-	return this->mpSkinningWeights;
+	return std::move(this->mpSkeleton);
 }
 
-bool MeshObject::HasUVs()
+ArrayView<const FbxLoader::ControlPointInfo> MeshObject::GetSkinningWeights() const
 {
-	return this->mHasUvs;
+	return ::ConstView(this->mSkinningWeights);
 }
 
-bool MeshObject::HasNormals()
+ArrayView<const Bounds::AABB> MeshObject::GetJointBounds() const
 {
-	return this->mHasNormals;
+	return ::ConstView(this->mJointBounds);
 }
 
-bool MeshObject::HasSkeleton()
+size_t MeshObject::GetStorageSize() const
 {
-	return this->mHasSkeleton;
+	return this->mStorageSize;
 }
 
+bool MeshObject::HasUVs() const
+{
+	return !this->mUVs.empty();
+}
+
+bool MeshObject::HasNormals() const
+{
+	return !this->mNormals.empty();
+}
+
+bool MeshObject::HasSkeleton() const
+{
+	return !this->mSkinningWeights.empty();
+}
@@ -1,36 +1,69 @@
 #pragma once
 #include "Fbx_loader.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "Bounds.h"
+#include "ArrayView.h"
+#include <vector>
 
+// Owns the imported attributes of one mesh in a single allocation, every attribute is a separate array (SoA) inside it.
+// The block is sized from the counts the importer reports and the importer writes straight into it.
+// The tables derived from the attributes afterwards (meshlets, LODs, joint bounds) are kept in their own vectors.
+// The views handed out stay valid for the lifetime of the object, also after it has been moved.
 class MeshObject {
 private:
-	std::vector<DirectX::XMFLOAT3>* mpVertexPosVector = nullptr;
-	std::vector<int>* mpIndexVector = nullptr;
-	std::vector<DirectX::XMFLOAT3>* mpNormalVector = nullptr;
-	std::vector<DirectX::XMFLOAT2>* mpUVVector = nullptr;
+	std::unique_ptr<unsigned char[]> mpStorage;
+	size_t mStorageSize = 0;
 
-	bool mHasUvs = false;
-	bool mHasNormals = false;
+	ArrayView<DirectX::XMFLOAT3> mPositions;
+	ArrayView<unsigned int> mIndices;
+	ArrayView<DirectX::XMFLOAT3> mNormals;
+	ArrayView<DirectX::XMFLOAT2> mUVs;
+	// Indices of LOD 1 and up, uploaded right behind mIndices in the same index buffer
+	std::vector<unsigned int> mLodIndices;
+	// Clusters of the index buffer, used for cluster culling
+	std::vector<Meshlets::Meshlet> mMeshlets;
+	// Simplified levels of detail, offsets count from the start of mIndices
+	std::vector<MeshSimplifier::MeshLod> mLods;
+	// Object space bounds of the whole mesh
+	Bounds::MeshBounds mBounds = {};
 
 	// Used for skinning / skeletal animation
-	FbxLoader::Skeleton* mpSkeleton = nullptr;
-	std::vector<FbxLoader::ControlPointInfo>* mpSkinningWeights = nullptr;
-	bool mHasSkeleton = false;
+	std::unique_ptr<FbxLoader::Skeleton> mpSkeleton;
+	ArrayView<FbxLoader::ControlPointInfo> mSkinningWeights;
+	// Bind pose bounds of the vertices influenced by each joint
+	std::vector<Bounds::AABB> mJointBounds;
+
+	void Clear();
 
 public:
 	MeshObject();
 	~MeshObject();
-	// Populates the vectors with data from provided .fbx filepath
+	MeshObject(MeshObject&& other);
+	MeshObject& operator=(MeshObject&& other);
+	MeshObject(const MeshObject&) = delete;
+	MeshObject& operator=(const MeshObject&) = delete;
+
+	// Populates the mesh with data from provided .fbx filepath
 	HRESULT LoadFBX(const std::string& filePath);
 
-	std::vector<DirectX::XMFLOAT3>* GetVertexPositionVector();
-	std::vector<int>* GetIndexVector();
-	std::vector<DirectX::XMFLOAT3>* GetNormalVector();
-	std::vector<DirectX::XMFLOAT2>* GetUVVector();
+	ArrayView<const DirectX::XMFLOAT3> GetVertexPositions() const;
+	ArrayView<const unsigned int> GetIndices() const;
+	ArrayView<const unsigned int> GetLodIndices() const;
+	ArrayView<const DirectX::XMFLOAT3> GetNormals() const;
+	ArrayView<const DirectX::XMFLOAT2> GetUVs() const;
+	ArrayView<const Meshlets::Meshlet> GetMeshlets() const;
+	ArrayView<const MeshSimplifier::MeshLod> GetLods() const;
+	const Bounds::MeshBounds& GetBounds() const;
 
 	FbxLoader::Skeleton* GetSkeleton();
-	std::vector<FbxLoader::ControlPointInfo>* GetSkinningWeights();
+	// Hands the skeleton over to the caller, it is shared by every instance of the mesh
+	std::unique_ptr<FbxLoader::Skeleton> ReleaseSkeleton();
+	ArrayView<const FbxLoader::ControlPointInfo> GetSkinningWeights() const;
+	ArrayView<const Bounds::AABB> GetJointBounds() const;
 
-	bool HasUVs();
-	bool HasNormals();
-	bool HasSkeleton();
-};
\ No newline at end of file
+	size_t GetStorageSize() const;
+	bool HasUVs() const;
+	bool HasNormals() const;
+	bool HasSkeleton() const;
+};
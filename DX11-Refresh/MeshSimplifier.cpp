@@ -0,0 +1,416 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Anonymous namespace for MeshSimplifier
+namespace {
+	// Symmetric 4x4 plane quadric, only the upper triangle is stored
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	};
+
+	void AddPlane(Quadric* pQuadric, double a, double b, double c, double d)
+	{
+		pQuadric->a2 += a * a; pQuadric->ab += a * b; pQuadric->ac += a * c; pQuadric->ad += a * d;
+		pQuadric->b2 += b * b; pQuadric->bc += b * c; pQuadric->bd += b * d;
+		pQuadric->c2 += c * c; pQuadric->cd += c * d;
+		pQuadric->d2 += d * d;
+	}
+
+	void AddQuadric(Quadric* pQuadric, const Quadric& other)
+	{
+		pQuadric->a2 += other.a2; pQuadric->ab += other.ab; pQuadric->ac += other.ac; pQuadric->ad += other.ad;
+		pQuadric->b2 += other.b2; pQuadric->bc += other.bc; pQuadric->bd += other.bd;
+		pQuadric->c2 += other.c2; pQuadric->cd += other.cd;
+		pQuadric->d2 += other.d2;
+	}
+
+	// Sum of squared distances from p to all planes in the quadric
+	double EvaluateQuadric(const Quadric& q, const DirectX::XMFLOAT3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+			+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+			+ q.c2 * z * z + 2.0 * q.cd * z
+			+ q.d2;
+		return error > 0.0 ? error : 0.0;
+	}
+
+	const float* AttributeAt(const void* pData, unsigned int stride, unsigned int index)
+	{
+		return reinterpret_cast<const float*>(static_cast<const unsigned char*>(pData) + (size_t)index * stride);
+	}
+
+	// Vertex data used to find duplicated vertices
+	struct VertexKey
+	{
+		float data[8];
+		bool operator==(const VertexKey& other) const
+		{
+			return memcmp(data, other.data, sizeof(data)) == 0;
+		}
+	};
+
+	struct VertexKeyHasher
+	{
+		size_t operator()(const VertexKey& key) const
+		{
+			unsigned int words[8];
+			memcpy(words, key.data, sizeof(words));
+			size_t hash = 2166136261u;
+			for (unsigned int word : words)
+			{
+				hash = (hash ^ word) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	DirectX::XMVECTOR TriangleNormal(const DirectX::XMFLOAT3& a, const DirectX::XMFLOAT3& b, const DirectX::XMFLOAT3& c)
+	{
+		DirectX::XMVECTOR va = DirectX::XMLoadFloat3(&a);
+		return DirectX::XMVector3Cross(
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&b), va),
+			DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&c), va));
+	}
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(const MeshSimplifier::SimplifyInput& input) : mInput(input)
+		{
+			mPositions.resize(input.vertexCount);
+			for (unsigned int i = 0; i < input.vertexCount; ++i)
+			{
+				const float* p = AttributeAt(input.pPositions, input.positionStride, i);
+				mPositions[i] = DirectX::XMFLOAT3(p[0], p[1], p[2]);
+			}
+			this->WeldVertices();
+			this->LockVertices();
+			this->BuildQuadrics();
+		}
+
+		// Indices of the welded original mesh, the starting point for LOD 1
+		const std::vector<unsigned int>& GetWeldedIndices() const
+		{
+			return mWeldedIndices;
+		}
+
+		// Collapses edges in indices until targetTriangles is reached or no valid collapse is left.
+		// Returns the largest collapse error so far.
+		double Simplify(std::vector<unsigned int>* pIndices, size_t targetTriangles)
+		{
+			while (pIndices->size() / 3 > targetTriangles)
+			{
+				size_t collapses_needed = (pIndices->size() / 3 - targetTriangles) / 2 + 1;
+				if (this->CollapsePass(pIndices, collapses_needed) == 0)
+					break;
+			}
+			return mMaxError;
+		}
+
+	private:
+		const MeshSimplifier::SimplifyInput& mInput;
+		std::vector<DirectX::XMFLOAT3> mPositions;
+		std::vector<unsigned int> mWeldedIndices;
+		std::vector<Quadric> mQuadrics;
+		std::vector<bool> mLocked;
+		double mMaxError = 0.0;
+
+		// Vertices that share position and attributes are merged so the mesh becomes connected
+		void WeldVertices()
+		{
+			std::unordered_map<VertexKey, unsigned int, VertexKeyHasher> unique_vertices;
+			unique_vertices.reserve(mInput.vertexCount);
+			std::vector<unsigned int> remap(mInput.vertexCount);
+			for (unsigned int i = 0; i < mInput.vertexCount; ++i)
+			{
+				VertexKey key = {};
+				memcpy(&key.data[0], &mPositions[i], sizeof(DirectX::XMFLOAT3));
+				if (mInput.pNormals)
+					memcpy(&key.data[3], AttributeAt(mInput.pNormals, mInput.normalStride, i), sizeof(DirectX::XMFLOAT3));
+				if (mInput.pUVs)
+					memcpy(&key.data[6], AttributeAt(mInput.pUVs, mInput.uvStride, i), sizeof(DirectX::XMFLOAT2));
+				remap[i] = unique_vertices.insert({ key, i }).first->second;
+			}
+
+			mWeldedIndices.resize(mInput.indexCount);
+			for (unsigned int i = 0; i < mInput.indexCount; ++i)
+			{
+				mWeldedIndices[i] = remap[mInput.pIndices[i]];
+			}
+		}
+
+		// Locks vertices on UV/normal seams, open borders and vertex group boundaries
+		void LockVertices()
+		{
+			mLocked.assign(mInput.vertexCount, false);
+
+			// Seams: welded vertices that still share their position with another vertex
+			std::unordered_map<VertexKey, unsigned int, VertexKeyHasher> position_owner;
+			for (unsigned int index : mWeldedIndices)
+			{
+				VertexKey key = {};
+				memcpy(&key.data[0], &mPositions[index], sizeof(DirectX::XMFLOAT3));
+				auto result = position_owner.insert({ key, index });
+				if (result.first->second != index)
+				{
+					mLocked[index] = true;
+					mLocked[result.first->second] = true;
+				}
+			}
+
+			// Borders: edges that only belong to one triangle
+			std::unordered_map<unsigned long long, int> edge_use;
+			edge_use.reserve(mWeldedIndices.size());
+			for (size_t i = 0; i + 2 < mWeldedIndices.size(); i += 3)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					unsigned int a = mWeldedIndices[i + e];
+					unsigned int b = mWeldedIndices[i + (e + 1) % 3];
+					unsigned long long edge = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+					edge_use[edge]++;
+					// Group boundaries
+					if (mInput.pVertexGroups && mInput.pVertexGroups[a] != mInput.pVertexGroups[b])
+					{
+						mLocked[a] = true;
+						mLocked[b] = true;
+					}
+				}
+			}
+			for (auto& edge : edge_use)
+			{
+				if (edge.second == 1)
+				{
+					mLocked[(unsigned int)(edge.first >> 32)] = true;
+					mLocked[(unsigned int)(edge.first & 0xffffffff)] = true;
+				}
+			}
+		}
+
+		void BuildQuadrics()
+		{
+			mQuadrics.assign(mInput.vertexCount, Quadric());
+			for (size_t i = 0; i + 2 < mWeldedIndices.size(); i += 3)
+			{
+				unsigned int a = mWeldedIndices[i], b = mWeldedIndices[i + 1], c = mWeldedIndices[i + 2];
+				DirectX::XMVECTOR normal = TriangleNormal(mPositions[a], mPositions[b], mPositions[c]);
+				if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(normal)) <= 1e-20f)
+					continue;
+				normal = DirectX::XMVector3Normalize(normal);
+				DirectX::XMFLOAT3 n;
+				DirectX::XMStoreFloat3(&n, normal);
+				double d = -((double)n.x * mPositions[a].x + (double)n.y * mPositions[a].y + (double)n.z * mPositions[a].z);
+				::AddPlane(&mQuadrics[a], n.x, n.y, n.z, d);
+				::AddPlane(&mQuadrics[b], n.x, n.y, n.z, d);
+				::AddPlane(&mQuadrics[c], n.x, n.y, n.z, d);
+			}
+		}
+
+		bool CanCollapse(unsigned int from, unsigned int to) const
+		{
+			if (mLocked[from])
+				return false;
+			if (mInput.pVertexGroups && mInput.pVertexGroups[from] != mInput.pVertexGroups[to])
+				return false;
+			return true;
+		}
+
+		double CollapseCost(unsigned int from, unsigned int to) const
+		{
+			Quadric q = mQuadrics[from];
+			::AddQuadric(&q, mQuadrics[to]);
+			return ::EvaluateQuadric(q, mPositions[to]);
+		}
+
+		// Returns true if moving from onto to flips or collapses any triangle around from
+		bool CollapseFlipsTriangle(unsigned int from, unsigned int to, const std::vector<unsigned int>& indices,
+			const std::vector<unsigned int>& triangleOffsets, const std::vector<unsigned int>& triangleList) const
+		{
+			for (unsigned int t = triangleOffsets[from]; t < triangleOffsets[from + 1]; ++t)
+			{
+				const unsigned int* tri = &indices[triangleList[t] * 3];
+				// Triangles that contain both vertices disappear, they can not flip
+				if (tri[0] == to || tri[1] == to || tri[2] == to)
+					continue;
+
+				DirectX::XMFLOAT3 corners[3] = { mPositions[tri[0]], mPositions[tri[1]], mPositions[tri[2]] };
+				DirectX::XMVECTOR before = TriangleNormal(corners[0], corners[1], corners[2]);
+				for (int c = 0; c < 3; ++c)
+				{
+					if (tri[c] == from)
+						corners[c] = mPositions[to];
+				}
+				DirectX::XMVECTOR after = TriangleNormal(corners[0], corners[1], corners[2]);
+				if (DirectX::XMVectorGetX(DirectX::XMVector3Dot(before, after)) <= 0.0f)
+					return true;
+			}
+			return false;
+		}
+
+		// One round of non-overlapping edge collapses, cheapest first. Returns the number of collapses.
+		size_t CollapsePass(std::vector<unsigned int>* pIndices, size_t maxCollapses)
+		{
+			std::vector<unsigned int>& indices = *pIndices;
+			size_t triangle_count = indices.size() / 3;
+
+			// Vertex to triangle adjacency
+			std::vector<unsigned int> triangle_offsets(mInput.vertexCount + 1, 0);
+			for (unsigned int index : indices)
+			{
+				triangle_offsets[index + 1]++;
+			}
+			for (unsigned int i = 0; i < mInput.vertexCount; ++i)
+			{
+				triangle_offsets[i + 1] += triangle_offsets[i];
+			}
+			std::vector<unsigned int> triangle_list(indices.size());
+			std::vector<unsigned int> fill = triangle_offsets;
+			for (size_t i = 0; i < indices.size(); ++i)
+			{
+				triangle_list[fill[indices[i]]++] = (unsigned int)(i / 3);
+			}
+
+			// Every edge is considered in its cheapest valid direction
+			std::vector<Collapse> collapses;
+			collapses.reserve(indices.size());
+			for (size_t t = 0; t < triangle_count; ++t)
+			{
+				for (int e = 0; e < 3; ++e)
+				{
+					unsigned int a = indices[t * 3 + e];
+					unsigned int b = indices[t * 3 + (e + 1) % 3];
+					// Each interior edge is seen from both triangles, only use it once
+					if (a > b)
+						continue;
+					bool a_to_b = this->CanCollapse(a, b);
+					bool b_to_a = this->CanCollapse(b, a);
+					if (!a_to_b && !b_to_a)
+						continue;
+					double cost_a_to_b = a_to_b ? this->CollapseCost(a, b) : DBL_MAX;
+					double cost_b_to_a = b_to_a ? this->CollapseCost(b, a) : DBL_MAX;
+					if (cost_a_to_b <= cost_b_to_a)
+						collapses.push_back({ a, b, cost_a_to_b });
+					else
+						collapses.push_back({ b, a, cost_b_to_a });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+			std::vector<unsigned int> remap(mInput.vertexCount);
+			for (unsigned int i = 0; i < mInput.vertexCount; ++i)
+			{
+				remap[i] = i;
+			}
+			// Vertices touched this pass, their neighbourhood has changed so the flip test would be stale
+			std::vector<bool> touched(mInput.vertexCount, false);
+			size_t collapse_count = 0;
+			for (auto& collapse : collapses)
+			{
+				if (collapse_count >= maxCollapses)
+					break;
+				if (touched[collapse.from] || touched[collapse.to])
+					continue;
+				if (this->CollapseFlipsTriangle(collapse.from, collapse.to, indices, triangle_offsets, triangle_list))
+					continue;
+
+				remap[collapse.from] = collapse.to;
+				::AddQuadric(&mQuadrics[collapse.to], mQuadrics[collapse.from]);
+				mMaxError = std::max(mMaxError, collapse.cost);
+				// Lock the one ring of the removed vertex for the rest of the pass
+				for (unsigned int t = triangle_offsets[collapse.from]; t < triangle_offsets[collapse.from + 1]; ++t)
+				{
+					const unsigned int* tri = &indices[triangle_list[t] * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+				}
+				collapse_count++;
+			}
+
+			// Rewrite the index list and drop the triangles that became degenerate
+			size_t write = 0;
+			for (size_t t = 0; t < triangle_count; ++t)
+			{
+				unsigned int a = remap[indices[t * 3]];
+				unsigned int b = remap[indices[t * 3 + 1]];
+				unsigned int c = remap[indices[t * 3 + 2]];
+				if (a == b || b == c || a == c)
+					continue;
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+			indices.resize(write);
+			return collapse_count;
+		}
+	};
+}
+
+void MeshSimplifier::BuildLodChain(const SimplifyInput& input,
+	unsigned int maxLevels,
+	std::vector<unsigned int>* pOutIndices,
+	std::vector<MeshLod>* pOutLods)
+{
+	pOutLods->clear();
+	pOutLods->push_back({ 0, input.indexCount, 0.0f });
+	if (!input.pPositions || !input.pIndices || input.indexCount < 3)
+		return;
+
+	::Simplifier simplifier(input);
+	std::vector<unsigned int> lod_indices = simplifier.GetWeldedIndices();
+	unsigned int next_offset = input.indexCount;
+
+	for (unsigned int level = 1; level < maxLevels; ++level)
+	{
+		size_t previous_count = lod_indices.size();
+		size_t target_triangles = (size_t)(previous_count / 3 * LOD_TRIANGLE_REDUCTION);
+		if (target_triangles == 0)
+			break;
+
+		double error = simplifier.Simplify(&lod_indices, target_triangles);
+		// Stop when the mesh is too constrained by locked vertices to be reduced any further
+		if (lod_indices.size() > previous_count * 0.9f || lod_indices.empty())
+			break;
+
+		pOutIndices->insert(pOutIndices->end(), lod_indices.begin(), lod_indices.end());
+		pOutLods->push_back({ next_offset, (unsigned int)lod_indices.size(), (float)std::sqrt(error) });
+		next_offset += (unsigned int)lod_indices.size();
+	}
+}
+
+unsigned int MeshSimplifier::SelectLod(const std::vector<MeshLod>& lods,
+	const DirectX::XMMATRIX& projection,
+	float viewportHeight,
+	float distance,
+	float worldScale,
+	float maxPixelError)
+{
+	if (lods.empty())
+		return 0;
+	// _22 converts view space height to clip space, w is the view distance for a perspective projection (_34 = 1)
+	// and 1 for an orthographic one (_34 = 0, _44 = 1), which keeps the size on screen the same at every distance
+	DirectX::XMFLOAT4X4 proj;
+	DirectX::XMStoreFloat4x4(&proj, projection);
+	const float w = std::fabs(proj._34) * distance + proj._44;
+	float pixels_per_unit = proj._22 * viewportHeight * 0.5f / std::max(w, 1e-4f);
+
+	unsigned int selected = 0;
+	for (unsigned int i = 1; i < (unsigned int)lods.size(); ++i)
+	{
+		if (lods[i].error * worldScale * pixels_per_unit > maxPixelError)
+			break;
+		selected = i;
+	}
+	return selected;
+}
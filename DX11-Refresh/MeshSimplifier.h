@@ -0,0 +1,55 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#define LOD_MAX_LEVELS 5
+#define LOD_TRIANGLE_REDUCTION 0.5f
+
+namespace MeshSimplifier
+{
+	// One level of detail inside a mesh index buffer.
+	// LOD 0 is the original index list, the following levels are appended after it.
+	struct MeshLod
+	{
+		unsigned int indexOffset;
+		unsigned int indexCount;
+		float error; // Geometric error in object space units, 0 for the original mesh
+	};
+
+	// Input for the simplifier. Any of the attribute pointers except pPositions may be nullptr.
+	struct SimplifyInput
+	{
+		const void* pPositions = nullptr;
+		unsigned int positionStride = 0;
+		const void* pNormals = nullptr;
+		unsigned int normalStride = 0;
+		const void* pUVs = nullptr;
+		unsigned int uvStride = 0;
+		// Vertices with different groups (for example the dominant joint of a skinned vertex)
+		// are never collapsed into each other and the vertices between groups are kept
+		const unsigned int* pVertexGroups = nullptr;
+		unsigned int vertexCount = 0;
+		const unsigned int* pIndices = nullptr;
+		unsigned int indexCount = 0;
+	};
+
+	// Builds a chain of simplified index lists with quadric error metric edge collapses.
+	// Every level targets LOD_TRIANGLE_REDUCTION of the triangles of the previous one, vertices on UV seams,
+	// open borders and vertex group boundaries are locked. The vertex buffer is shared by all levels.
+	// pOutIndices receives the indices of LOD 1 and up, their offsets start at input.indexCount so they can be
+	// appended directly after the original indices. pOutLods receives LOD 0 followed by every generated level.
+	void BuildLodChain(const SimplifyInput& input,
+		unsigned int maxLevels,
+		std::vector<unsigned int>* pOutIndices,
+		std::vector<MeshLod>* pOutLods);
+
+	// Picks the coarsest level whose error, projected to the screen, stays below maxPixelError.
+	// projection is the camera projection matrix (Camera::GetProjectionMatrix), perspective or orthographic,
+	// distance is the view distance to the mesh and worldScale the uniform scale of the mesh world matrix.
+	unsigned int SelectLod(const std::vector<MeshLod>& lods,
+		const DirectX::XMMATRIX& projection,
+		float viewportHeight,
+		float distance,
+		float worldScale,
+		float maxPixelError);
+}
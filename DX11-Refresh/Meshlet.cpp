@@ -0,0 +1,191 @@
+#include "Meshlet.h"
+#include <algorithm>
+#include <cmath>
+
+// Anonymous namespace for Meshlet
+namespace {
+	DirectX::XMVECTOR LoadPosition(const unsigned char* pPositions, unsigned int positionStride, unsigned int index)
+	{
+		return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(pPositions + (size_t)index * positionStride));
+	}
+
+	// Returns how many vertices of the triangle are not yet part of the meshlet tagged with tag
+	unsigned int CountNewVertices(const unsigned int* pTriangle, const std::vector<unsigned int>& vertexTag, unsigned int tag)
+	{
+		unsigned int a = pTriangle[0], b = pTriangle[1], c = pTriangle[2];
+		return (vertexTag[a] != tag) +
+			(vertexTag[b] != tag && b != a) +
+			(vertexTag[c] != tag && c != a && c != b);
+	}
+
+	// Calculates the bounding sphere and normal cone for the triangles of a finished meshlet
+	void FinalizeMeshlet(const unsigned char* pPositions, unsigned int positionStride, const unsigned int* pIndices, Meshlets::Meshlet* pMeshlet)
+	{
+		const unsigned int* p_first = pIndices + pMeshlet->indexOffset;
+
+		// Bounding sphere, centered in the middle of the AABB
+		DirectX::XMVECTOR min_pos = LoadPosition(pPositions, positionStride, p_first[0]);
+		DirectX::XMVECTOR max_pos = min_pos;
+		for (unsigned int i = 1; i < pMeshlet->indexCount; ++i)
+		{
+			DirectX::XMVECTOR pos = LoadPosition(pPositions, positionStride, p_first[i]);
+			min_pos = DirectX::XMVectorMin(min_pos, pos);
+			max_pos = DirectX::XMVectorMax(max_pos, pos);
+		}
+		DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(min_pos, max_pos), 0.5f);
+		float radius_sq = 0.0f;
+		for (unsigned int i = 0; i < pMeshlet->indexCount; ++i)
+		{
+			DirectX::XMVECTOR offset = DirectX::XMVectorSubtract(LoadPosition(pPositions, positionStride, p_first[i]), center);
+			radius_sq = std::max(radius_sq, DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(offset)));
+		}
+		DirectX::XMStoreFloat3(&pMeshlet->center, center);
+		pMeshlet->radius = std::sqrt(radius_sq);
+
+		// Normal cone, the axis is the average of the triangle normals
+		std::vector<DirectX::XMFLOAT3> normals;
+		normals.reserve(pMeshlet->indexCount / 3);
+		DirectX::XMVECTOR axis = DirectX::XMVectorZero();
+		for (unsigned int i = 0; i + 2 < pMeshlet->indexCount; i += 3)
+		{
+			DirectX::XMVECTOR a = LoadPosition(pPositions, positionStride, p_first[i]);
+			DirectX::XMVECTOR b = LoadPosition(pPositions, positionStride, p_first[i + 1]);
+			DirectX::XMVECTOR c = LoadPosition(pPositions, positionStride, p_first[i + 2]);
+			// Front faces are clockwise, which makes (b - a) x (c - a) point towards the viewer
+			DirectX::XMVECTOR normal = DirectX::XMVector3Cross(DirectX::XMVectorSubtract(b, a), DirectX::XMVectorSubtract(c, a));
+			// Skip degenerate triangles, they have no facing
+			if (DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(normal)) <= 1e-20f)
+				continue;
+			normal = DirectX::XMVector3Normalize(normal);
+			DirectX::XMFLOAT3 stored_normal;
+			DirectX::XMStoreFloat3(&stored_normal, normal);
+			normals.push_back(stored_normal);
+			axis = DirectX::XMVectorAdd(axis, normal);
+		}
+
+		pMeshlet->coneAxis = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+		pMeshlet->coneCutoff = 1.0f;
+		if (normals.empty() || DirectX::XMVectorGetX(DirectX::XMVector3LengthSq(axis)) <= 1e-12f)
+			return;
+
+		axis = DirectX::XMVector3Normalize(axis);
+		float min_dot = 1.0f;
+		for (auto& normal : normals)
+		{
+			min_dot = std::min(min_dot, DirectX::XMVectorGetX(DirectX::XMVector3Dot(DirectX::XMLoadFloat3(&normal), axis)));
+		}
+		DirectX::XMStoreFloat3(&pMeshlet->coneAxis, axis);
+		// A cone that spreads close to or past a hemisphere can never be fully backfacing
+		if (min_dot > 0.1f)
+		{
+			pMeshlet->coneCutoff = std::sqrt(1.0f - min_dot * min_dot);
+		}
+	}
+}
+
+void Meshlets::BuildMeshlets(const void* pPositions,
+	unsigned int positionStride,
+	unsigned int vertexCount,
+	const unsigned int* pIndices,
+	unsigned int indexCount,
+	std::vector<Meshlet>* pOutMeshlets)
+{
+	if (!pPositions || !pIndices || !pOutMeshlets || indexCount < 3)
+		return;
+
+	const unsigned char* p_positions = static_cast<const unsigned char*>(pPositions);
+	// Stores which meshlet (+1) last used a vertex, avoids clearing a set for every meshlet
+	std::vector<unsigned int> vertex_tag(vertexCount, 0);
+	unsigned int current_tag = 1;
+
+	Meshlet current = {};
+	pOutMeshlets->reserve(pOutMeshlets->size() + indexCount / (3 * MESHLET_MAX_TRIANGLES) + 1);
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		unsigned int new_vertices = ::CountNewVertices(&pIndices[i], vertex_tag, current_tag);
+
+		// Start a new meshlet if this triangle does not fit
+		if (current.vertexCount + new_vertices > MESHLET_MAX_VERTICES ||
+			current.indexCount / 3 + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			::FinalizeMeshlet(p_positions, positionStride, pIndices, &current);
+			pOutMeshlets->push_back(current);
+
+			current = {};
+			current.indexOffset = i;
+			current_tag++;
+			new_vertices = ::CountNewVertices(&pIndices[i], vertex_tag, current_tag);
+		}
+
+		for (unsigned int j = 0; j < 3; ++j)
+		{
+			vertex_tag[pIndices[i + j]] = current_tag;
+		}
+		current.vertexCount += new_vertices;
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+	{
+		::FinalizeMeshlet(p_positions, positionStride, pIndices, &current);
+		pOutMeshlets->push_back(current);
+	}
+}
+
+unsigned int Meshlets::CullMeshlets(const std::vector<Meshlet>& meshlets,
+	const DirectX::XMMATRIX& world,
+	const DirectX::XMFLOAT4* pFrustumPlanes,
+	const DirectX::XMVECTOR& cameraPosition,
+	std::vector<IndexRange>* pOutRanges)
+{
+	pOutRanges->clear();
+	unsigned int visible_triangles = 0;
+
+	DirectX::XMVECTOR planes[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		planes[i] = DirectX::XMLoadFloat4(&pFrustumPlanes[i]);
+	}
+	// World is assumed to only contain uniform scale, the length of the first row is the scale
+	float world_scale = DirectX::XMVectorGetX(DirectX::XMVector3Length(world.r[0]));
+
+	for (auto& meshlet : meshlets)
+	{
+		DirectX::XMVECTOR center = DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&meshlet.center), world);
+		float radius = meshlet.radius * world_scale;
+
+		bool visible = true;
+		for (int i = 0; i < 6 && visible; ++i)
+		{
+			float distance = DirectX::XMVectorGetX(DirectX::XMPlaneDotCoord(planes[i], center));
+			visible = distance >= -radius;
+		}
+
+		// Every triangle in the meshlet faces away from the camera if the view direction lies inside the cone
+		if (visible && meshlet.coneCutoff < 1.0f)
+		{
+			DirectX::XMVECTOR axis = DirectX::XMVector3Normalize(
+				DirectX::XMVector3TransformNormal(DirectX::XMLoadFloat3(&meshlet.coneAxis), world));
+			DirectX::XMVECTOR view = DirectX::XMVectorSubtract(center, cameraPosition);
+			float view_dot = DirectX::XMVectorGetX(DirectX::XMVector3Dot(view, axis));
+			float view_length = DirectX::XMVectorGetX(DirectX::XMVector3Length(view));
+			visible = view_dot < meshlet.coneCutoff * view_length + radius;
+		}
+
+		if (!visible)
+			continue;
+
+		visible_triangles += meshlet.indexCount / 3;
+		// Merge with the previous range if they are adjacent in the index buffer
+		if (!pOutRanges->empty() && pOutRanges->back().indexOffset + pOutRanges->back().indexCount == meshlet.indexOffset)
+		{
+			pOutRanges->back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			pOutRanges->push_back({ meshlet.indexOffset, meshlet.indexCount });
+		}
+	}
+	return visible_triangles;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+namespace Meshlets
+{
+	// A cluster of at most MESHLET_MAX_VERTICES unique vertices and MESHLET_MAX_TRIANGLES triangles.
+	// The triangles of a meshlet are contiguous in the mesh index buffer, starting at indexOffset.
+	struct Meshlet
+	{
+		DirectX::XMFLOAT3 center;	// Bounding sphere in object space
+		float radius;
+		DirectX::XMFLOAT3 coneAxis;	// Average facing direction of the triangles
+		float coneCutoff;			// sin of the cone spread, 1.0f means the cone can never be culled
+		unsigned int indexOffset;
+		unsigned int indexCount;
+		unsigned int vertexCount;
+	};
+
+	// A range of indices that can be submitted with a single DrawIndexed
+	struct IndexRange
+	{
+		unsigned int indexOffset;
+		unsigned int indexCount;
+	};
+
+	// Partitions an indexed triangle list into meshlets, in index buffer order.
+	// pPositions points to the first position, positionStride is the byte distance between two positions.
+	void BuildMeshlets(const void* pPositions,
+		unsigned int positionStride,
+		unsigned int vertexCount,
+		const unsigned int* pIndices,
+		unsigned int indexCount,
+		std::vector<Meshlet>* pOutMeshlets);
+
+	// Tests every meshlet against the frustum planes (see Camera::GetFrustumPlanes) and the camera position
+	// for backface cone culling.
+	// world is the object to world matrix of the mesh, it is assumed to only contain uniform scale.
+	// Visible meshlets that are adjacent in the index buffer are merged into a single range.
+	// Returns the number of visible triangles.
+	unsigned int CullMeshlets(const std::vector<Meshlet>& meshlets,
+		const DirectX::XMMATRIX& world,
+		const DirectX::XMFLOAT4* pFrustumPlanes,
+		const DirectX::XMVECTOR& cameraPosition,
+		std::vector<IndexRange>* pOutRanges);
+}
@@ -0,0 +1,392 @@
+#include "Occlusion.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+// Anonymous namespace for OcclusionBuffer
+namespace {
+	const unsigned int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_SIZE;
+	const unsigned int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_SIZE;
+	const unsigned int HIZ_WIDTH = OCCLUSION_WIDTH / OCCLUSION_HIZ_BLOCK_SIZE;
+	const unsigned int HIZ_HEIGHT = OCCLUSION_HEIGHT / OCCLUSION_HIZ_BLOCK_SIZE;
+	// A triangle clipped against five planes has at most eight corners
+	const unsigned int MAX_CLIPPED_VERTICES = 8;
+
+	// The clip space half spaces a visible point is in: left, right, bottom, top and near
+	const DirectX::XMFLOAT4 CLIP_PLANES[5] = {
+		DirectX::XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f),
+		DirectX::XMFLOAT4(-1.0f, 0.0f, 0.0f, 1.0f),
+		DirectX::XMFLOAT4(0.0f, 1.0f, 0.0f, 1.0f),
+		DirectX::XMFLOAT4(0.0f, -1.0f, 0.0f, 1.0f),
+		DirectX::XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f)
+	};
+
+	float Distance(const DirectX::XMFLOAT4& plane, const DirectX::XMFLOAT4& v)
+	{
+		return plane.x * v.x + plane.y * v.y + plane.z * v.z + plane.w * v.w;
+	}
+
+	// Keeps the part of the polygon on the positive side of the plane
+	unsigned int ClipPolygon(const DirectX::XMFLOAT4* pIn, unsigned int count, const DirectX::XMFLOAT4& plane, DirectX::XMFLOAT4* pOut)
+	{
+		unsigned int out_count = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			const DirectX::XMFLOAT4& a = pIn[i];
+			const DirectX::XMFLOAT4& b = pIn[(i + 1) % count];
+			float distance_a = ::Distance(plane, a);
+			float distance_b = ::Distance(plane, b);
+			if (distance_a >= 0.0f)
+				pOut[out_count++] = a;
+			if ((distance_a >= 0.0f) != (distance_b >= 0.0f))
+			{
+				float t = distance_a / (distance_a - distance_b);
+				pOut[out_count++] = DirectX::XMFLOAT4(a.x + (b.x - a.x) * t,
+					a.y + (b.y - a.y) * t,
+					a.z + (b.z - a.z) * t,
+					a.w + (b.w - a.w) * t);
+			}
+		}
+		return out_count;
+	}
+
+	DirectX::XMVECTOR Load(const float* pValues)
+	{
+		return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(pValues));
+	}
+
+	float Milliseconds(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	this->mDepth.resize(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+	this->mHiZ.resize(HIZ_WIDTH * HIZ_HEIGHT, 1.0f);
+	this->mBins.resize(TILES_X * TILES_Y);
+	DirectX::XMStoreFloat4x4(&this->mViewProj, DirectX::XMMatrixIdentity());
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+
+}
+
+void OcclusionBuffer::BeginFrame(const DirectX::XMMATRIX& viewProj)
+{
+	DirectX::XMStoreFloat4x4(&this->mViewProj, viewProj);
+	std::fill(this->mDepth.begin(), this->mDepth.end(), 1.0f);
+	std::fill(this->mHiZ.begin(), this->mHiZ.end(), 1.0f);
+	this->mTriangles.clear();
+	for (auto& bin : this->mBins)
+	{
+		bin.clear();
+	}
+	this->mStats = {};
+}
+
+void OcclusionBuffer::AddOccluder(const void* pPositions,
+	unsigned int positionStride,
+	const uint32_t* pIndices,
+	unsigned int indexCount,
+	const DirectX::XMMATRIX& world)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	const DirectX::XMMATRIX world_view_proj = DirectX::XMMatrixMultiply(world, DirectX::XMLoadFloat4x4(&this->mViewProj));
+	const unsigned char* p_bytes = static_cast<const unsigned char*>(pPositions);
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		DirectX::XMFLOAT4 clip[3];
+		for (int v = 0; v < 3; ++v)
+		{
+			const DirectX::XMFLOAT3* p_position = reinterpret_cast<const DirectX::XMFLOAT3*>(p_bytes + pIndices[i + v] * positionStride);
+			DirectX::XMStoreFloat4(&clip[v], DirectX::XMVector3Transform(DirectX::XMLoadFloat3(p_position), world_view_proj));
+		}
+		this->AddClipTriangle(clip);
+	}
+	this->mStats.setupMilliseconds += ::Milliseconds(start);
+}
+
+void OcclusionBuffer::AddOccluderBox(const Bounds::AABB& box, const DirectX::XMMATRIX& world)
+{
+	// Corner i takes max on x if bit 0 is set, on y for bit 1 and on z for bit 2
+	DirectX::XMFLOAT3 corners[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		corners[i] = DirectX::XMFLOAT3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+	}
+	const uint32_t indices[36] = {
+		0, 2, 3, 0, 3, 1,		// -z
+		4, 5, 7, 4, 7, 6,		// +z
+		0, 4, 6, 0, 6, 2,		// -x
+		1, 3, 7, 1, 7, 5,		// +x
+		0, 1, 5, 0, 5, 4,		// -y
+		2, 6, 7, 2, 7, 3		// +y
+	};
+	this->AddOccluder(corners, sizeof(DirectX::XMFLOAT3), indices, 36, world);
+}
+
+void OcclusionBuffer::Rasterize(unsigned int threadCount)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	// The tiles do not share pixels, so the jobs need no other synchronization
+	const unsigned int tile_count = TILES_X * TILES_Y;
+	auto rasterize_tiles = [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int tile = begin; tile < end; ++tile)
+		{
+			this->RasterizeTile(tile);
+		}
+	};
+	if (threadCount == 1)
+		rasterize_tiles(0, tile_count);
+	else
+		JobSystem::ParallelFor(tile_count, 1, rasterize_tiles);
+	this->mStats.rasterizeMilliseconds += ::Milliseconds(start);
+}
+
+bool OcclusionBuffer::IsVisible(const Bounds::AABB& worldBox) const
+{
+	const DirectX::XMMATRIX view_proj = DirectX::XMLoadFloat4x4(&this->mViewProj);
+	float min_x = FLT_MAX;
+	float min_y = FLT_MAX;
+	float max_x = -FLT_MAX;
+	float max_y = -FLT_MAX;
+	float min_z = FLT_MAX;
+	for (int i = 0; i < 8; ++i)
+	{
+		DirectX::XMVECTOR corner = DirectX::XMVectorSet(i & 1 ? worldBox.max.x : worldBox.min.x,
+			i & 2 ? worldBox.max.y : worldBox.min.y,
+			i & 4 ? worldBox.max.z : worldBox.min.z,
+			1.0f);
+		DirectX::XMFLOAT4 clip;
+		DirectX::XMStoreFloat4(&clip, DirectX::XMVector4Transform(corner, view_proj));
+		// The projection of a box that crosses the near plane is unbounded
+		if (clip.z < 0.0f)
+			return true;
+		float inverse_w = 1.0f / clip.w;
+		float x = (clip.x * inverse_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (0.5f - clip.y * inverse_w * 0.5f) * OCCLUSION_HEIGHT;
+		min_x = (std::min)(min_x, x);
+		max_x = (std::max)(max_x, x);
+		min_y = (std::min)(min_y, y);
+		max_y = (std::max)(max_y, y);
+		min_z = (std::min)(min_z, clip.z * inverse_w);
+	}
+
+	// Every pixel the box touches, not only the ones whose center it covers
+	const int pixel_x0 = (std::max)((int)floorf(min_x), 0);
+	const int pixel_y0 = (std::max)((int)floorf(min_y), 0);
+	const int pixel_x1 = (std::min)((int)ceilf(max_x), OCCLUSION_WIDTH);
+	const int pixel_y1 = (std::min)((int)ceilf(max_y), OCCLUSION_HEIGHT);
+	if (pixel_x0 >= pixel_x1 || pixel_y0 >= pixel_y1)
+		return false;
+
+	for (int block_y = pixel_y0 / OCCLUSION_HIZ_BLOCK_SIZE; block_y * OCCLUSION_HIZ_BLOCK_SIZE < pixel_y1; ++block_y)
+	{
+		for (int block_x = pixel_x0 / OCCLUSION_HIZ_BLOCK_SIZE; block_x * OCCLUSION_HIZ_BLOCK_SIZE < pixel_x1; ++block_x)
+		{
+			// The whole block is nearer than the box
+			if (min_z > this->mHiZ[block_y * HIZ_WIDTH + block_x])
+				continue;
+
+			const int y0 = (std::max)(pixel_y0, block_y * OCCLUSION_HIZ_BLOCK_SIZE);
+			const int y1 = (std::min)(pixel_y1, (block_y + 1) * OCCLUSION_HIZ_BLOCK_SIZE);
+			const int x0 = (std::max)(pixel_x0, block_x * OCCLUSION_HIZ_BLOCK_SIZE);
+			const int x1 = (std::min)(pixel_x1, (block_x + 1) * OCCLUSION_HIZ_BLOCK_SIZE);
+			for (int y = y0; y < y1; ++y)
+			{
+				const float* p_row = &this->mDepth[y * OCCLUSION_WIDTH];
+				for (int x = x0; x < x1; ++x)
+				{
+					if (p_row[x] >= min_z)
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+unsigned int OcclusionBuffer::CullAABBs(const Bounds::AABB* pWorldBoxes, const uint32_t* pIndices, unsigned int indexCount, uint32_t* pOutVisible)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int visible_count = 0;
+	for (unsigned int i = 0; i < indexCount; ++i)
+	{
+		uint32_t index = pIndices[i];
+		if (this->IsVisible(pWorldBoxes[index]))
+			pOutVisible[visible_count++] = index;
+	}
+	this->mStats.testedObjects += indexCount;
+	this->mStats.occludedObjects += indexCount - visible_count;
+	this->mStats.testMilliseconds += ::Milliseconds(start);
+	return visible_count;
+}
+
+const OcclusionStats& OcclusionBuffer::GetStats() const
+{
+	return this->mStats;
+}
+
+const float* OcclusionBuffer::GetDepth() const
+{
+	return this->mDepth.data();
+}
+
+void OcclusionBuffer::AddClipTriangle(const DirectX::XMFLOAT4* pClip)
+{
+	DirectX::XMFLOAT4 polygon[2][MAX_CLIPPED_VERTICES + 1];
+	unsigned int count = 3;
+	std::copy(pClip, pClip + 3, polygon[0]);
+	int current = 0;
+	for (const auto& plane : CLIP_PLANES)
+	{
+		count = ::ClipPolygon(polygon[current], count, plane, polygon[1 - current]);
+		current = 1 - current;
+		if (count < 3)
+			return;
+	}
+
+	// Project to pixels, the near plane clip keeps w positive
+	float x[MAX_CLIPPED_VERTICES + 1];
+	float y[MAX_CLIPPED_VERTICES + 1];
+	float z[MAX_CLIPPED_VERTICES + 1];
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const DirectX::XMFLOAT4& v = polygon[current][i];
+		float inverse_w = 1.0f / v.w;
+		x[i] = (v.x * inverse_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		y[i] = (0.5f - v.y * inverse_w * 0.5f) * OCCLUSION_HEIGHT;
+		z[i] = v.z * inverse_w;
+	}
+
+	// The clipped polygon is convex, fan it out from the first corner
+	for (unsigned int i = 1; i + 1 < count; ++i)
+	{
+		unsigned int corners[3] = { 0, i, i + 1 };
+		float area = (x[corners[1]] - x[0]) * (y[corners[2]] - y[0]) - (x[corners[2]] - x[0]) * (y[corners[1]] - y[0]);
+		if (fabsf(area) < 1e-6f)
+			continue;
+		if (area < 0.0f)
+			std::swap(corners[1], corners[2]);
+
+		Triangle triangle;
+		for (int c = 0; c < 3; ++c)
+		{
+			triangle.x[c] = x[corners[c]];
+			triangle.y[c] = y[corners[c]];
+			triangle.z[c] = z[corners[c]];
+		}
+		const uint32_t triangle_index = (uint32_t)this->mTriangles.size();
+		this->mTriangles.push_back(triangle);
+		this->mStats.occluderTriangles++;
+
+		// Every tile the bounding rectangle touches
+		float min_x = (std::min)((std::min)(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float max_x = (std::max)((std::max)(triangle.x[0], triangle.x[1]), triangle.x[2]);
+		float min_y = (std::min)((std::min)(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		float max_y = (std::max)((std::max)(triangle.y[0], triangle.y[1]), triangle.y[2]);
+		unsigned int tile_x0 = (unsigned int)(std::max)(min_x, 0.0f) / OCCLUSION_TILE_SIZE;
+		unsigned int tile_y0 = (unsigned int)(std::max)(min_y, 0.0f) / OCCLUSION_TILE_SIZE;
+		unsigned int tile_x1 = (std::min)((unsigned int)(std::max)(max_x, 0.0f) / OCCLUSION_TILE_SIZE, TILES_X - 1);
+		unsigned int tile_y1 = (std::min)((unsigned int)(std::max)(max_y, 0.0f) / OCCLUSION_TILE_SIZE, TILES_Y - 1);
+		for (unsigned int tile_y = tile_y0; tile_y <= tile_y1; ++tile_y)
+		{
+			for (unsigned int tile_x = tile_x0; tile_x <= tile_x1; ++tile_x)
+			{
+				this->mBins[tile_y * TILES_X + tile_x].push_back(triangle_index);
+				this->mStats.binnedTriangles++;
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::RasterizeTile(unsigned int tile)
+{
+	const int tile_x0 = (int)(tile % TILES_X) * OCCLUSION_TILE_SIZE;
+	const int tile_y0 = (int)(tile / TILES_X) * OCCLUSION_TILE_SIZE;
+	const int tile_x1 = tile_x0 + OCCLUSION_TILE_SIZE;
+	const int tile_y1 = tile_y0 + OCCLUSION_TILE_SIZE;
+	const DirectX::XMVECTOR lane_offsets = DirectX::XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const DirectX::XMVECTOR zero = DirectX::XMVectorZero();
+
+	for (uint32_t triangle_index : this->mBins[tile])
+	{
+		const Triangle& triangle = this->mTriangles[triangle_index];
+		const float* x = triangle.x;
+		const float* y = triangle.y;
+		const float* z = triangle.z;
+
+		// Edge e is a * px + b * py + c, positive on the inner side
+		DirectX::XMVECTOR edge_a[3];
+		float edge_b[3];
+		float edge_c[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			int next = (e + 1) % 3;
+			edge_a[e] = DirectX::XMVectorReplicate(y[e] - y[next]);
+			edge_b[e] = x[next] - x[e];
+			edge_c[e] = x[e] * y[next] - x[next] * y[e];
+		}
+		// Depth is linear in screen space
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		float dz_dx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+		float dz_dy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+		const DirectX::XMVECTOR z_step = DirectX::XMVectorReplicate(dz_dx);
+
+		// Start on a multiple of four so every row is covered by whole vectors
+		const int min_x = (std::max)((int)floorf((std::min)((std::min)(x[0], x[1]), x[2])), tile_x0) & ~3;
+		const int max_x = (std::min)((int)ceilf((std::max)((std::max)(x[0], x[1]), x[2])), tile_x1);
+		const int min_y = (std::max)((int)floorf((std::min)((std::min)(y[0], y[1]), y[2])), tile_y0);
+		const int max_y = (std::min)((int)ceilf((std::max)((std::max)(y[0], y[1]), y[2])), tile_y1);
+		for (int row = min_y; row < max_y; ++row)
+		{
+			const float pixel_y = row + 0.5f;
+			DirectX::XMVECTOR row_edges[3];
+			for (int e = 0; e < 3; ++e)
+			{
+				row_edges[e] = DirectX::XMVectorReplicate(edge_b[e] * pixel_y + edge_c[e]);
+			}
+			const DirectX::XMVECTOR row_z = DirectX::XMVectorReplicate(z[0] + dz_dy * (pixel_y - y[0]) - dz_dx * x[0]);
+			float* p_row = &this->mDepth[row * OCCLUSION_WIDTH];
+			for (int column = min_x; column < max_x; column += 4)
+			{
+				DirectX::XMVECTOR pixel_x = DirectX::XMVectorAdd(DirectX::XMVectorReplicate((float)column), lane_offsets);
+				DirectX::XMVECTOR inside = DirectX::XMVectorGreaterOrEqual(DirectX::XMVectorMultiplyAdd(pixel_x, edge_a[0], row_edges[0]), zero);
+				inside = DirectX::XMVectorAndInt(inside,
+					DirectX::XMVectorGreaterOrEqual(DirectX::XMVectorMultiplyAdd(pixel_x, edge_a[1], row_edges[1]), zero));
+				inside = DirectX::XMVectorAndInt(inside,
+					DirectX::XMVectorGreaterOrEqual(DirectX::XMVectorMultiplyAdd(pixel_x, edge_a[2], row_edges[2]), zero));
+
+				DirectX::XMVECTOR depth = ::Load(p_row + column);
+				DirectX::XMVECTOR nearest = DirectX::XMVectorMin(depth, DirectX::XMVectorMultiplyAdd(pixel_x, z_step, row_z));
+				DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(p_row + column), DirectX::XMVectorSelect(depth, nearest, inside));
+			}
+		}
+	}
+
+	// Farthest depth of every block of the tile
+	for (int block_y = tile_y0; block_y < tile_y1; block_y += OCCLUSION_HIZ_BLOCK_SIZE)
+	{
+		for (int block_x = tile_x0; block_x < tile_x1; block_x += OCCLUSION_HIZ_BLOCK_SIZE)
+		{
+			DirectX::XMVECTOR farthest = zero;
+			for (int row = block_y; row < block_y + OCCLUSION_HIZ_BLOCK_SIZE; ++row)
+			{
+				for (int column = block_x; column < block_x + OCCLUSION_HIZ_BLOCK_SIZE; column += 4)
+				{
+					farthest = DirectX::XMVectorMax(farthest, ::Load(&this->mDepth[row * OCCLUSION_WIDTH + column]));
+				}
+			}
+			DirectX::XMFLOAT4 lanes;
+			DirectX::XMStoreFloat4(&lanes, farthest);
+			this->mHiZ[(block_y / OCCLUSION_HIZ_BLOCK_SIZE) * HIZ_WIDTH + block_x / OCCLUSION_HIZ_BLOCK_SIZE] =
+				(std::max)((std::max)(lanes.x, lanes.y), (std::max)(lanes.z, lanes.w));
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "Bounds.h"
+
+// Resolution of the software depth buffer, both multiples of OCCLUSION_TILE_SIZE
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+// Triangles are binned into square tiles of this many pixels, every tile is rasterized by one thread
+#define OCCLUSION_TILE_SIZE 32
+// Pixels per side of the blocks the hierarchical level keeps the farthest depth of
+#define OCCLUSION_HIZ_BLOCK_SIZE 8
+
+struct OcclusionStats
+{
+	unsigned int occluderTriangles;		// After clipping
+	unsigned int binnedTriangles;		// A triangle counts once per tile it touches
+	unsigned int testedObjects;			// Through CullAABBs
+	unsigned int occludedObjects;
+	float setupMilliseconds;			// Transforming, clipping and binning the occluders
+	float rasterizeMilliseconds;
+	float testMilliseconds;
+};
+
+// Software occlusion culling on the CPU.
+// Selected occluders are rasterized into a small depth buffer every frame, then the screen space bounds of other
+// objects are tested against it. Depth is D3D clip space z / w, 0 at the near plane, and every pixel keeps the
+// nearest occluder depth at its center. The buffer also keeps the farthest depth of every OCCLUSION_HIZ_BLOCK_SIZE
+// block so most tests only read a few values.
+// Occluders are added from one thread, Rasterize spreads the tiles over the job system and the tests only read the buffer.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+	~OcclusionBuffer();
+
+	// Clears the depth, the occluders and the stats of the last frame
+	void BeginFrame(const DirectX::XMMATRIX& viewProj);
+
+	// Adds an indexed triangle list, both sides are rasterized so the winding does not matter.
+	// pPositions points to the first position, positionStride is the byte distance between two positions.
+	void AddOccluder(const void* pPositions,
+		unsigned int positionStride,
+		const uint32_t* pIndices,
+		unsigned int indexCount,
+		const DirectX::XMMATRIX& world);
+	// Adds the 12 triangles of box transformed by world
+	void AddOccluderBox(const Bounds::AABB& box, const DirectX::XMMATRIX& world);
+
+	// Rasterizes the added occluders, one JobSystem job per tile. threadCount 1 rasterizes on the calling thread only.
+	void Rasterize(unsigned int threadCount = 0);
+
+	// Returns false if the world space box is hidden behind the occluders or off screen.
+	// Boxes that cross the near plane are always visible.
+	bool IsVisible(const Bounds::AABB& worldBox) const;
+	// Writes the indices in pIndices whose box in pWorldBoxes is visible to pOutVisible and returns how many there are.
+	// pOutVisible may be pIndices. Counts towards the stats.
+	unsigned int CullAABBs(const Bounds::AABB* pWorldBoxes, const uint32_t* pIndices, unsigned int indexCount, uint32_t* pOutVisible);
+
+	const OcclusionStats& GetStats() const;
+	// OCCLUSION_WIDTH * OCCLUSION_HEIGHT depths, rows from the top of the screen down
+	const float* GetDepth() const;
+
+private:
+	// Screen space in pixels, counter clockwise on screen after binning
+	struct Triangle
+	{
+		float x[3];
+		float y[3];
+		float z[3];
+	};
+
+	DirectX::XMFLOAT4X4 mViewProj;
+	std::vector<float> mDepth;
+	// Farthest depth of every block, row major
+	std::vector<float> mHiZ;
+	std::vector<Triangle> mTriangles;
+	// Indices into mTriangles, one list per tile
+	std::vector<std::vector<uint32_t>> mBins;
+	OcclusionStats mStats = {};
+
+	// Clips a clip space triangle against the screen and the near plane and bins the pieces
+	void AddClipTriangle(const DirectX::XMFLOAT4* pClip);
+	void RasterizeTile(unsigned int tile);
+};
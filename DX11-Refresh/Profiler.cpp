@@ -0,0 +1,224 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct ZoneEvent
+	{
+		const char* name;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	struct ThreadRing
+	{
+		ZoneEvent events[PROFILER_RING_SIZE];
+		// Zones recorded so far, only written by the owning thread
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<const char*> name{ nullptr };
+		unsigned int threadId = 0;
+	};
+
+	std::mutex gRingMutex;
+	// Rings outlive their threads, so a dump still has what finished threads recorded
+	std::vector<std::unique_ptr<ThreadRing>> gRings;
+	thread_local ThreadRing* tRing = nullptr;
+
+	// A tick count and a steady_clock time read together, the tick rate is measured from here
+	struct ClockOrigin
+	{
+		uint64_t ticks;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	const ClockOrigin& GetClockOrigin()
+	{
+		static const ClockOrigin origin = { Profiler::Now(), std::chrono::steady_clock::now() };
+		return origin;
+	}
+
+	ThreadRing* GetRing()
+	{
+		if (tRing == nullptr)
+		{
+			::GetClockOrigin();
+			std::unique_ptr<ThreadRing> ring(new ThreadRing());
+			std::lock_guard<std::mutex> lock(gRingMutex);
+			ring->threadId = (unsigned int)gRings.size();
+			tRing = ring.get();
+			gRings.push_back(std::move(ring));
+		}
+		return tRing;
+	}
+
+	// Copies the zones the rings hold, one vector per ring. The oldest zones can be overwritten while they are copied,
+	// those are left out
+	void CopyZones(std::vector<ThreadRing*>* pRings, std::vector<std::vector<ZoneEvent>>* pThreadEvents)
+	{
+		{
+			std::lock_guard<std::mutex> lock(gRingMutex);
+			for (auto& ring : gRings)
+			{
+				pRings->push_back(ring.get());
+			}
+		}
+
+		pThreadEvents->resize(pRings->size());
+		for (size_t i = 0; i < pRings->size(); ++i)
+		{
+			const ThreadRing* p_ring = (*pRings)[i];
+			const uint64_t count = p_ring->count.load(std::memory_order_acquire);
+			const uint64_t first = count > PROFILER_RING_SIZE ? count - PROFILER_RING_SIZE : 0;
+			std::vector<ZoneEvent>& events = (*pThreadEvents)[i];
+			for (uint64_t index = first; index < count; ++index)
+			{
+				events.push_back(p_ring->events[index & (PROFILER_RING_SIZE - 1)]);
+			}
+			// The thread may have moved on meanwhile, the zone it writes now replaces the one PROFILER_RING_SIZE before it
+			const uint64_t count_after = p_ring->count.load(std::memory_order_acquire);
+			if (count_after + 1 > first + PROFILER_RING_SIZE)
+			{
+				const uint64_t overwritten = (std::min)((uint64_t)events.size(), count_after + 1 - PROFILER_RING_SIZE - first);
+				events.erase(events.begin(), events.begin() + (size_t)overwritten);
+			}
+		}
+	}
+
+	void WriteString(std::ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* p = text; *p; ++p)
+		{
+			if (*p == '"' || *p == '\\')
+				file << '\\';
+			file << *p;
+		}
+		file << '"';
+	}
+}
+
+void Profiler::Record(const char* name, uint64_t begin, uint64_t end)
+{
+	ThreadRing* p_ring = ::GetRing();
+	const uint64_t index = p_ring->count.load(std::memory_order_relaxed);
+	ZoneEvent& event = p_ring->events[index & (PROFILER_RING_SIZE - 1)];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	p_ring->count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	::GetRing()->name.store(name, std::memory_order_release);
+}
+
+double Profiler::GetTicksPerSecond()
+{
+#if PROFILER_USE_TSC
+	const ClockOrigin& origin = ::GetClockOrigin();
+	// The longer the interval, the better the rate, a few milliseconds already get it within a fraction of a percent
+	if (std::chrono::steady_clock::now() - origin.time < std::chrono::milliseconds(10))
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	const uint64_t ticks = Profiler::Now();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin.time).count();
+	return (double)(ticks - origin.ticks) / seconds;
+#else
+	return 1e9;
+#endif
+}
+
+bool Profiler::WriteChromeTrace(const char* filepath)
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+
+	// Copy the zones first, the oldest ones can be overwritten while they are copied
+	std::vector<ThreadRing*> rings;
+	std::vector<std::vector<ZoneEvent>> thread_events;
+	::CopyZones(&rings, &thread_events);
+	uint64_t first_tick = UINT64_MAX;
+	for (auto& events : thread_events)
+	{
+		for (auto& event : events)
+		{
+			first_tick = (std::min)(first_tick, event.begin);
+		}
+	}
+
+	// Complete events ("ph":"X") in microseconds from the first zone, plus the thread names as metadata
+	const double microseconds_per_tick = 1e6 / Profiler::GetTicksPerSecond();
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[";
+	bool first_event = true;
+	for (size_t i = 0; i < rings.size(); ++i)
+	{
+		const unsigned int tid = rings[i]->threadId;
+		const char* name = rings[i]->name.load(std::memory_order_acquire);
+		if (name)
+		{
+			file << (first_event ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid << ",\"args\":{\"name\":";
+			::WriteString(file, name);
+			file << "}}";
+			first_event = false;
+		}
+		for (auto& event : thread_events[i])
+		{
+			file << (first_event ? "\n" : ",\n") << "{\"name\":";
+			::WriteString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+				<< ",\"ts\":" << (double)(event.begin - first_tick) * microseconds_per_tick
+				<< ",\"dur\":" << (double)(event.end - event.begin) * microseconds_per_tick << "}";
+			first_event = false;
+		}
+	}
+	file << "\n]}\n";
+	return file.good();
+}
+
+void Profiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(gRingMutex);
+	for (auto& ring : gRings)
+	{
+		ring->count.store(0, std::memory_order_release);
+	}
+}
+
+void Profiler::SummarizeZones(std::vector<ZoneSummary>* pOutSummaries)
+{
+	std::vector<ThreadRing*> rings;
+	std::vector<std::vector<ZoneEvent>> thread_events;
+	::CopyZones(&rings, &thread_events);
+
+	// Few distinct names, a linear search is fine. The same literal can have a different address in every module
+	const double seconds_per_tick = 1.0 / Profiler::GetTicksPerSecond();
+	pOutSummaries->clear();
+	for (auto& events : thread_events)
+	{
+		for (auto& event : events)
+		{
+			auto summary = std::find_if(pOutSummaries->begin(), pOutSummaries->end(), [&](const ZoneSummary& s) { return strcmp(s.name, event.name) == 0; });
+			if (summary == pOutSummaries->end())
+			{
+				pOutSummaries->push_back({ event.name, 0, 0.0, 0.0 });
+				summary = pOutSummaries->end() - 1;
+			}
+			const double seconds = (double)(event.end - event.begin) * seconds_per_tick;
+			summary->count++;
+			summary->totalSeconds += seconds;
+			summary->maxSeconds = (std::max)(summary->maxSeconds, seconds);
+		}
+	}
+	std::sort(pOutSummaries->begin(), pOutSummaries->end(), [](const ZoneSummary& a, const ZoneSummary& b) { return a.totalSeconds > b.totalSeconds; });
+}
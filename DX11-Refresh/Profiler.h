@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define PROFILER_USE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_USE_TSC 1
+#else
+#include <chrono>
+#define PROFILER_USE_TSC 0
+#endif
+
+// Zones are recorded unless PROFILER_ENABLED is 0, which is the default for release builds (NDEBUG)
+#ifndef PROFILER_ENABLED
+#ifdef NDEBUG
+#define PROFILER_ENABLED 0
+#else
+#define PROFILER_ENABLED 1
+#endif
+#endif
+// Zones kept per thread, a power of two. Once a thread has recorded more, its oldest zones are overwritten
+#define PROFILER_RING_SIZE 65536
+
+// Scoped CPU zones for finding out where the time of a frame goes.
+// A zone reads the clock when it is constructed and again when it is destroyed, and then appends its name and the two
+// timestamps to the ring of the calling thread. Every thread writes only its own ring, so recording takes no lock.
+// Names are not copied, they have to be string literals. WriteChromeTrace saves what the rings hold in the Chrome
+// trace event format, to be opened with chrome://tracing or ui.perfetto.dev.
+// The clock is the TSC on x86 and std::chrono::steady_clock elsewhere, the TSC is converted to seconds with a rate
+// measured against steady_clock.
+namespace Profiler
+{
+	// Clock ticks, only meaningful as differences
+	inline uint64_t Now()
+	{
+#if PROFILER_USE_TSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// Appends a finished zone to the ring of the calling thread
+	void Record(const char* name, uint64_t begin, uint64_t end);
+	// Name of the calling thread in the trace, a string literal
+	void SetThreadName(const char* name);
+	// Ticks of Now per second
+	double GetTicksPerSecond();
+	// Writes the zones still held by the rings of every thread as Chrome trace JSON. Threads can keep recording
+	// meanwhile, zones they overwrite during the dump are left out. Returns false if the file cannot be written
+	bool WriteChromeTrace(const char* filepath);
+	// Forgets every recorded zone, only call while no thread is recording
+	void Clear();
+
+	// The zones of one name, over every thread
+	struct ZoneSummary
+	{
+		const char* name;
+		uint64_t count;
+		double totalSeconds;
+		double maxSeconds;
+	};
+	// Sums up the zones still held by the rings by name, the largest total first. Nested zones are counted in their
+	// own name and again in the zones around them
+	void SummarizeZones(std::vector<ZoneSummary>* pOutSummaries);
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* name) : mName(name), mBegin(Now())
+		{
+		}
+
+		~Zone()
+		{
+			Record(this->mName, this->mBegin, Now());
+		}
+
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* mName;
+		uint64_t mBegin;
+	};
+}
+
+#if PROFILER_ENABLED
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+// Times the rest of the enclosing scope. The empty strings around name only let string literals through
+#define PROFILE_ZONE(name) Profiler::Zone PROFILER_CONCAT(profilerZone, __LINE__)("" name "")
+#define PROFILE_THREAD(name) Profiler::SetThreadName("" name "")
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
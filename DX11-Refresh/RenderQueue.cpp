@@ -0,0 +1,48 @@
+#include "RenderQueue.h"
+
+RenderQueue::RenderQueue()
+{
+
+}
+
+RenderQueue::~RenderQueue()
+{
+
+}
+
+uint64_t RenderQueue::MakeKey(RENDER_PASS pass, unsigned int shader, unsigned int material, float depth)
+{
+	return DrawKey::Make(pass, shader, material, depth);
+}
+
+void RenderQueue::Clear()
+{
+	this->mItems.clear();
+	this->mKeys.Clear();
+}
+
+void RenderQueue::Submit(uint64_t key, const DrawItem& item)
+{
+	this->mKeys.Add(key, this->mItems.size());
+	this->mItems.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+	this->mKeys.Sort();
+}
+
+size_t RenderQueue::GetCount() const
+{
+	return this->mKeys.GetCount();
+}
+
+const DrawItem& RenderQueue::GetSortedItem(size_t index) const
+{
+	return this->mItems[this->mKeys.GetIndex(index)];
+}
+
+uint64_t RenderQueue::GetSortedKey(size_t index) const
+{
+	return this->mKeys.GetKey(index);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <vector>
+#include <stdint.h>
+#include "DrawKey.h"
+
+// Everything needed to execute one DrawIndexed or DrawIndexedInstanced
+struct DrawItem
+{
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	ID3D11InputLayout* pInputLayout;
+	ID3D11Buffer* pVertexBuffer;
+	UINT vertexStride;
+	ID3D11Buffer* pIndexBuffer;
+	DXGI_FORMAT indexFormat;
+	UINT indexCount;
+	UINT startIndex;
+	// Drawn with DrawIndexedInstanced when instanceCount is not 0, the instance buffer is bound to slot 1
+	ID3D11Buffer* pInstanceBuffer;
+	UINT instanceStride;
+	UINT instanceCount;
+	UINT startInstance;
+
+	ID3D11VertexShader* pVertexShader;
+	ID3D11PixelShader* pPixelShader;
+	ID3D11Buffer* pObjectConstants;		// Bound to VS slot 1 when not null
+	ID3D11ShaderResourceView* pVertexResource;	// Bound to VS slot 0 when not null
+	ID3D11ShaderResourceView* pTexture;
+	ID3D11SamplerState* pSampler;
+
+	ID3D11RasterizerState* pRasterizerState;
+	ID3D11DepthStencilState* pDepthStencilState;
+	UINT stencilRef;
+
+	DirectX::XMFLOAT4X4 world;			// Transposed, ready for the constant buffer. Unused by instanced draws
+};
+
+// Collects the draws of a frame and orders them by their draw key, see DrawKey and DrawKeyList.
+// Sorting by pass, shader and material first keeps draws that share state next to each other,
+// inside a material opaque draws end up front to back.
+class RenderQueue
+{
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	// Same as DrawKey::Make
+	static uint64_t MakeKey(RENDER_PASS pass, unsigned int shader, unsigned int material, float depth);
+
+	void Clear();
+	void Submit(uint64_t key, const DrawItem& item);
+	// Radix sorts the submitted draws by key, draws with equal keys keep their submission order
+	void Sort();
+
+	size_t GetCount() const;
+	// Draw at position index after sorting
+	const DrawItem& GetSortedItem(size_t index) const;
+	uint64_t GetSortedKey(size_t index) const;
+
+private:
+	std::vector<DrawItem> mItems;
+	DrawKeyList mKeys;
+};
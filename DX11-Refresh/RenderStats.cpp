@@ -0,0 +1,296 @@
+#include "RenderStats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+	const uint64_t HALF_SUB_BUCKET_COUNT = FRAME_HISTOGRAM_SUB_BUCKET_COUNT / 2;
+
+	unsigned int HighestBit(uint64_t value)
+	{
+		unsigned int bit = 0;
+		for (unsigned int step = 32; step > 0; step /= 2)
+		{
+			if (value >> (bit + step))
+				bit += step;
+		}
+		return bit;
+	}
+
+	// The counters in the order of the CSV columns and the JSON fields
+	struct CounterColumn
+	{
+		const char* name;
+		double (*pGet)(const RenderFrameStats& stats);
+	};
+
+	const CounterColumn COUNTER_COLUMNS[] = {
+		{ "draws", [](const RenderFrameStats& s) { return (double)s.draws; } },
+		{ "instances", [](const RenderFrameStats& s) { return (double)s.instances; } },
+		{ "indices", [](const RenderFrameStats& s) { return (double)s.indices; } },
+		{ "stateChanges", [](const RenderFrameStats& s) { return (double)s.stateChanges; } },
+		{ "filteredStateCalls", [](const RenderFrameStats& s) { return (double)s.filteredStateCalls; } },
+		{ "commandBytes", [](const RenderFrameStats& s) { return (double)s.commandBytes; } },
+		{ "constantBytes", [](const RenderFrameStats& s) { return (double)s.constantBytes; } },
+		{ "paletteBytes", [](const RenderFrameStats& s) { return (double)s.paletteBytes; } },
+		{ "instanceBytes", [](const RenderFrameStats& s) { return (double)s.instanceBytes; } },
+		{ "occlusionTested", [](const RenderFrameStats& s) { return (double)s.occlusionTested; } },
+		{ "occluded", [](const RenderFrameStats& s) { return (double)s.occluded; } },
+		{ "jobs", [](const RenderFrameStats& s) { return (double)s.jobs; } },
+		{ "frameArenaBytes", [](const RenderFrameStats& s) { return (double)s.frameArenaBytes; } },
+	};
+
+	void WriteCounters(std::ostream& stream, const RenderFrameStats& stats)
+	{
+		stream << "{";
+		for (size_t i = 0; i < sizeof(COUNTER_COLUMNS) / sizeof(COUNTER_COLUMNS[0]); ++i)
+		{
+			stream << (i > 0 ? "," : "") << "\"" << COUNTER_COLUMNS[i].name << "\":" << COUNTER_COLUMNS[i].pGet(stats);
+		}
+		stream << "}";
+	}
+
+	// In milliseconds, which is what frame times are usually compared in
+	void WritePercentiles(std::ostream& stream, const FrameTimeHistogram& histogram)
+	{
+		stream << "{\"min\":" << histogram.GetMin() * 1000.0
+			<< ",\"mean\":" << histogram.GetMean() * 1000.0
+			<< ",\"p50\":" << histogram.GetPercentile(50.0) * 1000.0
+			<< ",\"p95\":" << histogram.GetPercentile(95.0) * 1000.0
+			<< ",\"p99\":" << histogram.GetPercentile(99.0) * 1000.0
+			<< ",\"max\":" << histogram.GetMax() * 1000.0 << "}";
+	}
+}
+
+FrameTimeHistogram::FrameTimeHistogram()
+{
+	this->Reset();
+}
+
+void FrameTimeHistogram::Record(double seconds)
+{
+	const uint64_t nanoseconds = seconds > 0.0 ? (uint64_t)(seconds * 1e9) : 0;
+	this->mCounts[FrameTimeHistogram::BucketOf(nanoseconds)]++;
+	this->mMin = this->mCount == 0 ? nanoseconds : (std::min)(this->mMin, nanoseconds);
+	this->mMax = (std::max)(this->mMax, nanoseconds);
+	this->mSum += (double)nanoseconds;
+	this->mCount++;
+}
+
+void FrameTimeHistogram::Reset()
+{
+	memset(this->mCounts, 0, sizeof(this->mCounts));
+	this->mCount = 0;
+	this->mMin = 0;
+	this->mMax = 0;
+	this->mSum = 0.0;
+}
+
+uint64_t FrameTimeHistogram::GetCount() const
+{
+	return this->mCount;
+}
+
+double FrameTimeHistogram::GetMin() const
+{
+	return this->mMin * 1e-9;
+}
+
+double FrameTimeHistogram::GetMax() const
+{
+	return this->mMax * 1e-9;
+}
+
+double FrameTimeHistogram::GetMean() const
+{
+	return this->mCount > 0 ? this->mSum / this->mCount * 1e-9 : 0.0;
+}
+
+double FrameTimeHistogram::GetPercentile(double percentile) const
+{
+	if (this->mCount == 0)
+		return 0.0;
+	// Nearest rank: the smallest value that at least percentile percent of the values do not exceed, counted from 1
+	uint64_t rank = (uint64_t)std::ceil(percentile * this->mCount / 100.0);
+	rank = (std::max)((uint64_t)1, (std::min)(rank, this->mCount));
+	uint64_t seen = 0;
+	for (unsigned int bucket = 0; bucket < FRAME_HISTOGRAM_BUCKET_COUNT; ++bucket)
+	{
+		seen += this->mCounts[bucket];
+		if (seen >= rank)
+			return (std::min)(FrameTimeHistogram::UpperBoundOf(bucket), this->mMax) * 1e-9;
+	}
+	return this->GetMax();
+}
+
+unsigned int FrameTimeHistogram::BucketOf(uint64_t nanoseconds)
+{
+	// Exact below FRAME_HISTOGRAM_SUB_BUCKET_COUNT, above that the lowest bits are dropped so that
+	// FRAME_HISTOGRAM_SUB_BUCKET_BITS significant bits remain
+	if (nanoseconds < FRAME_HISTOGRAM_SUB_BUCKET_COUNT)
+		return (unsigned int)nanoseconds;
+	const unsigned int shift = ::HighestBit(nanoseconds) - (FRAME_HISTOGRAM_SUB_BUCKET_BITS - 1);
+	return (unsigned int)(shift * HALF_SUB_BUCKET_COUNT + (nanoseconds >> shift));
+}
+
+uint64_t FrameTimeHistogram::UpperBoundOf(unsigned int bucket)
+{
+	if (bucket < FRAME_HISTOGRAM_SUB_BUCKET_COUNT)
+		return bucket;
+	const unsigned int shift = (unsigned int)(bucket / HALF_SUB_BUCKET_COUNT - 1);
+	const uint64_t sub_bucket = bucket % HALF_SUB_BUCKET_COUNT + HALF_SUB_BUCKET_COUNT;
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+void RenderStats::AddFrame(const RenderFrameStats& frame)
+{
+	if (this->mHistory.size() < RENDER_STATS_HISTORY)
+		this->mHistory.push_back(frame);
+	else
+		this->mHistory[this->mNextIndex] = frame;
+	this->mNextIndex = (this->mNextIndex + 1) % RENDER_STATS_HISTORY;
+	this->mFrameCount++;
+	this->mFrameTimes.Record(frame.frameTime);
+	this->mRenderTimes.Record(frame.renderTime);
+}
+
+void RenderStats::Reset()
+{
+	this->mHistory.clear();
+	this->mNextIndex = 0;
+	this->mFrameCount = 0;
+	this->mFrameTimes.Reset();
+	this->mRenderTimes.Reset();
+}
+
+uint64_t RenderStats::GetFrameCount() const
+{
+	return this->mFrameCount;
+}
+
+const RenderFrameStats& RenderStats::GetLastFrame() const
+{
+	static const RenderFrameStats empty;
+	if (this->mHistory.empty())
+		return empty;
+	return this->mHistory[(this->mNextIndex + RENDER_STATS_HISTORY - 1) % RENDER_STATS_HISTORY];
+}
+
+RenderFrameStats RenderStats::GetAverage() const
+{
+	RenderFrameStats average;
+	if (this->mHistory.empty())
+		return average;
+	double sums[sizeof(COUNTER_COLUMNS) / sizeof(COUNTER_COLUMNS[0]) + 2] = {};
+	for (auto& frame : this->mHistory)
+	{
+		sums[0] += frame.frameTime;
+		sums[1] += frame.renderTime;
+		sums[2] += frame.draws;
+		sums[3] += frame.instances;
+		sums[4] += (double)frame.indices;
+		sums[5] += frame.stateChanges;
+		sums[6] += frame.filteredStateCalls;
+		sums[7] += frame.commandBytes;
+		sums[8] += frame.constantBytes;
+		sums[9] += frame.paletteBytes;
+		sums[10] += frame.instanceBytes;
+		sums[11] += frame.occlusionTested;
+		sums[12] += frame.occluded;
+		sums[13] += (double)frame.jobs;
+		sums[14] += (double)frame.frameArenaBytes;
+	}
+	const double count = (double)this->mHistory.size();
+	average.frame = this->GetLastFrame().frame;
+	average.frameTime = sums[0] / count;
+	average.renderTime = sums[1] / count;
+	average.draws = (unsigned int)(sums[2] / count + 0.5);
+	average.instances = (unsigned int)(sums[3] / count + 0.5);
+	average.indices = (uint64_t)(sums[4] / count + 0.5);
+	average.stateChanges = (unsigned int)(sums[5] / count + 0.5);
+	average.filteredStateCalls = (unsigned int)(sums[6] / count + 0.5);
+	average.commandBytes = (unsigned int)(sums[7] / count + 0.5);
+	average.constantBytes = (unsigned int)(sums[8] / count + 0.5);
+	average.paletteBytes = (unsigned int)(sums[9] / count + 0.5);
+	average.instanceBytes = (unsigned int)(sums[10] / count + 0.5);
+	average.occlusionTested = (unsigned int)(sums[11] / count + 0.5);
+	average.occluded = (unsigned int)(sums[12] / count + 0.5);
+	average.jobs = (uint64_t)(sums[13] / count + 0.5);
+	average.frameArenaBytes = (size_t)(sums[14] / count + 0.5);
+	return average;
+}
+
+const FrameTimeHistogram& RenderStats::GetFrameTimes() const
+{
+	return this->mFrameTimes;
+}
+
+const FrameTimeHistogram& RenderStats::GetRenderTimes() const
+{
+	return this->mRenderTimes;
+}
+
+bool RenderStats::WriteCsv(const char* filepath) const
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+	file << "frame,frameTimeMs,renderTimeMs";
+	for (auto& column : COUNTER_COLUMNS)
+	{
+		file << "," << column.name;
+	}
+	file << "\n";
+
+	// Oldest first
+	const size_t first = this->mHistory.size() < RENDER_STATS_HISTORY ? 0 : this->mNextIndex;
+	for (size_t i = 0; i < this->mHistory.size(); ++i)
+	{
+		const RenderFrameStats& frame = this->mHistory[(first + i) % this->mHistory.size()];
+		file << frame.frame << "," << frame.frameTime * 1000.0 << "," << frame.renderTime * 1000.0;
+		for (auto& column : COUNTER_COLUMNS)
+		{
+			file << "," << column.pGet(frame);
+		}
+		file << "\n";
+	}
+	return file.good();
+}
+
+bool RenderStats::WriteJson(const char* filepath) const
+{
+	std::ofstream file(filepath);
+	if (!file.is_open())
+		return false;
+	file << "{\n\"frames\":" << this->mFrameCount << ",\n\"frameTimeMs\":";
+	::WritePercentiles(file, this->mFrameTimes);
+	file << ",\n\"renderTimeMs\":";
+	::WritePercentiles(file, this->mRenderTimes);
+	file << ",\n\"average\":";
+	::WriteCounters(file, this->GetAverage());
+	file << ",\n\"last\":";
+	::WriteCounters(file, this->GetLastFrame());
+	file << "\n}\n";
+	return file.good();
+}
+
+std::string RenderStats::FormatSummary() const
+{
+	const RenderFrameStats& last = this->GetLastFrame();
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(2)
+		<< "frame p50 " << this->mFrameTimes.GetPercentile(50.0) * 1000.0
+		<< " p95 " << this->mFrameTimes.GetPercentile(95.0) * 1000.0
+		<< " p99 " << this->mFrameTimes.GetPercentile(99.0) * 1000.0
+		<< " max " << this->mFrameTimes.GetMax() * 1000.0 << " ms"
+		<< " | draws " << last.draws
+		<< " instances " << last.instances
+		<< " state " << last.stateChanges
+		<< " cb " << last.constantBytes / 1024 << " KB"
+		<< " palette " << last.paletteBytes / 1024 << " KB";
+	return stream.str();
+}
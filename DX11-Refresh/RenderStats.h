@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Each power of two of the histogram is split into 2^(bits - 1) buckets, so a bucket is at most 1/64 of its value wide
+#define FRAME_HISTOGRAM_SUB_BUCKET_BITS 7
+#define FRAME_HISTOGRAM_SUB_BUCKET_COUNT (1 << FRAME_HISTOGRAM_SUB_BUCKET_BITS)
+// Enough buckets for any 64-bit number of nanoseconds
+#define FRAME_HISTOGRAM_BUCKET_COUNT ((64 - FRAME_HISTOGRAM_SUB_BUCKET_BITS + 2) * FRAME_HISTOGRAM_SUB_BUCKET_COUNT / 2)
+// Frames kept for WriteCsv, older ones only remain in the histograms
+#define RENDER_STATS_HISTORY 4096
+
+// Counters of one frame, filled by the renderer
+struct RenderFrameStats
+{
+	uint64_t frame = 0;
+	double frameTime = 0.0;				// CPU seconds of the whole frame, simulation included
+	double renderTime = 0.0;			// CPU seconds spent drawing
+	unsigned int draws = 0;
+	unsigned int instances = 0;			// Drawn by the instanced draws
+	uint64_t indices = 0;				// Over all draws and instances
+	unsigned int stateChanges = 0;		// State calls that were recorded
+	unsigned int filteredStateCalls = 0;	// Redundant state calls dropped by the state caches
+	unsigned int commandBytes = 0;		// Recorded into the command buffers
+	unsigned int constantBytes = 0;		// Allocated from the constant buffer ring
+	unsigned int paletteBytes = 0;		// Joint matrices uploaded for the skinned meshes and the crowd
+	unsigned int instanceBytes = 0;		// Instance data uploaded
+	unsigned int occlusionTested = 0;
+	unsigned int occluded = 0;
+	uint64_t jobs = 0;					// Run by the job system during the frame
+	size_t frameArenaBytes = 0;			// Used from the frame arena of the render thread
+};
+
+// Counts frame times in buckets whose width grows with the value, like an HDR histogram: every value from a nanosecond
+// to hours is kept with about 1.5 % error, in a fixed amount of memory and without allocating.
+class FrameTimeHistogram
+{
+public:
+	FrameTimeHistogram();
+
+	void Record(double seconds);
+	void Reset();
+
+	uint64_t GetCount() const;
+	double GetMin() const;
+	double GetMax() const;
+	double GetMean() const;
+	// Seconds that percentile percent of the recorded times do not exceed. The upper end of the bucket is returned,
+	// so the result errs on the slow side, but it is never more than GetMax
+	double GetPercentile(double percentile) const;
+
+private:
+	static unsigned int BucketOf(uint64_t nanoseconds);
+	static uint64_t UpperBoundOf(unsigned int bucket);
+
+	uint64_t mCounts[FRAME_HISTOGRAM_BUCKET_COUNT];
+	uint64_t mCount = 0;
+	uint64_t mMin = 0;
+	uint64_t mMax = 0;
+	double mSum = 0.0;
+};
+
+// Collects the counters of every frame. The recent frames are kept as they are, the frame and render times of all
+// frames go into histograms. WriteCsv writes one row per recent frame, WriteJson a summary with percentiles.
+class RenderStats
+{
+public:
+	void AddFrame(const RenderFrameStats& frame);
+	void Reset();
+
+	uint64_t GetFrameCount() const;
+	// The last frame passed to AddFrame
+	const RenderFrameStats& GetLastFrame() const;
+	// Averages of the counters over the recent frames
+	RenderFrameStats GetAverage() const;
+	const FrameTimeHistogram& GetFrameTimes() const;
+	const FrameTimeHistogram& GetRenderTimes() const;
+
+	bool WriteCsv(const char* filepath) const;
+	bool WriteJson(const char* filepath) const;
+	// One line with the frame time percentiles and the main counters of the last frame
+	std::string FormatSummary() const;
+
+private:
+	// Ring of the recent frames, oldest first once it is full
+	std::vector<RenderFrameStats> mHistory;
+	size_t mNextIndex = 0;
+	uint64_t mFrameCount = 0;
+	FrameTimeHistogram mFrameTimes;
+	FrameTimeHistogram mRenderTimes;
+};
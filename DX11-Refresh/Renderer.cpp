@@ -8,6 +8,12 @@ int currentAnimFrame = 0;
 
 
 Renderer::Renderer()
+	: Renderer(RendererSettings())
+{
+}
+
+Renderer::Renderer(const RendererSettings& settings)
+	: mSettings(settings)
 {
 	this->Init();
 	this->CreateShadersAndInputLayout();
@@ -23,12 +29,18 @@ Renderer::Renderer()
 	this->CreateSphere(10, 10);
 
 	//this->ObjLoaderTest();
+
+	// Render always has a packet to draw
+	this->PublishFrame();
 }
 
 Renderer::~Renderer()
 {
+	this->SetPipelineMode(FRAME_PIPELINE_SERIAL);
 	if (this->mCamera != nullptr)
 		delete this->mCamera;
+	if (this->mRenderCamera != nullptr)
+		delete this->mRenderCamera;
 
 	SafeRelease(&this->mDevice);
 	SafeRelease(&this->mDeviceContext);
@@ -42,7 +54,9 @@ Renderer::~Renderer()
 	SafeRelease(&this->mDefaultInputLayout);
 	SafeRelease(&this->mRasterState);
 	SafeRelease(&this->mSwapChain);
-	SafeRelease(&this->mWVPBuffer);
+	this->mConstantRingBackend.Release();
+	this->mDeferredBackend.Release();
+	SafeRelease(&this->mDeviceContext1);
 
 	sphereIndexBuffer->Release();
 	sphereVertBuffer->Release();
@@ -54,204 +68,614 @@ Renderer::~Renderer()
 
 	DSLessEqual->Release();
 	RSCullNone->Release();
+
+	for (auto& mesh : this->mInstancedMeshes)
+	{
+		SafeRelease(&mesh.pVertexBuffer);
+		SafeRelease(&mesh.pIndexBuffer);
+		SafeRelease(&mesh.pInstanceBuffer);
+	}
+	SafeRelease(&this->mInstancedVertexShader);
+	SafeRelease(&this->mInstancedInputLayout);
+
+	// UniqueSkeletonData does not own its frame data
+	for (auto& skeleton : this->mCrowdSkeletons)
+	{
+		delete[] skeleton.frameData;
+	}
+	SafeRelease(&this->mCrowdInstanceBuffer);
+	SafeRelease(&this->mPaletteSRV);
+	SafeRelease(&this->mPaletteBuffer);
+	SafeRelease(&this->mCrowdVertexShader);
+	SafeRelease(&this->mCrowdInputLayout);
 }
-static int timeLastFrame = 0;
 static bool animate = false;
 void Renderer::Frame()
 {
+	PROFILE_ZONE("Frame");
+	const double frameStart = this->mPipelineClock.Now();
 	this->gameTimer.Tick();
-	float timeThisFrame = this->gameTimer.GameTime();
-	this->HandleInput();
+	this->Update(this->gameTimer.DeltaTime());
+	this->PublishFrame();
+	this->Render(1.0f);
+	this->EndFrame(this->mPipelineClock.Now() - frameStart);
+}
 
+void Renderer::Update(float dt)
+{
+	// Read once per step, so a recording holds exactly what the step saw
+	InputSnapshot input;
+	input.keyboard = this->m_keyboard->GetState();
+	input.mouse = this->m_mouse->GetState();
+	if (this->mpInputRecorder != nullptr)
+		this->mpInputRecorder->RecordStep(dt, input);
+	this->Update(dt, input);
+}
 
-	sphereWorld = XMMatrixIdentity();
+void Renderer::Update(float dt, const InputSnapshot& input)
+{
+	PROFILE_ZONE("Update");
+	// Every step is a frame of the arena of the thread it runs on, so its transient memory is not reset on the
+	// schedule of the render thread
+	FrameArena::ThreadLocal().BeginFrame();
+	// Render interpolates the camera from where it was before this step
+	XMStoreFloat4(&this->mPreviousCameraPosition, this->mCamera->GetPosition());
+	XMStoreFloat4(&this->mPreviousCameraLook, this->mCamera->GetLookVector());
+	this->mLastStepTime = dt;
+	if (this->mpCameraPath != nullptr)
+	{
+		this->mCameraPathTime += dt;
+		this->mpCameraPath->Apply(this->mCameraPathTime, this->mCamera);
+	}
+	else
+	{
+		this->HandleInput(dt, input);
+	}
 
-	//Define sphereWorld's world space matrix
-	XMMATRIX Scale = XMMatrixScaling(5.0f, 5.0f, 5.0f);
-	//Make sure the sphere is always centered around camera
-	XMMATRIX Translation = XMMatrixTranslationFromVector(this->mCamera->GetPosition());
+	// ------ Skinned meshes ------ 
+	if (rotation > 0.01f || rotation < -0.01f)
+	{
+		animate = true;
+		
+		if (rotation > 0.01f)
+		{
+			this->skinSkeletons[0]->StartAnimation(FbxLoader::ANIMATION_TYPE::IDLE);
+			this->skinSkeletons[0]->StopAnimation(FbxLoader::ANIMATION_TYPE::MOVE);
+		}
+		else if (rotation < 0.01f)
+		{
+			this->skinSkeletons[0]->StartAnimation(FbxLoader::ANIMATION_TYPE::MOVE);
+			this->skinSkeletons[0]->StopAnimation(FbxLoader::ANIMATION_TYPE::IDLE);
+		}
+	}
+	if (animate)
+	{
+		PROFILE_ZONE("Skeleton::UpdateAnimation");
+		this->skinSkeletons[0]->UpdateAnimation(dt);
+		currentAnimFrame = (currentAnimFrame + 1) % this->skinSkeletons[0]->frameCount;
+		rotation = 0.0f;
+	}
 
-	//Set sphereWorld's world space using the transformations
-	sphereWorld = Scale * Translation;
+	this->AnimateCrowd(dt);
+}
+
+void Renderer::PublishFrame()
+{
+	PROFILE_ZONE("PublishFrame");
+	FramePacket& packet = this->mFramePackets.GetWriteBuffer();
+	packet.frame = ++this->mPublishedFrames;
+	packet.stepTime = this->mLastStepTime;
+	packet.previousCameraPosition = this->mPreviousCameraPosition;
+	packet.previousCameraLook = this->mPreviousCameraLook;
+	XMStoreFloat4(&packet.cameraPosition, this->mCamera->GetPosition());
+	XMStoreFloat4(&packet.cameraLook, this->mCamera->GetLookVector());
+	packet.meshScale = scale;
+	packet.useDeferredContexts = this->mUseDeferredContexts;
+	packet.showStatsOverlay = this->mShowStatsOverlay;
+
+	// Copies, the simulation overwrites the joint matrices with the next step
+	packet.skinPalette.clear();
+	if (animate)
+	{
+		const FbxLoader::Skeleton* skeleton = this->skinSkeletons[0].get();
+		packet.skinPalette.assign(skeleton->frameData, skeleton->frameData + skeleton->jointCount);
+	}
+	this->PackCrowd(&packet);
 
+	const bool cameraMoved = memcmp(&packet.previousCameraPosition, &packet.cameraPosition, sizeof(XMFLOAT4)) != 0 ||
+		memcmp(&packet.previousCameraLook, &packet.cameraLook, sizeof(XMFLOAT4)) != 0;
+	packet.animating = animate || !this->mCrowdCharacters.empty() || cameraMoved;
+	packet.publishTime = this->mPipelineClock.Now();
+	this->mFramePackets.Publish();
+}
 
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	this->mDeviceContext->ClearDepthStencilView(
-		this->mDepthStencilView,
-		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
-		1.0f,
-		0
-	);
-	this->mDeviceContext->ClearRenderTargetView(this->mRenderTargetView, this->mClearColor);
+bool Renderer::IsAnimating() const
+{
+	return this->mFramePackets.GetReadBuffer().animating;
+}
 
+void Renderer::Render(float alpha)
+{
+	this->AcquireFramePacket();
+	this->DrawFrame(alpha);
+}
 
+void Renderer::RenderLatest()
+{
+	this->AcquireFramePacket();
+	// The simulation publishes once per step, so the camera reaches the state of the packet as the next one arrives
+	const FramePacket& packet = this->mFramePackets.GetReadBuffer();
+	float alpha = 1.0f;
+	if (packet.stepTime > 0.0f)
+		alpha = (std::min)((float)((this->mPipelineClock.Now() - packet.publishTime) / packet.stepTime), 1.0f);
+	this->DrawFrame(alpha);
+}
 
-	this->mDeviceContext->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	this->mDeviceContext->OMSetRenderTargets(1, &this->mRenderTargetView, this->mDepthStencilView);
-	this->mDeviceContext->IASetInputLayout(mDefaultInputLayout);
-	this->mDeviceContext->OMSetBlendState(NULL, NULL, 0xffffffff);
-	this->mDeviceContext->OMSetDepthStencilState(this->DSDefault, 0);
+void Renderer::AcquireFramePacket()
+{
+	this->mFramePackets.Acquire();
+	const FramePacket& packet = this->mFramePackets.GetReadBuffer();
+	if (packet.frame == this->mRenderedFrame)
+		this->mPipelineStats.repeated++;
+	this->mRenderedFrame = packet.frame;
+	this->mPipelineStats.published = packet.frame;
+	this->mPipelineStats.overwritten = this->mFramePackets.GetOverwrittenCount();
+}
 
-	// ----- Render cube
-	this->mDeviceContext->VSSetShader(this->mCubeVertexShader, NULL, 0);
-	this->mDeviceContext->PSSetShader(this->mTexturePixelShader, NULL, 0);
-	this->mDeviceContext->RSSetState(this->mRasterState);
+void Renderer::SetPipelineMode(FRAME_PIPELINE_MODE mode)
+{
+	if (mode == this->mPipelineMode)
+		return;
+	this->mPipelineMode = mode;
+	if (mode == FRAME_PIPELINE_THREADED)
+	{
+		this->mSimulationRunning.store(true);
+		this->mSimulationThread = std::thread(&Renderer::SimulationLoop, this);
+	}
+	else
+	{
+		this->mSimulationRunning.store(false);
+		this->mSimulationThread.join();
+	}
+}
 
-	this->mDeviceContext->IASetVertexBuffers(0, 1, &this->mCubeVertexBuffer, &stride, &offset);
-	this->mDeviceContext->IASetIndexBuffer(this->mCubeIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	// Set the WVP buffer.
-	this->updateWVP(this->gameTimer.DeltaTime());
-	this->mDeviceContext->PSSetShaderResources(0, 1, &mCubeTexSRV);
-	this->mDeviceContext->PSSetSamplers(0, 1, &skyboxSamplerState);
-	this->mDeviceContext->VSSetConstantBuffers(0, 1, &this->mWVPBuffer);
+FRAME_PIPELINE_MODE Renderer::GetPipelineMode() const
+{
+	return this->mPipelineMode;
+}
 
+void Renderer::SimulationLoop()
+{
+	PROFILE_THREAD("Simulation");
+	// Wakes up once per step, how fast the main thread renders does not matter here
+	FrameSchedulerSettings settings;
+	settings.targetFrameTime = settings.fixedStep;
+	FrameScheduler<SystemFrameClock> scheduler;
+	scheduler.Init(&this->mPipelineClock, settings);
+	while (this->mSimulationRunning.load())
+	{
+		FrameTick tick = scheduler.BeginFrame();
+		if (tick.steps > 0)
+		{
+			std::lock_guard<std::mutex> lock(this->mSceneMutex);
+			for (unsigned int step = 0; step < tick.steps; ++step)
+			{
+				this->Update(tick.stepTime);
+			}
+			this->PublishFrame();
+		}
+		scheduler.EndFrame();
+	}
+}
 
-	this->mDeviceContext->DrawIndexed(36, 0, 0);
+const FramePipelineStats& Renderer::GetPipelineStats() const
+{
+	return this->mPipelineStats;
+}
 
-	// ----- Render sphere
-	this->mDeviceContext->IASetIndexBuffer(this->sphereIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-	this->mDeviceContext->IASetVertexBuffers(0, 1, &this->sphereVertBuffer, &stride, &offset);
+void Renderer::EndFrame(double frameTime)
+{
+	this->mFrameStats.frameTime = frameTime;
+	this->mRenderStats.AddFrame(this->mFrameStats);
+}
 
-	auto WVP = this->sphereWorld * this->mCamera->GetViewMatrix() * this->mCamera->GetProjectionMatrix();
-	WVP = XMMatrixTranspose(WVP);
-	VS_WVP_CONSTANT_BUFFER vsConstData;
-	DirectX::XMStoreFloat4x4(&vsConstData.mWorldViewProj, WVP);
-	this->mDeviceContext->UpdateSubresource(
-		this->mWVPBuffer,
-		0,
-		NULL,
-		&vsConstData,
-		0,
-		0
-	);
-	this->mDeviceContext->VSSetConstantBuffers(0, 1, &this->mWVPBuffer);
-	this->mDeviceContext->PSSetShaderResources(0, 1, &smrv);
-	this->mDeviceContext->PSSetSamplers(0, 1, &skyboxSamplerState);
+const RenderStats& Renderer::GetRenderStats() const
+{
+	return this->mRenderStats;
+}
 
-	this->mDeviceContext->VSSetShader(SKYBOX_VS, 0, 0);
-	this->mDeviceContext->PSSetShader(SKYBOX_PS, 0, 0);
-	this->mDeviceContext->OMSetDepthStencilState(DSLessEqual, 0);
-	this->mDeviceContext->RSSetState(RSCullNone);
-	this->mDeviceContext->DrawIndexed(NumSphereFaces * 3, 0, 0);
+void Renderer::SetStatsOverlay(bool show)
+{
+	this->mShowStatsOverlay = show;
+}
 
-	this->mDeviceContext->OMSetDepthStencilState(this->DSDefault, 1);
+void Renderer::ResetStats()
+{
+	this->mRenderStats.Reset();
+	this->mPipelineStats = FramePipelineStats();
+	this->mPipelineStats.published = this->mPublishedFrames;
+}
 
+void Renderer::SetInputRecorder(InputRecorder* pRecorder)
+{
+	this->mpInputRecorder = pRecorder;
+	if (pRecorder != nullptr)
+		this->mRandom.seed(this->mRandomSeed);
+}
 
-	
+InputSessionState Renderer::GetInputSessionState() const
+{
+	InputSessionState state;
+	XMStoreFloat4(&state.cameraPosition, this->mCamera->GetPosition());
+	XMStoreFloat4(&state.cameraLook, this->mCamera->GetLookVector());
+	state.pitch = this->m_pitch;
+	state.yaw = this->m_yaw;
+	state.meshScale = scale;
+	state.meshRotation = rotation;
+	state.lastScroll = lastscroll;
+	state.useDeferredContexts = this->mUseDeferredContexts;
+	state.showStatsOverlay = this->mShowStatsOverlay;
+	state.randomSeed = this->mRandomSeed;
+	return state;
+}
 
-	this->mDeviceContext->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	// ------ Render tests ------ 
-	WVP = XMMatrixScaling(scale, scale, scale) * XMMatrixRotationRollPitchYaw(0.0f, 0.0f, 0.0f) * XMMatrixTranslation(0.0f, 7.0f, 0.0f) * this->mCamera->GetViewMatrix() * this->mCamera->GetProjectionMatrix();
-	WVP = XMMatrixTranspose(WVP);
-	DirectX::XMStoreFloat4x4(&vsConstData.mWorldViewProj, WVP);
-	this->mDeviceContext->UpdateSubresource(
-		this->mWVPBuffer,
-		0,
-		NULL,
-		&vsConstData,
-		0,
+void Renderer::SetInputSessionState(const InputSessionState& state)
+{
+	this->mCamera->SetCameraPosition(XMLoadFloat4(&state.cameraPosition));
+	this->mCamera->SetLookVector(XMLoadFloat4(&state.cameraLook));
+	// Nothing to interpolate from before the first step
+	this->mPreviousCameraPosition = state.cameraPosition;
+	this->mPreviousCameraLook = state.cameraLook;
+	this->m_pitch = state.pitch;
+	this->m_yaw = state.yaw;
+	scale = state.meshScale;
+	rotation = state.meshRotation;
+	lastscroll = state.lastScroll;
+	this->mUseDeferredContexts = state.useDeferredContexts;
+	this->mShowStatsOverlay = state.showStatsOverlay;
+	this->mRandomSeed = state.randomSeed;
+	this->mRandom.seed(state.randomSeed);
+}
+
+void Renderer::SetCameraPath(const CameraPath* pPath)
+{
+	this->mpCameraPath = pPath;
+	this->mCameraPathTime = 0.0;
+	if (pPath != nullptr)
+		pPath->Apply(0.0, this->mCamera);
+}
+
+void Renderer::UpdateStatsOverlay(bool show)
+{
+	// A headless renderer has no title to show them in
+	if (this->mWindow == nullptr)
+		return;
+	if (show)
+	{
+		const double now = this->mPipelineClock.Now();
+		if (this->mOverlayVisible && now - this->mLastOverlayTime < RENDER_STATS_OVERLAY_INTERVAL)
+			return;
+		if (!this->mOverlayVisible)
+		{
+			char title[256] = {};
+			GetWindowTextA(this->mWindow, title, sizeof(title));
+			this->mWindowTitle = title;
+		}
+		SetWindowTextA(this->mWindow, this->mRenderStats.FormatSummary().c_str());
+		this->mLastOverlayTime = now;
+		this->mOverlayVisible = true;
+	}
+	else if (this->mOverlayVisible)
+	{
+		SetWindowTextA(this->mWindow, this->mWindowTitle.c_str());
+		this->mOverlayVisible = false;
+	}
+}
+
+void Renderer::DrawFrame(float alpha)
+{
+	PROFILE_ZONE("Render");
+	if (this->mpInputRecorder != nullptr)
+		this->mpInputRecorder->RecordFrame(alpha);
+	const double renderStart = this->mPipelineClock.Now();
+	this->mFrameStats = RenderFrameStats();
+	this->mFrameStats.frame = this->mFrameIndex;
+	// Transient allocations of this frame come from the frame arena of the render thread, the simulation steps
+	// count the frames of their own thread's arena
+	FrameArena::ThreadLocal().BeginFrame();
+
+	// The camera is drawn between its states before and after the last step of the packet
+	const FramePacket& packet = this->mFramePackets.GetReadBuffer();
+	this->mRenderCamera->SetCameraPosition(XMVectorLerp(XMLoadFloat4(&packet.previousCameraPosition), XMLoadFloat4(&packet.cameraPosition), alpha));
+	this->mRenderCamera->SetLookVector(XMVectorLerp(XMLoadFloat4(&packet.previousCameraLook), XMLoadFloat4(&packet.cameraLook), alpha));
+	const float meshScale = packet.meshScale;
+
+
+	sphereWorld = XMMatrixIdentity();
+
+	//Define sphereWorld's world space matrix
+	XMMATRIX Scale = XMMatrixScaling(5.0f, 5.0f, 5.0f);
+	//Make sure the sphere is always centered around camera
+	XMMATRIX Translation = XMMatrixTranslationFromVector(this->mRenderCamera->GetPosition());
+
+	//Set sphereWorld's world space using the transformations
+	sphereWorld = Scale * Translation;
+
+
+	this->mDeviceContext->ClearDepthStencilView(
+		this->mDepthStencilView,
+		D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
+		1.0f,
 		0
 	);
-	this->mDeviceContext->VSSetShader(this->mCubeVertexShader, NULL, 0);
-	this->mDeviceContext->PSSetShader(this->mDefaultPixelShader, NULL, 0);
-	this->mDeviceContext->RSSetState(this->mRasterState);
-	this->mDeviceContext->VSSetConstantBuffers(0, 1, &this->mWVPBuffer);
-	this->mDeviceContext->PSSetShaderResources(0, 1, &mCubeTexSRV);
-	//this->mDeviceContext->RSSetState(RSCullNone);
-	int iter = 0;
-	for (auto a : testVertexBuffers)
-	{
-		this->mDeviceContext->IASetVertexBuffers(0, 1, &a, &stride, &offset);
-		this->mDeviceContext->IASetIndexBuffer(testIndexBuffers[iter], DXGI_FORMAT_R32_UINT, 0);
-		this->mDeviceContext->DrawIndexed(testIndexCount[iter], 0, 0);
-		iter++;
-	}
-
-	// ------ Render Skinned Meshes ------ 
-	this->mDeviceContext->OMSetDepthStencilState(this->DSDefault, 5);
-	if (rotation > 0.01f || rotation < -0.01f)
+	this->mDeviceContext->ClearRenderTargetView(this->mRenderTargetView, this->mClearColor);
+
+
+
+	this->mStateCache.OMSetRenderTargets(1, &this->mRenderTargetView, this->mDepthStencilView);
+	this->mStateCache.OMSetBlendState(NULL, NULL, 0xffffffff);
+
+	// Everything is submitted to the render queue first, it decides the draw order
+	this->mRenderQueue.Clear();
+	XMMATRIX viewProj = this->mRenderCamera->GetViewMatrix() * this->mRenderCamera->GetProjectionMatrix();
+	XMVECTOR cameraPosition = this->mRenderCamera->GetPosition();
+
+	DrawItem item = {};
+	item.topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	item.pInputLayout = this->mDefaultInputLayout;
+	item.vertexStride = sizeof(Vertex);
+	item.pSampler = this->skyboxSamplerState;
+
+	// ----- Floor cube
+	item.pVertexBuffer = this->mCubeVertexBuffer;
+	item.pIndexBuffer = this->mCubeIndexBuffer;
+	item.indexFormat = this->mCubeIndexFormat;
+	item.indexCount = 36;
+	item.startIndex = 0;
+	item.pVertexShader = this->mCubeVertexShader;
+	item.pPixelShader = this->mTexturePixelShader;
+	item.pTexture = this->mCubeTexSRV;
+	item.pRasterizerState = this->mRasterState;
+	item.pDepthStencilState = this->DSDefault;
+	item.stencilRef = 0;
+	this->updateFloorWorld(packet.stepTime, &item.world);
+	float floorDepth = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat4x4(&this->mCubeWorld).r[3], cameraPosition)));
+	this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SHADER_PROGRAM_TEXTURE, 0, floorDepth), item);
+
+	// The floor is the only occluder so far, everything tested below has to be behind it
+	this->mOcclusion.BeginFrame(viewProj);
+	this->mOcclusion.AddOccluderBox({ XMFLOAT3(-1.0f, -1.0f, -1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) }, XMMatrixTranspose(XMLoadFloat4x4(&item.world)));
+	this->mOcclusion.Rasterize();
+
+	// ----- Sky sphere, in its own pass after the opaque geometry so it only shades the uncovered pixels
+	item.pVertexBuffer = this->sphereVertBuffer;
+	item.pIndexBuffer = this->sphereIndexBuffer;
+	item.indexFormat = this->sphereIndexFormat;
+	item.indexCount = NumSphereFaces * 3;
+	item.pVertexShader = SKYBOX_VS;
+	item.pPixelShader = SKYBOX_PS;
+	item.pTexture = smrv;
+	item.pRasterizerState = RSCullNone;
+	item.pDepthStencilState = DSLessEqual;
+	XMStoreFloat4x4(&item.world, XMMatrixTranspose(this->sphereWorld));
+	this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_SKY, SHADER_PROGRAM_SKYBOX, 0, 0.0f), item);
+
+	// ------ Test meshes ------ 
+	XMMATRIX testWorld = XMMatrixScaling(meshScale, meshScale, meshScale) * XMMatrixRotationRollPitchYaw(0.0f, 0.0f, 0.0f) * XMMatrixTranslation(0.0f, 7.0f, 0.0f);
+	item.pVertexShader = this->mCubeVertexShader;
+	item.pPixelShader = this->mDefaultPixelShader;
+	item.pTexture = this->mCubeTexSRV;
+	item.pRasterizerState = this->mRasterState;
+	item.pDepthStencilState = this->DSDefault;
+	item.stencilRef = 1;
+	XMStoreFloat4x4(&item.world, XMMatrixTranspose(testWorld));
+	// Only submit the meshlets that are inside the frustum and not facing away from the camera
+	XMFLOAT4 frustumPlanes[6];
+	this->mRenderCamera->GetFrustumPlanes(frustumPlanes);
+	// Pick the LOD from the projected error, the test meshes all share the same world matrix
+	float testDistance = XMVectorGetX(XMVector3Length(XMVectorSubtract(testWorld.r[3], cameraPosition)));
+	for (size_t iter = 0; iter < testVertexBuffers.size(); ++iter)
 	{
-		animate = true;
-		
-		if (rotation > 0.01f)
+		// Skip the whole mesh before looking at its meshlets
+		if (!Bounds::IsSphereVisible(testBounds[iter].sphere, testWorld, frustumPlanes))
+			continue;
+		const Bounds::AABB testBox = Bounds::TransformAABB(testBounds[iter].box, testWorld);
+		const uint32_t testIndex = 0;
+		uint32_t visibleIndex;
+		if (this->mOcclusion.CullAABBs(&testBox, &testIndex, 1, &visibleIndex) == 0)
+			continue;
+		unsigned int lod = MeshSimplifier::SelectLod(testLods[iter], this->mRenderCamera->GetProjectionMatrix(), this->vp.Height, testDistance, meshScale, LOD_MAX_PIXEL_ERROR);
+		if (lod == 0)
 		{
-			this->skinSkeletons[0]->StartAnimation(FbxLoader::ANIMATION_TYPE::IDLE);
-			this->skinSkeletons[0]->StopAnimation(FbxLoader::ANIMATION_TYPE::MOVE);
+			// Meshlets only cover the full resolution mesh
+			Meshlets::CullMeshlets(testMeshlets[iter], testWorld, frustumPlanes, cameraPosition, &this->mVisibleIndexRanges);
 		}
-		else if (rotation < 0.01f)
+		else
 		{
-			this->skinSkeletons[0]->StartAnimation(FbxLoader::ANIMATION_TYPE::MOVE);
-			this->skinSkeletons[0]->StopAnimation(FbxLoader::ANIMATION_TYPE::IDLE);
+			this->mVisibleIndexRanges.clear();
+			this->mVisibleIndexRanges.push_back({ testLods[iter][lod].indexOffset, testLods[iter][lod].indexCount });
+		}
+		item.pVertexBuffer = testVertexBuffers[iter];
+		item.pIndexBuffer = testIndexBuffers[iter];
+		item.indexFormat = testIndexFormats[iter];
+		for (auto& range : this->mVisibleIndexRanges)
+		{
+			item.indexCount = range.indexCount;
+			item.startIndex = range.indexOffset;
+			this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SHADER_PROGRAM_DEFAULT, (unsigned int)iter, testDistance), item);
 		}
 	}
-	if (animate)
+
+	// ------ Instanced meshes ------ 
+	for (size_t iter = 0; iter < this->mInstancedMeshes.size(); ++iter)
 	{
-		if (true)
-		{
-			this->skinSkeletons[0]->UpdateAnimation(this->gameTimer.DeltaTime());
-			currentAnimFrame = (currentAnimFrame + 1) % this->skinSkeletons[0]->frameCount;
-			VS_BONE_CONSTANT_BUFFER vsConstData = {};
-
-			// ------------ NEW SYSTEM -----------------
-
-			DirectX::XMFLOAT4X4* anim_data = this->skinSkeletons[0]->animationData;
-			//memcpy(&vsConstData.mBoneTransforms[0], &anim_data[currentAnimFrame * this->skinSkeletons[0]->jointCount], this->skinSkeletons[0]->jointCount * sizeof(XMFLOAT4X4));
-			memcpy(&vsConstData.mBoneTransforms[0], this->skinSkeletons[0]->frameData, this->skinSkeletons[0]->jointCount * sizeof(XMFLOAT4X4));
-
-			this->mDeviceContext->UpdateSubresource(
-				this->mBoneTransformBuffer,
-				0,
-				NULL,
-				&vsConstData,
-				0,
-				0
-			);
+		InstancedMesh& mesh = this->mInstancedMeshes[iter];
+		mesh.visible.clear();
+		mesh.bvh.QueryFrustum(frustumPlanes, &mesh.visible);
+		UINT instanceCount = this->mOcclusion.CullAABBs(mesh.worldBoxes.data(), mesh.visible.data(), (unsigned int)mesh.visible.size(), mesh.visible.data());
+		Instancing::TransformInstances(mesh.worlds.data(), mesh.visible.data(), instanceCount, viewProj, mesh.instances.data());
+		if (instanceCount == 0)
+			continue;
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (FAILED(this->mDeviceContext->Map(mesh.pInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			continue;
+		memcpy(mapped.pData, mesh.instances.data(), instanceCount * sizeof(Instancing::InstanceData));
+		this->mDeviceContext->Unmap(mesh.pInstanceBuffer, 0);
+		this->mFrameStats.instanceBytes += instanceCount * sizeof(Instancing::InstanceData);
+
+		DrawItem instancedItem = item;
+		instancedItem.pInputLayout = this->mInstancedInputLayout;
+		instancedItem.pVertexShader = this->mInstancedVertexShader;
+		instancedItem.pVertexBuffer = mesh.pVertexBuffer;
+		instancedItem.pIndexBuffer = mesh.pIndexBuffer;
+		instancedItem.indexFormat = mesh.indexFormat;
+		instancedItem.indexCount = mesh.indexCount;
+		instancedItem.startIndex = 0;
+		instancedItem.pInstanceBuffer = mesh.pInstanceBuffer;
+		instancedItem.instanceStride = sizeof(Instancing::InstanceData);
+		instancedItem.instanceCount = instanceCount;
+		instancedItem.stencilRef = 0;
+		this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SHADER_PROGRAM_INSTANCED, (unsigned int)iter, 0.0f), instancedItem);
+	}
 
-			rotation = 0.0f;
-			timeLastFrame = timeThisFrame;
-		}
+	// ------ Skinned meshes ------ 
+	if (!packet.skinPalette.empty())
+	{
+		VS_BONE_CONSTANT_BUFFER vsConstData = {};
+
+		// ------------ NEW SYSTEM -----------------
+
+		memcpy(&vsConstData.mBoneTransforms[0], packet.skinPalette.data(), (std::min)(packet.skinPalette.size(), (size_t)MAX_NUMBER_OF_BONES_IN_SHADER) * sizeof(XMFLOAT4X4));
+
+		this->mDeviceContext->UpdateSubresource(
+			this->mBoneTransformBuffer,
+			0,
+			NULL,
+			&vsConstData,
+			0,
+			0
+		);
+		this->mFrameStats.paletteBytes += sizeof(vsConstData);
 	}
 
-	this->mDeviceContext->IASetInputLayout(mSkinInputLayout);
-	this->mDeviceContext->VSSetShader(this->mSkinVertexShader, NULL, 0);
-	this->mDeviceContext->VSSetConstantBuffers(1, 1, &this->mBoneTransformBuffer);
-	UINT skinStride = sizeof(SkinVertex);
-	iter = 0;
-	for (auto a : skinVertexBuffers)
+	item.pInputLayout = this->mSkinInputLayout;
+	item.vertexStride = sizeof(SkinVertex);
+	item.pVertexShader = this->mSkinVertexShader;
+	item.pObjectConstants = this->mBoneTransformBuffer;
+	item.stencilRef = 5;
+	for (size_t iter = 0; iter < skinVertexBuffers.size(); ++iter)
 	{
+		// Every skinned mesh is drawn with the same palette, the box follows it once a pose was uploaded
+		const std::vector<Bounds::AABB>& jointBounds = skinJointBounds[iter];
+		if (!packet.skinPalette.empty() && !jointBounds.empty() && jointBounds.size() <= (std::min)(packet.skinPalette.size(), (size_t)MAX_NUMBER_OF_BONES_IN_SHADER))
+			this->mSkinPoseBoxes[iter] = Bounds::ComputeSkinnedBounds(jointBounds, packet.skinPalette.data());
+		const Bounds::AABB skinBox = Bounds::TransformAABB(this->mSkinPoseBoxes[iter], testWorld);
+		if (!Bounds::IsAABBVisible(skinBox, frustumPlanes))
+			continue;
+		const uint32_t skinIndex = 0;
+		uint32_t visibleIndex;
+		if (this->mOcclusion.CullAABBs(&skinBox, &skinIndex, 1, &visibleIndex) == 0)
+			continue;
+		unsigned int lod = MeshSimplifier::SelectLod(skinLods[iter], this->mRenderCamera->GetProjectionMatrix(), this->vp.Height, testDistance, meshScale, LOD_MAX_PIXEL_ERROR);
+		item.pVertexBuffer = skinVertexBuffers[iter];
+		item.pIndexBuffer = skinIndexBuffers[iter];
+		item.indexFormat = skinIndexFormats[iter];
+		item.indexCount = skinLods[iter][lod].indexCount;
+		item.startIndex = skinLods[iter][lod].indexOffset;
+		this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SHADER_PROGRAM_SKIN, (unsigned int)iter, testDistance), item);
+	}
 
-		this->mDeviceContext->IASetVertexBuffers(0, 1, &a, &skinStride, &offset);
-		this->mDeviceContext->IASetIndexBuffer(skinIndexBuffers[iter], DXGI_FORMAT_R32_UINT, 0);
-		this->mDeviceContext->DrawIndexed(skinIndexCount[iter], 0, 0);
-		iter++;
+	// ------ Crowd ------ 
+	if (this->UpdateCrowd(packet, viewProj))
+	{
+		DrawItem crowdItem = item;
+		crowdItem.pInputLayout = this->mCrowdInputLayout;
+		crowdItem.pVertexShader = this->mCrowdVertexShader;
+		crowdItem.pObjectConstants = nullptr;
+		crowdItem.pVertexResource = this->mPaletteSRV;
+		crowdItem.pInstanceBuffer = this->mCrowdInstanceBuffer;
+		crowdItem.instanceStride = sizeof(Crowd::InstanceData);
+		crowdItem.stencilRef = 0;
+		// One draw per mesh, every instance finds its joint matrices through its palette offset
+		for (auto& batch : packet.crowdBatches)
+		{
+			crowdItem.pVertexBuffer = skinVertexBuffers[batch.mesh];
+			crowdItem.pIndexBuffer = skinIndexBuffers[batch.mesh];
+			crowdItem.indexFormat = skinIndexFormats[batch.mesh];
+			crowdItem.indexCount = skinLods[batch.mesh][0].indexCount;
+			crowdItem.startIndex = skinLods[batch.mesh][0].indexOffset;
+			crowdItem.instanceCount = batch.instanceCount;
+			crowdItem.startInstance = batch.firstInstance;
+			this->mRenderQueue.Submit(RenderQueue::MakeKey(RENDER_PASS_OPAQUE, SHADER_PROGRAM_CROWD, batch.mesh, 0.0f), crowdItem);
+		}
 	}
+
+	this->mRenderQueue.Sort();
+	this->mConstantRing.BeginFrame(this->mFrameIndex);
+	this->DrawRenderQueue(viewProj);
+	this->mFrameStats.constantBytes = this->mConstantRing.GetStats().allocatedBytes;
 	
 	// ------ Render Skinned Mesh Outlines ------ 
-	this->mDeviceContext->OMSetRenderTargets(1, &this->mRenderTargetView, NULL);
+	this->mStateCache.OMSetRenderTargets(1, &this->mRenderTargetView, NULL);
 	//this->mDeviceContext->OMSetDepthStencilState(this->DSOutline, 0);
-	this->mDeviceContext->PSSetShaderResources(0, 1, &mOutlineStencilSRV);
-	this->mDeviceContext->PSSetSamplers(0, 0, NULL);
-	this->mDeviceContext->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-	this->mDeviceContext->RSSetState(RSCullNone);
-	this->mDeviceContext->OMSetBlendState(this->mDefaultBlendState,NULL, 0xffffffff);
+	this->mStateCache.PSSetShaderResources(0, 1, &mOutlineStencilSRV);
+	this->mStateCache.PSSetSamplers(0, 0, NULL);
+	this->mStateCache.IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	this->mStateCache.RSSetState(RSCullNone);
+	this->mStateCache.OMSetBlendState(this->mDefaultBlendState,NULL, 0xffffffff);
 
 	// unbind all the buffers and input layout
-	this->mDeviceContext->IASetVertexBuffers(0, 0, NULL, 0, 0);
-	this->mDeviceContext->IASetVertexBuffers(1, 0, NULL, 0, 0);
-	this->mDeviceContext->IASetIndexBuffer(NULL, DXGI_FORMAT_R32_UINT, 0);
-	this->mDeviceContext->IASetInputLayout(NULL);
+	this->mStateCache.IASetVertexBuffers(0, 0, NULL, 0, 0);
+	this->mStateCache.IASetVertexBuffers(1, 0, NULL, 0, 0);
+	this->mStateCache.IASetIndexBuffer(NULL, DXGI_FORMAT_R32_UINT, 0);
+	this->mStateCache.IASetInputLayout(NULL);
 	
 	
-	this->mDeviceContext->VSSetShader(this->mOutlineVertexShader, NULL, 0);
-	this->mDeviceContext->PSSetShader(this->mOutlinePixelShader, NULL, 0);
+	this->mStateCache.VSSetShader(this->mOutlineVertexShader, NULL, 0);
+	this->mStateCache.PSSetShader(this->mOutlinePixelShader, NULL, 0);
 
 	this->mDeviceContext->Draw(3, 0);
 	
 	ID3D11ShaderResourceView* nullSRV[1] = { nullptr };
-	this->mDeviceContext->PSSetShaderResources(0, 1, nullSRV);
+	this->mStateCache.PSSetShaderResources(0, 1, nullSRV);
 	
-	HRESULT hr = this->mSwapChain->Present(0, 0);
+	if (this->mSwapChain != nullptr)
+		this->mSwapChain->Present(0, 0);
+	this->mConstantRing.EndFrame();
+	this->mFrameIndex++;
+
+	// Keep the counters of the finished frame around and start counting the next one
+	this->mLastStateCacheStats = this->mStateCache.GetStats();
+	this->mStateCache.ResetStats();
+
+	// The recorders filtered the state calls of the draws, the state cache only the ones between the slices and after them
+	this->mFrameStats.filteredStateCalls += this->mLastStateCacheStats.filteredCalls;
+	this->mFrameStats.occlusionTested = this->mOcclusion.GetStats().testedObjects;
+	this->mFrameStats.occluded = this->mOcclusion.GetStats().occludedObjects;
+	const uint64_t jobCount = JobSystem::GetStats().executedJobs;
+	this->mFrameStats.jobs = jobCount - this->mLastJobCount;
+	this->mLastJobCount = jobCount;
+	this->mFrameStats.frameArenaBytes = FrameArena::ThreadLocal().GetStats().usedBytes;
+	this->mFrameStats.renderTime = this->mPipelineClock.Now() - renderStart;
+	this->UpdateStatsOverlay(packet.showStatsOverlay);
+
+	// How long the simulated state took to reach the screen
+	const double latency = this->mPipelineClock.Now() - packet.publishTime;
+	this->mPipelineStats.rendered++;
+	this->mPipelineStats.lastLatency = latency;
+	this->mPipelineStats.averageLatency += (latency - this->mPipelineStats.averageLatency) / this->mPipelineStats.rendered;
+	this->mPipelineStats.maxLatency = (std::max)(this->mPipelineStats.maxLatency, latency);
+}
+
+const StateCacheStats& Renderer::GetStateCacheStats() const
+{
+	return this->mLastStateCacheStats;
+}
+
+const OcclusionStats& Renderer::GetOcclusionStats() const
+{
+	return this->mOcclusion.GetStats();
 }
 
 void Renderer::MouseMoved(int x, int y)
@@ -281,7 +705,21 @@ void Renderer::KeyPressed(WPARAM key)
 
 void Renderer::LoadMesh(std::string& filepath)
 {
-	this->objLoader.LoadFile(filepath);
+	PROFILE_ZONE("LoadMesh");
+	MEMORY_SCOPE(MEMORY_CATEGORY_OBJ_IMPORT);
+	if (this->mpInputRecorder != nullptr)
+		this->mpInputRecorder->RecordLoad(filepath, false);
+	// A file whose import alone needs more than the budget is not used
+	MemoryTracker::ResetPeak(MEMORY_CATEGORY_OBJ_IMPORT);
+	{
+		PROFILE_ZONE("objl::Loader::LoadFile");
+		this->objLoader.LoadFile(filepath);
+	}
+	if (MemoryTracker::IsOverBudget(MEMORY_CATEGORY_OBJ_IMPORT))
+	{
+		OutputDebugStringA(("OBJ import over its memory budget, skipped: " + filepath + "\n").c_str());
+		return;
+	}
 	std::vector<objl::Mesh> meshes = objLoader.LoadedMeshes;
 
 
@@ -308,74 +746,94 @@ void Renderer::LoadMesh(std::string& filepath)
 		);
 
 
-		D3D11_BUFFER_DESC ibd;
-		ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
-		ibd.Usage = D3D11_USAGE_IMMUTABLE;
-		ibd.ByteWidth = sizeof(UINT) * a.Indices.size();
-		ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		ibd.CPUAccessFlags = 0;
-		ibd.MiscFlags = 0;
-		ibd.StructureByteStride = 0;
-
-		D3D11_SUBRESOURCE_DATA iinitData;
-		iinitData.pSysMem = &a.Indices[0];
-
-		hr = this->mDevice->CreateBuffer(&ibd, &iinitData, &indBuf);
+		// The simplified LODs are appended after the original indices and share the vertex buffer
+		MeshSimplifier::SimplifyInput simplifyInput;
+		simplifyInput.pPositions = &a.Vertices[0].Position;
+		simplifyInput.positionStride = sizeof(objl::Vertex);
+		simplifyInput.pNormals = &a.Vertices[0].Normal;
+		simplifyInput.normalStride = sizeof(objl::Vertex);
+		simplifyInput.pUVs = &a.Vertices[0].TextureCoordinate;
+		simplifyInput.uvStride = sizeof(objl::Vertex);
+		simplifyInput.vertexCount = (unsigned int)a.Vertices.size();
+		simplifyInput.pIndices = a.Indices.data();
+		simplifyInput.indexCount = (unsigned int)a.Indices.size();
+		std::vector<unsigned int> lodIndices;
+		std::vector<MeshSimplifier::MeshLod> lods;
+		MeshSimplifier::BuildLodChain(simplifyInput, LOD_MAX_LEVELS, &lodIndices, &lods);
+		// Only needed until the index buffer is created
+		FrameVector<unsigned int> indices;
+		indices.reserve(a.Indices.size() + lodIndices.size());
+		indices.insert(indices.end(), a.Indices.begin(), a.Indices.end());
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+
+		DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+		hr = this->CreateIndexBuffer(indices.data(), (UINT)indices.size(), (UINT)a.Vertices.size(), &indBuf, &indexFormat);
+
+		std::vector<Meshlets::Meshlet> meshlets;
+		Meshlets::BuildMeshlets(&a.Vertices[0].Position,
+			sizeof(objl::Vertex),
+			(unsigned int)a.Vertices.size(),
+			a.Indices.data(),
+			(unsigned int)a.Indices.size(),
+			&meshlets);
 
 		testVertexBuffers.push_back(verBuf);
 		testIndexBuffers.push_back(indBuf);
+		testIndexFormats.push_back(indexFormat);
 		testIndexCount.push_back(a.Indices.size());
+		testMeshlets.push_back(meshlets);
+		testLods.push_back(lods);
+		testBounds.push_back(Bounds::ComputeBounds(&a.Vertices[0].Position, sizeof(objl::Vertex), (unsigned int)a.Vertices.size()));
 	}
 }
 
 void Renderer::LoadMesh(std::string& filepath, bool fbx)
 {
+	PROFILE_ZONE("LoadMesh");
+	MEMORY_SCOPE(MEMORY_CATEGORY_FBX_IMPORT);
+	if (this->mpInputRecorder != nullptr)
+		this->mpInputRecorder->RecordLoad(filepath, true);
+	// The skeleton counts against the animation budget, the rest of the import against the FBX one
+	MemoryTracker::ResetPeak(MEMORY_CATEGORY_FBX_IMPORT);
+	MemoryTracker::ResetPeak(MEMORY_CATEGORY_ANIMATION);
 
 	MeshObject mesh;
-	mesh.LoadFBX(filepath);
-	std::vector<DirectX::XMFLOAT3>* vertexPositions = mesh.GetVertexPositionVector();
-	std::vector<int>* vertexIndices = mesh.GetIndexVector();
-	std::vector<DirectX::XMFLOAT3>* normals = mesh.GetNormalVector();
-	std::vector<DirectX::XMFLOAT2>* UVs = mesh.GetUVVector();
+	HRESULT loadResult = mesh.LoadFBX(filepath);
+	if (SUCCEEDED(loadResult) && (MemoryTracker::IsOverBudget(MEMORY_CATEGORY_FBX_IMPORT) || MemoryTracker::IsOverBudget(MEMORY_CATEGORY_ANIMATION)))
+	{
+		OutputDebugStringA(("FBX import over its memory budget, skipped: " + filepath + "\n").c_str());
+		loadResult = E_OUTOFMEMORY;
+	}
+	// Views into the mesh storage, nothing is copied until the vertices are interleaved
+	ArrayView<const DirectX::XMFLOAT3> vertexPositions = mesh.GetVertexPositions();
+	ArrayView<const unsigned int> indices = mesh.GetIndices();
+	ArrayView<const unsigned int> lodIndices = mesh.GetLodIndices();
+	ArrayView<const DirectX::XMFLOAT3> normals = mesh.GetNormals();
+	ArrayView<const DirectX::XMFLOAT2> UVs = mesh.GetUVs();
 	FbxLoader::Skeleton* skeleton = mesh.GetSkeleton();
-	std::vector<FbxLoader::ControlPointInfo>* skinWeights = mesh.GetSkinningWeights();
+	ArrayView<const FbxLoader::ControlPointInfo> skinWeights = mesh.GetSkinningWeights();
 	ID3D11Buffer* verBuf = nullptr;
 	ID3D11Buffer* indBuf = nullptr;
-	if (vertexIndices)
+	if (SUCCEEDED(loadResult))
 	{
 		// Non-skinned mesh
-		if (!skeleton)
+		if (!mesh.HasSkeleton())
 		{
-			objl::Vertex* input_vertices = new objl::Vertex[vertexPositions->size()];
-			for (int i = 0; i < vertexPositions->size(); ++i)
-			{
-				input_vertices[i].Position.X = (*vertexPositions)[i].x;
-				input_vertices[i].Position.Y = (*vertexPositions)[i].y;
-				input_vertices[i].Position.Z = (*vertexPositions)[i].z;
-				if (mesh.HasUVs())
-				{
-					input_vertices[i].TextureCoordinate.X = (*UVs)[i].x;
-					input_vertices[i].TextureCoordinate.Y = (*UVs)[i].y;
-				}
-				if (mesh.HasNormals())
-				{
-					input_vertices[i].Normal.X = (*normals)[i].x;
-					input_vertices[i].Normal.Y = (*normals)[i].y;
-					input_vertices[i].Normal.Z = (*normals)[i].z;
-				}
-
-			}
+			// Missing normals or UVs have empty views and are packed as zero.
+			// The interleaved vertices are only needed until the vertex buffer is created
+			FrameVector<Vertex> input_vertices(vertexPositions.size());
+			VertexLayout::Pack(input_vertices.data(), input_vertices.size(), vertexPositions.data(), normals.data(), UVs.data());
 
 			D3D11_BUFFER_DESC vbd;
 			vbd.Usage = D3D11_USAGE_IMMUTABLE;
-			vbd.ByteWidth = sizeof(objl::Vertex) * vertexPositions->size();
+			vbd.ByteWidth = sizeof(Vertex) * vertexPositions.size();
 			vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 			vbd.CPUAccessFlags = 0;
 			vbd.MiscFlags = 0;
 			vbd.StructureByteStride = 0;
 
 			D3D11_SUBRESOURCE_DATA vinitData;
-			vinitData.pSysMem = input_vertices;
+			vinitData.pSysMem = input_vertices.data();
 
 			HRESULT hr = this->mDevice->CreateBuffer(
 				&vbd,
@@ -384,63 +842,33 @@ void Renderer::LoadMesh(std::string& filepath, bool fbx)
 			);
 
 
-			D3D11_BUFFER_DESC ibd;
-			ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
-			ibd.Usage = D3D11_USAGE_IMMUTABLE;
-			ibd.ByteWidth = sizeof(UINT) * vertexIndices->size();
-			ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-			ibd.CPUAccessFlags = 0;
-			ibd.MiscFlags = 0;
-			ibd.StructureByteStride = 0;
-
-			D3D11_SUBRESOURCE_DATA iinitData;
-			iinitData.pSysMem = vertexIndices->data();
-
-			hr = this->mDevice->CreateBuffer(&ibd, &iinitData, &indBuf);
+			DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+			hr = this->CreateIndexBuffer(indices.data(), (UINT)indices.size(), lodIndices.data(), (UINT)lodIndices.size(),
+				(UINT)vertexPositions.size(), &indBuf, &indexFormat);
 
 			testVertexBuffers.push_back(verBuf);
 			testIndexBuffers.push_back(indBuf);
-			testIndexCount.push_back(vertexIndices->size());
+			testIndexFormats.push_back(indexFormat);
+			testIndexCount.push_back(mesh.GetIndices().size());
+			testMeshlets.push_back(std::vector<Meshlets::Meshlet>(mesh.GetMeshlets().begin(), mesh.GetMeshlets().end()));
+			testLods.push_back(std::vector<MeshSimplifier::MeshLod>(mesh.GetLods().begin(), mesh.GetLods().end()));
+			testBounds.push_back(mesh.GetBounds());
 		}
 		else
 		{
-			SkinVertex* input_vertices = new SkinVertex[vertexPositions->size()];
-			for (int i = 0; i < vertexPositions->size(); ++i)
-			{
-				input_vertices[i].Pos.x = (*vertexPositions)[i].x;
-				input_vertices[i].Pos.y = (*vertexPositions)[i].y;
-				input_vertices[i].Pos.z = (*vertexPositions)[i].z;
-				if (mesh.HasUVs())
-				{
-					input_vertices[i].Texcoord.x = (*UVs)[i].x;
-					input_vertices[i].Texcoord.y = (*UVs)[i].y;
-				}
-				if (mesh.HasNormals())
-				{
-					input_vertices[i].Normal.x = (*normals)[i].x;
-					input_vertices[i].Normal.y = (*normals)[i].y;
-					input_vertices[i].Normal.z = (*normals)[i].z;
-				}
-				input_vertices[i].BlendWeights.x = (*skinWeights)[i].weightPairs[0].weight;
-				input_vertices[i].BlendIndices.x = (*skinWeights)[i].weightPairs[0].index;
-				input_vertices[i].BlendWeights.y = (*skinWeights)[i].weightPairs[1].weight;
-				input_vertices[i].BlendIndices.y = (*skinWeights)[i].weightPairs[1].index;
-				input_vertices[i].BlendWeights.z = (*skinWeights)[i].weightPairs[2].weight;
-				input_vertices[i].BlendIndices.z = (*skinWeights)[i].weightPairs[2].index;
-				input_vertices[i].BlendIndices.w = (*skinWeights)[i].weightPairs[3].index;
-				// Last weight not needed as it can be calculated in the shader
-			}
+			FrameVector<SkinVertex> input_vertices(vertexPositions.size());
+			SkinVertexLayout::Pack(input_vertices.data(), input_vertices.size(), vertexPositions.data(), normals.data(), UVs.data(), skinWeights.data(), skinWeights.data());
 
 				D3D11_BUFFER_DESC vbd;
 				vbd.Usage = D3D11_USAGE_IMMUTABLE;
-				vbd.ByteWidth = sizeof(SkinVertex) * vertexPositions->size();
+				vbd.ByteWidth = sizeof(SkinVertex) * vertexPositions.size();
 				vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 				vbd.CPUAccessFlags = 0;
 				vbd.MiscFlags = 0;
 				vbd.StructureByteStride = 0;
 
 				D3D11_SUBRESOURCE_DATA vinitData;
-				vinitData.pSysMem = input_vertices;
+				vinitData.pSysMem = input_vertices.data();
 
 				HRESULT hr = this->mDevice->CreateBuffer(
 					&vbd,
@@ -449,19 +877,9 @@ void Renderer::LoadMesh(std::string& filepath, bool fbx)
 				);
 
 
-				D3D11_BUFFER_DESC ibd;
-				ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
-				ibd.Usage = D3D11_USAGE_IMMUTABLE;
-				ibd.ByteWidth = sizeof(UINT) * vertexIndices->size();
-				ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-				ibd.CPUAccessFlags = 0;
-				ibd.MiscFlags = 0;
-				ibd.StructureByteStride = 0;
-
-				D3D11_SUBRESOURCE_DATA iinitData;
-				iinitData.pSysMem = vertexIndices->data();
-
-				hr = this->mDevice->CreateBuffer(&ibd, &iinitData, &indBuf);
+				DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+				hr = this->CreateIndexBuffer(indices.data(), (UINT)indices.size(), lodIndices.data(), (UINT)lodIndices.size(),
+					(UINT)vertexPositions.size(), &indBuf, &indexFormat);
 				std::vector<XMFLOAT4X4> temp;
 				FbxAMatrix tempFbxMatrix;
 				int iter = 0;
@@ -492,22 +910,83 @@ void Renderer::LoadMesh(std::string& filepath, bool fbx)
 					0,
 					0
 				);
+				// The simulation thread reads the skeletons and bounds while it steps
+				std::lock_guard<std::mutex> lock(this->mSceneMutex);
 				skinVertexBuffers.push_back(verBuf);
 				skinIndexBuffers.push_back(indBuf);
-				skinIndexCount.push_back(vertexIndices->size());
-				skinSkeletons.push_back(skeleton);
+				skinIndexFormats.push_back(indexFormat);
+				skinIndexCount.push_back(mesh.GetIndices().size());
+				skinLods.push_back(std::vector<MeshSimplifier::MeshLod>(mesh.GetLods().begin(), mesh.GetLods().end()));
+				skinBounds.push_back(mesh.GetBounds());
+				skinJointBounds.push_back(std::vector<Bounds::AABB>(mesh.GetJointBounds().begin(), mesh.GetJointBounds().end()));
+				mSkinPoseBoxes.push_back(mesh.GetBounds().box);
+				skinSkeletons.push_back(mesh.ReleaseSkeleton());
 		}
 	}
 }
 
+HRESULT Renderer::CreateIndexBuffer(const UINT* pIndices, UINT indexCount, UINT vertexCount, ID3D11Buffer** ppIndexBuffer, DXGI_FORMAT* pIndexFormat)
+{
+	return this->CreateIndexBuffer(pIndices, indexCount, nullptr, 0, vertexCount, ppIndexBuffer, pIndexFormat);
+}
+
+HRESULT Renderer::CreateIndexBuffer(const UINT* pIndices, UINT indexCount, const UINT* pLodIndices, UINT lodIndexCount, UINT vertexCount,
+	ID3D11Buffer** ppIndexBuffer, DXGI_FORMAT* pIndexFormat)
+{
+	// Every index fits in 16 bits when the mesh has fewer than 65536 vertices, which halves the index memory
+	std::vector<USHORT> shortIndices;
+	std::vector<UINT> joinedIndices;
+	const void* pData = pIndices;
+	UINT indexSize = sizeof(UINT);
+	*pIndexFormat = DXGI_FORMAT_R32_UINT;
+	if (vertexCount <= 0xffff)
+	{
+		shortIndices.reserve(indexCount + lodIndexCount);
+		shortIndices.assign(pIndices, pIndices + indexCount);
+		if (lodIndexCount > 0)
+			shortIndices.insert(shortIndices.end(), pLodIndices, pLodIndices + lodIndexCount);
+		pData = shortIndices.data();
+		indexSize = sizeof(USHORT);
+		*pIndexFormat = DXGI_FORMAT_R16_UINT;
+	}
+	else if (lodIndexCount > 0)
+	{
+		joinedIndices.reserve(indexCount + lodIndexCount);
+		joinedIndices.assign(pIndices, pIndices + indexCount);
+		joinedIndices.insert(joinedIndices.end(), pLodIndices, pLodIndices + lodIndexCount);
+		pData = joinedIndices.data();
+	}
+	indexCount += lodIndexCount;
+
+	D3D11_BUFFER_DESC ibd;
+	ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = indexSize * indexCount;
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ibd.CPUAccessFlags = 0;
+	ibd.MiscFlags = 0;
+	ibd.StructureByteStride = 0;
+
+	D3D11_SUBRESOURCE_DATA iinitData;
+	iinitData.pSysMem = pData;
+
+	return this->mDevice->CreateBuffer(&ibd, &iinitData, ppIndexBuffer);
+}
+
 bool Renderer::Init()
 {
 	HRESULT hr;
 
 
-	HWND activeWindow = GetActiveWindow();
-	RECT activeWindowRect;
-	GetWindowRect(activeWindow, &activeWindowRect);
+	// A headless renderer has no window, its offscreen target gets the size of the settings
+	HWND activeWindow = nullptr;
+	RECT activeWindowRect = { 0, 0, (LONG)this->mSettings.width, (LONG)this->mSettings.height };
+	if (!this->mSettings.headless)
+	{
+		activeWindow = GetActiveWindow();
+		GetWindowRect(activeWindow, &activeWindowRect);
+	}
+	this->mWindow = activeWindow;
 
 	this->mAspectRatio = (float)(activeWindowRect.right - activeWindowRect.left) / (float)(activeWindowRect.bottom - activeWindowRect.top);
 
@@ -521,6 +1000,9 @@ bool Renderer::Init()
 		1000.0f,
 		LOOK_MODE::LOOK_TO
 	);
+	XMStoreFloat4(&this->mPreviousCameraPosition, this->mCamera->GetPosition());
+	XMStoreFloat4(&this->mPreviousCameraLook, this->mCamera->GetLookVector());
+	this->mRenderCamera = new Camera(*this->mCamera);
 
 	
 
@@ -567,18 +1049,36 @@ bool Renderer::Init()
 	//dxgiAdapter->Release();
 	//dxgiFactory->Release();
 
-	hr = D3D11CreateDeviceAndSwapChain(NULL,
-		D3D_DRIVER_TYPE_HARDWARE,
-		NULL,
-		D3D11_CREATE_DEVICE_DEBUG,
-		NULL,
-		NULL,
-		D3D11_SDK_VERSION,
-		&swapChainDesc,
-		&this->mSwapChain,
-		&this->mDevice,
-		NULL,
-		&this->mDeviceContext);
+	if (this->mSettings.headless)
+	{
+		// Without the debug layer, headless renderers are there to be timed
+		const D3D_DRIVER_TYPE driverTypes[] = { D3D_DRIVER_TYPE_HARDWARE, D3D_DRIVER_TYPE_WARP, D3D_DRIVER_TYPE_NULL };
+		hr = D3D11CreateDevice(NULL,
+			driverTypes[this->mSettings.backend],
+			NULL,
+			0,
+			NULL,
+			0,
+			D3D11_SDK_VERSION,
+			&this->mDevice,
+			NULL,
+			&this->mDeviceContext);
+	}
+	else
+	{
+		hr = D3D11CreateDeviceAndSwapChain(NULL,
+			D3D_DRIVER_TYPE_HARDWARE,
+			NULL,
+			D3D11_CREATE_DEVICE_DEBUG,
+			NULL,
+			NULL,
+			D3D11_SDK_VERSION,
+			&swapChainDesc,
+			&this->mSwapChain,
+			&this->mDevice,
+			NULL,
+			&this->mDeviceContext);
+	}
 	
 	//hr = dxgiFactory->CreateSwapChain(mDevice, &swapChainDesc, &mSwapChain);
 
@@ -588,9 +1088,57 @@ bool Renderer::Init()
 		return false;
 	}
 
+	// Constant buffer slices are bound with offsets, which needs the D3D11.1 runtime (Windows 8, or Windows 7 with
+	// the Platform Update) and a driver that reports ConstantBufferOffsetting. Feature level 11_1 devices and WARP
+	// always do, most older devices do with a WDDM 1.2 driver. This is the minimum requirement of the renderer,
+	// there is no path that draws without the ring.
+	hr = this->mDeviceContext->QueryInterface(__uuidof(ID3D11DeviceContext1),
+		reinterpret_cast<void**>(&this->mDeviceContext1));
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(hr))
+		hr = this->mDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (FAILED(hr) || !options.ConstantBufferOffsetting)
+	{
+		MessageBox(0, L"This renderer needs Direct3D 11.1 with constant buffer offsetting (Windows 8 or later, or the Platform Update for Windows 7, and a WDDM 1.2 driver). Try -benchmark -backend warp to run on the software rasterizer.", 0, 0);
+		return false;
+	}
+	this->mStateCache.SetContext(this->mDeviceContext1);
+
+	// The draw list is recorded by up to one job per worker, every recorder writes into its own buffer
+	unsigned int sliceCount = (std::min)(JobSystem::GetWorkerCount(), (unsigned int)COMMAND_MAX_SLICES);
+	this->mCommandBuffers.resize(sliceCount);
+	this->mCommandRecorders.resize(sliceCount);
+	for (unsigned int i = 0; i < sliceCount; ++i)
+	{
+		this->mCommandRecorders[i].SetContext(&this->mCommandBuffers[i]);
+	}
+	hr = this->mDeferredBackend.Init(this->mDevice, sliceCount);
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateDeferredContext failed.", 0, 0);
+		return false;
+	}
+
 
-	hr = mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D),
-		reinterpret_cast<void**>(&mBackBuffer));
+	if (this->mSettings.headless)
+	{
+		D3D11_TEXTURE2D_DESC targetDesc;
+		ZeroMemory(&targetDesc, sizeof(D3D11_TEXTURE2D_DESC));
+		targetDesc.Width				= modeDesc.Width;
+		targetDesc.Height				= modeDesc.Height;
+		targetDesc.MipLevels			= 1;
+		targetDesc.ArraySize			= 1;
+		targetDesc.Format				= modeDesc.Format;
+		targetDesc.SampleDesc.Count		= 1;
+		targetDesc.Usage				= D3D11_USAGE_DEFAULT;
+		targetDesc.BindFlags			= D3D11_BIND_RENDER_TARGET;
+		hr = this->mDevice->CreateTexture2D(&targetDesc, 0, &mBackBuffer);
+	}
+	else
+	{
+		hr = mSwapChain->GetBuffer(0, __uuidof(ID3D11Texture2D),
+			reinterpret_cast<void**>(&mBackBuffer));
+	}
 
 	if (FAILED(hr))
 	{
@@ -682,7 +1230,8 @@ bool Renderer::Init()
 	// Initialize keyboard and mouse
 	m_keyboard = std::make_unique<DirectX::Keyboard>();
 	m_mouse = std::make_unique<DirectX::Mouse>();
-	m_mouse->SetWindow(activeWindow);
+	if (activeWindow != nullptr)
+		m_mouse->SetWindow(activeWindow);
 
 	return true;
 }
@@ -743,19 +1292,7 @@ bool Renderer::CreateVertexBuffers()
 		4, 3, 7
 	};
 
-	D3D11_BUFFER_DESC ibd;
-	ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * 36;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = indices;
-
-	hr = this->mDevice->CreateBuffer(&ibd, &iinitData, &this->mCubeIndexBuffer);
+	hr = this->CreateIndexBuffer(indices, 36, 8, &this->mCubeIndexBuffer, &this->mCubeIndexFormat);
 
 	if (FAILED(hr))
 	{
@@ -819,16 +1356,11 @@ bool Renderer::CreateShadersAndInputLayout()
 
 	// Create input layout
 
-	D3D11_INPUT_ELEMENT_DESC vertexDesc[] =
-	{
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0}
-	};
+	auto vertexDesc = VertexLayout::InputElements();
 
 	hr = mDevice->CreateInputLayout(
-		vertexDesc,
-		3,
+		vertexDesc.data(),
+		(UINT)vertexDesc.size(),
 		vs_blob->GetBufferPointer(),
 		vs_blob->GetBufferSize(),
 		&this->mDefaultInputLayout
@@ -881,23 +1413,126 @@ bool Renderer::CreateShadersAndInputLayout()
 	}
 
 	// Create input layout for skinning VS
-	D3D11_INPUT_ELEMENT_DESC skinVertexDesc[] =
-	{
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"BLENDWEIGHT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{"BLENDINDICES", 0, DXGI_FORMAT_R32G32B32A32_SINT, 0, 44, D3D11_INPUT_PER_VERTEX_DATA, 0}
-	};
+	auto skinVertexDesc = SkinVertexLayout::InputElements();
 
 	hr = mDevice->CreateInputLayout(
-		skinVertexDesc,
-		5,
+		skinVertexDesc.data(),
+		(UINT)skinVertexDesc.size(),
 		skin_vs_blob->GetBufferPointer(),
 		skin_vs_blob->GetBufferSize(),
 		&this->mSkinInputLayout
 	);
 
+	// Compile instanced VS
+
+	ID3DBlob* instanced_vs_blob = nullptr;
+	hr = D3DCompileFromFile(
+		L"InstancedVS.hlsl",
+		nullptr,
+		nullptr,
+		"INSTANCED_VS",
+		"vs_5_0",
+		0,
+		0,
+		&instanced_vs_blob,
+		nullptr
+	);
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"D3DCompileFromFile Compiling Instanced Vertex Shader failed", 0, 0);
+		return false;
+	}
+
+	hr = this->mDevice->CreateVertexShader(
+		instanced_vs_blob->GetBufferPointer(),
+		instanced_vs_blob->GetBufferSize(),
+		nullptr,
+		&mInstancedVertexShader
+	);
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateVertexShader failed for instanced_vs", 0, 0);
+		return false;
+	}
+
+	// Per vertex data from slot 0 followed by the per instance matrix rows from slot 1
+	auto instancedVertexDesc = VertexLayout::InputElements(0);
+	auto instanceDesc = InstanceLayout::InputElements(1, D3D11_INPUT_PER_INSTANCE_DATA, 1);
+	std::vector<D3D11_INPUT_ELEMENT_DESC> instancedDesc(instancedVertexDesc.begin(), instancedVertexDesc.end());
+	instancedDesc.insert(instancedDesc.end(), instanceDesc.begin(), instanceDesc.end());
+
+	hr = mDevice->CreateInputLayout(
+		instancedDesc.data(),
+		(UINT)instancedDesc.size(),
+		instanced_vs_blob->GetBufferPointer(),
+		instanced_vs_blob->GetBufferSize(),
+		&this->mInstancedInputLayout
+	);
+	instanced_vs_blob->Release();
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateInputLayout failed for instanced_vs", 0, 0);
+		return false;
+	}
+
+	// Compile crowd VS
+
+	ID3DBlob* crowd_vs_blob = nullptr;
+	hr = D3DCompileFromFile(
+		L"CrowdSkinningVS.hlsl",
+		nullptr,
+		nullptr,
+		"CROWD_VS",
+		"vs_5_0",
+		0,
+		0,
+		&crowd_vs_blob,
+		nullptr
+	);
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"D3DCompileFromFile Compiling Crowd Vertex Shader failed", 0, 0);
+		return false;
+	}
+
+	hr = this->mDevice->CreateVertexShader(
+		crowd_vs_blob->GetBufferPointer(),
+		crowd_vs_blob->GetBufferSize(),
+		nullptr,
+		&mCrowdVertexShader
+	);
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateVertexShader failed for crowd_vs", 0, 0);
+		return false;
+	}
+
+	// Skinned vertices from slot 0 followed by the per instance matrix rows and palette offset from slot 1
+	auto crowdVertexDesc = SkinVertexLayout::InputElements(0);
+	auto crowdInstanceDesc = CrowdInstanceLayout::InputElements(1, D3D11_INPUT_PER_INSTANCE_DATA, 1);
+	std::vector<D3D11_INPUT_ELEMENT_DESC> crowdDesc(crowdVertexDesc.begin(), crowdVertexDesc.end());
+	crowdDesc.insert(crowdDesc.end(), crowdInstanceDesc.begin(), crowdInstanceDesc.end());
+
+	hr = mDevice->CreateInputLayout(
+		crowdDesc.data(),
+		(UINT)crowdDesc.size(),
+		crowd_vs_blob->GetBufferPointer(),
+		crowd_vs_blob->GetBufferSize(),
+		&this->mCrowdInputLayout
+	);
+	crowd_vs_blob->Release();
+
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateInputLayout failed for crowd_vs", 0, 0);
+		return false;
+	}
+
 	// Compile outline VS
 
 	ID3DBlob* outline_vs_blob = nullptr;
@@ -1115,38 +1750,14 @@ bool Renderer::CreateConstantBuffers()
 {
 	DirectX::XMStoreFloat4x4(&mCubeWorld, DirectX::XMMatrixIdentity());
 
-	DirectX::XMMATRIX view = this->mCamera->GetViewMatrix();
-
-	DirectX::XMMATRIX proj = DirectX::XMMatrixPerspectiveFovLH(0.25f * DirectX::XM_PI, this->mAspectRatio, 1.0f, 1000.0f);
-	DirectX::XMStoreFloat4x4(&mProjection, proj);
-
-	DirectX::XMMATRIX wvp = DirectX::XMMatrixMultiply(view, proj);
-
-	VS_WVP_CONSTANT_BUFFER vsConstData;
-	DirectX::XMStoreFloat4x4(&vsConstData.mWorldViewProj, wvp);
-	// Fill in a buffer description.
-	D3D11_BUFFER_DESC cbDesc;
-	cbDesc.ByteWidth = sizeof(VS_WVP_CONSTANT_BUFFER);
-	cbDesc.Usage = D3D11_USAGE_DEFAULT;
-	cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbDesc.CPUAccessFlags = 0;
-	cbDesc.MiscFlags = 0;
-	cbDesc.StructureByteStride = 0;
-
-	// Fill in the subresource data.
-	D3D11_SUBRESOURCE_DATA InitData;
-	InitData.pSysMem = &vsConstData;
-	InitData.SysMemPitch = 0;
-	InitData.SysMemSlicePitch = 0;
-
-	// Create the buffer.
-	HRESULT hr = this->mDevice->CreateBuffer(&cbDesc, &InitData,
-		&this->mWVPBuffer);
+	// The per frame and per object constants are slices of one dynamic ring buffer
+	HRESULT hr = this->mConstantRingBackend.Init(this->mDevice, this->mDeviceContext, CONSTANT_BUFFER_RING_SIZE);
 	if (FAILED(hr))
 	{
-		MessageBox(0, L"CreateBuffer for WVP failed", 0, 0);
+		MessageBox(0, L"CreateBuffer for the constant buffer ring failed", 0, 0);
 		return false;
 	}
+	this->mConstantRing.Init(&this->mConstantRingBackend, CONSTANT_BUFFER_RING_SIZE);
 
 	VS_BONE_CONSTANT_BUFFER vsSkeletonData;
 	
@@ -1473,7 +2084,7 @@ void Renderer::CreateSphere(int LatLines, int LongLines)
 		HRESULT hr = this->mDevice->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &sphereVertBuffer);
 
 
-		std::vector<DWORD> indices(NumSphereFaces * 3);
+		std::vector<UINT> indices(NumSphereFaces * 3);
 
 		int k = 0;
 		for (DWORD l = 0; l < LongLines - 1; ++l)
@@ -1527,19 +2138,7 @@ void Renderer::CreateSphere(int LatLines, int LongLines)
 		indices[k + 1] = (NumSphereVertices - 1) - LongLines;
 		indices[k + 2] = NumSphereVertices - 2;
 
-		D3D11_BUFFER_DESC indexBufferDesc;
-		ZeroMemory(&indexBufferDesc, sizeof(indexBufferDesc));
-
-		indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-		indexBufferDesc.ByteWidth = sizeof(DWORD) * NumSphereFaces * 3;
-		indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		indexBufferDesc.CPUAccessFlags = 0;
-		indexBufferDesc.MiscFlags = 0;
-
-		D3D11_SUBRESOURCE_DATA iinitData;
-
-		iinitData.pSysMem = &indices[0];
-		this->mDevice->CreateBuffer(&indexBufferDesc, &iinitData, &sphereIndexBuffer);
+		this->CreateIndexBuffer(indices.data(), NumSphereFaces * 3, NumSphereVertices, &sphereIndexBuffer, &sphereIndexFormat);
 	}
 }
 
@@ -1572,58 +2171,489 @@ void Renderer::ObjLoaderTest()
 		);
 
 
+		// The simplified LODs are appended after the original indices and share the vertex buffer
+		MeshSimplifier::SimplifyInput simplifyInput;
+		simplifyInput.pPositions = &a.Vertices[0].Position;
+		simplifyInput.positionStride = sizeof(objl::Vertex);
+		simplifyInput.pNormals = &a.Vertices[0].Normal;
+		simplifyInput.normalStride = sizeof(objl::Vertex);
+		simplifyInput.pUVs = &a.Vertices[0].TextureCoordinate;
+		simplifyInput.uvStride = sizeof(objl::Vertex);
+		simplifyInput.vertexCount = (unsigned int)a.Vertices.size();
+		simplifyInput.pIndices = a.Indices.data();
+		simplifyInput.indexCount = (unsigned int)a.Indices.size();
+		std::vector<unsigned int> lodIndices;
+		std::vector<MeshSimplifier::MeshLod> lods;
+		MeshSimplifier::BuildLodChain(simplifyInput, LOD_MAX_LEVELS, &lodIndices, &lods);
+		// Only needed until the index buffer is created
+		FrameVector<unsigned int> indices;
+		indices.reserve(a.Indices.size() + lodIndices.size());
+		indices.insert(indices.end(), a.Indices.begin(), a.Indices.end());
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+
+		DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+		hr = this->CreateIndexBuffer(indices.data(), (UINT)indices.size(), (UINT)a.Vertices.size(), &indBuf, &indexFormat);
+
+		std::vector<Meshlets::Meshlet> meshlets;
+		Meshlets::BuildMeshlets(&a.Vertices[0].Position,
+			sizeof(objl::Vertex),
+			(unsigned int)a.Vertices.size(),
+			a.Indices.data(),
+			(unsigned int)a.Indices.size(),
+			&meshlets);
+
+		testVertexBuffers.push_back(verBuf);
+		testIndexBuffers.push_back(indBuf);
+		testIndexFormats.push_back(indexFormat);
+		testIndexCount.push_back(a.Indices.size());
+		testMeshlets.push_back(meshlets);
+		testLods.push_back(lods);
+		testBounds.push_back(Bounds::ComputeBounds(&a.Vertices[0].Position, sizeof(objl::Vertex), (unsigned int)a.Vertices.size()));
+	}
+}
+
+void Renderer::LoadInstancedMesh(const std::string& filepath, const std::vector<DirectX::XMFLOAT4X4>& worlds)
+{
+	PROFILE_ZONE("LoadInstancedMesh");
+	MEMORY_SCOPE(MEMORY_CATEGORY_OBJ_IMPORT);
+	MemoryTracker::ResetPeak(MEMORY_CATEGORY_OBJ_IMPORT);
+	if (worlds.empty() || !this->objLoader.LoadFile(filepath))
+		return;
+	if (MemoryTracker::IsOverBudget(MEMORY_CATEGORY_OBJ_IMPORT))
+	{
+		OutputDebugStringA(("OBJ import over its memory budget, skipped: " + filepath + "\n").c_str());
+		return;
+	}
+	std::vector<objl::Mesh> meshes = objLoader.LoadedMeshes;
+
+	for (auto& a : meshes)
+	{
+		if (a.Vertices.empty() || a.Indices.empty())
+			continue;
+
+		InstancedMesh mesh;
+		D3D11_BUFFER_DESC vbd;
+		vbd.Usage = D3D11_USAGE_IMMUTABLE;
+		vbd.ByteWidth = (UINT)(sizeof(objl::Vertex) * a.Vertices.size());
+		vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vbd.CPUAccessFlags = 0;
+		vbd.MiscFlags = 0;
+		vbd.StructureByteStride = 0;
+
+		D3D11_SUBRESOURCE_DATA vinitData;
+		vinitData.pSysMem = &a.Vertices[0];
+
+		HRESULT hr = this->mDevice->CreateBuffer(&vbd, &vinitData, &mesh.pVertexBuffer);
+		if (FAILED(hr))
+			return;
+
+		hr = this->CreateIndexBuffer(a.Indices.data(), (UINT)a.Indices.size(), (UINT)a.Vertices.size(), &mesh.pIndexBuffer, &mesh.indexFormat);
+		if (FAILED(hr))
+		{
+			SafeRelease(&mesh.pVertexBuffer);
+			return;
+		}
+
+		// Rewritten every frame with the visible instances
 		D3D11_BUFFER_DESC ibd;
-		ZeroMemory(&ibd, sizeof(D3D11_BUFFER_DESC));
-		ibd.Usage = D3D11_USAGE_IMMUTABLE;
-		ibd.ByteWidth = sizeof(UINT) * a.Indices.size();
-		ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		ibd.CPUAccessFlags = 0;
+		ibd.Usage = D3D11_USAGE_DYNAMIC;
+		ibd.ByteWidth = (UINT)(sizeof(Instancing::InstanceData) * worlds.size());
+		ibd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		ibd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		ibd.MiscFlags = 0;
 		ibd.StructureByteStride = 0;
 
-		D3D11_SUBRESOURCE_DATA iinitData;
-		iinitData.pSysMem = &a.Indices[0];
+		hr = this->mDevice->CreateBuffer(&ibd, NULL, &mesh.pInstanceBuffer);
+		if (FAILED(hr))
+		{
+			SafeRelease(&mesh.pVertexBuffer);
+			SafeRelease(&mesh.pIndexBuffer);
+			return;
+		}
 
-		hr = this->mDevice->CreateBuffer(&ibd, &iinitData, &indBuf);
+		mesh.indexCount = (UINT)a.Indices.size();
+		mesh.bounds = Bounds::ComputeBounds(&a.Vertices[0].Position, sizeof(objl::Vertex), (unsigned int)a.Vertices.size());
+		mesh.worlds = worlds;
+		mesh.worldBoxes.resize(worlds.size());
+		for (size_t i = 0; i < worlds.size(); ++i)
+		{
+			mesh.worldBoxes[i] = Bounds::TransformAABB(mesh.bounds.box, XMLoadFloat4x4(&worlds[i]));
+			mesh.bvh.Insert(mesh.worldBoxes[i], (uint32_t)i);
+		}
+		// The placements never move, one SAH build gives a better tree than the incremental inserts
+		mesh.bvh.Rebuild();
+		mesh.visible.reserve(worlds.size());
+		mesh.instances.resize(worlds.size());
+		this->mInstancedMeshes.push_back(std::move(mesh));
+	}
+}
 
-		testVertexBuffers.push_back(verBuf);
-		testIndexBuffers.push_back(indBuf);
-		testIndexCount.push_back(a.Indices.size());
+void Renderer::LoadForest(unsigned int treeCount)
+{
+	// Square grid of trees centered on the origin with a bit of jitter, rotation and scale per tree
+	unsigned int side = (unsigned int)ceilf(sqrtf((float)treeCount));
+	const float spacing = 4.0f;
+	std::vector<DirectX::XMFLOAT4X4> worlds(treeCount);
+	srand(1337);
+	for (unsigned int i = 0; i < treeCount; ++i)
+	{
+		float x = ((float)(i % side) - side * 0.5f) * spacing + (rand() / (float)RAND_MAX - 0.5f) * spacing;
+		float z = ((float)(i / side) - side * 0.5f) * spacing + (rand() / (float)RAND_MAX - 0.5f) * spacing;
+		float yaw = (rand() / (float)RAND_MAX) * XM_2PI;
+		float size = 0.8f + (rand() / (float)RAND_MAX) * 0.4f;
+		XMStoreFloat4x4(&worlds[i], XMMatrixScaling(size, size, size) * XMMatrixRotationY(yaw) * XMMatrixTranslation(x, 0.0f, z));
+	}
+	this->LoadInstancedMesh(FOREST_MODEL_PATH, worlds);
+}
+
+void Renderer::SpawnCrowd(unsigned int mesh, unsigned int count)
+{
+	MEMORY_SCOPE(MEMORY_CATEGORY_ANIMATION);
+	if (mesh >= skinSkeletons.size())
+		return;
+	FbxLoader::Skeleton* skeleton = skinSkeletons[mesh].get();
+
+	// UniqueSkeletonData starts out in the idle animation, any other one would crossfade from it
+	if (skeleton->animationFlags[FbxLoader::IDLE] == -1)
+		return;
+
+	// Rows of characters in front of the origin, continuing where the previous spawn stopped
+	const unsigned int rowLength = 64;
+	const float spacing = (std::max)(skinBounds[mesh].sphere.radius * 2.0f, 1.0f);
+	const unsigned int first = (unsigned int)this->mCrowdCharacters.size();
+	const unsigned int total = first + count;
+	this->mCrowdSkeletons.reserve(total);
+	this->mCrowdAnimations.reserve(total);
+	this->mCrowdCharacters.reserve(total);
+	for (unsigned int i = first; i < total; ++i)
+	{
+		FbxLoader::UniqueSkeletonData data;
+		data.Init(skeleton, this->mRandom());
+		// Start every character at a different point of the animation
+		data.ResetFrameCount();
+
+		Crowd::Character character;
+		character.mesh = mesh;
+		float x = ((float)(i % rowLength) - rowLength * 0.5f) * spacing;
+		float z = (float)(i / rowLength + 1) * spacing;
+		float yaw = std::uniform_real_distribution<float>(0.0f, XM_2PI)(this->mRandom);
+		XMStoreFloat4x4(&character.world, XMMatrixRotationY(yaw) * XMMatrixTranslation(x, 0.0f, z));
+		character.pJointMatrices = data.frameData;
+		character.jointCount = skeleton->jointCount;
+
+		this->mCrowdSkeletons.push_back(data);
+		this->mCrowdAnimations.push_back(FbxLoader::IDLE);
+		this->mCrowdCharacters.push_back(character);
+	}
+
+	// The bind pose box of the mesh until the first step has sampled a pose
+	this->mCrowdBoxes.Resize(total);
+	for (unsigned int i = first; i < total; ++i)
+	{
+		this->mCrowdBoxes.Set(i, Bounds::TransformAABB(skinBounds[mesh].box, XMLoadFloat4x4(&this->mCrowdCharacters[i].world)));
+	}
+}
+
+void Renderer::AnimateCrowd(float dt)
+{
+	PROFILE_ZONE("AnimateCrowd");
+	// The characters only write their own frame data, so they animate in parallel
+	JobSystem::ParallelFor((unsigned int)this->mCrowdSkeletons.size(), CROWD_ANIMATION_BATCH_SIZE, [this, dt](unsigned int begin, unsigned int end)
+	{
+		PROFILE_ZONE("AnimateCrowd batch");
+		for (unsigned int i = begin; i < end; ++i)
+		{
+			this->mCrowdSkeletons[i].UpdateAnimation(dt, this->mCrowdAnimations[i]);
+			// Every character only sets its own lanes of the boxes
+			const Crowd::Character& character = this->mCrowdCharacters[i];
+			const std::vector<Bounds::AABB>& jointBounds = skinJointBounds[character.mesh];
+			if (!jointBounds.empty() && jointBounds.size() <= character.jointCount)
+			{
+				const Bounds::AABB pose = Bounds::ComputeSkinnedBounds(jointBounds, character.pJointMatrices);
+				this->mCrowdBoxes.Set(i, Bounds::TransformAABB(pose, XMLoadFloat4x4(&character.world)));
+			}
+		}
+	});
+}
+
+void Renderer::PackCrowd(FramePacket* pPacket)
+{
+	pPacket->crowdInstances.clear();
+	pPacket->crowdPalette.clear();
+	pPacket->crowdBatches.clear();
+	if (this->mCrowdCharacters.empty())
+		return;
+
+	// Every character keeps animating, only the ones in the frustum are drawn
+	XMMATRIX viewProj = this->mCamera->GetViewMatrix() * this->mCamera->GetProjectionMatrix();
+	XMFLOAT4 frustumPlanes[6];
+	Culling::ExtractFrustumPlanes(viewProj, frustumPlanes);
+	this->mCrowdVisible.resize(this->mCrowdBoxes.PaddedCount());
+	unsigned int visibleCount = Culling::CullAABBs(this->mCrowdBoxes, frustumPlanes, this->mCrowdVisible.data());
+	if (visibleCount == 0)
+		return;
+	this->mCrowdVisibleCharacters.resize(visibleCount);
+	for (unsigned int i = 0; i < visibleCount; ++i)
+	{
+		this->mCrowdVisibleCharacters[i] = this->mCrowdCharacters[this->mCrowdVisible[i]];
 	}
+
+	// The camera Render draws with is not known yet, the instances keep their world matrices
+	Crowd::Pack(this->mCrowdVisibleCharacters.data(),
+		visibleCount,
+		(unsigned int)skinSkeletons.size(),
+		XMMatrixIdentity(),
+		&pPacket->crowdInstances,
+		&pPacket->crowdPalette,
+		&pPacket->crowdBatches);
+}
+
+bool Renderer::UpdateCrowd(const FramePacket& packet, const DirectX::XMMATRIX& viewProj)
+{
+	if (packet.crowdInstances.empty())
+		return false;
+
+	UINT instanceCount = (UINT)packet.crowdInstances.size();
+	UINT paletteCount = (UINT)packet.crowdPalette.size();
+	if (instanceCount > this->mCrowdInstanceCapacity || paletteCount > this->mPaletteCapacity)
+	{
+		if (!this->CreateCrowdBuffers(Crowd::GrowCapacity(this->mCrowdInstanceCapacity, instanceCount),
+			Crowd::GrowCapacity(this->mPaletteCapacity, paletteCount)))
+			return false;
+	}
+
+	// One upload per buffer for the whole crowd
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	if (FAILED(this->mDeviceContext->Map(this->mPaletteBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	memcpy(mapped.pData, packet.crowdPalette.data(), paletteCount * sizeof(XMFLOAT4X4));
+	this->mDeviceContext->Unmap(this->mPaletteBuffer, 0);
+
+	if (FAILED(this->mDeviceContext->Map(this->mCrowdInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	Crowd::ApplyViewProj(packet.crowdInstances.data(), instanceCount, viewProj, static_cast<Crowd::InstanceData*>(mapped.pData));
+	this->mDeviceContext->Unmap(this->mCrowdInstanceBuffer, 0);
+	this->mFrameStats.paletteBytes += paletteCount * sizeof(XMFLOAT4X4);
+	this->mFrameStats.instanceBytes += instanceCount * sizeof(Crowd::InstanceData);
+	return true;
 }
 
-void Renderer::updateWVP(float dt)
+bool Renderer::CreateCrowdBuffers(UINT instanceCapacity, UINT paletteCapacity)
+{
+	SafeRelease(&this->mCrowdInstanceBuffer);
+	SafeRelease(&this->mPaletteSRV);
+	SafeRelease(&this->mPaletteBuffer);
+	this->mCrowdInstanceCapacity = 0;
+	this->mPaletteCapacity = 0;
+	// The new buffers can reuse the addresses of the released ones
+	this->mStateCache.Invalidate();
+
+	D3D11_BUFFER_DESC ibd;
+	ibd.Usage = D3D11_USAGE_DYNAMIC;
+	ibd.ByteWidth = sizeof(Crowd::InstanceData) * instanceCapacity;
+	ibd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	ibd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	ibd.MiscFlags = 0;
+	ibd.StructureByteStride = 0;
+
+	HRESULT hr = this->mDevice->CreateBuffer(&ibd, NULL, &this->mCrowdInstanceBuffer);
+	if (FAILED(hr))
+	{
+		MessageBox(0, L"CreateBuffer for crowd instances failed", 0, 0);
+		return false;
+	}
+
+	D3D11_BUFFER_DESC pbd;
+	pbd.Usage = D3D11_USAGE_DYNAMIC;
+	pbd.ByteWidth = sizeof(XMFLOAT4X4) * paletteCapacity;
+	pbd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	pbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	pbd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	pbd.StructureByteStride = sizeof(XMFLOAT4X4);
+
+	hr = this->mDevice->CreateBuffer(&pbd, NULL, &this->mPaletteBuffer);
+	if (FAILED(hr))
+	{
+		SafeRelease(&this->mCrowdInstanceBuffer);
+		MessageBox(0, L"CreateBuffer for crowd palette failed", 0, 0);
+		return false;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	ZeroMemory(&srvDesc, sizeof(srvDesc));
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = paletteCapacity;
+
+	hr = this->mDevice->CreateShaderResourceView(this->mPaletteBuffer, &srvDesc, &this->mPaletteSRV);
+	if (FAILED(hr))
+	{
+		SafeRelease(&this->mCrowdInstanceBuffer);
+		SafeRelease(&this->mPaletteBuffer);
+		MessageBox(0, L"CreateShaderResourceView for crowd palette failed", 0, 0);
+		return false;
+	}
+
+	this->mCrowdInstanceCapacity = instanceCapacity;
+	this->mPaletteCapacity = paletteCapacity;
+	return true;
+}
+
+void Renderer::updateFloorWorld(float dt, DirectX::XMFLOAT4X4* pWorld)
 {
 	DirectX::XMMATRIX newWorld = DirectX::XMLoadFloat4x4(&this->mCubeWorld);
 	//newWorld *= DirectX::XMMatrixRotationRollPitchYaw(dt, dt*0.1f, 0.0f);
 
 	DirectX::XMStoreFloat4x4(&this->mCubeWorld, newWorld);
-	DirectX::XMMATRIX view = this->mCamera->GetViewMatrix();
-
-	DirectX::XMMATRIX proj = DirectX::XMLoadFloat4x4(&this->mProjection);
 	// Make cube into floor
 	newWorld *= XMMatrixScaling(50.0f, 0.1f, 50.0f);
-	DirectX::XMMATRIX wvp = XMMatrixTranspose(DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(newWorld, view), proj));
 
-	VS_WVP_CONSTANT_BUFFER vsConstData;
-	DirectX::XMStoreFloat4x4(&vsConstData.mWorldViewProj, wvp);
+	DirectX::XMStoreFloat4x4(pWorld, XMMatrixTranspose(newWorld));
+}
 
-	this->mDeviceContext->UpdateSubresource(
-		this->mWVPBuffer,
-		0,
-		NULL,
-		&vsConstData,
-		0,
-		0
-	);
+void Renderer::DrawRenderQueue(const DirectX::XMMATRIX& viewProj)
+{
+	PROFILE_ZONE("DrawRenderQueue");
+	// Write the constants of every draw first, the ring has to be unmapped before the draws read from it.
+	// Sorted draws of the same object follow each other, so they share one slice.
+	if (!this->mConstantRing.Map())
+		return;
+	D3D11ConstantRing::Slice frameSlice;
+	bool frameAllocated = this->mConstantRing.Allocate(sizeof(VS_FRAME_CONSTANT_BUFFER), &frameSlice);
+	if (frameAllocated)
+	{
+		VS_FRAME_CONSTANT_BUFFER* pFrameConstants = static_cast<VS_FRAME_CONSTANT_BUFFER*>(frameSlice.pData);
+		XMStoreFloat4x4(&pFrameConstants->mViewProj, XMMatrixTranspose(viewProj));
+	}
+	this->mObjectSlices.resize(this->mRenderQueue.GetCount());
+	const XMFLOAT4X4* pWrittenWorld = nullptr;
+	D3D11ConstantRing::Slice objectSlice = {};
+	for (size_t i = 0; i < this->mRenderQueue.GetCount(); ++i)
+	{
+		const DrawItem& item = this->mRenderQueue.GetSortedItem(i);
+		// The instances carry their own matrices
+		if (item.instanceCount > 0)
+			continue;
+		if (!pWrittenWorld || memcmp(&item.world, pWrittenWorld, sizeof(XMFLOAT4X4)) != 0)
+		{
+			if (!this->mConstantRing.Allocate(sizeof(VS_OBJECT_CONSTANT_BUFFER), &objectSlice))
+				objectSlice = {};
+			else
+				static_cast<VS_OBJECT_CONSTANT_BUFFER*>(objectSlice.pData)->mWorld = item.world;
+			pWrittenWorld = &item.world;
+		}
+		this->mObjectSlices[i] = objectSlice;
+	}
+	this->mConstantRing.Unmap();
+	if (!frameAllocated)
+		return;
+
+	// Every job records its own slice of the sorted draws. The slices cannot see each other's state, so each one
+	// binds everything it draws with and can be played back on a fresh deferred context.
+	const size_t drawCount = this->mRenderQueue.GetCount();
+	const unsigned int sliceCount = (unsigned int)(std::min)(this->mCommandBuffers.size(),
+		(std::max)((size_t)1, drawCount / COMMAND_MIN_DRAWS_PER_SLICE));
+	const size_t drawsPerSlice = (drawCount + sliceCount - 1) / sliceCount;
+	JobSystem::ParallelFor(sliceCount, 1, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int slice = begin; slice < end; ++slice)
+		{
+			this->RecordDraws(slice, (std::min)(drawCount, slice * drawsPerSlice), (std::min)(drawCount, (slice + 1) * drawsPerSlice), frameSlice);
+		}
+	});
 
+	for (size_t i = 0; i < drawCount; ++i)
+	{
+		const DrawItem& item = this->mRenderQueue.GetSortedItem(i);
+		this->mFrameStats.instances += item.instanceCount;
+		this->mFrameStats.indices += (uint64_t)item.indexCount * (std::max)(item.instanceCount, 1u);
+	}
+	this->mFrameStats.draws = (unsigned int)drawCount;
+	for (unsigned int slice = 0; slice < sliceCount; ++slice)
+	{
+		const StateCacheStats& recorderStats = this->mCommandRecorders[slice].GetStats();
+		this->mFrameStats.stateChanges += recorderStats.issuedCalls;
+		this->mFrameStats.filteredStateCalls += recorderStats.filteredCalls;
+		this->mFrameStats.commandBytes += (unsigned int)this->mCommandBuffers[slice].GetSize();
+		this->mCommandRecorders[slice].ResetStats();
+	}
+
+	if (this->mFramePackets.GetReadBuffer().useDeferredContexts)
+	{
+		// Executing a command list leaves the state of the immediate context as it was, the state cache stays valid
+		this->mDeferredBackend.Execute(this->mCommandBuffers.data(), sliceCount, this->mDeviceContext);
+		return;
+	}
+	for (unsigned int slice = 0; slice < sliceCount; ++slice)
+	{
+		Commands::Replay(this->mCommandBuffers[slice], &this->mStateCache);
+	}
 }
 
-void Renderer::HandleInput()
+void Renderer::RecordDraws(unsigned int slice, size_t begin, size_t end, const D3D11ConstantRing::Slice& frameSlice)
 {
-	auto kb = this->m_keyboard->GetState();
-	auto mouse = this->m_mouse->GetState();
-	float dt = this->gameTimer.DeltaTime();
+	UINT offset = 0;
+	UINT offsets[2] = { 0, 0 };
+	ID3D11Buffer* pRingBuffer = this->mConstantRingBackend.GetBuffer();
+	StateCache<CommandBuffer>& recorder = this->mCommandRecorders[slice];
+	this->mCommandBuffers[slice].Clear();
+	recorder.Invalidate();
+
+	recorder.OMSetRenderTargets(1, &this->mRenderTargetView, this->mDepthStencilView);
+	recorder.OMSetBlendState(NULL, NULL, 0xffffffff);
+	recorder.RSSetViewports(1, &this->vp);
+	UINT firstConstant = frameSlice.FirstConstant();
+	UINT constantCount = frameSlice.ConstantCount();
+	recorder.VSSetConstantBuffers1(2, 1, &pRingBuffer, &firstConstant, &constantCount);
+	for (size_t i = begin; i < end; ++i)
+	{
+		const DrawItem& item = this->mRenderQueue.GetSortedItem(i);
+		// Skip draws whose constants did not fit into the ring
+		if (item.instanceCount == 0 && this->mObjectSlices[i].size == 0)
+			continue;
+		recorder.IASetPrimitiveTopology(item.topology);
+		recorder.IASetInputLayout(item.pInputLayout);
+		if (item.instanceCount > 0)
+		{
+			ID3D11Buffer* buffers[2] = { item.pVertexBuffer, item.pInstanceBuffer };
+			UINT strides[2] = { item.vertexStride, item.instanceStride };
+			recorder.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+		}
+		else
+		{
+			recorder.IASetVertexBuffers(0, 1, &item.pVertexBuffer, &item.vertexStride, &offset);
+		}
+		recorder.IASetIndexBuffer(item.pIndexBuffer, item.indexFormat, 0);
+		recorder.VSSetShader(item.pVertexShader, NULL, 0);
+		recorder.PSSetShader(item.pPixelShader, NULL, 0);
+		if (item.pObjectConstants)
+			recorder.VSSetConstantBuffers(1, 1, &item.pObjectConstants);
+		if (item.pVertexResource)
+			recorder.VSSetShaderResources(0, 1, &item.pVertexResource);
+		recorder.PSSetShaderResources(0, 1, &item.pTexture);
+		recorder.PSSetSamplers(0, 1, &item.pSampler);
+		recorder.RSSetState(item.pRasterizerState);
+		recorder.OMSetDepthStencilState(item.pDepthStencilState, item.stencilRef);
+
+		if (item.instanceCount > 0)
+		{
+			recorder.DrawIndexedInstanced(item.indexCount, item.instanceCount, item.startIndex, 0, item.startInstance);
+			continue;
+		}
+
+		firstConstant = this->mObjectSlices[i].FirstConstant();
+		constantCount = this->mObjectSlices[i].ConstantCount();
+		recorder.VSSetConstantBuffers1(0, 1, &pRingBuffer, &firstConstant, &constantCount);
+		recorder.DrawIndexed(item.indexCount, item.startIndex, 0);
+	}
+}
+
+void Renderer::HandleInput(float dt, const InputSnapshot& input)
+{
+	PROFILE_ZONE("HandleInput");
+	const DirectX::Keyboard::State& kb = input.keyboard;
+	const DirectX::Mouse::State& mouse = input.mouse;
 	float speed = 10.0f * dt;
 	if (kb.LeftShift)
 		speed *= 2;
@@ -1675,6 +2705,24 @@ void Renderer::HandleInput()
 		lastscroll = mouse.scrollWheelValue;
 
 	}
+	// Each press of C adds a crowd of the last loaded skinned mesh
+	if (kb.C && !this->mCrowdKeyDown && !skinSkeletons.empty())
+	{
+		this->SpawnCrowd((unsigned int)skinSkeletons.size() - 1, CROWD_SPAWN_COUNT);
+	}
+	this->mCrowdKeyDown = kb.C;
+	// P switches the playback of the recorded draws between the immediate and the deferred contexts
+	if (kb.P && !this->mDeferredKeyDown)
+	{
+		this->mUseDeferredContexts = !this->mUseDeferredContexts;
+	}
+	this->mDeferredKeyDown = kb.P;
+	// F1 shows and hides the stats overlay
+	if (kb.F1 && !this->mStatsOverlayKeyDown)
+	{
+		this->mShowStatsOverlay = !this->mShowStatsOverlay;
+	}
+	this->mStatsOverlayKeyDown = kb.F1;
 	if (kb.LeftAlt)
 	{
 		if (mouse.scrollWheelValue > lastscroll)
@@ -1715,5 +2763,7 @@ void Renderer::HandleInput()
 		this->mCamera->RotateCameraPitchYawRoll2(m_pitch, m_yaw, 0.0f);
 	}
 
-	m_mouse->SetMode(mouse.leftButton ? DirectX::Mouse::MODE_RELATIVE : DirectX::Mouse::MODE_ABSOLUTE);
+	// Without a window there is no cursor to capture, the mode of a replay comes from the recorded mouse
+	if (this->mWindow != nullptr)
+		m_mouse->SetMode(mouse.leftButton ? DirectX::Mouse::MODE_RELATIVE : DirectX::Mouse::MODE_ABSOLUTE);
 }
@@ -11,13 +11,51 @@
 #include <d3dcompiler.h>
 #include "Timer.h"
 #include "Camera.h"
+#include "CameraPath.h"
 #include "Keyboard.h"
 #include "Mouse.h"
 #include "Obj_Loader.h"
 #include "MeshObject.h"
+#include "Meshlet.h"
+#include "MeshSimplifier.h"
+#include "Bounds.h"
+#include "VertexFormat.h"
+#include "StateCache.h"
+#include "D3D11ConstantRingBackend.h"
+#include "FrameArena.h"
+#include "RenderQueue.h"
+#include "Instancing.h"
+#include "Bvh.h"
+#include "Crowd.h"
+#include "Culling.h"
+#include "Occlusion.h"
+#include "JobSystem.h"
+#include "D3D11DeferredCommandBackend.h"
+#include "FrameScheduler.h"
+#include "TripleBuffer.h"
+#include "Profiler.h"
+#include "RenderStats.h"
+#include "MemoryTracker.h"
+#include "InputRecording.h"
 #include <math.h>
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
 
 #define MAX_NUMBER_OF_BONES_IN_SHADER 63
+// Largest on screen error in pixels allowed when picking a mesh LOD
+#define LOD_MAX_PIXEL_ERROR 1.0f
+// Number of characters added by each press of C
+#define CROWD_SPAWN_COUNT 1000
+// Characters animated per job
+#define CROWD_ANIMATION_BATCH_SIZE 32
+// Seconds between updates of the stats overlay in the window title
+#define RENDER_STATS_OVERLAY_INTERVAL 0.5
+// Tree LoadForest instances, relative to the working directory like the other models
+#define FOREST_MODEL_PATH "../Models/BirchTree_2.obj"
+// Seed of the random choices of the simulation until a replay sets the one of its recording
+#define RENDER_RANDOM_SEED 1337
 
 using namespace DirectX;
 
@@ -46,9 +84,155 @@ struct SkinVertex
 	DirectX::XMINT4	  BlendIndices;
 };
 
-struct VS_WVP_CONSTANT_BUFFER
+// ------ Vertex layouts ------
+// The input layouts and the vertex packing code are generated from these
+
+namespace VertexFormat
+{
+	template <> struct FormatOf<objl::Vector2> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32_FLOAT; };
+	template <> struct FormatOf<objl::Vector3> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32B32_FLOAT; };
+
+	// The first three skinning weights, the last one is calculated in the shader
+	template <> struct Converter<FbxLoader::ControlPointInfo, DirectX::XMFLOAT3>
+	{
+		static void Convert(const FbxLoader::ControlPointInfo& source, DirectX::XMFLOAT3* pAttribute)
+		{
+			pAttribute->x = (float)source.weightPairs[0].weight;
+			pAttribute->y = (float)source.weightPairs[1].weight;
+			pAttribute->z = (float)source.weightPairs[2].weight;
+		}
+	};
+
+	template <> struct Converter<FbxLoader::ControlPointInfo, DirectX::XMINT4>
+	{
+		static void Convert(const FbxLoader::ControlPointInfo& source, DirectX::XMINT4* pAttribute)
+		{
+			pAttribute->x = source.weightPairs[0].index;
+			pAttribute->y = source.weightPairs[1].index;
+			pAttribute->z = source.weightPairs[2].index;
+			pAttribute->w = source.weightPairs[3].index;
+		}
+	};
+}
+
+VERTEX_ATTRIBUTE(VertexPosition, Vertex, Pos, DirectX::XMFLOAT3, "POSITION", 0);
+VERTEX_ATTRIBUTE(VertexNormal, Vertex, Normal, DirectX::XMFLOAT3, "NORMAL", 0);
+VERTEX_ATTRIBUTE(VertexTexcoord, Vertex, Texcoord, DirectX::XMFLOAT2, "TEXCOORD", 0);
+typedef VertexFormat::Layout<Vertex, VertexPosition, VertexNormal, VertexTexcoord> VertexLayout;
+
+VERTEX_ATTRIBUTE(SkinVertexPosition, SkinVertex, Pos, DirectX::XMFLOAT3, "POSITION", 0);
+VERTEX_ATTRIBUTE(SkinVertexNormal, SkinVertex, Normal, DirectX::XMFLOAT3, "NORMAL", 0);
+VERTEX_ATTRIBUTE(SkinVertexTexcoord, SkinVertex, Texcoord, DirectX::XMFLOAT2, "TEXCOORD", 0);
+VERTEX_ATTRIBUTE(SkinVertexBlendWeights, SkinVertex, BlendWeights, FbxLoader::ControlPointInfo, "BLENDWEIGHT", 0);
+VERTEX_ATTRIBUTE(SkinVertexBlendIndices, SkinVertex, BlendIndices, FbxLoader::ControlPointInfo, "BLENDINDICES", 0);
+typedef VertexFormat::Layout<SkinVertex, SkinVertexPosition, SkinVertexNormal, SkinVertexTexcoord, SkinVertexBlendWeights, SkinVertexBlendIndices> SkinVertexLayout;
+
+// objl meshes are uploaded as loaded and drawn with the VertexLayout input layout
+VERTEX_ATTRIBUTE(ObjVertexPosition, objl::Vertex, Position, objl::Vector3, "POSITION", 0);
+VERTEX_ATTRIBUTE(ObjVertexNormal, objl::Vertex, Normal, objl::Vector3, "NORMAL", 0);
+VERTEX_ATTRIBUTE(ObjVertexTexcoord, objl::Vertex, TextureCoordinate, objl::Vector2, "TEXCOORD", 0);
+typedef VertexFormat::Layout<objl::Vertex, ObjVertexPosition, ObjVertexNormal, ObjVertexTexcoord> ObjVertexLayout;
+static_assert(VertexFormat::IsCompatible<ObjVertexLayout, VertexLayout>::value, "objl::Vertex does not match the Vertex input layout");
+
+// Shader programs used in draw keys, draws with the same program are executed together
+enum SHADER_PROGRAM {
+	SHADER_PROGRAM_DEFAULT = 0,
+	SHADER_PROGRAM_TEXTURE = 1,
+	SHADER_PROGRAM_SKIN = 2,
+	SHADER_PROGRAM_SKYBOX = 3,
+	SHADER_PROGRAM_INSTANCED = 4,
+	SHADER_PROGRAM_CROWD = 5
+};
+
+// How Update and Render share the frame, see Renderer::SetPipelineMode
+enum FRAME_PIPELINE_MODE {
+	FRAME_PIPELINE_SERIAL = 0,		// Update and Render take turns on the main thread, Render draws the state of this frame
+	FRAME_PIPELINE_THREADED = 1		// Update runs on a simulation thread, Render draws the newest packet it published, about a step later
+};
+
+// Device a renderer draws with, see RendererSettings
+enum RENDER_BACKEND {
+	RENDER_BACKEND_HARDWARE = 0,
+	RENDER_BACKEND_WARP = 1,		// The software rasterizer, slow but there on every machine
+	RENDER_BACKEND_NULL = 2			// Accepts every call and draws nothing, leaves only the CPU cost of the frame. Needs the D3D SDK layers
+};
+
+struct RendererSettings
+{
+	// Draws into an offscreen target of width by height pixels instead of the active window, and never presents
+	bool headless = false;
+	// Only for headless renderers, the window is always drawn by the hardware
+	RENDER_BACKEND backend = RENDER_BACKEND_HARDWARE;
+	UINT width = 1200;
+	UINT height = 800;
+};
+
+// Everything Render takes from the simulation. Written by PublishFrame and not changed once it is published,
+// so the simulation can go on with the next step while it is drawn
+struct FramePacket
+{
+	uint64_t frame = 0;						// Counts the published packets
+	double publishTime = 0.0;				// SystemFrameClock time of PublishFrame
+	float stepTime = 0.0f;
+	// The camera before and after the last step, Render interpolates between them
+	DirectX::XMFLOAT4 previousCameraPosition;
+	DirectX::XMFLOAT4 previousCameraLook;
+	DirectX::XMFLOAT4 cameraPosition;
+	DirectX::XMFLOAT4 cameraLook;
+	float meshScale = 1.0f;
+	bool useDeferredContexts = false;
+	bool showStatsOverlay = false;
+	// True while something moves without input
+	bool animating = false;
+	// Joint matrices of the first skinned mesh, empty while it does not animate
+	std::vector<DirectX::XMFLOAT4X4> skinPalette;
+	// The crowd characters visible from the camera after the step. The instances hold the world matrices,
+	// Render multiplies in the interpolated view projection
+	std::vector<Crowd::InstanceData> crowdInstances;
+	std::vector<DirectX::XMFLOAT4X4> crowdPalette;
+	std::vector<Crowd::Batch> crowdBatches;
+};
+
+struct FramePipelineStats
 {
-	DirectX::XMFLOAT4X4 mWorldViewProj;
+	uint64_t published = 0;			// Packets written by PublishFrame
+	uint64_t rendered = 0;			// Frames drawn
+	uint64_t repeated = 0;			// Frames that drew the same packet as the frame before
+	uint64_t overwritten = 0;		// Packets replaced by a newer one before Render got to them
+	double lastLatency = 0.0;		// Seconds from PublishFrame until the frame that drew the packet was presented
+	double averageLatency = 0.0;
+	double maxLatency = 0.0;
+};
+
+// A mesh drawn at many placements with a single DrawIndexedInstanced
+struct InstancedMesh
+{
+	ID3D11Buffer* pVertexBuffer = nullptr;
+	ID3D11Buffer* pIndexBuffer = nullptr;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+	UINT indexCount = 0;
+	Bounds::MeshBounds bounds = {};
+	std::vector<DirectX::XMFLOAT4X4> worlds;
+	// World space boxes of the placements, the user data of a leaf is its index in worlds
+	std::vector<Bounds::AABB> worldBoxes;
+	DynamicBvh bvh;
+	// The visible placements of the current frame, rebuilt every frame
+	std::vector<uint32_t> visible;
+	std::vector<Instancing::InstanceData> instances;
+	// Dynamic, has room for an instance per placement
+	ID3D11Buffer* pInstanceBuffer = nullptr;
+};
+
+// Constants that are the same for every draw of a frame, register b2
+struct VS_FRAME_CONSTANT_BUFFER
+{
+	DirectX::XMFLOAT4X4 mViewProj;
+};
+
+// Constants of one object, register b0
+struct VS_OBJECT_CONSTANT_BUFFER
+{
+	DirectX::XMFLOAT4X4 mWorld;
 };
 
 struct VS_BONE_CONSTANT_BUFFER
@@ -60,22 +244,84 @@ class Renderer
 {
 public:
 	Renderer();
+	explicit Renderer(const RendererSettings& settings);
 	~Renderer();
 
 
+	// Simulates the time since the last call in one step and renders
 	void Frame();
+	// Advances input, camera and animation by one step of dt seconds. Not called from outside while the
+	// simulation thread runs
+	void Update(float dt);
+	// Update with the given input instead of the keyboard and mouse, replays step through here
+	void Update(float dt, const InputSnapshot& input);
+	// Hands the simulated state to Render as a frame packet
+	void PublishFrame();
+	// Draws the newest published packet, alpha moves the camera between its positions before and after the last step
+	void Render(float alpha);
+	// Draws the newest packet of the simulation thread, alpha follows from how long ago it was published
+	void RenderLatest();
+	// FRAME_PIPELINE_THREADED starts the simulation thread, FRAME_PIPELINE_SERIAL stops it again
+	void SetPipelineMode(FRAME_PIPELINE_MODE mode);
+	FRAME_PIPELINE_MODE GetPipelineMode() const;
+	// Files the counters of the frame drawn last, frameTime is the CPU time of the whole frame in seconds
+	void EndFrame(double frameTime);
+	// True while something moves without input, the scene then has to be drawn even if nothing else happens
+	bool IsAnimating() const;
 	void MouseMoved(int x, int y);
 	void KeyPressed(WPARAM key);
 
 	void LoadMesh(std::string &filepath);
 	void LoadMesh(std::string& filepath, bool fbx);
+	// Loads an .obj and draws it once per world matrix with hardware instancing
+	void LoadInstancedMesh(const std::string& filepath, const std::vector<DirectX::XMFLOAT4X4>& worlds);
+	// Scatters treeCount instances of FOREST_MODEL_PATH over the floor, the same trees on every run
+	void LoadForest(unsigned int treeCount);
+
+	// Number of state calls issued and filtered by the state cache during the last frame
+	const StateCacheStats& GetStateCacheStats() const;
+	// Occluders, tested objects and the time spent by the occlusion culling of the last frame
+	const OcclusionStats& GetOcclusionStats() const;
+	// Packets passed from the simulation to the rendering and how old they were when they were presented
+	const FramePipelineStats& GetPipelineStats() const;
+	// Counters of the recent frames and the frame time histograms
+	const RenderStats& GetRenderStats() const;
+	// Shows the frame time percentiles and the counters of the last frame in the window title, also toggled with F1
+	void SetStatsOverlay(bool show);
+	// Forgets the render and pipeline stats of the frames so far, for example after warming up
+	void ResetStats();
+	// Records the steps, frames and loads from now on, nullptr stops. Set before the simulation thread starts, the
+	// recorder has to outlive the renderer or be removed first. The random choices start over from the seed of
+	// GetInputSessionState, like they do in the replay
+	void SetInputRecorder(InputRecorder* pRecorder);
+	// Camera, mouse look, scroll wheel state and random seed the input builds on, for the start of a recording and its replay
+	InputSessionState GetInputSessionState() const;
+	void SetInputSessionState(const InputSessionState& state);
+	// Flies the camera along pPath instead of handing it to the keyboard and mouse, the path starts over at time 0.
+	// nullptr gives the camera back to the input. The path is not copied and has to outlive its use
+	void SetCameraPath(const CameraPath* pPath);
 
 private:
+	// Owned by the simulation, Render draws from mRenderCamera
 	Camera* mCamera = nullptr;
+	Camera* mRenderCamera = nullptr;
+	// Camera before the last Update, Render interpolates from here
+	DirectX::XMFLOAT4 mPreviousCameraPosition;
+	DirectX::XMFLOAT4 mPreviousCameraLook;
+	float mLastStepTime = 0.0f;
 	float m_pitch = 0.0f;
 	float m_yaw = 0.0f;
+	// Replaces HandleInput while set, the time only advances by the steps of Update
+	const CameraPath* mpCameraPath = nullptr;
+	double mCameraPathTime = 0.0;
+	InputRecorder* mpInputRecorder = nullptr;
+	// Only drawn from by the simulation, restarted from the seed when a recording or a replay starts
+	uint32_t mRandomSeed = RENDER_RANDOM_SEED;
+	std::mt19937 mRandom = std::mt19937(RENDER_RANDOM_SEED);
+	RendererSettings mSettings;
 
 	ID3D11Buffer* sphereIndexBuffer;
+	DXGI_FORMAT sphereIndexFormat = DXGI_FORMAT_R32_UINT;
 	ID3D11Buffer* sphereVertBuffer;
 
 	ID3D11VertexShader* SKYBOX_VS;
@@ -104,23 +350,73 @@ private:
 	std::vector<ID3D11Buffer*> testIndexBuffers;
 	std::vector<ID3D11Buffer*> testVertexBuffers;
 	std::vector<int> testIndexCount;
-
-	std::vector<FbxLoader::Skeleton*> skinSkeletons;
+	std::vector<DXGI_FORMAT> testIndexFormats;
+	std::vector<std::vector<Meshlets::Meshlet>> testMeshlets;
+	std::vector<std::vector<MeshSimplifier::MeshLod>> testLods;
+	std::vector<Bounds::MeshBounds> testBounds;
+	// Reused every frame to hold the visible index ranges of the mesh being drawn
+	std::vector<Meshlets::IndexRange> mVisibleIndexRanges;
+	// Draws of the current frame, sorted by draw key before they are executed
+	RenderQueue mRenderQueue;
+
+	std::vector<InstancedMesh> mInstancedMeshes;
+
+	std::vector<std::unique_ptr<FbxLoader::Skeleton>> skinSkeletons;
 	std::vector<std::vector<XMFLOAT4X4>> skinBoneMatrices;
 	std::vector<ID3D11Buffer*> skinIndexBuffers;
 	std::vector<ID3D11Buffer*> skinVertexBuffers;
 	std::vector<int> skinIndexCount;
+	std::vector<DXGI_FORMAT> skinIndexFormats;
+	std::vector<std::vector<MeshSimplifier::MeshLod>> skinLods;
+	std::vector<Bounds::MeshBounds> skinBounds;
+	// Bind pose box of every joint of a skinned mesh, moved by the joint matrices they bound the posed mesh
+	std::vector<std::vector<Bounds::AABB>> skinJointBounds;
+	// Object space box of every skinned mesh in the pose last uploaded to the bone buffer, only used by the render thread
+	std::vector<Bounds::AABB> mSkinPoseBoxes;
+
+	// ------ Crowd ------
+	// One entry per character, Crowd::Character::mesh indexes the skin vectors above
+	std::vector<FbxLoader::UniqueSkeletonData> mCrowdSkeletons;
+	std::vector<FbxLoader::ANIMATION_TYPE> mCrowdAnimations;
+	std::vector<Crowd::Character> mCrowdCharacters;
+	// World space box of every character in its current pose, updated while it animates
+	Culling::AABBSoA mCrowdBoxes;
+	// Culled every published frame, only the visible characters are packed into the frame packet
+	std::vector<unsigned int> mCrowdVisible;
+	std::vector<Crowd::Character> mCrowdVisibleCharacters;
+	ID3D11Buffer* mCrowdInstanceBuffer = nullptr;
+	UINT mCrowdInstanceCapacity = 0;
+	// Structured buffer with the joint matrices of every character
+	ID3D11Buffer* mPaletteBuffer = nullptr;
+	ID3D11ShaderResourceView* mPaletteSRV = nullptr;
+	UINT mPaletteCapacity = 0;
+	bool mCrowdKeyDown = false;
+
+	// ------ Frame pipeline ------
+	TripleBuffer<FramePacket> mFramePackets;
+	uint64_t mPublishedFrames = 0;
+	// The packet drawn by the last frame
+	uint64_t mRenderedFrame = 0;
+	FramePipelineStats mPipelineStats;
+	SystemFrameClock mPipelineClock;
+	FRAME_PIPELINE_MODE mPipelineMode = FRAME_PIPELINE_SERIAL;
+	std::thread mSimulationThread;
+	std::atomic<bool> mSimulationRunning{ false };
+	// Held by the simulation thread while it steps, and by the main thread while it adds skinned meshes
+	std::mutex mSceneMutex;
 
 	ID3D11Buffer* mCubeVertexBuffer = nullptr;
 	ID3D11Buffer* mCubeIndexBuffer = nullptr;
+	DXGI_FORMAT mCubeIndexFormat = DXGI_FORMAT_R32_UINT;
 	ID3D11VertexShader* mCubeVertexShader = nullptr;
 	ID3D11VertexShader* mOutlineVertexShader = nullptr;
+	ID3D11VertexShader* mInstancedVertexShader = nullptr;
+	ID3D11VertexShader* mCrowdVertexShader = nullptr;
 	ID3D11PixelShader* mTexturePixelShader = nullptr;
 	ID3D11PixelShader* mOutlinePixelShader = nullptr;
 	ID3D11PixelShader* mDefaultPixelShader = nullptr;
 	DirectX::XMFLOAT4X4 mCubeWorld;
 	//DirectX::XMFLOAT4X4 mView;
-	DirectX::XMFLOAT4X4 mProjection;
 	ID3D11ShaderResourceView* mCubeTexSRV;
 	ID3D11ShaderResourceView* mOutlineStencilSRV;
 
@@ -130,7 +426,12 @@ private:
 
 	float mClearColor[4] = { 0.5f, 0.0f, 0.5f, 1.0f };
 
-	ID3D11Buffer* mWVPBuffer = nullptr;
+	// The per frame and per object constants of every draw are allocated from here
+	D3D11ConstantRingBackend mConstantRingBackend;
+	D3D11ConstantRing mConstantRing;
+	// Object constants of every sorted draw, reused between frames
+	std::vector<D3D11ConstantRing::Slice> mObjectSlices;
+	uint64_t mFrameIndex = 0;
 	ID3D11Buffer* mBoneTransformBuffer = nullptr;
 
 	ID3D11RasterizerState* mRasterState = nullptr;
@@ -138,6 +439,32 @@ private:
 	Timer gameTimer;
 	ID3D11Device* mDevice = nullptr;
 	ID3D11DeviceContext* mDeviceContext = nullptr;
+	ID3D11DeviceContext1* mDeviceContext1 = nullptr;
+	// Frame binds its state through here so that redundant calls never reach the context
+	StateCache<ID3D11DeviceContext1> mStateCache;
+	StateCacheStats mLastStateCacheStats;
+	// One command buffer per recording job, each recorded through its own state cache
+	std::vector<CommandBuffer> mCommandBuffers;
+	std::vector<StateCache<CommandBuffer>> mCommandRecorders;
+	D3D11DeferredCommandBackend mDeferredBackend;
+	// Toggled with P, plays the command buffers back on deferred contexts instead of the immediate context.
+	// Input state of the simulation, Render reads it from the frame packet
+	bool mUseDeferredContexts = false;
+	bool mDeferredKeyDown = false;
+	// Counters of the frame being drawn, filed by EndFrame
+	RenderFrameStats mFrameStats;
+	RenderStats mRenderStats;
+	uint64_t mLastJobCount = 0;
+	// Input state of the simulation like mUseDeferredContexts
+	bool mShowStatsOverlay = false;
+	bool mStatsOverlayKeyDown = false;
+	// The overlay replaces the window title, the original one is put back when it is hidden
+	HWND mWindow = nullptr;
+	std::string mWindowTitle;
+	double mLastOverlayTime = 0.0;
+	bool mOverlayVisible = false;
+	// The floor is rasterized into it every frame and hides what lies below it
+	OcclusionBuffer mOcclusion;
 	ID3D11RenderTargetView* mRenderTargetView = nullptr;
 	ID3D11Texture2D* mBackBuffer = nullptr;
 	IDXGISwapChain* mSwapChain = nullptr;
@@ -147,6 +474,10 @@ private:
 
 	ID3D11InputLayout* mDefaultInputLayout;
 	ID3D11InputLayout* mSkinInputLayout;
+	// Vertex data in slot 0, Instancing::InstanceData in slot 1
+	ID3D11InputLayout* mInstancedInputLayout = nullptr;
+	// SkinVertex data in slot 0, Crowd::InstanceData in slot 1
+	ID3D11InputLayout* mCrowdInputLayout = nullptr;
 
 	ID3D11VertexShader* mSkinVertexShader = nullptr;
 
@@ -162,11 +493,41 @@ private:
 	bool CreateBlendStates();
 	bool CreateFloorTexture();
 	void CreateSphere(int LatLines, int LongLines);
+	// Creates an immutable index buffer, 16-bit if vertexCount allows it. pIndexFormat receives the format to bind it with
+	HRESULT CreateIndexBuffer(const UINT* pIndices, UINT indexCount, UINT vertexCount, ID3D11Buffer** ppIndexBuffer, DXGI_FORMAT* pIndexFormat);
+	// Same, with pLodIndices placed right behind pIndices in the buffer
+	HRESULT CreateIndexBuffer(const UINT* pIndices, UINT indexCount, const UINT* pLodIndices, UINT lodIndexCount, UINT vertexCount,
+		ID3D11Buffer** ppIndexBuffer, DXGI_FORMAT* pIndexFormat);
 
 	void ObjLoaderTest();
-
-	void updateWVP(float dt);
-	void HandleInput();
+	// Adds count animated characters of skinned mesh number mesh around the origin
+	void SpawnCrowd(unsigned int mesh, unsigned int count);
+	void AnimateCrowd(float dt);
+	// Culls the crowd with the simulated camera and packs the visible characters into the packet
+	void PackCrowd(FramePacket* pPacket);
+	// Uploads the palettes and instances of the packet, the instances get viewProj applied on the way.
+	// Returns false if there is nothing to draw
+	bool UpdateCrowd(const FramePacket& packet, const DirectX::XMMATRIX& viewProj);
+	// Recreates the crowd instance and palette buffers with room for the given number of elements
+	bool CreateCrowdBuffers(UINT instanceCapacity, UINT paletteCapacity);
+
+	// Stores the transposed world matrix of the floor cube
+	void updateFloorWorld(float dt, DirectX::XMFLOAT4X4* pWorld);
+	// Executes the sorted render queue, the constants come from the constant buffer ring.
+	// Slices of the queue are recorded into command buffers on the job system and played back in order, on the
+	// immediate context through the state cache or on deferred contexts.
+	void DrawRenderQueue(const DirectX::XMMATRIX& viewProj);
+	// Records the sorted draws [begin, end) into command buffer number slice, starting with the frame wide state
+	void RecordDraws(unsigned int slice, size_t begin, size_t end, const D3D11ConstantRing::Slice& frameSlice);
+	void HandleInput(float dt, const InputSnapshot& input);
+	// Draws the packet the read buffer of mFramePackets holds
+	void DrawFrame(float alpha);
+	// Takes the newest packet for the next DrawFrame
+	void AcquireFramePacket();
+	// Writes the stats of the last frames to the window title while the overlay is on
+	void UpdateStatsOverlay(bool show);
+	// Body of the simulation thread, steps and publishes at the fixed step rate until mSimulationRunning is cleared
+	void SimulationLoop();
 
 	std::unique_ptr<DirectX::Keyboard> m_keyboard;
 	std::unique_ptr<DirectX::Mouse> m_mouse;
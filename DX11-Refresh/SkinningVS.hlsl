@@ -1,9 +1,16 @@
 static const int MAX_AFFECTING_BONES = 4;
 static const int MAX_BONE_MATRICES = 63;
 
-cbuffer wvp : register(b0)
+// Per object constants, a slice of the constant buffer ring
+cbuffer object : register(b0)
 {
-	float4x4 gWorldViewProj;
+	float4x4 gWorld;
+};
+
+// Per frame constants, bound once per frame
+cbuffer frame : register(b2)
+{
+	float4x4 gViewProj;
 };
 
 cbuffer bones : register(b1)
@@ -46,7 +53,7 @@ VSOut SKIN_VS(SKIN_VSIn input)
 	v += lastWeight * mul(float4(input.Pos, 1.0f), gBoneTransforms[input.blendIndices[MAX_AFFECTING_BONES - 1]]);
 	norm += (lastWeight * mul(float4(input.Normal, 1.0f), gBoneTransforms[input.blendIndices[MAX_AFFECTING_BONES - 1]])).xyz;
 	v.w = 1.0f;
-	output.Pos = mul(v, gWorldViewProj);
+	output.Pos = mul(mul(v, gWorld), gViewProj);
 	output.UV = input.UV;
 	output.Color = float4(input.Normal, 1.0f);
 	// Used for normal testing purposes to assign colour in the pixel shader
@@ -1,6 +1,13 @@
-cbuffer wvp
+// Per object constants, a slice of the constant buffer ring
+cbuffer object : register(b0)
 {
-	float4x4 gWorldViewProj;
+	float4x4 gWorld;
+};
+
+// Per frame constants, bound once per frame
+cbuffer frame : register(b2)
+{
+	float4x4 gViewProj;
 };
 
 struct SKYBOX_VS_OUTPUT    //output structure for SKYBOX vertex shader
@@ -20,7 +27,7 @@ SKYBOX_VS_OUTPUT SKYBOX_VS(VSIn input)
 {
 	SKYBOX_VS_OUTPUT output = (SKYBOX_VS_OUTPUT)0;
 	// xyww, z always 1, furthest away
-	output.Pos = mul(float4(input.Pos, 1.0f), gWorldViewProj).xyww;
+	output.Pos = mul(mul(float4(input.Pos, 1.0f), gWorld), gViewProj).xyww;
 
 	output.texCoord = input.Pos;
 
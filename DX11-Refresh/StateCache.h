@@ -0,0 +1,441 @@
+#pragma once
+#include "D3D11Types.h"
+#include <cstring>
+
+// Number of slots of each kind whose bindings are tracked, calls beyond these slots are always issued
+#define STATE_CACHE_VERTEX_BUFFER_SLOTS 4
+#define STATE_CACHE_CONSTANT_BUFFER_SLOTS 14
+#define STATE_CACHE_SHADER_RESOURCE_SLOTS 16
+#define STATE_CACHE_SAMPLER_SLOTS 16
+#define STATE_CACHE_RENDER_TARGET_SLOTS 8
+
+struct StateCacheStats
+{
+	unsigned int issuedCalls = 0;	// Calls forwarded to the context
+	unsigned int filteredCalls = 0;	// Calls dropped because the state was already bound
+};
+
+// Remembers the IA/VS/PS/RS/OM state bound through it and drops calls that would bind the same state again.
+// ContextT is ID3D11DeviceContext1 or any class with the same methods, such as a mock that records the calls.
+// Only pointers are compared, nothing is AddRef'd, so call Invalidate after releasing objects that might still
+// be bound or after binding state on the context directly.
+template <class ContextT>
+class StateCache
+{
+public:
+	StateCache()
+	{
+		this->Invalidate();
+	}
+
+	void SetContext(ContextT* pContext)
+	{
+		this->mpContext = pContext;
+		this->Invalidate();
+	}
+
+	ContextT* GetContext() const
+	{
+		return this->mpContext;
+	}
+
+	// Forgets all cached state, the next call of every kind is issued
+	void Invalidate()
+	{
+		this->mInputLayout.valid = false;
+		this->mTopology.valid = false;
+		this->mIndexBuffer.valid = false;
+		this->mVertexShader.valid = false;
+		this->mPixelShader.valid = false;
+		this->mRasterizerState.valid = false;
+		this->mViewport.valid = false;
+		this->mDepthStencilState.valid = false;
+		this->mBlendState.valid = false;
+		this->mRenderTargets.valid = false;
+		for (auto& slot : this->mVertexBuffers) slot.valid = false;
+		for (auto& slot : this->mVSConstantBuffers) slot.valid = false;
+		for (auto& slot : this->mVSConstantBufferRanges) slot.valid = false;
+		for (auto& slot : this->mPSConstantBuffers) slot.valid = false;
+		for (auto& slot : this->mVSShaderResources) slot.valid = false;
+		for (auto& slot : this->mPSShaderResources) slot.valid = false;
+		for (auto& slot : this->mPSSamplers) slot.valid = false;
+	}
+
+	const StateCacheStats& GetStats() const
+	{
+		return this->mStats;
+	}
+
+	void ResetStats()
+	{
+		this->mStats = StateCacheStats();
+	}
+
+	// ------ Input assembler ------
+
+	void IASetInputLayout(ID3D11InputLayout* pInputLayout)
+	{
+		if (this->Filter(&this->mInputLayout, pInputLayout))
+			return;
+		this->mpContext->IASetInputLayout(pInputLayout);
+	}
+
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+	{
+		if (this->Filter(&this->mTopology, topology))
+			return;
+		this->mpContext->IASetPrimitiveTopology(topology);
+	}
+
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets)
+	{
+		// Binding zero buffers does nothing on the context either
+		if (numBuffers == 0)
+		{
+			this->mStats.filteredCalls++;
+			return;
+		}
+		bool redundant = startSlot + numBuffers <= STATE_CACHE_VERTEX_BUFFER_SLOTS;
+		for (UINT i = 0; i < numBuffers && redundant; ++i)
+		{
+			const VertexBufferBinding& slot = this->mVertexBuffers[startSlot + i];
+			redundant = slot.valid && slot.value.pBuffer == ppVertexBuffers[i] && slot.value.stride == pStrides[i] && slot.value.offset == pOffsets[i];
+		}
+		if (redundant)
+		{
+			this->mStats.filteredCalls++;
+			return;
+		}
+		for (UINT i = 0; i < numBuffers && startSlot + i < STATE_CACHE_VERTEX_BUFFER_SLOTS; ++i)
+		{
+			VertexBufferBinding& slot = this->mVertexBuffers[startSlot + i];
+			slot.valid = true;
+			slot.value.pBuffer = ppVertexBuffers[i];
+			slot.value.stride = pStrides[i];
+			slot.value.offset = pOffsets[i];
+		}
+		this->mStats.issuedCalls++;
+		this->mpContext->IASetVertexBuffers(startSlot, numBuffers, ppVertexBuffers, pStrides, pOffsets);
+	}
+
+	void IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT format, UINT offset)
+	{
+		IndexBuffer index_buffer = { pIndexBuffer, format, offset };
+		if (this->Filter(&this->mIndexBuffer, index_buffer))
+			return;
+		this->mpContext->IASetIndexBuffer(pIndexBuffer, format, offset);
+	}
+
+	// ------ Shaders ------
+
+	// Calls with class instances are always issued and leave the shader untracked
+	void VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+	{
+		if (numClassInstances == 0 && this->Filter(&this->mVertexShader, pVertexShader))
+			return;
+		if (numClassInstances != 0)
+		{
+			this->mVertexShader.valid = false;
+			this->mStats.issuedCalls++;
+		}
+		this->mpContext->VSSetShader(pVertexShader, ppClassInstances, numClassInstances);
+	}
+
+	void PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances, UINT numClassInstances)
+	{
+		if (numClassInstances == 0 && this->Filter(&this->mPixelShader, pPixelShader))
+			return;
+		if (numClassInstances != 0)
+		{
+			this->mPixelShader.valid = false;
+			this->mStats.issuedCalls++;
+		}
+		this->mpContext->PSSetShader(pPixelShader, ppClassInstances, numClassInstances);
+	}
+
+	void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+	{
+		if (this->FilterSlots(this->mVSConstantBuffers, STATE_CACHE_CONSTANT_BUFFER_SLOTS, startSlot, numBuffers, ppConstantBuffers))
+			return;
+		for (UINT i = 0; i < numBuffers && startSlot + i < STATE_CACHE_CONSTANT_BUFFER_SLOTS; ++i)
+		{
+			this->mVSConstantBufferRanges[startSlot + i].valid = false;
+		}
+		this->mpContext->VSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+	}
+
+	// Binds ranges of constant buffers, first and count are in 16 byte constants (D3D11.1)
+	void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+	{
+		bool redundant = startSlot + numBuffers <= STATE_CACHE_CONSTANT_BUFFER_SLOTS;
+		for (UINT i = 0; i < numBuffers && redundant; ++i)
+		{
+			const Cached<ConstantBufferRange>& slot = this->mVSConstantBufferRanges[startSlot + i];
+			redundant = slot.valid && slot.value.pBuffer == ppConstantBuffers[i] &&
+				slot.value.firstConstant == pFirstConstant[i] && slot.value.numConstants == pNumConstants[i];
+		}
+		if (redundant)
+		{
+			this->mStats.filteredCalls++;
+			return;
+		}
+		// The whole buffer bindings of the slots are no longer known
+		for (UINT i = 0; i < numBuffers && startSlot + i < STATE_CACHE_CONSTANT_BUFFER_SLOTS; ++i)
+		{
+			Cached<ConstantBufferRange>& slot = this->mVSConstantBufferRanges[startSlot + i];
+			slot.valid = true;
+			slot.value.pBuffer = ppConstantBuffers[i];
+			slot.value.firstConstant = pFirstConstant[i];
+			slot.value.numConstants = pNumConstants[i];
+			this->mVSConstantBuffers[startSlot + i].valid = false;
+		}
+		this->mStats.issuedCalls++;
+		this->mpContext->VSSetConstantBuffers1(startSlot, numBuffers, ppConstantBuffers, pFirstConstant, pNumConstants);
+	}
+
+	void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* ppConstantBuffers)
+	{
+		if (this->FilterSlots(this->mPSConstantBuffers, STATE_CACHE_CONSTANT_BUFFER_SLOTS, startSlot, numBuffers, ppConstantBuffers))
+			return;
+		this->mpContext->PSSetConstantBuffers(startSlot, numBuffers, ppConstantBuffers);
+	}
+
+	void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+	{
+		if (this->FilterSlots(this->mVSShaderResources, STATE_CACHE_SHADER_RESOURCE_SLOTS, startSlot, numViews, ppShaderResourceViews))
+			return;
+		this->mpContext->VSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+	}
+
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+	{
+		if (this->FilterSlots(this->mPSShaderResources, STATE_CACHE_SHADER_RESOURCE_SLOTS, startSlot, numViews, ppShaderResourceViews))
+			return;
+		this->mpContext->PSSetShaderResources(startSlot, numViews, ppShaderResourceViews);
+	}
+
+	void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* ppSamplers)
+	{
+		if (this->FilterSlots(this->mPSSamplers, STATE_CACHE_SAMPLER_SLOTS, startSlot, numSamplers, ppSamplers))
+			return;
+		this->mpContext->PSSetSamplers(startSlot, numSamplers, ppSamplers);
+	}
+
+	// ------ Rasterizer ------
+
+	void RSSetState(ID3D11RasterizerState* pRasterizerState)
+	{
+		if (this->Filter(&this->mRasterizerState, pRasterizerState))
+			return;
+		this->mpContext->RSSetState(pRasterizerState);
+	}
+
+	// Only a single viewport is tracked, calls with more are always issued
+	void RSSetViewports(UINT numViewports, const D3D11_VIEWPORT* pViewports)
+	{
+		if (numViewports != 1)
+		{
+			this->mViewport.valid = false;
+			this->mStats.issuedCalls++;
+			this->mpContext->RSSetViewports(numViewports, pViewports);
+			return;
+		}
+		Viewport viewport = { pViewports[0] };
+		if (this->Filter(&this->mViewport, viewport))
+			return;
+		this->mpContext->RSSetViewports(numViewports, pViewports);
+	}
+
+	// ------ Output merger ------
+
+	void OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT stencilRef)
+	{
+		DepthStencilState depth_stencil_state = { pDepthStencilState, stencilRef };
+		if (this->Filter(&this->mDepthStencilState, depth_stencil_state))
+			return;
+		this->mpContext->OMSetDepthStencilState(pDepthStencilState, stencilRef);
+	}
+
+	void OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT blendFactor[4], UINT sampleMask)
+	{
+		// A null blend factor means { 1, 1, 1, 1 }
+		BlendState blend_state = { pBlendState, { 1.0f, 1.0f, 1.0f, 1.0f }, sampleMask };
+		if (blendFactor)
+			memcpy(blend_state.blendFactor, blendFactor, sizeof(blend_state.blendFactor));
+		if (this->Filter(&this->mBlendState, blend_state))
+			return;
+		this->mpContext->OMSetBlendState(pBlendState, blendFactor, sampleMask);
+	}
+
+	void OMSetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView)
+	{
+		if (numViews > STATE_CACHE_RENDER_TARGET_SLOTS)
+		{
+			this->mRenderTargets.valid = false;
+			this->mStats.issuedCalls++;
+			this->mpContext->OMSetRenderTargets(numViews, ppRenderTargetViews, pDepthStencilView);
+			return;
+		}
+		RenderTargets render_targets = {};
+		render_targets.numViews = numViews;
+		for (UINT i = 0; i < numViews; ++i)
+		{
+			render_targets.pRenderTargetViews[i] = ppRenderTargetViews ? ppRenderTargetViews[i] : nullptr;
+		}
+		render_targets.pDepthStencilView = pDepthStencilView;
+		if (this->Filter(&this->mRenderTargets, render_targets))
+			return;
+		this->mpContext->OMSetRenderTargets(numViews, ppRenderTargetViews, pDepthStencilView);
+	}
+
+	// ------ Draws ------
+
+	// Forwarded as they are, so a StateCache can take the place of the context when a CommandBuffer is replayed
+	void DrawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+	{
+		this->mpContext->DrawIndexed(indexCount, startIndex, baseVertex);
+	}
+
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndex, INT baseVertex, UINT startInstance)
+	{
+		this->mpContext->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+	}
+
+private:
+	template <class T>
+	struct Cached
+	{
+		bool valid;
+		T value;
+	};
+
+	struct VertexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		UINT stride;
+		UINT offset;
+	};
+	typedef Cached<VertexBuffer> VertexBufferBinding;
+
+	struct ConstantBufferRange
+	{
+		ID3D11Buffer* pBuffer;
+		UINT firstConstant;
+		UINT numConstants;
+	};
+
+	struct IndexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		DXGI_FORMAT format;
+		UINT offset;
+		bool operator==(const IndexBuffer& other) const
+		{
+			return pBuffer == other.pBuffer && format == other.format && offset == other.offset;
+		}
+	};
+
+	struct DepthStencilState
+	{
+		ID3D11DepthStencilState* pState;
+		UINT stencilRef;
+		bool operator==(const DepthStencilState& other) const
+		{
+			return pState == other.pState && stencilRef == other.stencilRef;
+		}
+	};
+
+	struct BlendState
+	{
+		ID3D11BlendState* pState;
+		FLOAT blendFactor[4];
+		UINT sampleMask;
+		bool operator==(const BlendState& other) const
+		{
+			return pState == other.pState && sampleMask == other.sampleMask &&
+				memcmp(blendFactor, other.blendFactor, sizeof(blendFactor)) == 0;
+		}
+	};
+
+	struct Viewport
+	{
+		D3D11_VIEWPORT value;
+		bool operator==(const Viewport& other) const
+		{
+			return memcmp(&value, &other.value, sizeof(D3D11_VIEWPORT)) == 0;
+		}
+	};
+
+	struct RenderTargets
+	{
+		UINT numViews;
+		ID3D11RenderTargetView* pRenderTargetViews[STATE_CACHE_RENDER_TARGET_SLOTS];
+		ID3D11DepthStencilView* pDepthStencilView;
+		bool operator==(const RenderTargets& other) const
+		{
+			return numViews == other.numViews && pDepthStencilView == other.pDepthStencilView &&
+				memcmp(pRenderTargetViews, other.pRenderTargetViews, numViews * sizeof(ID3D11RenderTargetView*)) == 0;
+		}
+	};
+
+	ContextT* mpContext = nullptr;
+	StateCacheStats mStats;
+
+	Cached<ID3D11InputLayout*> mInputLayout;
+	Cached<D3D11_PRIMITIVE_TOPOLOGY> mTopology;
+	VertexBufferBinding mVertexBuffers[STATE_CACHE_VERTEX_BUFFER_SLOTS];
+	Cached<IndexBuffer> mIndexBuffer;
+	Cached<ID3D11VertexShader*> mVertexShader;
+	Cached<ID3D11PixelShader*> mPixelShader;
+	Cached<ID3D11Buffer*> mVSConstantBuffers[STATE_CACHE_CONSTANT_BUFFER_SLOTS];
+	Cached<ConstantBufferRange> mVSConstantBufferRanges[STATE_CACHE_CONSTANT_BUFFER_SLOTS];
+	Cached<ID3D11Buffer*> mPSConstantBuffers[STATE_CACHE_CONSTANT_BUFFER_SLOTS];
+	Cached<ID3D11ShaderResourceView*> mVSShaderResources[STATE_CACHE_SHADER_RESOURCE_SLOTS];
+	Cached<ID3D11ShaderResourceView*> mPSShaderResources[STATE_CACHE_SHADER_RESOURCE_SLOTS];
+	Cached<ID3D11SamplerState*> mPSSamplers[STATE_CACHE_SAMPLER_SLOTS];
+	Cached<ID3D11RasterizerState*> mRasterizerState;
+	Cached<Viewport> mViewport;
+	Cached<DepthStencilState> mDepthStencilState;
+	Cached<BlendState> mBlendState;
+	Cached<RenderTargets> mRenderTargets;
+
+	// Returns true if value is already bound, otherwise stores it and counts the call as issued
+	template <class T>
+	bool Filter(Cached<T>* pCached, const T& value)
+	{
+		if (pCached->valid && pCached->value == value)
+		{
+			this->mStats.filteredCalls++;
+			return true;
+		}
+		pCached->valid = true;
+		pCached->value = value;
+		this->mStats.issuedCalls++;
+		return false;
+	}
+
+	// Same as Filter for a range of slots, the call is only dropped if every slot in the range is already bound
+	template <class T>
+	bool FilterSlots(Cached<T*>* pSlots, UINT slotCount, UINT startSlot, UINT numSlots, T* const* ppValues)
+	{
+		bool redundant = startSlot + numSlots <= slotCount;
+		for (UINT i = 0; i < numSlots && redundant; ++i)
+		{
+			// A null array unbinds the slots
+			T* value = ppValues ? ppValues[i] : nullptr;
+			redundant = pSlots[startSlot + i].valid && pSlots[startSlot + i].value == value;
+		}
+		if (redundant)
+		{
+			this->mStats.filteredCalls++;
+			return true;
+		}
+		for (UINT i = 0; i < numSlots && startSlot + i < slotCount; ++i)
+		{
+			pSlots[startSlot + i].valid = true;
+			pSlots[startSlot + i].value = ppValues ? ppValues[i] : nullptr;
+		}
+		this->mStats.issuedCalls++;
+		return false;
+	}
+};
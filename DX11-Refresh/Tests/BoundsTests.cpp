@@ -0,0 +1,223 @@
+#include "Bounds.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Joints of the random skeleton in the skinning test
+#define TEST_JOINT_COUNT 8
+// Influences per vertex, like the skinned vertices of the renderer
+#define TEST_INFLUENCES 4
+// Slack for points that went through a few float transforms
+#define TEST_EPSILON 1e-3f
+
+using namespace DirectX;
+
+namespace
+{
+	// A position with other attributes after it, so the stride is not the size of the position
+	struct TestVertex
+	{
+		XMFLOAT3 position;
+		float padding[2];
+	};
+
+	std::vector<TestVertex> MakeVertices(std::mt19937& random, size_t count)
+	{
+		std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+		std::vector<TestVertex> vertices(count);
+		for (TestVertex& vertex : vertices)
+		{
+			vertex.position = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random));
+			vertex.padding[0] = vertex.padding[1] = NAN;
+		}
+		return vertices;
+	}
+
+	bool Contains(const Bounds::AABB& box, const XMFLOAT3& point, float epsilon)
+	{
+		return point.x >= box.min.x - epsilon && point.y >= box.min.y - epsilon && point.z >= box.min.z - epsilon &&
+			point.x <= box.max.x + epsilon && point.y <= box.max.y + epsilon && point.z <= box.max.z + epsilon;
+	}
+
+	void TestReduction()
+	{
+		std::mt19937 random(5);
+		// Counts around the four accumulators of the reduction and one large one
+		const size_t counts[8] = { 1, 2, 3, 4, 5, 7, 8, 1001 };
+		for (size_t count : counts)
+		{
+			const std::vector<TestVertex> vertices = ::MakeVertices(random, count);
+			Bounds::AABB expected = { XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+			for (const TestVertex& vertex : vertices)
+			{
+				expected.min.x = (std::min)(expected.min.x, vertex.position.x);
+				expected.min.y = (std::min)(expected.min.y, vertex.position.y);
+				expected.min.z = (std::min)(expected.min.z, vertex.position.z);
+				expected.max.x = (std::max)(expected.max.x, vertex.position.x);
+				expected.max.y = (std::max)(expected.max.y, vertex.position.y);
+				expected.max.z = (std::max)(expected.max.z, vertex.position.z);
+			}
+
+			const Bounds::MeshBounds bounds = Bounds::ComputeBounds(&vertices[0].position, sizeof(TestVertex), (unsigned int)count);
+			CHECK(bounds.box.min.x == expected.min.x && bounds.box.min.y == expected.min.y && bounds.box.min.z == expected.min.z);
+			CHECK(bounds.box.max.x == expected.max.x && bounds.box.max.y == expected.max.y && bounds.box.max.z == expected.max.z);
+
+			// The sphere holds every vertex and touches the furthest one
+			float furthest = 0.0f;
+			for (const TestVertex& vertex : vertices)
+			{
+				const XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&vertex.position), XMLoadFloat3(&bounds.sphere.center));
+				furthest = (std::max)(furthest, XMVectorGetX(XMVector3Length(offset)));
+			}
+			CHECK(furthest <= bounds.sphere.radius * 1.0001f);
+			CHECK(furthest >= bounds.sphere.radius * 0.9999f);
+		}
+
+		const Bounds::MeshBounds empty = Bounds::ComputeBounds(nullptr, sizeof(TestVertex), 0);
+		CHECK_EQUAL(0.0f, empty.sphere.radius);
+	}
+
+	// A random rigid transform with a uniform scale, stored transposed like the palette uploaded to the shader
+	XMFLOAT4X4 MakeJointTransform(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+		std::uniform_real_distribution<float> offset(-5.0f, 5.0f);
+		std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+		const float joint_scale = scale(random);
+		const XMMATRIX transform = XMMatrixScaling(joint_scale, joint_scale, joint_scale) *
+			XMMatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)) *
+			XMMatrixTranslation(offset(random), offset(random), offset(random));
+		XMFLOAT4X4 stored;
+		XMStoreFloat4x4(&stored, XMMatrixTranspose(transform));
+		return stored;
+	}
+
+	void TestSkinnedBounds()
+	{
+		std::mt19937 random(9);
+		const unsigned int vertex_count = 2000;
+		const std::vector<TestVertex> vertices = ::MakeVertices(random, vertex_count);
+
+		// Up to four influences per vertex, some of them unused with weight 0. The last joint influences nothing
+		std::uniform_int_distribution<unsigned int> joint(0, TEST_JOINT_COUNT - 2);
+		std::uniform_real_distribution<float> weight(0.0f, 1.0f);
+		std::vector<unsigned int> joint_indices(vertex_count * TEST_INFLUENCES);
+		std::vector<float> joint_weights(joint_indices.size());
+		for (unsigned int i = 0; i < vertex_count; ++i)
+		{
+			float sum = 0.0f;
+			for (unsigned int j = 0; j < TEST_INFLUENCES; ++j)
+			{
+				joint_indices[i * TEST_INFLUENCES + j] = joint(random);
+				joint_weights[i * TEST_INFLUENCES + j] = (j == 0 || weight(random) > 0.5f) ? weight(random) + 0.01f : 0.0f;
+				sum += joint_weights[i * TEST_INFLUENCES + j];
+			}
+			for (unsigned int j = 0; j < TEST_INFLUENCES; ++j)
+			{
+				joint_weights[i * TEST_INFLUENCES + j] /= sum;
+			}
+		}
+
+		std::vector<Bounds::AABB> joint_bounds;
+		Bounds::ComputeJointBounds(&vertices[0].position, sizeof(TestVertex), vertex_count, joint_indices.data(), joint_weights.data(),
+			TEST_INFLUENCES, TEST_JOINT_COUNT, &joint_bounds);
+		CHECK_EQUAL(TEST_JOINT_COUNT, joint_bounds.size());
+		CHECK(Bounds::IsEmpty(joint_bounds[TEST_JOINT_COUNT - 1]));
+
+		// Every vertex is in the box of every joint that moves it
+		bool in_joint_boxes = true;
+		for (unsigned int i = 0; i < vertex_count; ++i)
+		{
+			for (unsigned int j = 0; j < TEST_INFLUENCES; ++j)
+			{
+				if (joint_weights[i * TEST_INFLUENCES + j] > 0.0f)
+					in_joint_boxes = in_joint_boxes && ::Contains(joint_bounds[joint_indices[i * TEST_INFLUENCES + j]], vertices[i].position, 0.0f);
+			}
+		}
+		CHECK(in_joint_boxes);
+
+		for (int pose = 0; pose < 10; ++pose)
+		{
+			XMFLOAT4X4 palette[TEST_JOINT_COUNT];
+			for (XMFLOAT4X4& transform : palette)
+			{
+				transform = ::MakeJointTransform(random);
+			}
+			const Bounds::AABB skinned_box = Bounds::ComputeSkinnedBounds(joint_bounds, palette);
+			CHECK(!Bounds::IsEmpty(skinned_box));
+
+			// Skinned like the vertex shader does it, every result has to be inside the box
+			bool contained = true;
+			for (unsigned int i = 0; i < vertex_count; ++i)
+			{
+				XMVECTOR skinned = XMVectorZero();
+				for (unsigned int j = 0; j < TEST_INFLUENCES; ++j)
+				{
+					const XMMATRIX transform = XMMatrixTranspose(XMLoadFloat4x4(&palette[joint_indices[i * TEST_INFLUENCES + j]]));
+					const XMVECTOR moved = XMVector3TransformCoord(XMLoadFloat3(&vertices[i].position), transform);
+					skinned = XMVectorMultiplyAdd(XMVectorReplicate(joint_weights[i * TEST_INFLUENCES + j]), moved, skinned);
+				}
+				XMFLOAT3 position;
+				XMStoreFloat3(&position, skinned);
+				contained = contained && ::Contains(skinned_box, position, TEST_EPSILON);
+			}
+			CHECK(contained);
+		}
+	}
+
+	void TestBoxVisibility()
+	{
+		// A frustum looking down +z from the origin
+		XMFLOAT4 planes[6];
+		XMStoreFloat4(&planes[0], XMPlaneNormalize(XMVectorSet(1.0f, 0.0f, 1.0f, 0.0f)));
+		XMStoreFloat4(&planes[1], XMPlaneNormalize(XMVectorSet(-1.0f, 0.0f, 1.0f, 0.0f)));
+		XMStoreFloat4(&planes[2], XMPlaneNormalize(XMVectorSet(0.0f, 1.0f, 1.0f, 0.0f)));
+		XMStoreFloat4(&planes[3], XMPlaneNormalize(XMVectorSet(0.0f, -1.0f, 1.0f, 0.0f)));
+		planes[4] = XMFLOAT4(0.0f, 0.0f, 1.0f, -1.0f);
+		planes[5] = XMFLOAT4(0.0f, 0.0f, -1.0f, 100.0f);
+
+		CHECK(Bounds::IsAABBVisible({ XMFLOAT3(-1.0f, -1.0f, 10.0f), XMFLOAT3(1.0f, 1.0f, 12.0f) }, planes));
+		// Behind the camera, past the far plane and to the side
+		CHECK(!Bounds::IsAABBVisible({ XMFLOAT3(-1.0f, -1.0f, -12.0f), XMFLOAT3(1.0f, 1.0f, -10.0f) }, planes));
+		CHECK(!Bounds::IsAABBVisible({ XMFLOAT3(-1.0f, -1.0f, 101.0f), XMFLOAT3(1.0f, 1.0f, 110.0f) }, planes));
+		CHECK(!Bounds::IsAABBVisible({ XMFLOAT3(20.0f, -1.0f, 10.0f), XMFLOAT3(22.0f, 1.0f, 12.0f) }, planes));
+		// Reaching into the frustum from the side
+		CHECK(Bounds::IsAABBVisible({ XMFLOAT3(9.0f, -1.0f, 10.0f), XMFLOAT3(22.0f, 1.0f, 12.0f) }, planes));
+
+		// Against the corners, a box is culled exactly when all of them are behind the same plane
+		std::mt19937 random(13);
+		std::uniform_real_distribution<float> coordinate(-120.0f, 120.0f);
+		std::uniform_real_distribution<float> size(0.0f, 20.0f);
+		bool matches = true;
+		for (int i = 0; i < 10000; ++i)
+		{
+			Bounds::AABB box;
+			box.min = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random));
+			box.max = XMFLOAT3(box.min.x + size(random), box.min.y + size(random), box.min.z + size(random));
+			bool expected = true;
+			for (int p = 0; p < 6 && expected; ++p)
+			{
+				bool all_behind = true;
+				for (int corner = 0; corner < 8; ++corner)
+				{
+					const XMVECTOR point = XMVectorSet(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z, 1.0f);
+					all_behind = all_behind && XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&planes[p]), point)) < 0.0f;
+				}
+				expected = !all_behind;
+			}
+			matches = matches && Bounds::IsAABBVisible(box, planes) == expected;
+		}
+		CHECK(matches);
+	}
+}
+
+int main()
+{
+	::TestReduction();
+	::TestSkinnedBounds();
+	::TestBoxVisibility();
+	return TEST_RESULT();
+}
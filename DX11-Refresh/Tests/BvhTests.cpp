@@ -0,0 +1,295 @@
+#include "Bvh.h"
+#include "Culling.h"
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Random inserts, removes and refits, the tree is rebuilt half way through
+#define TEST_OPERATION_COUNT 6000
+// The queries are checked against the linear scans every this many operations
+#define TEST_CHECK_INTERVAL 500
+// Queries per check
+#define TEST_QUERY_COUNT 64
+// Boxes closer than this to a plane may be classified either way, the BVH and the scalar test add in another order
+#define TEST_EPSILON 1e-3f
+// Workers for the batched ray casts
+#define TEST_WORKER_COUNT 4
+
+using namespace DirectX;
+
+namespace
+{
+	// What the test expects the tree to hold, the user data of a leaf is its index here
+	struct TestLeaf
+	{
+		uint32_t proxy;
+		Bounds::AABB box;
+		bool alive;
+	};
+
+	Bounds::AABB MakeBox(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> coordinate(-200.0f, 200.0f);
+		std::uniform_real_distribution<float> size(0.0f, 20.0f);
+		Bounds::AABB box;
+		box.min = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random) + 200.0f);
+		box.max = XMFLOAT3(box.min.x + size(random), box.min.y + size(random), box.min.z + size(random));
+		return box;
+	}
+
+	bool Overlaps(const Bounds::AABB& a, const Bounds::AABB& b)
+	{
+		return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y && a.min.z <= b.max.z && a.max.z >= b.min.z;
+	}
+
+	// The slab test in doubles with parallel axes handled explicitly, -1 if the ray misses the box within maxDistance
+	double RayEnterReference(const Bounds::AABB& box, const DynamicBvh::Ray& ray)
+	{
+		const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+		const float min[3] = { box.min.x, box.min.y, box.min.z };
+		const float max[3] = { box.max.x, box.max.y, box.max.z };
+		double enter = 0.0;
+		double exit = ray.maxDistance;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (direction[axis] == 0.0f)
+			{
+				if (origin[axis] < min[axis] || origin[axis] > max[axis])
+					return -1.0;
+				continue;
+			}
+			double t1 = ((double)min[axis] - origin[axis]) / direction[axis];
+			double t2 = ((double)max[axis] - origin[axis]) / direction[axis];
+			enter = (std::max)(enter, (std::min)(t1, t2));
+			exit = (std::min)(exit, (std::max)(t1, t2));
+		}
+		return enter <= exit ? enter : -1.0;
+	}
+
+	void CheckFrustum(const DynamicBvh& bvh, const std::vector<TestLeaf>& leaves, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+		std::uniform_real_distribution<float> far_distance(50.0f, 600.0f);
+		bool matches = true;
+		for (int q = 0; q < TEST_QUERY_COUNT; ++q)
+		{
+			const XMMATRIX view = XMMatrixRotationRollPitchYaw(angle(random), angle(random), 0.0f) * XMMatrixTranslation(0.0f, 0.0f, 200.0f);
+			const XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, far_distance(random));
+			XMFLOAT4 planes[6];
+			Culling::ExtractFrustumPlanes(XMMatrixInverse(nullptr, view) * projection, planes);
+
+			std::vector<uint32_t> visible;
+			bvh.QueryFrustum(planes, &visible);
+			std::sort(visible.begin(), visible.end());
+			matches = matches && std::adjacent_find(visible.begin(), visible.end()) == visible.end();
+			for (uint32_t i = 0; i < leaves.size(); ++i)
+			{
+				const bool found = std::binary_search(visible.begin(), visible.end(), i);
+				if (!leaves[i].alive)
+				{
+					matches = matches && !found;
+					continue;
+				}
+				const Bounds::AABB& box = leaves[i].box;
+				float nearest = FLT_MAX;
+				for (int p = 0; p < 6; ++p)
+				{
+					const XMFLOAT4& plane = planes[p];
+					const XMVECTOR corner = XMVectorSet(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y,
+						plane.z >= 0.0f ? box.max.z : box.min.z, 1.0f);
+					nearest = (std::min)(nearest, std::fabs(XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), corner))));
+				}
+				matches = matches && (nearest < TEST_EPSILON || found == Bounds::IsAABBVisible(box, planes));
+			}
+		}
+		CHECK(matches);
+	}
+
+	void CheckOverlap(const DynamicBvh& bvh, const std::vector<TestLeaf>& leaves, std::mt19937& random)
+	{
+		bool matches = true;
+		for (int q = 0; q < TEST_QUERY_COUNT; ++q)
+		{
+			const Bounds::AABB query = ::MakeBox(random);
+			std::vector<uint32_t> found;
+			bvh.QueryOverlap(query, &found);
+			std::sort(found.begin(), found.end());
+
+			std::vector<uint32_t> expected;
+			for (uint32_t i = 0; i < leaves.size(); ++i)
+			{
+				if (leaves[i].alive && ::Overlaps(leaves[i].box, query))
+					expected.push_back(i);
+			}
+			matches = matches && found == expected;
+		}
+		CHECK(matches);
+	}
+
+	// Random rays, and rays along an axis that start on the plane of a box face, where 0 * inf used to give NaN
+	std::vector<DynamicBvh::Ray> MakeRays(const std::vector<TestLeaf>& leaves, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> coordinate(-250.0f, 250.0f);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_int_distribution<size_t> leaf(0, leaves.size() - 1);
+		std::vector<DynamicBvh::Ray> rays(TEST_QUERY_COUNT);
+		for (DynamicBvh::Ray& ray : rays)
+		{
+			ray.origin = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random) + 200.0f);
+			XMStoreFloat3(&ray.direction, XMVector3Normalize(XMVectorSet(coordinate(random), coordinate(random), coordinate(random), 0.0f)));
+			ray.maxDistance = unit(random) < 0.5f ? FLT_MAX : 300.0f;
+		}
+		for (int i = 0; i < TEST_QUERY_COUNT / 2; ++i)
+		{
+			const TestLeaf& target = leaves[leaf(random)];
+			if (!target.alive)
+				continue;
+			// On the min x face plane, inside the box in y, travelling along z from in front of it
+			DynamicBvh::Ray& ray = rays[i];
+			ray.origin = XMFLOAT3(target.box.min.x, target.box.min.y + (target.box.max.y - target.box.min.y) * unit(random), target.box.min.z - 10.0f);
+			ray.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
+			ray.maxDistance = FLT_MAX;
+		}
+		return rays;
+	}
+
+	void CheckRays(const DynamicBvh& bvh, const std::vector<TestLeaf>& leaves, std::mt19937& random)
+	{
+		const std::vector<DynamicBvh::Ray> rays = ::MakeRays(leaves, random);
+		std::vector<DynamicBvh::RayHit> batch_hits(rays.size());
+		bvh.RayCastBatch(rays.data(), (unsigned int)rays.size(), batch_hits.data());
+
+		bool matches = true;
+		bool batch_matches = true;
+		for (size_t r = 0; r < rays.size(); ++r)
+		{
+			const DynamicBvh::Ray& ray = rays[r];
+			double nearest = -1.0;
+			for (const TestLeaf& leaf : leaves)
+			{
+				const double enter = leaf.alive ? ::RayEnterReference(leaf.box, ray) : -1.0;
+				if (enter >= 0.0 && (nearest < 0.0 || enter < nearest))
+					nearest = enter;
+			}
+
+			DynamicBvh::RayHit hit;
+			const bool was_hit = bvh.RayCast(ray, &hit);
+			matches = matches && was_hit == (nearest >= 0.0);
+			if (was_hit && nearest >= 0.0)
+			{
+				// The leaf reported has to be entered at the distance reported, and no other leaf before it
+				const bool known = hit.userData < leaves.size() && leaves[hit.userData].alive && hit.proxy == leaves[hit.userData].proxy;
+				const double hit_enter = known ? ::RayEnterReference(leaves[hit.userData].box, ray) : -1.0;
+				matches = matches && known && std::fabs(hit.distance - nearest) <= TEST_EPSILON * (1.0 + nearest) &&
+					std::fabs(hit_enter - nearest) <= TEST_EPSILON * (1.0 + nearest);
+			}
+
+			const DynamicBvh::RayHit& batch_hit = batch_hits[r];
+			batch_matches = batch_matches && batch_hit.proxy == hit.proxy && batch_hit.userData == hit.userData && batch_hit.distance == hit.distance;
+		}
+		CHECK(matches);
+		CHECK(batch_matches);
+	}
+
+	void TestRandomOperations()
+	{
+		std::mt19937 random(31);
+		std::uniform_real_distribution<float> operation(0.0f, 1.0f);
+		std::uniform_real_distribution<float> move(-5.0f, 5.0f);
+		DynamicBvh bvh;
+		std::vector<TestLeaf> leaves;
+		std::vector<uint32_t> alive;
+		for (int step = 1; step <= TEST_OPERATION_COUNT; ++step)
+		{
+			const float choice = operation(random);
+			if (alive.empty() || choice < 0.5f)
+			{
+				const Bounds::AABB box = ::MakeBox(random);
+				const uint32_t index = (uint32_t)leaves.size();
+				leaves.push_back({ bvh.Insert(box, index), box, true });
+				alive.push_back(index);
+			}
+			else
+			{
+				const size_t slot = std::uniform_int_distribution<size_t>(0, alive.size() - 1)(random);
+				TestLeaf& leaf = leaves[alive[slot]];
+				if (choice < 0.7f)
+				{
+					bvh.Remove(leaf.proxy);
+					leaf.alive = false;
+					alive[slot] = alive.back();
+					alive.pop_back();
+				}
+				else
+				{
+					// Moved a little like a scene object, or anywhere
+					const float dx = move(random), dy = move(random), dz = move(random);
+					Bounds::AABB box = choice < 0.9f ? leaf.box : ::MakeBox(random);
+					if (choice < 0.9f)
+					{
+						box.min = XMFLOAT3(box.min.x + dx, box.min.y + dy, box.min.z + dz);
+						box.max = XMFLOAT3(box.max.x + dx, box.max.y + dy, box.max.z + dz);
+					}
+					bvh.Refit(leaf.proxy, box);
+					leaf.box = box;
+				}
+			}
+			if (step == TEST_OPERATION_COUNT / 2)
+				bvh.Rebuild();
+
+			if (step % TEST_CHECK_INTERVAL == 0)
+			{
+				CHECK_EQUAL((uint32_t)alive.size(), bvh.GetLeafCount());
+				bool stored = true;
+				for (uint32_t index : alive)
+				{
+					const Bounds::AABB& box = bvh.GetBox(leaves[index].proxy);
+					stored = stored && bvh.GetUserData(leaves[index].proxy) == index &&
+						box.min.x == leaves[index].box.min.x && box.max.z == leaves[index].box.max.z;
+				}
+				CHECK(stored);
+				::CheckFrustum(bvh, leaves, random);
+				::CheckOverlap(bvh, leaves, random);
+				::CheckRays(bvh, leaves, random);
+			}
+		}
+	}
+
+	void TestParallelRay()
+	{
+		// Every leaf lies in the plane x = 0 of the ray origin, only the one the ray runs through may be hit
+		DynamicBvh bvh;
+		bvh.Insert({ XMFLOAT3(0.0f, -1.0f, 5.0f), XMFLOAT3(2.0f, 1.0f, 6.0f) }, 1);
+		bvh.Insert({ XMFLOAT3(-2.0f, -1.0f, 3.0f), XMFLOAT3(0.0f, 1.0f, 4.0f) }, 2);
+		bvh.Insert({ XMFLOAT3(0.5f, -1.0f, 1.0f), XMFLOAT3(2.0f, 1.0f, 2.0f) }, 3);
+		DynamicBvh::Ray ray = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), FLT_MAX };
+		DynamicBvh::RayHit hit;
+		CHECK(bvh.RayCast(ray, &hit));
+		CHECK_EQUAL(2u, hit.userData);
+		CHECK_EQUAL(3.0f, hit.distance);
+
+		// Along y through the edge where two faces meet
+		ray = { XMFLOAT3(-2.0f, -5.0f, 4.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), FLT_MAX };
+		CHECK(bvh.RayCast(ray, &hit));
+		CHECK_EQUAL(2u, hit.userData);
+		CHECK_EQUAL(4.0f, hit.distance);
+
+		// Just outside the face plane misses
+		ray = { XMFLOAT3(-2.001f, -5.0f, 4.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), FLT_MAX };
+		CHECK(!bvh.RayCast(ray, &hit));
+	}
+}
+
+int main()
+{
+	JobSystem::Init(TEST_WORKER_COUNT);
+	::TestRandomOperations();
+	::TestParallelRay();
+	JobSystem::Shutdown();
+	return TEST_RESULT();
+}
@@ -0,0 +1,138 @@
+#include "CameraPath.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+// Written into the working directory of the test and removed again
+#define TEST_PATH_FILE "CameraPathTests.path"
+// Slack for positions that went through the spline in float
+#define TEST_EPSILON 1e-4f
+
+using namespace DirectX;
+
+namespace
+{
+	float Distance(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&a), XMLoadFloat3(&b))));
+	}
+
+	// Four keys that are not on one line, one second per key
+	CameraPath MakePath()
+	{
+		CameraPath path;
+		path.AddKey(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 10.0f));
+		path.AddKey(XMFLOAT3(10.0f, 2.0f, 0.0f), XMFLOAT3(10.0f, 0.0f, 10.0f));
+		path.AddKey(XMFLOAT3(10.0f, 5.0f, 10.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+		path.AddKey(XMFLOAT3(-3.0f, 1.0f, 8.0f), XMFLOAT3(5.0f, 5.0f, 5.0f));
+		path.SetDuration(4.0f);
+		return path;
+	}
+
+	void TestControlPoints()
+	{
+		const CameraPath path = ::MakePath();
+		for (size_t i = 0; i < path.GetKeyCount(); ++i)
+		{
+			const CameraKey& key = path.GetKeys()[i];
+			XMFLOAT3 position;
+			XMFLOAT3 look;
+			path.Evaluate((double)i, &position, &look);
+			CHECK(::Distance(key.position, position) < TEST_EPSILON);
+
+			XMFLOAT3 expected_look;
+			XMStoreFloat3(&expected_look, XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&key.target), XMLoadFloat3(&key.position))));
+			CHECK(::Distance(expected_look, look) < TEST_EPSILON);
+		}
+
+		// The path loops, also for times before the start
+		XMFLOAT3 position;
+		XMFLOAT3 look;
+		path.Evaluate(4.0 * 1000.0 + 2.0, &position, &look);
+		CHECK(::Distance(path.GetKeys()[2].position, position) < TEST_EPSILON);
+		path.Evaluate(-1.0, &position, &look);
+		CHECK(::Distance(path.GetKeys()[3].position, position) < TEST_EPSILON);
+	}
+
+	void TestContinuity()
+	{
+		const CameraPath path = ::MakePath();
+		const double step = 1e-3;
+		// Every join, the last one is where the loop closes
+		for (size_t i = 1; i <= path.GetKeyCount(); ++i)
+		{
+			const double join = (double)i;
+			XMFLOAT3 before[2];
+			XMFLOAT3 after[2];
+			XMFLOAT3 look;
+			path.Evaluate(join - 2.0 * step, &before[0], &look);
+			path.Evaluate(join - step, &before[1], &look);
+			path.Evaluate(join + step, &after[0], &look);
+			path.Evaluate(join + 2.0 * step, &after[1], &look);
+
+			// No jump in the position
+			CHECK(::Distance(before[1], after[0]) < 0.05f);
+			// Nor in the velocity, Catmull-Rom segments share the tangent at their joins
+			const float speed_before = ::Distance(before[0], before[1]);
+			const float speed_after = ::Distance(after[0], after[1]);
+			CHECK(std::fabs(speed_before - speed_after) < 0.1f * speed_before + TEST_EPSILON);
+			const XMVECTOR direction_before = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&before[1]), XMLoadFloat3(&before[0])));
+			const XMVECTOR direction_after = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&after[1]), XMLoadFloat3(&after[0])));
+			CHECK(XMVectorGetX(XMVector3Dot(direction_before, direction_after)) > 0.99f);
+		}
+	}
+
+	void TestDegenerate()
+	{
+		// Without keys nothing is written
+		CameraPath path;
+		XMFLOAT3 position(7.0f, 7.0f, 7.0f);
+		XMFLOAT3 look(7.0f, 7.0f, 7.0f);
+		path.Evaluate(1.0, &position, &look);
+		CHECK_EQUAL(7.0f, position.x);
+
+		// Looking at its own position the camera looks along +z
+		path.AddKey(XMFLOAT3(1.0f, 1.0f, 1.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+		path.Evaluate(1.0, &position, &look);
+		CHECK(::Distance(XMFLOAT3(1.0f, 1.0f, 1.0f), position) < TEST_EPSILON);
+		CHECK(::Distance(XMFLOAT3(0.0f, 0.0f, 1.0f), look) < TEST_EPSILON);
+
+		// A duration of zero or less is ignored
+		path.SetDuration(0.0f);
+		CHECK_EQUAL(CAMERA_PATH_DEFAULT_DURATION, path.GetDuration());
+	}
+
+	void TestLoad()
+	{
+		{
+			std::ofstream file(TEST_PATH_FILE);
+			file << "# Two keys\nduration 8\n0 0 0  0 0 1\n\n1 2 3  4 5 6 # trailing comment\nnot a key\n";
+		}
+		CameraPath path;
+		CHECK(path.LoadFromFile(TEST_PATH_FILE));
+		CHECK_EQUAL(2u, path.GetKeyCount());
+		CHECK_EQUAL(8.0f, path.GetDuration());
+		CHECK_EQUAL(3.0f, path.GetKeys()[1].position.z);
+		CHECK_EQUAL(6.0f, path.GetKeys()[1].target.z);
+
+		// Fewer than two keys leaves the path as it was
+		{
+			std::ofstream file(TEST_PATH_FILE);
+			file << "0 0 0  0 0 1\n";
+		}
+		CHECK(!path.LoadFromFile(TEST_PATH_FILE));
+		CHECK_EQUAL(2u, path.GetKeyCount());
+		std::remove(TEST_PATH_FILE);
+		CHECK(!path.LoadFromFile(TEST_PATH_FILE));
+	}
+}
+
+int main()
+{
+	::TestControlPoints();
+	::TestContinuity();
+	::TestDegenerate();
+	::TestLoad();
+	return TEST_RESULT();
+}
@@ -0,0 +1,163 @@
+#include "CommandStream.h"
+#include "JobSystem.h"
+#include "StateCache.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+// Draws of the recorded list, every TEST_INSTANCED_EVERY-th one is instanced
+#define TEST_DRAW_COUNT 2000
+#define TEST_INSTANCED_EVERY 5
+// Distinct materials the draws cycle through, neighbouring draws often share one so the state cache filters
+#define TEST_MATERIAL_COUNT 8
+
+namespace
+{
+	// Only the pointers are recorded, they are never dereferenced
+	template <class T>
+	T* FakeObject(uintptr_t id)
+	{
+		return reinterpret_cast<T*>(id * 16);
+	}
+
+	struct TestDraw
+	{
+		unsigned int material;
+		unsigned int indexCount;
+		unsigned int instanceCount;		// 0 for draws that are not instanced
+	};
+
+	// Records draws [begin, end) the way Renderer::RecordDraws does, every slice binds everything it needs
+	void RecordSlice(const std::vector<TestDraw>& draws, size_t begin, size_t end, StateCache<CommandBuffer>* pRecorder)
+	{
+		ID3D11RenderTargetView* p_target = ::FakeObject<ID3D11RenderTargetView>(1);
+		const D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 1200.0f, 800.0f, 0.0f, 1.0f };
+		pRecorder->Invalidate();
+		pRecorder->OMSetRenderTargets(1, &p_target, ::FakeObject<ID3D11DepthStencilView>(2));
+		pRecorder->OMSetBlendState(nullptr, nullptr, 0xffffffff);
+		pRecorder->RSSetViewports(1, &viewport);
+		for (size_t i = begin; i < end; ++i)
+		{
+			const TestDraw& draw = draws[i];
+			const UINT stride = 32;
+			const UINT offset = 0;
+			ID3D11Buffer* p_vertices = ::FakeObject<ID3D11Buffer>(100 + draw.material);
+			pRecorder->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			pRecorder->IASetInputLayout(::FakeObject<ID3D11InputLayout>(3));
+			pRecorder->IASetVertexBuffers(0, 1, &p_vertices, &stride, &offset);
+			pRecorder->IASetIndexBuffer(::FakeObject<ID3D11Buffer>(200 + draw.material), DXGI_FORMAT_R32_UINT, 0);
+			pRecorder->VSSetShader(::FakeObject<ID3D11VertexShader>(4), nullptr, 0);
+			pRecorder->PSSetShader(::FakeObject<ID3D11PixelShader>(5), nullptr, 0);
+			ID3D11ShaderResourceView* p_texture = ::FakeObject<ID3D11ShaderResourceView>(300 + draw.material);
+			pRecorder->PSSetShaderResources(0, 1, &p_texture);
+			if (draw.instanceCount > 0)
+				pRecorder->DrawIndexedInstanced(draw.indexCount, draw.instanceCount, 0, 0, 0);
+			else
+				pRecorder->DrawIndexed(draw.indexCount, 0, 0);
+		}
+	}
+
+	void TestParallelRecording()
+	{
+		std::vector<TestDraw> draws(TEST_DRAW_COUNT);
+		unsigned int expected_instances = 0;
+		uint64_t expected_indices = 0;
+		for (unsigned int i = 0; i < TEST_DRAW_COUNT; ++i)
+		{
+			draws[i].material = (i / 3) % TEST_MATERIAL_COUNT;
+			draws[i].indexCount = 3 * (1 + i % 50);
+			draws[i].instanceCount = i % TEST_INSTANCED_EVERY == 0 ? 1 + i % 7 : 0;
+			const unsigned int instances = draws[i].instanceCount > 0 ? draws[i].instanceCount : 1;
+			expected_instances += instances;
+			expected_indices += (uint64_t)draws[i].indexCount * instances;
+		}
+
+		JobSystem::Init(4);
+		const unsigned int slice_count = COMMAND_MAX_SLICES;
+		const size_t draws_per_slice = (TEST_DRAW_COUNT + slice_count - 1) / slice_count;
+		std::vector<CommandBuffer> buffers(slice_count);
+		std::vector<StateCache<CommandBuffer>> recorders(slice_count);
+		for (unsigned int slice = 0; slice < slice_count; ++slice)
+		{
+			recorders[slice].SetContext(&buffers[slice]);
+		}
+		JobSystem::ParallelFor(slice_count, 1, [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int slice = begin; slice < end; ++slice)
+			{
+				const size_t first = (std::min)((size_t)TEST_DRAW_COUNT, slice * draws_per_slice);
+				const size_t last = (std::min)((size_t)TEST_DRAW_COUNT, (slice + 1) * draws_per_slice);
+				::RecordSlice(draws, first, last, &recorders[slice]);
+			}
+		});
+		JobSystem::Shutdown();
+
+		// Played back in slice order the buffers draw exactly the list
+		NullCommandContext context;
+		unsigned int recorded_commands = 0;
+		for (unsigned int slice = 0; slice < slice_count; ++slice)
+		{
+			CHECK(Commands::Replay(buffers[slice], &context));
+			recorded_commands += buffers[slice].GetCommandCount();
+			// Every state call binds one slot, so a buffer holds the calls the cache let through and the draws
+			CHECK_EQUAL(recorders[slice].GetStats().issuedCalls, buffers[slice].GetCommandCount() - (unsigned int)(draws_per_slice));
+		}
+		const NullCommandStats& stats = context.GetStats();
+		CHECK_EQUAL(TEST_DRAW_COUNT, stats.draws);
+		CHECK_EQUAL(expected_instances, stats.instances);
+		CHECK_EQUAL(expected_indices, stats.indices);
+		CHECK_EQUAL(0u, stats.invalidDraws);
+		CHECK_EQUAL(TEST_DRAW_COUNT / TEST_INSTANCED_EVERY, stats.commands[COMMAND_DRAW_INDEXED_INSTANCED]);
+		// Every slice binds the shared state once
+		CHECK_EQUAL(slice_count, stats.commands[COMMAND_SET_RENDER_TARGETS]);
+		CHECK_EQUAL(slice_count, stats.commands[COMMAND_SET_VERTEX_SHADER]);
+		unsigned int replayed_commands = 0;
+		for (unsigned int type = 0; type < COMMAND_TYPE_COUNT; ++type)
+		{
+			replayed_commands += stats.commands[type];
+		}
+		CHECK_EQUAL(recorded_commands, replayed_commands);
+	}
+
+	void TestMissingState()
+	{
+		CommandBuffer buffer;
+		buffer.IASetInputLayout(::FakeObject<ID3D11InputLayout>(1));
+		buffer.DrawIndexed(36, 0, 0);
+		NullCommandContext context;
+		CHECK(Commands::Replay(buffer, &context));
+		CHECK_EQUAL(1u, context.GetStats().draws);
+		CHECK_EQUAL(1u, context.GetStats().invalidDraws);
+
+		context.Reset();
+		CHECK_EQUAL(0u, context.GetStats().draws);
+		CHECK_EQUAL(0u, context.GetStats().commands[COMMAND_SET_INPUT_LAYOUT]);
+	}
+
+	void TestClear()
+	{
+		CommandBuffer buffer;
+		const FLOAT factor[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+		buffer.OMSetBlendState(::FakeObject<ID3D11BlendState>(1), factor, 0xff);
+		buffer.DrawIndexedInstanced(6, 2, 0, 0, 0);
+		CHECK_EQUAL(2u, buffer.GetCommandCount());
+		// Every command is padded to 8 bytes
+		CHECK_EQUAL(0u, buffer.GetSize() % 8);
+
+		buffer.Clear();
+		CHECK_EQUAL(0u, buffer.GetCommandCount());
+		CHECK_EQUAL(0u, buffer.GetSize());
+		NullCommandContext context;
+		CHECK(Commands::Replay(buffer, &context));
+		CHECK_EQUAL(0u, context.GetStats().draws);
+	}
+}
+
+int main()
+{
+	::TestParallelRecording();
+	::TestMissingState();
+	::TestClear();
+	return TEST_RESULT();
+}
@@ -0,0 +1,178 @@
+#include "ConstantBufferRing.h"
+#include "TestCheck.h"
+#include <vector>
+
+namespace
+{
+	// Plays the GPU: frames complete when the test says so, or when the ring waits for them
+	class FakeBackend
+	{
+	public:
+		std::vector<unsigned char> memory;
+		unsigned int maps = 0;
+		unsigned int discards = 0;
+		std::vector<uint64_t> signaled;
+		std::vector<uint64_t> waited;
+		// Every frame up to and including this one is complete, none if -1
+		int64_t completed = -1;
+
+		explicit FakeBackend(uint32_t size) : memory(size) {}
+
+		void* Map(bool discard)
+		{
+			this->maps++;
+			this->discards += discard ? 1 : 0;
+			return this->memory.data();
+		}
+		void Unmap() {}
+		void SignalFrame(uint64_t frame) { this->signaled.push_back(frame); }
+		bool IsFrameComplete(uint64_t frame) { return (int64_t)frame <= this->completed; }
+		void WaitForFrame(uint64_t frame)
+		{
+			this->waited.push_back(frame);
+			if ((int64_t)frame > this->completed)
+				this->completed = (int64_t)frame;
+		}
+	};
+
+	typedef ConstantBufferRing<FakeBackend> FakeRing;
+
+	void TestAllocate()
+	{
+		FakeBackend backend(4096);
+		FakeRing ring;
+		// The size is rounded down to the alignment
+		ring.Init(&backend, 4096 + 100);
+		CHECK_EQUAL(4096u, ring.GetSize());
+
+		FakeRing::Slice slice;
+		// Nothing can be allocated before Map
+		CHECK(!ring.Allocate(64, &slice));
+
+		ring.BeginFrame(0);
+		CHECK(ring.Map());
+		CHECK(ring.Allocate(64, &slice));
+		CHECK_EQUAL(0u, slice.offset);
+		CHECK_EQUAL(CONSTANT_BUFFER_ALIGNMENT, slice.size);
+		CHECK(slice.pData == backend.memory.data());
+		CHECK(ring.Allocate(CONSTANT_BUFFER_ALIGNMENT + 1, &slice));
+		CHECK_EQUAL(CONSTANT_BUFFER_ALIGNMENT, slice.offset);
+		CHECK_EQUAL(2u * CONSTANT_BUFFER_ALIGNMENT, slice.size);
+		CHECK_EQUAL(CONSTANT_BUFFER_ALIGNMENT / 16, slice.FirstConstant());
+		CHECK_EQUAL(2u * CONSTANT_BUFFER_ALIGNMENT / 16, slice.ConstantCount());
+		CHECK(!ring.Allocate(0, &slice));
+		CHECK(!ring.Allocate(4097, &slice));
+		CHECK_EQUAL(3u * CONSTANT_BUFFER_ALIGNMENT, ring.GetStats().allocatedBytes);
+		ring.Unmap();
+
+		// Only the first map discards
+		CHECK(ring.Map());
+		ring.Unmap();
+		CHECK_EQUAL(2u, backend.maps);
+		CHECK_EQUAL(1u, backend.discards);
+		ring.EndFrame();
+		CHECK_EQUAL(1u, backend.signaled.size());
+		CHECK_EQUAL(0u, backend.waited.size());
+	}
+
+	void TestWrapAround()
+	{
+		const uint32_t size = 4 * CONSTANT_BUFFER_ALIGNMENT;
+		FakeBackend backend(size);
+		FakeRing ring;
+		ring.Init(&backend, size);
+		FakeRing::Slice slice;
+
+		// Frame 0 takes three of the four slices and is still on the GPU
+		ring.BeginFrame(0);
+		ring.Map();
+		for (int i = 0; i < 3; ++i)
+		{
+			CHECK(ring.Allocate(CONSTANT_BUFFER_ALIGNMENT, &slice));
+		}
+		ring.Unmap();
+		ring.EndFrame();
+
+		// Frame 1 gets the last slice, the next one wraps onto frame 0 and has to wait for it
+		ring.BeginFrame(1);
+		ring.Map();
+		CHECK(ring.Allocate(CONSTANT_BUFFER_ALIGNMENT, &slice));
+		CHECK_EQUAL(3u * CONSTANT_BUFFER_ALIGNMENT, slice.offset);
+		CHECK_EQUAL(0u, backend.waited.size());
+		CHECK(ring.Allocate(CONSTANT_BUFFER_ALIGNMENT, &slice));
+		CHECK_EQUAL(0u, slice.offset);
+		CHECK_EQUAL(1u, backend.waited.size());
+		CHECK_EQUAL(0u, backend.waited[0]);
+		CHECK_EQUAL(1u, ring.GetStats().waits);
+		ring.Unmap();
+		ring.EndFrame();
+
+		// Frame 1 is complete by the time frame 2 begins, its slices are free without waiting
+		backend.completed = 1;
+		ring.BeginFrame(2);
+		ring.Map();
+		CHECK(ring.Allocate(2 * CONSTANT_BUFFER_ALIGNMENT, &slice));
+		CHECK_EQUAL(CONSTANT_BUFFER_ALIGNMENT, slice.offset);
+		CHECK_EQUAL(1u, backend.waited.size());
+		CHECK_EQUAL(0u, ring.GetStats().waits);
+		ring.Unmap();
+		ring.EndFrame();
+
+		// Slices never straddle the end: two slices at offset 768 would not fit, so they start over at 0
+		backend.completed = 2;
+		ring.BeginFrame(3);
+		ring.Map();
+		CHECK(ring.Allocate(2 * CONSTANT_BUFFER_ALIGNMENT, &slice));
+		CHECK_EQUAL(0u, slice.offset);
+		// The skipped bytes at the end count as allocated
+		CHECK_EQUAL(3u * CONSTANT_BUFFER_ALIGNMENT, ring.GetStats().allocatedBytes);
+
+		// The frame itself fills the ring, there is nothing left to wait for
+		CHECK(!ring.Allocate(2 * CONSTANT_BUFFER_ALIGNMENT, &slice));
+		CHECK_EQUAL(0u, ring.GetStats().waits);
+		ring.Unmap();
+		ring.EndFrame();
+	}
+
+	void TestFrameLag()
+	{
+		FakeBackend backend(64 * CONSTANT_BUFFER_ALIGNMENT);
+		FakeRing ring;
+		ring.Init(&backend, 64 * CONSTANT_BUFFER_ALIGNMENT);
+		FakeRing::Slice slice;
+
+		// The GPU never catches up by itself, the CPU may only run CONSTANT_BUFFER_RING_MAX_FRAME_LAG frames ahead
+		for (uint64_t frame = 0; frame < 10; ++frame)
+		{
+			ring.BeginFrame(frame);
+			ring.Map();
+			CHECK(ring.Allocate(CONSTANT_BUFFER_ALIGNMENT, &slice));
+			ring.Unmap();
+			ring.EndFrame();
+			const unsigned int expected_waits = frame < CONSTANT_BUFFER_RING_MAX_FRAME_LAG ? 0 : 1;
+			CHECK_EQUAL(expected_waits, ring.GetStats().waits);
+		}
+		CHECK_EQUAL(10u, backend.signaled.size());
+		// Always the oldest frame in flight
+		CHECK_EQUAL(10u - CONSTANT_BUFFER_RING_MAX_FRAME_LAG, backend.waited.size());
+		for (size_t i = 0; i < backend.waited.size(); ++i)
+		{
+			CHECK_EQUAL(i, backend.waited[i]);
+		}
+
+		// Once the GPU is done with everything BeginFrame frees it all and EndFrame does not wait
+		backend.completed = 9;
+		ring.BeginFrame(10);
+		ring.EndFrame();
+		CHECK_EQUAL(0u, ring.GetStats().waits);
+		CHECK_EQUAL(10u - CONSTANT_BUFFER_RING_MAX_FRAME_LAG, backend.waited.size());
+	}
+}
+
+int main()
+{
+	::TestAllocate();
+	::TestWrapAround();
+	::TestFrameLag();
+	return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+#include "Crowd.h"
+#include "TestCheck.h"
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Joint matrices whose _11 tells which character and joint they came from
+	std::vector<XMFLOAT4X4> MakeJoints(unsigned int character, unsigned int jointCount)
+	{
+		std::vector<XMFLOAT4X4> joints(jointCount);
+		for (unsigned int joint = 0; joint < jointCount; ++joint)
+		{
+			XMStoreFloat4x4(&joints[joint], XMMatrixIdentity());
+			joints[joint]._11 = (float)(character * 100 + joint);
+		}
+		return joints;
+	}
+
+	void TestPack()
+	{
+		// Meshes 0 and 2 are used out of order, mesh 1 and 3 have no characters
+		const unsigned int meshes[5] = { 2, 0, 2, 0, 2 };
+		const unsigned int joint_counts[5] = { 3, 1, 4, 2, 5 };
+		std::vector<std::vector<XMFLOAT4X4>> joints(5);
+		std::vector<Crowd::Character> characters(5);
+		for (unsigned int i = 0; i < 5; ++i)
+		{
+			joints[i] = ::MakeJoints(i, joint_counts[i]);
+			characters[i].mesh = meshes[i];
+			XMStoreFloat4x4(&characters[i].world, XMMatrixTranslation((float)i, 0.0f, 0.0f));
+			characters[i].pJointMatrices = joints[i].data();
+			characters[i].jointCount = joint_counts[i];
+		}
+
+		std::vector<Crowd::InstanceData> instances;
+		std::vector<XMFLOAT4X4> palette;
+		std::vector<Crowd::Batch> batches;
+		Crowd::Pack(characters.data(), 5, 4, XMMatrixIdentity(), &instances, &palette, &batches);
+
+		// One batch per mesh with characters, in mesh order
+		CHECK_EQUAL(2u, batches.size());
+		CHECK_EQUAL(0u, batches[0].mesh);
+		CHECK_EQUAL(0u, batches[0].firstInstance);
+		CHECK_EQUAL(2u, batches[0].instanceCount);
+		CHECK_EQUAL(2u, batches[1].mesh);
+		CHECK_EQUAL(2u, batches[1].firstInstance);
+		CHECK_EQUAL(3u, batches[1].instanceCount);
+
+		// Instances of a mesh keep the character order: 1, 3 then 0, 2, 4
+		const unsigned int instance_character[5] = { 1, 3, 0, 2, 4 };
+		for (unsigned int i = 0; i < 5; ++i)
+		{
+			CHECK(instances[i].worldViewProjRow3.x == (float)instance_character[i]);
+		}
+
+		// Palettes are in character order, every instance points at its own
+		CHECK_EQUAL(15u, palette.size());
+		const unsigned int palette_offsets[5] = { 0, 3, 4, 8, 10 };
+		for (unsigned int i = 0; i < 5; ++i)
+		{
+			const unsigned int character = instance_character[i];
+			const unsigned int offset = instances[i].paletteOffset.x;
+			CHECK_EQUAL(palette_offsets[character], offset);
+			for (unsigned int joint = 0; joint < joint_counts[character]; ++joint)
+			{
+				CHECK(palette[offset + joint]._11 == (float)(character * 100 + joint));
+			}
+		}
+
+		// Packing again overwrites the outputs
+		Crowd::Pack(characters.data(), 0, 4, XMMatrixIdentity(), &instances, &palette, &batches);
+		CHECK(batches.empty());
+		CHECK(instances.empty());
+		CHECK(palette.empty());
+	}
+
+	void TestApplyViewProj()
+	{
+		Crowd::InstanceData instance = {};
+		instance.worldViewProjRow0 = XMFLOAT4(1.0f, 0.0f, 0.0f, 0.0f);
+		instance.worldViewProjRow1 = XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f);
+		instance.worldViewProjRow2 = XMFLOAT4(0.0f, 0.0f, 1.0f, 0.0f);
+		instance.worldViewProjRow3 = XMFLOAT4(1.0f, 2.0f, 3.0f, 1.0f);
+		instance.paletteOffset = XMUINT4(42, 0, 0, 0);
+		Crowd::InstanceData result = {};
+		Crowd::ApplyViewProj(&instance, 1, XMMatrixTranslation(10.0f, 0.0f, 0.0f), &result);
+		CHECK(result.worldViewProjRow3.x == 11.0f);
+		CHECK(result.worldViewProjRow3.y == 2.0f);
+		CHECK_EQUAL(42u, result.paletteOffset.x);
+	}
+
+	void TestGrowCapacity()
+	{
+		// Buffers cannot be created empty, the capacity is never 0
+		CHECK_EQUAL(1u, Crowd::GrowCapacity(0, 0));
+		CHECK_EQUAL(1u, Crowd::GrowCapacity(0, 1));
+		CHECK_EQUAL(8u, Crowd::GrowCapacity(0, 5));
+		CHECK_EQUAL(1024u, Crowd::GrowCapacity(0, 1000));
+		CHECK_EQUAL(8u, Crowd::GrowCapacity(8, 8));
+		CHECK_EQUAL(16u, Crowd::GrowCapacity(8, 9));
+		// Never shrinks
+		CHECK_EQUAL(64u, Crowd::GrowCapacity(64, 3));
+		// Past the largest power of two it stops doubling instead of wrapping around
+		CHECK_EQUAL(0xffffffffu, Crowd::GrowCapacity(0, 0xffffffffu));
+	}
+}
+
+int main()
+{
+	::TestPack();
+	::TestApplyViewProj();
+	::TestGrowCapacity();
+	return TEST_RESULT();
+}
@@ -0,0 +1,254 @@
+#include "Culling.h"
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Workers for the multi-threaded culls
+#define TEST_WORKER_COUNT 4
+// Objects closer than this to a plane may be classified either way, the kernels add in another order than the scalar tests
+#define TEST_EPSILON 1e-3f
+// Written to the visible lists before a cull, to catch indices that were never meant to be written
+#define TEST_UNUSED 0xffffffffu
+
+using namespace DirectX;
+
+namespace
+{
+	// A camera at the origin looking down +z
+	void MakeFrustum(XMFLOAT4* pPlanes)
+	{
+		const XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		const XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 16.0f / 9.0f, 1.0f, 500.0f);
+		Culling::ExtractFrustumPlanes(view * projection, pPlanes);
+	}
+
+	// What the scalar test says, 0 or 1, or -1 when the object is too close to a plane to tell
+	struct Expected
+	{
+		std::vector<int> visible;
+	};
+
+	// True if the first count indices of visible are ascending, in range and agree with expected
+	bool Matches(const std::vector<unsigned int>& visible, unsigned int count, const Expected& expected)
+	{
+		unsigned int next = 0;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			const unsigned int index = visible[i];
+			if (index >= expected.visible.size() || (i > 0 && index <= visible[i - 1]))
+				return false;
+			// Every index skipped on the way has to be culled
+			for (; next < index; ++next)
+			{
+				if (expected.visible[next] == 1)
+					return false;
+			}
+			if (expected.visible[index] == 0)
+				return false;
+			next = index + 1;
+		}
+		for (; next < expected.visible.size(); ++next)
+		{
+			if (expected.visible[next] == 1)
+				return false;
+		}
+		return true;
+	}
+
+	Expected ExpectSpheres(const std::vector<Bounds::Sphere>& spheres, const XMFLOAT4* pPlanes)
+	{
+		Expected expected;
+		for (const Bounds::Sphere& sphere : spheres)
+		{
+			float nearest = FLT_MAX;
+			for (int p = 0; p < 6; ++p)
+			{
+				const float distance = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&pPlanes[p]), XMLoadFloat3(&sphere.center)));
+				nearest = (std::min)(nearest, std::fabs(distance + sphere.radius));
+			}
+			expected.visible.push_back(nearest < TEST_EPSILON ? -1 : Bounds::IsSphereVisible(sphere, XMMatrixIdentity(), pPlanes) ? 1 : 0);
+		}
+		return expected;
+	}
+
+	Expected ExpectAABBs(const std::vector<Bounds::AABB>& boxes, const XMFLOAT4* pPlanes)
+	{
+		Expected expected;
+		for (const Bounds::AABB& box : boxes)
+		{
+			float nearest = FLT_MAX;
+			for (int p = 0; p < 6; ++p)
+			{
+				const XMFLOAT4& plane = pPlanes[p];
+				const XMVECTOR corner = XMVectorSet(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y,
+					plane.z >= 0.0f ? box.max.z : box.min.z, 1.0f);
+				nearest = (std::min)(nearest, std::fabs(XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&plane), corner))));
+			}
+			expected.visible.push_back(nearest < TEST_EPSILON ? -1 : Bounds::IsAABBVisible(box, pPlanes) ? 1 : 0);
+		}
+		return expected;
+	}
+
+	std::vector<Bounds::Sphere> MakeSpheres(std::mt19937& random, unsigned int count)
+	{
+		std::uniform_real_distribution<float> coordinate(-300.0f, 300.0f);
+		std::uniform_real_distribution<float> radius(0.0f, 20.0f);
+		std::vector<Bounds::Sphere> spheres(count);
+		for (Bounds::Sphere& sphere : spheres)
+		{
+			sphere.center = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random) + 200.0f);
+			sphere.radius = radius(random);
+		}
+		return spheres;
+	}
+
+	std::vector<Bounds::AABB> MakeAABBs(std::mt19937& random, unsigned int count)
+	{
+		std::uniform_real_distribution<float> coordinate(-300.0f, 300.0f);
+		std::uniform_real_distribution<float> size(0.0f, 30.0f);
+		std::vector<Bounds::AABB> boxes(count);
+		for (Bounds::AABB& box : boxes)
+		{
+			box.min = XMFLOAT3(coordinate(random), coordinate(random), coordinate(random) + 200.0f);
+			box.max = XMFLOAT3(box.min.x + size(random), box.min.y + size(random), box.min.z + size(random));
+		}
+		return boxes;
+	}
+
+	// Counts around the SIMD width, so most of them end in padding lanes, and two larger ones
+	const unsigned int TEST_COUNTS[10] = { 0, 1, 2, 3, 4, 5, 7, 9, 1001, 20003 };
+
+	void TestSpheres()
+	{
+		XMFLOAT4 planes[6];
+		::MakeFrustum(planes);
+		std::mt19937 random(21);
+		for (unsigned int count : TEST_COUNTS)
+		{
+			const std::vector<Bounds::Sphere> spheres = ::MakeSpheres(random, count);
+			Culling::SphereSoA soa;
+			soa.Resize(count);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				soa.Set(i, spheres[i]);
+			}
+			CHECK_EQUAL(0u, soa.PaddedCount() % CULL_SIMD_WIDTH);
+
+			std::vector<unsigned int> visible(soa.PaddedCount() + 1, TEST_UNUSED);
+			const unsigned int visible_count = Culling::CullSpheres(soa, planes, visible.data(), 1);
+			CHECK(::Matches(visible, visible_count, ::ExpectSpheres(spheres, planes)));
+			CHECK_EQUAL(TEST_UNUSED, visible[soa.PaddedCount()]);
+		}
+	}
+
+	void TestAABBs()
+	{
+		XMFLOAT4 planes[6];
+		::MakeFrustum(planes);
+		std::mt19937 random(23);
+		for (unsigned int count : TEST_COUNTS)
+		{
+			const std::vector<Bounds::AABB> boxes = ::MakeAABBs(random, count);
+			Culling::AABBSoA soa;
+			soa.Resize(count);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				soa.Set(i, boxes[i]);
+			}
+
+			std::vector<unsigned int> visible(soa.PaddedCount() + 1, TEST_UNUSED);
+			const unsigned int visible_count = Culling::CullAABBs(soa, planes, visible.data(), 1);
+			CHECK(::Matches(visible, visible_count, ::ExpectAABBs(boxes, planes)));
+			CHECK_EQUAL(TEST_UNUSED, visible[soa.PaddedCount()]);
+		}
+	}
+
+	void TestPadding()
+	{
+		// Planes that keep everything, only the padding lanes may be culled
+		XMFLOAT4 planes[6] = {
+			XMFLOAT4(1.0f, 0.0f, 0.0f, 1e6f), XMFLOAT4(-1.0f, 0.0f, 0.0f, 1e6f),
+			XMFLOAT4(0.0f, 1.0f, 0.0f, 1e6f), XMFLOAT4(0.0f, -1.0f, 0.0f, 1e6f),
+			XMFLOAT4(0.0f, 0.0f, 1.0f, 1e6f), XMFLOAT4(0.0f, 0.0f, -1.0f, 1e6f)
+		};
+		for (unsigned int count = 1; count <= 9; ++count)
+		{
+			Culling::SphereSoA spheres;
+			Culling::AABBSoA boxes;
+			spheres.Resize(count);
+			boxes.Resize(count);
+			for (unsigned int i = 0; i < count; ++i)
+			{
+				spheres.Set(i, { XMFLOAT3((float)i, 0.0f, 0.0f), 0.0f });
+				boxes.Set(i, { XMFLOAT3((float)i, 0.0f, 0.0f), XMFLOAT3((float)i, 0.0f, 0.0f) });
+			}
+			std::vector<unsigned int> visible(spheres.PaddedCount(), TEST_UNUSED);
+			CHECK_EQUAL(count, Culling::CullSpheres(spheres, planes, visible.data(), 1));
+			CHECK_EQUAL(count - 1, visible[count - 1]);
+			CHECK_EQUAL(count, Culling::CullAABBs(boxes, planes, visible.data(), 1));
+			CHECK_EQUAL(count - 1, visible[count - 1]);
+
+			// Shrinking turns the dropped objects into padding
+			spheres.Resize(count - 1);
+			boxes.Resize(count - 1);
+			CHECK_EQUAL(count - 1, Culling::CullSpheres(spheres, planes, visible.data(), 1));
+			CHECK_EQUAL(count - 1, Culling::CullAABBs(boxes, planes, visible.data(), 1));
+		}
+	}
+
+	void TestThreads()
+	{
+		XMFLOAT4 planes[6];
+		::MakeFrustum(planes);
+		std::mt19937 random(25);
+		const unsigned int count = 20003;
+		const std::vector<Bounds::Sphere> spheres = ::MakeSpheres(random, count);
+		const std::vector<Bounds::AABB> boxes = ::MakeAABBs(random, count);
+		Culling::SphereSoA sphere_soa;
+		Culling::AABBSoA box_soa;
+		sphere_soa.Resize(count);
+		box_soa.Resize(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			sphere_soa.Set(i, spheres[i]);
+			box_soa.Set(i, boxes[i]);
+		}
+
+		std::vector<unsigned int> single_spheres(sphere_soa.PaddedCount());
+		std::vector<unsigned int> single_boxes(box_soa.PaddedCount());
+		const unsigned int sphere_count = Culling::CullSpheres(sphere_soa, planes, single_spheres.data(), 1);
+		const unsigned int box_count = Culling::CullAABBs(box_soa, planes, single_boxes.data(), 1);
+		single_spheres.resize(sphere_count);
+		single_boxes.resize(box_count);
+		CHECK(sphere_count > 0 && sphere_count < count);
+		CHECK(box_count > 0 && box_count < count);
+
+		// Chunk counts that do not divide the objects evenly, and more chunks than are allowed
+		const unsigned int thread_counts[5] = { 2, 3, 7, CULL_MAX_CHUNKS, CULL_MAX_CHUNKS + 10 };
+		for (unsigned int threads : thread_counts)
+		{
+			std::vector<unsigned int> visible(sphere_soa.PaddedCount(), TEST_UNUSED);
+			visible.resize(Culling::CullSpheres(sphere_soa, planes, visible.data(), threads));
+			CHECK(visible == single_spheres);
+
+			visible.assign(box_soa.PaddedCount(), TEST_UNUSED);
+			visible.resize(Culling::CullAABBs(box_soa, planes, visible.data(), threads));
+			CHECK(visible == single_boxes);
+		}
+	}
+}
+
+int main()
+{
+	JobSystem::Init(TEST_WORKER_COUNT);
+	::TestSpheres();
+	::TestAABBs();
+	::TestPadding();
+	::TestThreads();
+	JobSystem::Shutdown();
+	return TEST_RESULT();
+}
@@ -0,0 +1,73 @@
+#include "DrawKey.h"
+#include "TestCheck.h"
+#include <random>
+
+namespace
+{
+	void TestKeyOrder()
+	{
+		// Passes come first, then shaders, then materials, then depth
+		CHECK(DrawKey::Make(RENDER_PASS_OPAQUE, 5, 9, 500.0f) < DrawKey::Make(RENDER_PASS_SKY, 0, 0, 0.0f));
+		CHECK(DrawKey::Make(RENDER_PASS_OPAQUE, 1, 9, 500.0f) < DrawKey::Make(RENDER_PASS_OPAQUE, 2, 0, 1.0f));
+		CHECK(DrawKey::Make(RENDER_PASS_OPAQUE, 1, 1, 500.0f) < DrawKey::Make(RENDER_PASS_OPAQUE, 1, 2, 1.0f));
+		// Opaque front to back, transparent back to front
+		CHECK(DrawKey::Make(RENDER_PASS_OPAQUE, 1, 1, 1.0f) < DrawKey::Make(RENDER_PASS_OPAQUE, 1, 1, 2.0f));
+		CHECK(DrawKey::Make(RENDER_PASS_TRANSPARENT, 1, 1, 2.0f) < DrawKey::Make(RENDER_PASS_TRANSPARENT, 1, 1, 1.0f));
+		// Behind the camera and NaN sort like depth 0
+		CHECK_EQUAL(DrawKey::Make(RENDER_PASS_OPAQUE, 1, 1, 0.0f), DrawKey::Make(RENDER_PASS_OPAQUE, 1, 1, -5.0f));
+		// Values wider than their bits are masked instead of spilling into the next field
+		CHECK_EQUAL(DrawKey::Make(RENDER_PASS_OPAQUE, 0, 0, 0.0f), DrawKey::Make(RENDER_PASS_OPAQUE, 1 << DRAW_KEY_SHADER_BITS, 0, 0.0f));
+	}
+
+	void TestSort()
+	{
+		std::mt19937 random(7);
+		std::uniform_int_distribution<unsigned int> shader(0, 3);
+		std::uniform_real_distribution<float> depth(0.0f, 100.0f);
+		DrawKeyList list;
+		for (size_t i = 0; i < 10000; ++i)
+		{
+			list.Add(DrawKey::Make(RENDER_PASS_OPAQUE, shader(random), 0, depth(random)), i);
+		}
+		// Duplicates of the first key, they have to stay in the order they were added
+		const uint64_t duplicate = DrawKey::Make(RENDER_PASS_OPAQUE, 2, 0, 50.0f);
+		for (size_t i = 10000; i < 10100; ++i)
+		{
+			list.Add(duplicate, i);
+		}
+		list.Sort();
+		CHECK_EQUAL(10100u, list.GetCount());
+
+		size_t last_duplicate = 0;
+		bool sorted = true;
+		bool stable = true;
+		for (size_t i = 1; i < list.GetCount(); ++i)
+		{
+			sorted = sorted && list.GetKey(i - 1) <= list.GetKey(i);
+			if (list.GetKey(i) == duplicate && list.GetIndex(i) >= 10000)
+			{
+				stable = stable && list.GetIndex(i) > last_duplicate;
+				last_duplicate = list.GetIndex(i);
+			}
+		}
+		CHECK(sorted);
+		CHECK(stable);
+
+		// Keys that only differ in one byte skip the other passes, the order still has to come out right
+		list.Clear();
+		list.Add(3, 0);
+		list.Add(1, 1);
+		list.Add(2, 2);
+		list.Sort();
+		CHECK_EQUAL(1u, list.GetIndex(0));
+		CHECK_EQUAL(2u, list.GetIndex(1));
+		CHECK_EQUAL(0u, list.GetIndex(2));
+	}
+}
+
+int main()
+{
+	::TestKeyOrder();
+	::TestSort();
+	return TEST_RESULT();
+}
@@ -0,0 +1,223 @@
+#include "FrameArena.h"
+#include "Crowd.h"
+#include "JobSystem.h"
+#include "MemoryTracker.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+using namespace DirectX;
+
+#if MEMORY_TRACKING_ENABLED
+// The tracker already replaces operator new, its counters see every allocation of the process
+namespace
+{
+	unsigned long long HeapAllocations()
+	{
+		unsigned long long allocations = 0;
+		for (int category = 0; category < MEMORY_CATEGORY_COUNT; ++category)
+		{
+			// The frame arenas record their frames there without touching the heap
+			if (category != MEMORY_CATEGORY_RENDER_TRANSIENT)
+				allocations += MemoryTracker::GetStats((MEMORY_CATEGORY)category).allocations;
+		}
+		return allocations;
+	}
+}
+#else
+// Counts every allocation of the process, a warm frame must not make any
+namespace
+{
+	std::atomic<unsigned long long> gHeapAllocations(0);
+
+	unsigned long long HeapAllocations()
+	{
+		return gHeapAllocations.load();
+	}
+}
+
+void* operator new(size_t size)
+{
+	gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+#endif
+
+// Characters in the simulated frames
+#define TEST_CHARACTER_COUNT 64
+// Meshes the characters are spread over
+#define TEST_MESH_COUNT 4
+// Joints of every character
+#define TEST_JOINT_COUNT 16
+// Frames before the allocations are counted, they size the output vectors
+#define TEST_WARMUP_FRAMES 4
+// Frames that have to run without touching the heap
+#define TEST_MEASURED_FRAMES 100
+
+namespace
+{
+	void SumJob(void* pData)
+	{
+		// Job scratch comes from the arena of the thread the job runs on
+		FrameVector<unsigned int> values(256, 1);
+		unsigned int sum = 0;
+		for (unsigned int value : values)
+		{
+			sum += value;
+		}
+		static_cast<std::atomic<unsigned int>*>(pData)->fetch_add(sum);
+	}
+
+	struct SimulationState
+	{
+		std::vector<XMFLOAT4X4> joints;
+		std::vector<Crowd::Character> characters;
+		std::vector<Crowd::InstanceData> instances;
+		std::vector<XMFLOAT4X4> palette;
+		std::vector<Crowd::Batch> batches;
+	};
+
+	// One step the way the renderer does one: a frame of the arena, a crowd packed into reused vectors and jobs
+	// that take scratch from the arena
+	void Step(SimulationState* pState, std::atomic<unsigned int>* pJobSum)
+	{
+		FrameArena::ThreadLocal().BeginFrame();
+		FrameVector<float> weights(TEST_CHARACTER_COUNT, 0.5f);
+		CHECK_EQUAL(TEST_CHARACTER_COUNT, weights.size());
+		Crowd::Pack(pState->characters.data(), TEST_CHARACTER_COUNT, TEST_MESH_COUNT, XMMatrixIdentity(),
+			&pState->instances, &pState->palette, &pState->batches);
+
+		JobCounter counter;
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			JobSystem::Run(&::SumJob, pJobSum, &counter);
+		}
+		JobSystem::Wait(&counter);
+	}
+
+	void TestWarmFramesDoNotAllocate()
+	{
+		SimulationState state;
+		state.joints.resize(TEST_CHARACTER_COUNT * TEST_JOINT_COUNT);
+		state.characters.resize(TEST_CHARACTER_COUNT);
+		for (unsigned int i = 0; i < TEST_CHARACTER_COUNT; ++i)
+		{
+			Crowd::Character& character = state.characters[i];
+			character.mesh = i % TEST_MESH_COUNT;
+			XMStoreFloat4x4(&character.world, XMMatrixTranslation((float)i, 0.0f, 0.0f));
+			character.pJointMatrices = &state.joints[i * TEST_JOINT_COUNT];
+			character.jointCount = TEST_JOINT_COUNT;
+		}
+
+		std::atomic<unsigned int> job_sum(0);
+		for (unsigned int frame = 0; frame < TEST_WARMUP_FRAMES; ++frame)
+		{
+			::Step(&state, &job_sum);
+		}
+
+		const unsigned long long before = ::HeapAllocations();
+		for (unsigned int frame = 0; frame < TEST_MEASURED_FRAMES; ++frame)
+		{
+			::Step(&state, &job_sum);
+		}
+		CHECK_EQUAL(0ull, ::HeapAllocations() - before);
+		CHECK_EQUAL((TEST_WARMUP_FRAMES + TEST_MEASURED_FRAMES) * 4u * 256u, job_sum.load());
+		CHECK_EQUAL(0u, FrameArena::ThreadLocal().GetStats().overflowCount);
+	}
+
+	void TestFramesArePerArena()
+	{
+		FrameArena render(1024);
+		FrameArena simulation(1024);
+
+		// Memory of frame n stays valid while the other arena moves on
+		unsigned int* p_value = simulation.Allocate<unsigned int>(1);
+		*p_value = 42;
+		for (unsigned int frame = 0; frame < 8; ++frame)
+		{
+			render.BeginFrame();
+			render.Allocate<unsigned int>(64);
+		}
+		CHECK_EQUAL(8u, render.GetFrame());
+		CHECK_EQUAL(0u, simulation.GetFrame());
+		CHECK_EQUAL(42u, *p_value);
+		CHECK_EQUAL(sizeof(unsigned int), simulation.GetStats().usedBytes);
+
+		// And until frame n + FRAME_ARENA_BUFFER_COUNT of its own arena
+		simulation.BeginFrame();
+		CHECK_EQUAL(42u, *p_value);
+		CHECK(simulation.Allocate<unsigned int>(1) != p_value);
+		simulation.BeginFrame();
+		CHECK(simulation.Allocate<unsigned int>(1) == p_value);
+	}
+
+	void TestRewind()
+	{
+		FrameArena arena(256);
+		arena.BeginFrame();
+		void* p_kept = arena.Allocate(16, 16);
+		const FrameArena::Marker marker = arena.GetMarker();
+		void* p_first = arena.Allocate(64, 16);
+		// Too big for the buffer, comes from the heap and is freed by the rewind
+		arena.Allocate(1024, 16);
+		CHECK_EQUAL(1u, arena.GetStats().overflowCount);
+		const size_t high_water_mark = arena.GetStats().highWaterMark;
+
+		arena.Rewind(marker);
+		CHECK_EQUAL(16u, arena.GetStats().usedBytes);
+		CHECK_EQUAL(0u, arena.GetStats().overflowCount);
+		CHECK_EQUAL(high_water_mark, arena.GetStats().highWaterMark);
+		CHECK(arena.Allocate(64, 16) == p_first);
+		CHECK(p_kept != p_first);
+
+		// A marker of an earlier frame is ignored
+		arena.BeginFrame();
+		arena.Allocate(32, 16);
+		arena.Rewind(marker);
+		CHECK_EQUAL(32u, arena.GetStats().usedBytes);
+	}
+
+	void TestWorkerArenasDoNotGrow()
+	{
+		JobSystem::Init(2);
+		const size_t used_bytes = FrameArena::ThreadLocal().GetStats().usedBytes;
+		std::atomic<unsigned int> job_sum(0);
+		for (unsigned int frame = 0; frame < TEST_MEASURED_FRAMES; ++frame)
+		{
+			JobCounter counter;
+			for (unsigned int i = 0; i < 64; ++i)
+			{
+				JobSystem::Run(&::SumJob, &job_sum, &counter);
+			}
+			JobSystem::Wait(&counter);
+		}
+		CHECK_EQUAL(TEST_MEASURED_FRAMES * 64u * 256u, job_sum.load());
+		// The main thread took part without beginning a frame, every job gave its memory back
+		CHECK_EQUAL(used_bytes, FrameArena::ThreadLocal().GetStats().usedBytes);
+		JobSystem::Shutdown();
+	}
+}
+
+int main()
+{
+	::TestWarmFramesDoNotAllocate();
+	::TestFramesArePerArena();
+	::TestRewind();
+	::TestWorkerArenasDoNotGrow();
+	return TEST_RESULT();
+}
@@ -0,0 +1,211 @@
+#include "FrameScheduler.h"
+#include "TestCheck.h"
+#include <cmath>
+
+// Slack for comparing times that went through a few additions
+#define TEST_EPSILON 1e-6
+// Frames run by the pacing tests, enough for a drift to show
+#define TEST_PACED_FRAMES 100
+
+namespace
+{
+	bool Near(double expected, double actual, double epsilon = TEST_EPSILON)
+	{
+		return std::fabs(expected - actual) <= epsilon;
+	}
+
+	void TestAccumulator()
+	{
+		VirtualFrameClock clock;
+		FrameScheduler<VirtualFrameClock> scheduler;
+		FrameSchedulerSettings settings;
+		settings.fixedStep = 0.01;
+		scheduler.Init(&clock, settings);
+
+		// One and a half steps
+		clock.Advance(0.015);
+		FrameTick tick = scheduler.BeginFrame();
+		CHECK_EQUAL(1u, tick.steps);
+		CHECK(::Near(0.015, tick.frameTime));
+		CHECK(::Near(0.5, tick.alpha, 1e-4));
+		CHECK(tick.render);
+
+		// The half step left over carries into the next frame
+		clock.Advance(0.0075);
+		tick = scheduler.BeginFrame();
+		CHECK_EQUAL(1u, tick.steps);
+		CHECK(::Near(0.25, tick.alpha, 1e-4));
+
+		// Less than a step renders without simulating
+		clock.Advance(0.005);
+		tick = scheduler.BeginFrame();
+		CHECK_EQUAL(0u, tick.steps);
+		CHECK(::Near(0.75, tick.alpha, 1e-4));
+		CHECK(tick.render);
+
+		CHECK_EQUAL(3u, scheduler.GetStats().frames);
+		CHECK_EQUAL(2u, scheduler.GetStats().steps);
+		CHECK_EQUAL(0u, scheduler.GetStats().droppedSteps);
+	}
+
+	void TestDroppedSteps()
+	{
+		VirtualFrameClock clock;
+		FrameScheduler<VirtualFrameClock> scheduler;
+		FrameSchedulerSettings settings;
+		settings.fixedStep = 0.01;
+		settings.maxStepsPerFrame = 4;
+		settings.maxFrameTime = 1.0;
+		scheduler.Init(&clock, settings);
+
+		// Ten and a half steps, six of them are dropped and the fraction is kept
+		clock.Advance(0.105);
+		FrameTick tick = scheduler.BeginFrame();
+		CHECK_EQUAL(4u, tick.steps);
+		CHECK_EQUAL(6u, scheduler.GetStats().droppedSteps);
+		CHECK(::Near(0.5, tick.alpha, 1e-4));
+
+		// The next frame does not catch up on them
+		clock.Advance(0.01);
+		tick = scheduler.BeginFrame();
+		CHECK_EQUAL(1u, tick.steps);
+
+		// A stall longer than maxFrameTime is clamped before it is split into steps
+		clock.Advance(30.0);
+		tick = scheduler.BeginFrame();
+		CHECK(::Near(1.0, tick.frameTime));
+		CHECK_EQUAL(4u, tick.steps);
+		CHECK_EQUAL(6u + 96u, scheduler.GetStats().droppedSteps);
+	}
+
+	// Runs frames that take work seconds each and returns when the last one ended
+	double RunPacedFrames(VirtualFrameClock* pClock, FrameScheduler<VirtualFrameClock>* pScheduler, double work, unsigned int frames)
+	{
+		for (unsigned int frame = 0; frame < frames; ++frame)
+		{
+			pScheduler->BeginFrame();
+			pClock->Advance(work);
+			pScheduler->EndFrame();
+		}
+		return pClock->Now();
+	}
+
+	void TestPacing()
+	{
+		const double target = 1.0 / 60.0;
+		VirtualFrameClock clock;
+		clock.SetYieldTime(0.0001);
+		// Less than the spin time, the yields absorb it and every frame ends on its deadline
+		clock.SetSleepOvershoot(0.001);
+		FrameScheduler<VirtualFrameClock> scheduler;
+		FrameSchedulerSettings settings;
+		settings.targetFrameTime = target;
+		settings.spinTime = 0.002;
+		scheduler.Init(&clock, settings);
+
+		double end = ::RunPacedFrames(&clock, &scheduler, 0.005, 1);
+		CHECK(end >= target && end < target + 0.0002);
+		end = ::RunPacedFrames(&clock, &scheduler, 0.005, TEST_PACED_FRAMES - 1);
+		CHECK(end >= TEST_PACED_FRAMES * target - TEST_EPSILON && end < TEST_PACED_FRAMES * target + 0.0002);
+		CHECK(scheduler.GetStats().sleptSeconds > 0.0);
+		CHECK(scheduler.GetStats().spunSeconds > 0.0);
+		// Most of the wait is slept, the spinning is only the last part of every frame
+		CHECK(scheduler.GetStats().spunSeconds < TEST_PACED_FRAMES * 0.0025);
+		CHECK(scheduler.GetStats().sleptSeconds > scheduler.GetStats().spunSeconds);
+	}
+
+	void TestPacingOvershoot()
+	{
+		const double target = 1.0 / 60.0;
+		VirtualFrameClock clock;
+		// Sleeps overshoot by more than the spin time, every frame ends late but the deadlines do not drift
+		clock.SetSleepOvershoot(0.004);
+		FrameScheduler<VirtualFrameClock> scheduler;
+		FrameSchedulerSettings settings;
+		settings.targetFrameTime = target;
+		settings.spinTime = 0.002;
+		scheduler.Init(&clock, settings);
+
+		const double end = ::RunPacedFrames(&clock, &scheduler, 0.005, TEST_PACED_FRAMES);
+		CHECK(end >= TEST_PACED_FRAMES * target - TEST_EPSILON);
+		CHECK(end < TEST_PACED_FRAMES * target + 0.0025);
+
+		// A frame that takes far longer than the target moves the deadline instead of rushing the next frames
+		scheduler.BeginFrame();
+		clock.Advance(0.1);
+		const double late = clock.Now();
+		scheduler.EndFrame();
+		CHECK(::Near(late, clock.Now()));
+		const double next = ::RunPacedFrames(&clock, &scheduler, 0.0, 1);
+		CHECK(next >= late + target - TEST_EPSILON);
+		CHECK(next < late + target + 0.0025);
+	}
+
+	void TestNoTarget()
+	{
+		VirtualFrameClock clock;
+		FrameScheduler<VirtualFrameClock> scheduler;
+		scheduler.Init(&clock, FrameSchedulerSettings());
+		const double end = ::RunPacedFrames(&clock, &scheduler, 0.001, 10);
+		CHECK(::Near(0.01, end));
+		CHECK_EQUAL(0.0, scheduler.GetStats().sleptSeconds);
+	}
+
+	void TestIdle()
+	{
+		VirtualFrameClock clock;
+		FrameScheduler<VirtualFrameClock> scheduler;
+		FrameSchedulerSettings settings;
+		settings.fixedStep = 0.01;
+		settings.targetFrameTime = 0.02;
+		settings.renderOnDemand = true;
+		settings.idleDelay = 0.5;
+		scheduler.Init(&clock, settings);
+
+		clock.Advance(0.4);
+		FrameTick tick = scheduler.BeginFrame();
+		CHECK(tick.render);
+		CHECK(!scheduler.IsIdle());
+
+		// Nothing requested for longer than the delay
+		clock.Advance(0.2);
+		tick = scheduler.BeginFrame();
+		CHECK(!tick.render);
+		CHECK_EQUAL(0u, tick.steps);
+		CHECK(scheduler.IsIdle());
+		// Idle frames do not wait
+		const double idle_start = clock.Now();
+		scheduler.EndFrame();
+		CHECK(::Near(idle_start, clock.Now()));
+		const uint64_t frames = scheduler.GetStats().frames;
+
+		clock.Advance(10.0);
+		tick = scheduler.BeginFrame();
+		CHECK(!tick.render);
+		CHECK_EQUAL(frames, scheduler.GetStats().frames);
+
+		// Woken up, the time spent idle is not simulated
+		scheduler.RequestRender();
+		CHECK(!scheduler.IsIdle());
+		clock.Advance(0.015);
+		tick = scheduler.BeginFrame();
+		CHECK(tick.render);
+		CHECK(::Near(0.015, tick.frameTime));
+		CHECK_EQUAL(1u, tick.steps);
+		// And the pacing starts over from the wake up
+		scheduler.EndFrame();
+		CHECK(clock.Now() >= idle_start + 10.0 + 0.02 - TEST_EPSILON);
+		CHECK(clock.Now() < idle_start + 10.0 + 0.0225);
+	}
+}
+
+int main()
+{
+	::TestAccumulator();
+	::TestDroppedSteps();
+	::TestPacing();
+	::TestPacingOvershoot();
+	::TestNoTarget();
+	::TestIdle();
+	return TEST_RESULT();
+}
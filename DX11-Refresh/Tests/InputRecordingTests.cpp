@@ -0,0 +1,198 @@
+#include "InputRecording.h"
+#include "TestCheck.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+// Written into the working directory of the test and removed again
+#define TEST_RECORDING_FILE "InputRecordingTests.rec"
+// Simulation steps in the recorded session
+#define TEST_STEP_COUNT 500
+
+using namespace DirectX;
+
+namespace
+{
+	InputSessionState MakeSessionState()
+	{
+		InputSessionState state;
+		state.cameraPosition = XMFLOAT4(1.0f, 2.0f, -3.0f, 1.0f);
+		state.cameraLook = XMFLOAT4(0.0f, 0.6f, 0.8f, 0.0f);
+		state.pitch = 0.25f;
+		state.yaw = -1.5f;
+		state.meshScale = 2.0f;
+		state.meshRotation = 0.75f;
+		state.lastScroll = 240.0f;
+		state.useDeferredContexts = true;
+		state.showStatsOverlay = false;
+		state.randomSeed = 0x9e3779b9u;
+		return state;
+	}
+
+	// A session of steps whose input changes now and then, frames between some of them and a few loads
+	std::vector<InputEvent> MakeSession(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::uniform_int_distribution<int> byte(0, 255);
+		std::uniform_int_distribution<int> position(-2000, 2000);
+		std::vector<InputEvent> events;
+		InputSnapshot input;
+		for (int step = 0; step < TEST_STEP_COUNT; ++step)
+		{
+			if (unit(random) < 0.1f)
+			{
+				// Any key, not only the ones the renderer reads
+				reinterpret_cast<uint8_t*>(&input.keyboard)[byte(random) % sizeof(input.keyboard)] = (uint8_t)byte(random);
+			}
+			if (unit(random) < 0.2f)
+			{
+				input.mouse.leftButton = unit(random) < 0.5f;
+				input.mouse.rightButton = unit(random) < 0.5f;
+				input.mouse.xButton2 = unit(random) < 0.5f;
+				input.mouse.positionMode = unit(random) < 0.5f ? Mouse::MODE_RELATIVE : Mouse::MODE_ABSOLUTE;
+				input.mouse.x = position(random);
+				input.mouse.y = position(random);
+				input.mouse.scrollWheelValue += 120 * (position(random) % 3);
+			}
+			InputEvent event;
+			event.type = INPUT_EVENT_STEP;
+			event.dt = unit(random) * 0.05f;
+			event.input = input;
+			events.push_back(event);
+
+			if (unit(random) < 0.6f)
+			{
+				InputEvent frame;
+				frame.type = INPUT_EVENT_FRAME;
+				frame.alpha = unit(random);
+				events.push_back(frame);
+			}
+			if (step % 200 == 100)
+			{
+				InputEvent load;
+				load.type = INPUT_EVENT_LOAD;
+				load.filepath = step == 100 ? "../Models/Crowd Character.fbx" : "";
+				load.fbx = step == 100;
+				events.push_back(load);
+			}
+		}
+		return events;
+	}
+
+	void Record(const InputSessionState& state, const std::vector<InputEvent>& events)
+	{
+		InputRecorder recorder;
+		CHECK(recorder.Open(TEST_RECORDING_FILE, state));
+		for (const InputEvent& event : events)
+		{
+			if (event.type == INPUT_EVENT_STEP)
+				recorder.RecordStep(event.dt, event.input);
+			else if (event.type == INPUT_EVENT_FRAME)
+				recorder.RecordFrame(event.alpha);
+			else
+				recorder.RecordLoad(event.filepath, event.fbx);
+		}
+		const InputRecorderStats stats = recorder.GetStats();
+		CHECK_EQUAL((uint64_t)TEST_STEP_COUNT, stats.steps);
+		CHECK(stats.frames > 0 && stats.loads > 0);
+		recorder.Close();
+	}
+
+	bool Equal(const InputEvent& a, const InputEvent& b)
+	{
+		if (a.type != b.type)
+			return false;
+		switch (a.type)
+		{
+		case INPUT_EVENT_STEP:
+			return memcmp(&a.dt, &b.dt, sizeof(a.dt)) == 0 &&
+				memcmp(&a.input.keyboard, &b.input.keyboard, sizeof(a.input.keyboard)) == 0 &&
+				a.input.mouse.leftButton == b.input.mouse.leftButton && a.input.mouse.middleButton == b.input.mouse.middleButton &&
+				a.input.mouse.rightButton == b.input.mouse.rightButton && a.input.mouse.xButton1 == b.input.mouse.xButton1 &&
+				a.input.mouse.xButton2 == b.input.mouse.xButton2 && a.input.mouse.positionMode == b.input.mouse.positionMode &&
+				a.input.mouse.x == b.input.mouse.x && a.input.mouse.y == b.input.mouse.y &&
+				a.input.mouse.scrollWheelValue == b.input.mouse.scrollWheelValue;
+		case INPUT_EVENT_FRAME:
+			return a.alpha == b.alpha;
+		default:
+			return a.filepath == b.filepath && a.fbx == b.fbx;
+		}
+	}
+
+	void TestRoundTrip()
+	{
+		std::mt19937 random(47);
+		const InputSessionState state = ::MakeSessionState();
+		const std::vector<InputEvent> events = ::MakeSession(random);
+		::Record(state, events);
+
+		InputPlayback playback;
+		CHECK(playback.Open(TEST_RECORDING_FILE));
+		const InputSessionState& played = playback.GetSessionState();
+		CHECK_EQUAL(state.cameraPosition.z, played.cameraPosition.z);
+		CHECK_EQUAL(state.cameraLook.y, played.cameraLook.y);
+		CHECK_EQUAL(state.yaw, played.yaw);
+		CHECK_EQUAL(state.lastScroll, played.lastScroll);
+		CHECK_EQUAL(state.useDeferredContexts, played.useDeferredContexts);
+		CHECK_EQUAL(state.showStatsOverlay, played.showStatsOverlay);
+		// The replay draws the same crowd from it
+		CHECK_EQUAL(state.randomSeed, played.randomSeed);
+
+		size_t read = 0;
+		bool matches = true;
+		InputEvent event;
+		while (playback.Next(&event))
+		{
+			matches = matches && read < events.size() && ::Equal(events[read], event);
+			read++;
+		}
+		CHECK_EQUAL(events.size(), read);
+		CHECK(matches);
+		std::remove(TEST_RECORDING_FILE);
+	}
+
+	void TestDamaged()
+	{
+		std::mt19937 random(53);
+		const std::vector<InputEvent> events = ::MakeSession(random);
+		::Record(::MakeSessionState(), events);
+
+		// A load record whose path claims to be 4 GB long, it is not read and ends the playback
+		{
+			std::ofstream file(TEST_RECORDING_FILE, std::ios::binary | std::ios::app);
+			const uint8_t record[6] = { INPUT_EVENT_LOAD, 1, 0xff, 0xff, 0xff, 0xff };
+			file.write((const char*)record, sizeof(record));
+			file.write("../Models/a.fbx", 15);
+		}
+		InputPlayback playback;
+		CHECK(playback.Open(TEST_RECORDING_FILE));
+		size_t read = 0;
+		InputEvent event;
+		while (playback.Next(&event))
+		{
+			read++;
+		}
+		CHECK_EQUAL(events.size(), read);
+		CHECK(event.filepath.size() <= INPUT_RECORDING_MAX_PATH_LENGTH);
+
+		// Another version is not read at all
+		{
+			std::fstream file(TEST_RECORDING_FILE, std::ios::binary | std::ios::in | std::ios::out);
+			const uint32_t version = INPUT_RECORDING_VERSION + 1;
+			file.seekp(sizeof(uint32_t));
+			file.write((const char*)&version, sizeof(version));
+		}
+		CHECK(!playback.Open(TEST_RECORDING_FILE));
+		std::remove(TEST_RECORDING_FILE);
+		CHECK(!playback.Open(TEST_RECORDING_FILE));
+	}
+}
+
+int main()
+{
+	::TestRoundTrip();
+	::TestDamaged();
+	return TEST_RESULT();
+}
@@ -0,0 +1,103 @@
+#include "Instancing.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	bool NearlyEqual(const XMFLOAT4& a, const XMVECTOR& b)
+	{
+		XMFLOAT4 expected;
+		XMStoreFloat4(&expected, b);
+		return fabsf(a.x - expected.x) < 1e-4f && fabsf(a.y - expected.y) < 1e-4f &&
+			fabsf(a.z - expected.z) < 1e-4f && fabsf(a.w - expected.w) < 1e-4f;
+	}
+
+	std::vector<XMFLOAT4X4> MakeWorlds(unsigned int count)
+	{
+		std::vector<XMFLOAT4X4> worlds(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			XMStoreFloat4x4(&worlds[i], XMMatrixScaling(1.0f + i * 0.1f, 1.0f + i * 0.1f, 1.0f + i * 0.1f) *
+				XMMatrixRotationY(i * 0.3f) * XMMatrixTranslation((float)i * 3.0f, 0.0f, 10.0f));
+		}
+		return worlds;
+	}
+
+	XMMATRIX MakeViewProj()
+	{
+		return XMMatrixLookAtLH(XMVectorSet(0.0f, 5.0f, -20.0f, 1.0f), XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)) *
+			XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 1000.0f);
+	}
+
+	void TestTransformInstances()
+	{
+		const std::vector<XMFLOAT4X4> worlds = ::MakeWorlds(10);
+		const XMMATRIX view_proj = ::MakeViewProj();
+		// Out of order and repeated, the instances follow the indices
+		const uint32_t indices[4] = { 7, 2, 2, 9 };
+		Instancing::InstanceData instances[5] = {};
+		Instancing::TransformInstances(worlds.data(), indices, 4, view_proj, instances);
+
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			const XMMATRIX expected = XMLoadFloat4x4(&worlds[indices[i]]) * view_proj;
+			CHECK(::NearlyEqual(instances[i].worldViewProjRow0, expected.r[0]));
+			CHECK(::NearlyEqual(instances[i].worldViewProjRow1, expected.r[1]));
+			CHECK(::NearlyEqual(instances[i].worldViewProjRow2, expected.r[2]));
+			CHECK(::NearlyEqual(instances[i].worldViewProjRow3, expected.r[3]));
+		}
+		// Nothing is written past indexCount
+		CHECK(instances[4].worldViewProjRow3.w == 0.0f);
+
+		Instancing::TransformInstances(worlds.data(), indices, 0, view_proj, instances + 4);
+		CHECK(instances[4].worldViewProjRow0.x == 0.0f);
+	}
+
+	void TestBuildInstances()
+	{
+		// Two batches, every second placement is moved behind the camera
+		const unsigned int count = INSTANCE_BATCH_SIZE * 2 + 5;
+		std::vector<XMFLOAT4X4> worlds(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			const float z = i % 2 == 0 ? 10.0f : -100.0f;
+			XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(0.0f, 0.0f, z));
+		}
+		const XMMATRIX view_proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 1000.0f);
+		XMFLOAT4 planes[6];
+		// The same planes Camera::GetFrustumPlanes extracts, pointing inwards
+		XMFLOAT4X4 m;
+		XMStoreFloat4x4(&m, view_proj);
+		planes[0] = XMFLOAT4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);
+		planes[1] = XMFLOAT4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);
+		planes[2] = XMFLOAT4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);
+		planes[3] = XMFLOAT4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);
+		planes[4] = XMFLOAT4(m._13, m._23, m._33, m._43);
+		planes[5] = XMFLOAT4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);
+		for (auto& plane : planes)
+		{
+			XMStoreFloat4(&plane, XMPlaneNormalize(XMLoadFloat4(&plane)));
+		}
+
+		Bounds::Sphere sphere;
+		sphere.center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		sphere.radius = 1.0f;
+		std::vector<Instancing::InstanceData> instances(count);
+		const unsigned int visible = Instancing::BuildInstances(worlds.data(), count, view_proj, sphere, planes, instances.data());
+		CHECK_EQUAL((count + 1) / 2, visible);
+
+		// The visible instances are packed in order and transformed like TransformInstances does
+		const XMMATRIX expected = XMLoadFloat4x4(&worlds[0]) * view_proj;
+		CHECK(::NearlyEqual(instances[visible - 1].worldViewProjRow3, expected.r[3]));
+	}
+}
+
+int main()
+{
+	::TestTransformInstances();
+	::TestBuildInstances();
+	return TEST_RESULT();
+}
@@ -0,0 +1,235 @@
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Workers the tests start, more than one so jobs are stolen even on a single core
+#define TEST_WORKER_COUNT 4
+// Threads outside the job system that queue and wait at the same time
+#define TEST_PRODUCER_COUNT 4
+// Jobs every producer queues per round, and the rounds
+#define TEST_PRODUCER_JOBS 256
+#define TEST_PRODUCER_ROUNDS 20
+// Times a single job is pushed and taken back by its owner while the others try to steal it
+#define TEST_LAST_ITEM_ROUNDS 20000
+// Init and Shutdown cycles
+#define TEST_INIT_CYCLES 20
+
+namespace
+{
+	void IncrementJob(void* pData)
+	{
+		static_cast<std::atomic<unsigned int>*>(pData)->fetch_add(1);
+	}
+
+	struct MainThreadJob
+	{
+		std::thread::id mainThread;
+		std::atomic<unsigned int> runs{ 0 };
+		std::atomic<unsigned int> wrongThread{ 0 };
+	};
+
+	void CheckMainThreadJob(void* pData)
+	{
+		MainThreadJob& job = *static_cast<MainThreadJob*>(pData);
+		if (std::this_thread::get_id() != job.mainThread)
+			job.wrongThread.fetch_add(1);
+		job.runs.fetch_add(1);
+	}
+
+	// Queues a main thread job from a worker, the main thread runs it while it waits for this job
+	void QueueMainThreadJob(void* pData)
+	{
+		JobSystem::RunOnMainThread(&::CheckMainThreadJob, pData, nullptr);
+	}
+
+	void TestWithoutInit()
+	{
+		CHECK_EQUAL(1u, JobSystem::GetWorkerCount());
+		std::atomic<unsigned int> runs(0);
+		JobCounter counter;
+		JobSystem::Run(&::IncrementJob, &runs, &counter);
+		// Without workers the job already ran
+		CHECK_EQUAL(1u, runs.load());
+		CHECK_EQUAL(0, counter.value.load());
+		JobSystem::RunOnMainThread(&::IncrementJob, &runs, &counter);
+		JobSystem::Wait(&counter);
+		CHECK_EQUAL(2u, runs.load());
+
+		unsigned int calls = 0;
+		unsigned int items = 0;
+		JobSystem::ParallelFor(10, 4, [&](unsigned int begin, unsigned int end)
+		{
+			calls++;
+			items += end - begin;
+		});
+		CHECK_EQUAL(3u, calls);
+		CHECK_EQUAL(10u, items);
+	}
+
+	void TestProducers()
+	{
+		// Threads that are not workers go through the shared queue, the main thread waits on its own jobs meanwhile
+		std::vector<std::atomic<unsigned int>> runs(TEST_PRODUCER_COUNT + 1);
+		std::vector<std::thread> producers;
+		for (unsigned int producer = 0; producer < TEST_PRODUCER_COUNT; ++producer)
+		{
+			producers.emplace_back([&runs, producer]()
+			{
+				for (unsigned int round = 0; round < TEST_PRODUCER_ROUNDS; ++round)
+				{
+					JobCounter counter;
+					for (unsigned int i = 0; i < TEST_PRODUCER_JOBS; ++i)
+					{
+						JobSystem::Run(&::IncrementJob, &runs[producer], &counter);
+					}
+					JobSystem::Wait(&counter);
+					if (counter.value.load() != 0 || runs[producer].load() != (round + 1) * TEST_PRODUCER_JOBS)
+						runs[producer].store(0);
+				}
+			});
+		}
+		for (unsigned int round = 0; round < TEST_PRODUCER_ROUNDS; ++round)
+		{
+			JobCounter counter;
+			for (unsigned int i = 0; i < TEST_PRODUCER_JOBS; ++i)
+			{
+				JobSystem::Run(&::IncrementJob, &runs[TEST_PRODUCER_COUNT], &counter);
+			}
+			JobSystem::Wait(&counter);
+		}
+		for (auto& producer : producers)
+		{
+			producer.join();
+		}
+		// A producer zeroes its count if a Wait returned early
+		for (auto& count : runs)
+		{
+			CHECK_EQUAL(TEST_PRODUCER_ROUNDS * TEST_PRODUCER_JOBS, count.load());
+		}
+	}
+
+	void TestNestedParallelFor()
+	{
+		const unsigned int outer_count = 64;
+		const unsigned int inner_count = 200;
+		std::unique_ptr<std::atomic<unsigned int>[]> visits(new std::atomic<unsigned int>[outer_count * inner_count]);
+		for (unsigned int i = 0; i < outer_count * inner_count; ++i)
+		{
+			visits[i] = 0;
+		}
+		JobSystem::ParallelFor(outer_count, 3, [&](unsigned int outer_begin, unsigned int outer_end)
+		{
+			for (unsigned int outer = outer_begin; outer < outer_end; ++outer)
+			{
+				JobSystem::ParallelFor(inner_count, 7, [&](unsigned int begin, unsigned int end)
+				{
+					for (unsigned int inner = begin; inner < end; ++inner)
+					{
+						visits[outer * inner_count + inner].fetch_add(1);
+					}
+				});
+			}
+		});
+		unsigned int wrong = 0;
+		for (unsigned int i = 0; i < outer_count * inner_count; ++i)
+		{
+			wrong += visits[i].load() == 1 ? 0 : 1;
+		}
+		CHECK_EQUAL(0u, wrong);
+	}
+
+	void TestStealLastItem()
+	{
+		// The owner pops the only job of its deque while the idle workers try to steal it, it must run exactly once
+		std::unique_ptr<std::atomic<unsigned int>[]> runs(new std::atomic<unsigned int>[TEST_LAST_ITEM_ROUNDS]);
+		for (unsigned int i = 0; i < TEST_LAST_ITEM_ROUNDS; ++i)
+		{
+			runs[i] = 0;
+		}
+		const uint64_t stolen_before = JobSystem::GetStats().stolenJobs;
+		for (unsigned int i = 0; i < TEST_LAST_ITEM_ROUNDS; ++i)
+		{
+			JobCounter counter;
+			JobSystem::Run(&::IncrementJob, &runs[i], &counter);
+			JobSystem::Wait(&counter);
+		}
+		unsigned int wrong = 0;
+		for (unsigned int i = 0; i < TEST_LAST_ITEM_ROUNDS; ++i)
+		{
+			wrong += runs[i].load() == 1 ? 0 : 1;
+		}
+		CHECK_EQUAL(0u, wrong);
+		CHECK(JobSystem::GetStats().stolenJobs >= stolen_before);
+	}
+
+	void TestMainThreadJobs()
+	{
+		MainThreadJob job;
+		job.mainThread = std::this_thread::get_id();
+
+		// Queued by a worker, run by the main thread while it waits
+		JobCounter counter;
+		for (unsigned int i = 0; i < 16; ++i)
+		{
+			JobSystem::Run(&::QueueMainThreadJob, &job, &counter);
+		}
+		JobSystem::Wait(&counter);
+		JobSystem::RunMainThreadJobs();
+		CHECK_EQUAL(16u, job.runs.load());
+
+		// Queued by a thread outside the job system, run once the main thread gets to them
+		JobCounter external_counter;
+		std::thread producer([&]()
+		{
+			for (unsigned int i = 0; i < 16; ++i)
+			{
+				JobSystem::RunOnMainThread(&::CheckMainThreadJob, &job, &external_counter);
+			}
+		});
+		producer.join();
+		CHECK_EQUAL(16u, job.runs.load());
+		JobSystem::RunMainThreadJobs();
+		CHECK_EQUAL(32u, job.runs.load());
+		CHECK_EQUAL(0, external_counter.value.load());
+		CHECK_EQUAL(0u, job.wrongThread.load());
+	}
+
+	void TestInitCycles()
+	{
+		for (unsigned int cycle = 0; cycle < TEST_INIT_CYCLES; ++cycle)
+		{
+			JobSystem::Init(1 + cycle % TEST_WORKER_COUNT);
+			CHECK_EQUAL(1 + cycle % TEST_WORKER_COUNT, JobSystem::GetWorkerCount());
+			std::atomic<unsigned int> runs(0);
+			JobCounter counter;
+			for (unsigned int i = 0; i < 100; ++i)
+			{
+				JobSystem::Run(&::IncrementJob, &runs, &counter);
+			}
+			JobSystem::Wait(&counter);
+			CHECK_EQUAL(100u, runs.load());
+			JobSystem::Shutdown();
+			CHECK_EQUAL(1u, JobSystem::GetWorkerCount());
+		}
+		// Back to running in place
+		std::atomic<unsigned int> runs(0);
+		JobSystem::Run(&::IncrementJob, &runs, nullptr);
+		CHECK_EQUAL(1u, runs.load());
+	}
+}
+
+int main()
+{
+	::TestWithoutInit();
+	JobSystem::Init(TEST_WORKER_COUNT);
+	::TestProducers();
+	::TestNestedParallelFor();
+	::TestStealLastItem();
+	::TestMainThreadJobs();
+	JobSystem::Shutdown();
+	::TestInitCycles();
+	return TEST_RESULT();
+}
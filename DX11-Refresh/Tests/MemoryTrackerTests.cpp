@@ -0,0 +1,165 @@
+#include "MemoryTracker.h"
+#include "TestCheck.h"
+#include <string>
+#include <thread>
+
+// Built twice, with MEMORY_TRACKING_ENABLED as 1 and as 0, see CMakeLists.txt
+
+namespace
+{
+	// The compiler may leave out a new whose result is never used, storing it here keeps it
+	void* volatile gpEscape = nullptr;
+
+	template <class T>
+	T* Keep(T* p)
+	{
+		gpEscape = p;
+		return p;
+	}
+
+#if MEMORY_TRACKING_ENABLED
+	bool Contains(const std::string& text, const char* part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+
+	void TestTaggedAllocations()
+	{
+		const MemoryCategoryStats before = MemoryTracker::GetStats(MEMORY_CATEGORY_OBJ_IMPORT);
+		const size_t outstanding = MemoryTracker::GetOutstandingBlockCount();
+		char* p_block = nullptr;
+		{
+			MEMORY_SCOPE(MEMORY_CATEGORY_OBJ_IMPORT);
+			p_block = ::Keep(new char[1000]);
+			{
+				// The innermost scope wins, the outer one is back afterwards
+				MEMORY_SCOPE(MEMORY_CATEGORY_ANIMATION);
+				CHECK_EQUAL(MEMORY_CATEGORY_ANIMATION, MemoryTracker::GetThreadCategory());
+			}
+			CHECK_EQUAL(MEMORY_CATEGORY_OBJ_IMPORT, MemoryTracker::GetThreadCategory());
+		}
+		CHECK_EQUAL(MEMORY_CATEGORY_UNTAGGED, MemoryTracker::GetThreadCategory());
+
+		MemoryCategoryStats stats = MemoryTracker::GetStats(MEMORY_CATEGORY_OBJ_IMPORT);
+		CHECK_EQUAL(before.allocations + 1, stats.allocations);
+		CHECK_EQUAL(before.currentBytes + 1000, stats.currentBytes);
+		CHECK_EQUAL(before.totalBytes + 1000, stats.totalBytes);
+		CHECK_EQUAL(outstanding + 1, MemoryTracker::GetOutstandingBlockCount());
+
+		// The block keeps its category wherever it is freed
+		std::thread other([p_block]()
+		{
+			delete[] p_block;
+		});
+		other.join();
+		stats = MemoryTracker::GetStats(MEMORY_CATEGORY_OBJ_IMPORT);
+		CHECK_EQUAL(before.frees + 1, stats.frees);
+		CHECK_EQUAL(before.currentBytes, stats.currentBytes);
+		CHECK(stats.peakBytes >= before.currentBytes + 1000);
+		CHECK_EQUAL(outstanding, MemoryTracker::GetOutstandingBlockCount());
+	}
+
+	void TestUntaggedAllocations()
+	{
+		const MemoryCategoryStats before = MemoryTracker::GetStats(MEMORY_CATEGORY_UNTAGGED);
+		const size_t outstanding = MemoryTracker::GetOutstandingBlockCount();
+		int* p_value = ::Keep(new int(7));
+		CHECK_EQUAL(before.allocations + 1, MemoryTracker::GetStats(MEMORY_CATEGORY_UNTAGGED).allocations);
+		// Counted, but not listed for the leak report
+		CHECK_EQUAL(outstanding, MemoryTracker::GetOutstandingBlockCount());
+		delete p_value;
+		CHECK_EQUAL(before.frees + 1, MemoryTracker::GetStats(MEMORY_CATEGORY_UNTAGGED).frees);
+	}
+
+	void TestLeakReport()
+	{
+		int* p_leak = nullptr;
+		{
+			MEMORY_SCOPE(MEMORY_CATEGORY_FBX_IMPORT);
+			p_leak = ::Keep(new int[25]);
+		}
+		std::string report = MemoryTracker::FormatReport();
+		CHECK(::Contains(report, "1 tagged blocks outstanding"));
+		CHECK(::Contains(report, "FBX import, 100 bytes"));
+
+		delete[] p_leak;
+		report = MemoryTracker::FormatReport();
+		CHECK(::Contains(report, "0 tagged blocks outstanding"));
+		CHECK(!::Contains(report, "FBX import, 100 bytes"));
+	}
+
+	void TestImportBudget()
+	{
+		CHECK(MemoryTracker::SetBudget(MEMORY_CATEGORY_ANIMATION, 1000));
+		MemoryTracker::ResetPeak(MEMORY_CATEGORY_ANIMATION);
+		char* p_first = nullptr;
+		char* p_second = nullptr;
+		{
+			MEMORY_SCOPE(MEMORY_CATEGORY_ANIMATION);
+			p_first = ::Keep(new char[600]);
+			CHECK(!MemoryTracker::IsOverBudget(MEMORY_CATEGORY_ANIMATION));
+			p_second = ::Keep(new char[600]);
+		}
+		CHECK(MemoryTracker::IsOverBudget(MEMORY_CATEGORY_ANIMATION));
+		CHECK_EQUAL(1u, MemoryTracker::GetStats(MEMORY_CATEGORY_ANIMATION).overBudgetCount);
+		CHECK(::Contains(MemoryTracker::FormatReport(), "over budget 1 times"));
+
+		// Once freed, a new peak is within the budget again
+		delete[] p_first;
+		delete[] p_second;
+		MemoryTracker::ResetPeak(MEMORY_CATEGORY_ANIMATION);
+		CHECK(!MemoryTracker::IsOverBudget(MEMORY_CATEGORY_ANIMATION));
+		CHECK(MemoryTracker::SetBudget(MEMORY_CATEGORY_ANIMATION, 0));
+	}
+#else
+	void TestUntracked()
+	{
+		// Nothing would ever count these, the budgets are refused instead of silently never failing
+		CHECK(!MemoryTracker::SetBudget(MEMORY_CATEGORY_OBJ_IMPORT, 1000));
+		CHECK(!MemoryTracker::SetBudget(MEMORY_CATEGORY_FBX_IMPORT, 1000));
+		CHECK_EQUAL(0u, MemoryTracker::GetStats(MEMORY_CATEGORY_OBJ_IMPORT).budgetBytes);
+		CHECK(MemoryTracker::SetBudget(MEMORY_CATEGORY_OBJ_IMPORT, 0));
+
+		const MemoryCategoryStats before = MemoryTracker::GetStats(MEMORY_CATEGORY_UNTAGGED);
+		int* p_value = ::Keep(new int(7));
+		delete p_value;
+		CHECK_EQUAL(before.allocations, MemoryTracker::GetStats(MEMORY_CATEGORY_UNTAGGED).allocations);
+		CHECK_EQUAL(0u, MemoryTracker::GetOutstandingBlockCount());
+	}
+#endif
+
+	// Counted the same with and without tracking
+	void TestRecordedBudget()
+	{
+		CHECK(MemoryTracker::SetBudget(MEMORY_CATEGORY_RENDER_TRANSIENT, 4096));
+		MemoryTracker::ResetPeak(MEMORY_CATEGORY_RENDER_TRANSIENT);
+		MemoryTracker::RecordAllocation(MEMORY_CATEGORY_RENDER_TRANSIENT, 3000, 3);
+		CHECK(!MemoryTracker::IsOverBudget(MEMORY_CATEGORY_RENDER_TRANSIENT));
+		MemoryTracker::RecordAllocation(MEMORY_CATEGORY_RENDER_TRANSIENT, 2000, 2);
+		CHECK(MemoryTracker::IsOverBudget(MEMORY_CATEGORY_RENDER_TRANSIENT));
+
+		MemoryCategoryStats stats = MemoryTracker::GetStats(MEMORY_CATEGORY_RENDER_TRANSIENT);
+		CHECK_EQUAL(5u, stats.allocations);
+		CHECK_EQUAL(5000u, stats.currentBytes);
+		CHECK_EQUAL(1u, stats.overBudgetCount);
+		MemoryTracker::RecordFree(MEMORY_CATEGORY_RENDER_TRANSIENT, 5000, 5);
+		stats = MemoryTracker::GetStats(MEMORY_CATEGORY_RENDER_TRANSIENT);
+		CHECK_EQUAL(5u, stats.frees);
+		CHECK_EQUAL(0u, stats.currentBytes);
+		CHECK_EQUAL(5000u, stats.peakBytes);
+	}
+}
+
+int main()
+{
+#if MEMORY_TRACKING_ENABLED
+	::TestTaggedAllocations();
+	::TestUntaggedAllocations();
+	::TestLeakReport();
+	::TestImportBudget();
+#else
+	::TestUntracked();
+#endif
+	::TestRecordedBudget();
+	return TEST_RESULT();
+}
@@ -0,0 +1,265 @@
+#include "MeshSimplifier.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <vector>
+
+// Quads along each side of the test grids
+#define TEST_GRID_SIZE 48
+
+using namespace DirectX;
+
+namespace
+{
+	struct TestVertex
+	{
+		XMFLOAT3 position;
+		XMFLOAT2 uv;
+	};
+
+	struct TestMesh
+	{
+		std::vector<TestVertex> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	XMFLOAT3 GridPosition(unsigned int x, unsigned int z)
+	{
+		return XMFLOAT3((float)x, 1.5f * sinf(x * 0.2f) * cosf(z * 0.15f), (float)z);
+	}
+
+	// A rolling grid in the xz plane. With seamColumn inside the grid the vertices of that column are there twice,
+	// the copy used left of it has u = 0 and the one used right of it u = 1, like a texture seam
+	TestMesh MakeGrid(unsigned int seamColumn)
+	{
+		TestMesh mesh;
+		std::vector<unsigned int> left_vertex((TEST_GRID_SIZE + 1) * (TEST_GRID_SIZE + 1));
+		std::vector<unsigned int> right_vertex(left_vertex.size());
+		for (unsigned int z = 0; z <= TEST_GRID_SIZE; ++z)
+		{
+			for (unsigned int x = 0; x <= TEST_GRID_SIZE; ++x)
+			{
+				const unsigned int grid_index = z * (TEST_GRID_SIZE + 1) + x;
+				left_vertex[grid_index] = (unsigned int)mesh.vertices.size();
+				right_vertex[grid_index] = (unsigned int)mesh.vertices.size();
+				mesh.vertices.push_back({ ::GridPosition(x, z), XMFLOAT2(x == seamColumn ? 0.0f : x / (float)TEST_GRID_SIZE, z / (float)TEST_GRID_SIZE) });
+				if (x == seamColumn)
+				{
+					right_vertex[grid_index] = (unsigned int)mesh.vertices.size();
+					mesh.vertices.push_back({ ::GridPosition(x, z), XMFLOAT2(1.0f, z / (float)TEST_GRID_SIZE) });
+				}
+			}
+		}
+		for (unsigned int z = 0; z < TEST_GRID_SIZE; ++z)
+		{
+			for (unsigned int x = 0; x < TEST_GRID_SIZE; ++x)
+			{
+				const std::vector<unsigned int>& vertex = x < seamColumn ? left_vertex : right_vertex;
+				const unsigned int corner = z * (TEST_GRID_SIZE + 1) + x;
+				const unsigned int quad[6] = {
+					vertex[corner], vertex[corner + TEST_GRID_SIZE + 1], vertex[corner + 1],
+					vertex[corner + 1], vertex[corner + TEST_GRID_SIZE + 1], vertex[corner + TEST_GRID_SIZE + 2] };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	MeshSimplifier::SimplifyInput MakeInput(const TestMesh& mesh)
+	{
+		MeshSimplifier::SimplifyInput input;
+		input.pPositions = &mesh.vertices[0].position;
+		input.positionStride = sizeof(TestVertex);
+		input.pUVs = &mesh.vertices[0].uv;
+		input.uvStride = sizeof(TestVertex);
+		input.vertexCount = (unsigned int)mesh.vertices.size();
+		input.pIndices = mesh.indices.data();
+		input.indexCount = (unsigned int)mesh.indices.size();
+		return input;
+	}
+
+	// The indices of every level, LOD 0 from the mesh and the rest from the generated list
+	std::vector<std::vector<unsigned int>> SplitLevels(const TestMesh& mesh, const std::vector<unsigned int>& lodIndices, const std::vector<MeshSimplifier::MeshLod>& lods)
+	{
+		std::vector<std::vector<unsigned int>> levels(1, mesh.indices);
+		for (size_t i = 1; i < lods.size(); ++i)
+		{
+			const unsigned int* p_first = lodIndices.data() + (lods[i].indexOffset - mesh.indices.size());
+			levels.push_back(std::vector<unsigned int>(p_first, p_first + lods[i].indexCount));
+		}
+		return levels;
+	}
+
+	void TestChain()
+	{
+		const TestMesh mesh = ::MakeGrid(TEST_GRID_SIZE + 1);
+		std::vector<unsigned int> lod_indices;
+		std::vector<MeshSimplifier::MeshLod> lods;
+		MeshSimplifier::BuildLodChain(::MakeInput(mesh), LOD_MAX_LEVELS, &lod_indices, &lods);
+		CHECK(lods.size() >= 3);
+		CHECK(lods.size() <= LOD_MAX_LEVELS);
+		CHECK_EQUAL(0u, lods[0].indexOffset);
+		CHECK_EQUAL(mesh.indices.size(), lods[0].indexCount);
+		CHECK_EQUAL(0.0f, lods[0].error);
+
+		// The levels follow each other in the index list, each one smaller and with at least the error of the last
+		unsigned int next_offset = (unsigned int)mesh.indices.size();
+		for (size_t i = 1; i < lods.size(); ++i)
+		{
+			CHECK_EQUAL(next_offset, lods[i].indexOffset);
+			CHECK(lods[i].indexCount < lods[i - 1].indexCount);
+			CHECK(lods[i].indexCount % 3 == 0);
+			CHECK(lods[i].error >= lods[i - 1].error);
+			next_offset += lods[i].indexCount;
+		}
+		CHECK_EQUAL(next_offset, mesh.indices.size() + lod_indices.size());
+		CHECK(lods.back().error > 0.0f);
+
+		bool in_range = true;
+		for (unsigned int index : lod_indices)
+		{
+			in_range = in_range && index < mesh.vertices.size();
+		}
+		CHECK(in_range);
+	}
+
+	void TestUVSeam()
+	{
+		const unsigned int seam_column = TEST_GRID_SIZE / 2;
+		const TestMesh mesh = ::MakeGrid(seam_column);
+		std::vector<unsigned int> lod_indices;
+		std::vector<MeshSimplifier::MeshLod> lods;
+		MeshSimplifier::BuildLodChain(::MakeInput(mesh), LOD_MAX_LEVELS, &lod_indices, &lods);
+		CHECK(lods.size() >= 3);
+
+		// Vertices left of the seam only ever share a triangle with vertices left of it or on its u = 0 side
+		std::vector<int> side(mesh.vertices.size());
+		std::set<unsigned int> seam_vertices;
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+		{
+			const TestVertex& vertex = mesh.vertices[i];
+			if (vertex.position.x == (float)seam_column)
+			{
+				side[i] = vertex.uv.x == 0.0f ? -1 : 1;
+				seam_vertices.insert((unsigned int)i);
+			}
+			else
+			{
+				side[i] = vertex.position.x < seam_column ? -1 : 1;
+			}
+		}
+		const std::vector<std::vector<unsigned int>> levels = ::SplitLevels(mesh, lod_indices, lods);
+		for (size_t level = 1; level < levels.size(); ++level)
+		{
+			const std::vector<unsigned int>& indices = levels[level];
+			bool one_side = true;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				one_side = one_side && side[indices[i]] == side[indices[i + 1]] && side[indices[i]] == side[indices[i + 2]];
+			}
+			CHECK(one_side);
+
+			// And the seam itself is kept, every vertex of it is still used
+			std::set<unsigned int> used(indices.begin(), indices.end());
+			CHECK(std::includes(used.begin(), used.end(), seam_vertices.begin(), seam_vertices.end()));
+		}
+	}
+
+	void TestVertexGroups()
+	{
+		// The dominant joint changes halfway along z, the grid itself has no seam
+		const TestMesh mesh = ::MakeGrid(TEST_GRID_SIZE + 1);
+		std::vector<unsigned int> groups(mesh.vertices.size());
+		for (size_t i = 0; i < mesh.vertices.size(); ++i)
+		{
+			groups[i] = mesh.vertices[i].position.z < TEST_GRID_SIZE / 2 ? 0 : 1;
+		}
+		MeshSimplifier::SimplifyInput input = ::MakeInput(mesh);
+		input.pVertexGroups = groups.data();
+
+		std::vector<unsigned int> lod_indices;
+		std::vector<MeshSimplifier::MeshLod> lods;
+		MeshSimplifier::BuildLodChain(input, LOD_MAX_LEVELS, &lod_indices, &lods);
+		CHECK(lods.size() >= 3);
+
+		// The vertices with a neighbour in the other group
+		std::set<unsigned int> boundary;
+		for (size_t i = 0; i < mesh.indices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				const unsigned int a = mesh.indices[i + e];
+				const unsigned int b = mesh.indices[i + (e + 1) % 3];
+				if (groups[a] != groups[b])
+				{
+					boundary.insert(a);
+					boundary.insert(b);
+				}
+			}
+		}
+		CHECK(!boundary.empty());
+
+		const std::vector<std::vector<unsigned int>> levels = ::SplitLevels(mesh, lod_indices, lods);
+		for (size_t level = 1; level < levels.size(); ++level)
+		{
+			const std::vector<unsigned int>& indices = levels[level];
+			// Triangles across the groups are only ever the ones of the boundary strip, no vertex moved into the other group
+			bool kept_apart = true;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				const unsigned int* p_triangle = &indices[i];
+				const bool mixed = groups[p_triangle[0]] != groups[p_triangle[1]] || groups[p_triangle[0]] != groups[p_triangle[2]];
+				kept_apart = kept_apart && (!mixed || (boundary.count(p_triangle[0]) && boundary.count(p_triangle[1]) && boundary.count(p_triangle[2])));
+			}
+			CHECK(kept_apart);
+			std::set<unsigned int> used(indices.begin(), indices.end());
+			CHECK(std::includes(used.begin(), used.end(), boundary.begin(), boundary.end()));
+		}
+	}
+
+	void TestSelectLod()
+	{
+		std::vector<MeshSimplifier::MeshLod> lods;
+		lods.push_back({ 0, 3000, 0.0f });
+		lods.push_back({ 3000, 1500, 0.01f });
+		lods.push_back({ 4500, 750, 0.05f });
+		lods.push_back({ 5250, 375, 0.2f });
+		const XMMATRIX perspective = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+		// Coarser the further away
+		CHECK_EQUAL(0u, MeshSimplifier::SelectLod(lods, perspective, 1080.0f, 0.5f, 1.0f, 1.0f));
+		unsigned int last = 0;
+		bool coarser = true;
+		for (float distance = 0.5f; distance < 2000.0f; distance *= 1.5f)
+		{
+			const unsigned int lod = MeshSimplifier::SelectLod(lods, perspective, 1080.0f, distance, 1.0f, 1.0f);
+			coarser = coarser && lod >= last;
+			last = lod;
+		}
+		CHECK(coarser);
+		CHECK_EQUAL(3u, last);
+		// A larger mesh or a stricter error keeps the finer level longer
+		CHECK_EQUAL(1u, MeshSimplifier::SelectLod(lods, perspective, 1080.0f, 20.0f, 1.0f, 1.0f));
+		CHECK_EQUAL(0u, MeshSimplifier::SelectLod(lods, perspective, 1080.0f, 20.0f, 10.0f, 1.0f));
+		CHECK_EQUAL(0u, MeshSimplifier::SelectLod(lods, perspective, 1080.0f, 20.0f, 1.0f, 0.1f));
+
+		// Orthographic, 100 units across 1080 pixels whatever the distance
+		const XMMATRIX orthographic = XMMatrixOrthographicLH(177.0f, 100.0f, 0.1f, 1000.0f);
+		const unsigned int near_lod = MeshSimplifier::SelectLod(lods, orthographic, 1080.0f, 1.0f, 1.0f, 1.0f);
+		CHECK_EQUAL(near_lod, MeshSimplifier::SelectLod(lods, orthographic, 1080.0f, 900.0f, 1.0f, 1.0f));
+		// 10.8 pixels per unit, 0.05 is half a pixel and 0.2 two pixels
+		CHECK_EQUAL(2u, near_lod);
+
+		CHECK_EQUAL(0u, MeshSimplifier::SelectLod(std::vector<MeshSimplifier::MeshLod>(), perspective, 1080.0f, 10.0f, 1.0f, 1.0f));
+	}
+}
+
+int main()
+{
+	::TestChain();
+	::TestUVSeam();
+	::TestVertexGroups();
+	::TestSelectLod();
+	return TEST_RESULT();
+}
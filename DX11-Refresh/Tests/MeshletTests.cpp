@@ -0,0 +1,168 @@
+#include "Meshlet.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+#include <vector>
+
+// Quads along each side of the test grid
+#define TEST_GRID_SIZE 40
+
+using namespace DirectX;
+
+namespace
+{
+	struct TestMesh
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<unsigned int> indices;
+	};
+
+	// A grid in the xz plane with a few hills, every triangle faces +y
+	TestMesh MakeGrid(unsigned int size, float height)
+	{
+		TestMesh mesh;
+		for (unsigned int z = 0; z <= size; ++z)
+		{
+			for (unsigned int x = 0; x <= size; ++x)
+			{
+				mesh.positions.push_back(XMFLOAT3((float)x, height * sinf(x * 0.5f) * cosf(z * 0.3f), (float)z));
+			}
+		}
+		for (unsigned int z = 0; z < size; ++z)
+		{
+			for (unsigned int x = 0; x < size; ++x)
+			{
+				const unsigned int corner = z * (size + 1) + x;
+				const unsigned int quad[6] = { corner, corner + size + 1, corner + 1, corner + 1, corner + size + 1, corner + size + 2 };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+		}
+		return mesh;
+	}
+
+	// Six planes far around everything, pointing inwards
+	void MakeOpenFrustum(XMFLOAT4* pPlanes)
+	{
+		pPlanes[0] = XMFLOAT4(1.0f, 0.0f, 0.0f, 1000.0f);
+		pPlanes[1] = XMFLOAT4(-1.0f, 0.0f, 0.0f, 1000.0f);
+		pPlanes[2] = XMFLOAT4(0.0f, 1.0f, 0.0f, 1000.0f);
+		pPlanes[3] = XMFLOAT4(0.0f, -1.0f, 0.0f, 1000.0f);
+		pPlanes[4] = XMFLOAT4(0.0f, 0.0f, 1.0f, 1000.0f);
+		pPlanes[5] = XMFLOAT4(0.0f, 0.0f, -1.0f, 1000.0f);
+	}
+
+	// Checks the limits, that the meshlets cover every triangle once in order and that the spheres hold their vertices
+	void CheckMeshlets(const TestMesh& mesh, const std::vector<Meshlets::Meshlet>& meshlets)
+	{
+		unsigned int next_index = 0;
+		std::vector<unsigned int> triangle_uses(mesh.indices.size() / 3, 0);
+		bool within_limits = true;
+		bool counted = true;
+		bool contained = true;
+		for (const Meshlets::Meshlet& meshlet : meshlets)
+		{
+			CHECK_EQUAL(next_index, meshlet.indexOffset);
+			next_index = meshlet.indexOffset + meshlet.indexCount;
+
+			std::set<unsigned int> vertices;
+			for (unsigned int i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; ++i)
+			{
+				vertices.insert(mesh.indices[i]);
+				const XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&mesh.positions[mesh.indices[i]]), XMLoadFloat3(&meshlet.center));
+				contained = contained && XMVectorGetX(XMVector3Length(offset)) <= meshlet.radius * 1.0001f + 1e-5f;
+			}
+			for (unsigned int i = meshlet.indexOffset; i < meshlet.indexOffset + meshlet.indexCount; i += 3)
+			{
+				triangle_uses[i / 3]++;
+			}
+			within_limits = within_limits && vertices.size() <= MESHLET_MAX_VERTICES && meshlet.indexCount / 3 <= MESHLET_MAX_TRIANGLES;
+			counted = counted && vertices.size() == meshlet.vertexCount && meshlet.indexCount % 3 == 0 && meshlet.indexCount > 0;
+		}
+		CHECK_EQUAL(mesh.indices.size(), next_index);
+		CHECK(within_limits);
+		CHECK(counted);
+		CHECK(contained);
+		CHECK(std::all_of(triangle_uses.begin(), triangle_uses.end(), [](unsigned int uses) { return uses == 1; }));
+	}
+
+	void TestGrid()
+	{
+		const TestMesh mesh = ::MakeGrid(TEST_GRID_SIZE, 2.0f);
+		std::vector<Meshlets::Meshlet> meshlets;
+		Meshlets::BuildMeshlets(mesh.positions.data(), sizeof(XMFLOAT3), (unsigned int)mesh.positions.size(),
+			mesh.indices.data(), (unsigned int)mesh.indices.size(), &meshlets);
+		CHECK(meshlets.size() > 1);
+		::CheckMeshlets(mesh, meshlets);
+
+		// A triangle list that shares no vertices runs into the vertex limit first
+		TestMesh scattered;
+		std::mt19937 random(3);
+		std::uniform_real_distribution<float> coordinate(-50.0f, 50.0f);
+		for (unsigned int i = 0; i < 3000; ++i)
+		{
+			scattered.positions.push_back(XMFLOAT3(coordinate(random), coordinate(random), coordinate(random)));
+			scattered.indices.push_back(i);
+		}
+		// Degenerate triangles repeat a vertex and count it once
+		scattered.indices.push_back(0);
+		scattered.indices.push_back(0);
+		scattered.indices.push_back(1);
+		meshlets.clear();
+		Meshlets::BuildMeshlets(scattered.positions.data(), sizeof(XMFLOAT3), (unsigned int)scattered.positions.size(),
+			scattered.indices.data(), (unsigned int)scattered.indices.size(), &meshlets);
+		CHECK_EQUAL(MESHLET_MAX_VERTICES / 3 * 3, meshlets[0].vertexCount);
+		::CheckMeshlets(scattered, meshlets);
+	}
+
+	void TestCulling()
+	{
+		// Flat, so every meshlet has a tight cone pointing up
+		const TestMesh mesh = ::MakeGrid(TEST_GRID_SIZE, 0.0f);
+		std::vector<Meshlets::Meshlet> meshlets;
+		Meshlets::BuildMeshlets(mesh.positions.data(), sizeof(XMFLOAT3), (unsigned int)mesh.positions.size(),
+			mesh.indices.data(), (unsigned int)mesh.indices.size(), &meshlets);
+		CHECK(meshlets[0].coneCutoff < 0.01f);
+		CHECK(meshlets[0].coneAxis.y > 0.99f);
+
+		XMFLOAT4 planes[6];
+		::MakeOpenFrustum(planes);
+		const unsigned int triangle_count = (unsigned int)mesh.indices.size() / 3;
+		std::vector<Meshlets::IndexRange> ranges;
+
+		// From above everything is visible, in a single merged range
+		const XMVECTOR above = XMVectorSet(TEST_GRID_SIZE * 0.5f, 30.0f, TEST_GRID_SIZE * 0.5f, 1.0f);
+		CHECK_EQUAL(triangle_count, Meshlets::CullMeshlets(meshlets, XMMatrixIdentity(), planes, above, &ranges));
+		CHECK_EQUAL(1u, ranges.size());
+		CHECK_EQUAL((unsigned int)mesh.indices.size(), ranges[0].indexCount);
+
+		// From below every cluster faces away
+		const XMVECTOR below = XMVectorSet(TEST_GRID_SIZE * 0.5f, -30.0f, TEST_GRID_SIZE * 0.5f, 1.0f);
+		CHECK_EQUAL(0u, Meshlets::CullMeshlets(meshlets, XMMatrixIdentity(), planes, below, &ranges));
+		CHECK(ranges.empty());
+
+		// Turned upside down the clusters face the camera below again
+		const XMMATRIX flipped = XMMatrixRotationX(XM_PI);
+		const XMVECTOR flipped_below = XMVectorSet(TEST_GRID_SIZE * 0.5f, -30.0f, -TEST_GRID_SIZE * 0.5f, 1.0f);
+		CHECK_EQUAL(triangle_count, Meshlets::CullMeshlets(meshlets, flipped, planes, flipped_below, &ranges));
+
+		// A plane that only keeps x < 10 culls the clusters past it, the rest stay visible
+		planes[1] = XMFLOAT4(-1.0f, 0.0f, 0.0f, 10.0f);
+		const unsigned int visible = Meshlets::CullMeshlets(meshlets, XMMatrixIdentity(), planes, above, &ranges);
+		CHECK(visible > 0 && visible < triangle_count);
+		bool sorted = true;
+		for (size_t i = 1; i < ranges.size(); ++i)
+		{
+			sorted = sorted && ranges[i - 1].indexOffset + ranges[i - 1].indexCount < ranges[i].indexOffset;
+		}
+		CHECK(sorted);
+	}
+}
+
+int main()
+{
+	::TestGrid();
+	::TestCulling();
+	return TEST_RESULT();
+}
@@ -0,0 +1,192 @@
+#include "Occlusion.h"
+#include "JobSystem.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Workers for the binned rasterization
+#define TEST_WORKER_COUNT 4
+// Clip planes of the test camera
+#define TEST_NEAR 1.0f
+#define TEST_FAR 100.0f
+
+using namespace DirectX;
+
+namespace
+{
+	// A camera at the origin looking down +z, with the aspect of the depth buffer
+	XMMATRIX MakeViewProj()
+	{
+		const XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		return view * XMMatrixPerspectiveFovLH(XM_PIDIV2, (float)OCCLUSION_WIDTH / OCCLUSION_HEIGHT, TEST_NEAR, TEST_FAR);
+	}
+
+	// A floor below the camera and a wall in front of it
+	const Bounds::AABB TEST_FLOOR = { XMFLOAT3(-50.0f, -2.0f, 1.0f), XMFLOAT3(50.0f, -1.0f, 60.0f) };
+	const Bounds::AABB TEST_WALL = { XMFLOAT3(-10.0f, -5.0f, 20.0f), XMFLOAT3(10.0f, 5.0f, 21.0f) };
+
+	void AddScene(OcclusionBuffer* pBuffer)
+	{
+		pBuffer->BeginFrame(::MakeViewProj());
+		pBuffer->AddOccluderBox(TEST_FLOOR, XMMatrixIdentity());
+		pBuffer->AddOccluderBox(TEST_WALL, XMMatrixIdentity());
+	}
+
+	// IsVisible without the hierarchical level, every pixel under the screen rectangle of the box is read
+	bool IsVisibleReference(const OcclusionBuffer& buffer, const XMMATRIX& viewProj, const Bounds::AABB& box)
+	{
+		float min_x = FLT_MAX;
+		float min_y = FLT_MAX;
+		float max_x = -FLT_MAX;
+		float max_y = -FLT_MAX;
+		float min_z = FLT_MAX;
+		for (int i = 0; i < 8; ++i)
+		{
+			const XMVECTOR corner = XMVectorSet(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z, 1.0f);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector4Transform(corner, viewProj));
+			if (clip.z < 0.0f)
+				return true;
+			const float inverse_w = 1.0f / clip.w;
+			const float x = (clip.x * inverse_w * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+			const float y = (0.5f - clip.y * inverse_w * 0.5f) * OCCLUSION_HEIGHT;
+			min_x = (std::min)(min_x, x);
+			max_x = (std::max)(max_x, x);
+			min_y = (std::min)(min_y, y);
+			max_y = (std::max)(max_y, y);
+			min_z = (std::min)(min_z, clip.z * inverse_w);
+		}
+
+		const float* p_depth = buffer.GetDepth();
+		for (int y = (std::max)((int)floorf(min_y), 0); y < (std::min)((int)ceilf(max_y), OCCLUSION_HEIGHT); ++y)
+		{
+			for (int x = (std::max)((int)floorf(min_x), 0); x < (std::min)((int)ceilf(max_x), OCCLUSION_WIDTH); ++x)
+			{
+				if (p_depth[y * OCCLUSION_WIDTH + x] >= min_z)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	void TestScene()
+	{
+		OcclusionBuffer buffer;
+		::AddScene(&buffer);
+		buffer.Rasterize(1);
+
+		// The wall faces the camera, its depth at the center of the screen is that of z = 20
+		const float wall_depth = TEST_FAR / (TEST_FAR - TEST_NEAR) * (1.0f - TEST_NEAR / TEST_WALL.min.z);
+		const float center_depth = buffer.GetDepth()[(OCCLUSION_HEIGHT / 2) * OCCLUSION_WIDTH + OCCLUSION_WIDTH / 2];
+		CHECK(std::fabs(center_depth - wall_depth) < 1e-4f);
+
+		// Behind the wall and under the floor
+		CHECK(!buffer.IsVisible({ XMFLOAT3(-1.0f, -1.0f, 30.0f), XMFLOAT3(1.0f, 1.0f, 32.0f) }));
+		CHECK(!buffer.IsVisible({ XMFLOAT3(-1.0f, -6.0f, 10.0f), XMFLOAT3(1.0f, -4.0f, 12.0f) }));
+		// In front of the wall, above the floor and reaching past the edge of the wall
+		CHECK(buffer.IsVisible({ XMFLOAT3(-1.0f, -0.5f, 10.0f), XMFLOAT3(1.0f, 1.0f, 12.0f) }));
+		CHECK(buffer.IsVisible({ XMFLOAT3(9.0f, -0.5f, 30.0f), XMFLOAT3(25.0f, 1.0f, 32.0f) }));
+		// Crossing the near plane, although the rest of it is behind the wall
+		CHECK(buffer.IsVisible({ XMFLOAT3(-1.0f, -0.5f, -1.0f), XMFLOAT3(1.0f, 1.0f, 30.0f) }));
+		// Partly off screen on the left and at the top, the part on screen is not covered
+		CHECK(buffer.IsVisible({ XMFLOAT3(-40.0f, -0.5f, 10.0f), XMFLOAT3(-15.0f, 1.0f, 12.0f) }));
+		CHECK(buffer.IsVisible({ XMFLOAT3(-1.0f, 2.0f, 10.0f), XMFLOAT3(1.0f, 20.0f, 12.0f) }));
+		// Completely off screen, nothing of it can be seen
+		CHECK(!buffer.IsVisible({ XMFLOAT3(100.0f, -1.0f, 10.0f), XMFLOAT3(102.0f, 1.0f, 12.0f) }));
+
+		// The same through CullAABBs, which counts the occluded ones
+		const Bounds::AABB boxes[3] = {
+			{ XMFLOAT3(-1.0f, -1.0f, 30.0f), XMFLOAT3(1.0f, 1.0f, 32.0f) },
+			{ XMFLOAT3(-1.0f, -0.5f, 10.0f), XMFLOAT3(1.0f, 1.0f, 12.0f) },
+			{ XMFLOAT3(-1.0f, -0.5f, -1.0f), XMFLOAT3(1.0f, 1.0f, 30.0f) }
+		};
+		uint32_t indices[3] = { 0, 1, 2 };
+		CHECK_EQUAL(2u, buffer.CullAABBs(boxes, indices, 3, indices));
+		CHECK_EQUAL(1u, indices[0]);
+		CHECK_EQUAL(2u, indices[1]);
+		CHECK_EQUAL(3u, buffer.GetStats().testedObjects);
+		CHECK_EQUAL(1u, buffer.GetStats().occludedObjects);
+	}
+
+	// Random boxes around the camera, some of them in front of it
+	Bounds::AABB MakeBox(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> coordinate(-30.0f, 30.0f);
+		std::uniform_real_distribution<float> depth(-5.0f, 80.0f);
+		std::uniform_real_distribution<float> size(0.0f, 6.0f);
+		Bounds::AABB box;
+		box.min = XMFLOAT3(coordinate(random), coordinate(random) * 0.3f, depth(random));
+		box.max = XMFLOAT3(box.min.x + size(random), box.min.y + size(random), box.min.z + size(random));
+		return box;
+	}
+
+	void AddRandomOccluders(OcclusionBuffer* pBuffer, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+		pBuffer->BeginFrame(::MakeViewProj());
+		for (int i = 0; i < 40; ++i)
+		{
+			// Rotated, so the edges are not aligned with the pixels
+			const Bounds::AABB box = ::MakeBox(random);
+			const XMFLOAT3 center((box.min.x + box.max.x) * 0.5f, (box.min.y + box.max.y) * 0.5f, (box.min.z + box.max.z) * 0.5f);
+			const XMMATRIX world = XMMatrixTranslation(-center.x, -center.y, -center.z) *
+				XMMatrixRotationRollPitchYaw(angle(random), angle(random), angle(random)) * XMMatrixTranslation(center.x, center.y, center.z);
+			pBuffer->AddOccluderBox(box, world);
+		}
+	}
+
+	void TestHiZ()
+	{
+		std::mt19937 random(41);
+		OcclusionBuffer buffer;
+		::AddRandomOccluders(&buffer, random);
+		buffer.Rasterize(1);
+
+		bool matches = true;
+		unsigned int hidden = 0;
+		for (int i = 0; i < 20000; ++i)
+		{
+			const Bounds::AABB box = ::MakeBox(random);
+			const bool visible = buffer.IsVisible(box);
+			matches = matches && visible == ::IsVisibleReference(buffer, ::MakeViewProj(), box);
+			hidden += visible ? 0 : 1;
+		}
+		CHECK(matches);
+		// Both answers have to come up for the comparison to mean anything
+		CHECK(hidden > 100 && hidden < 19900);
+	}
+
+	void TestThreads()
+	{
+		std::mt19937 random(43);
+		for (int frame = 0; frame < 5; ++frame)
+		{
+			// The same occluders in both buffers
+			std::mt19937 same_random = random;
+			OcclusionBuffer single;
+			::AddRandomOccluders(&single, random);
+			single.Rasterize(1);
+
+			OcclusionBuffer parallel;
+			::AddRandomOccluders(&parallel, same_random);
+			parallel.Rasterize(TEST_WORKER_COUNT);
+
+			CHECK(single.GetStats().binnedTriangles > single.GetStats().occluderTriangles);
+			CHECK(memcmp(single.GetDepth(), parallel.GetDepth(), OCCLUSION_WIDTH * OCCLUSION_HEIGHT * sizeof(float)) == 0);
+		}
+	}
+}
+
+int main()
+{
+	JobSystem::Init(TEST_WORKER_COUNT);
+	::TestScene();
+	::TestHiZ();
+	::TestThreads();
+	JobSystem::Shutdown();
+	return TEST_RESULT();
+}
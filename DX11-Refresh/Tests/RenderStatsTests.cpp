@@ -0,0 +1,177 @@
+#include "RenderStats.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Written into the working directory of the test and removed again
+#define TEST_CSV_FILE "RenderStatsTests.csv"
+#define TEST_JSON_FILE "RenderStatsTests.json"
+
+namespace
+{
+	// Half a nanosecond more than nanoseconds, so the conversion to whole nanoseconds cannot round it down by one
+	double Seconds(uint64_t nanoseconds)
+	{
+		return (nanoseconds + 0.5) * 1e-9;
+	}
+
+	uint64_t Nanoseconds(double seconds)
+	{
+		return (uint64_t)std::llround(seconds * 1e9);
+	}
+
+	std::string ReadFile(const char* filepath)
+	{
+		std::ifstream file(filepath);
+		std::stringstream text;
+		text << file.rdbuf();
+		return text.str();
+	}
+
+	bool Contains(const std::string& text, const char* part)
+	{
+		return text.find(part) != std::string::npos;
+	}
+
+	void TestBuckets()
+	{
+		// Below FRAME_HISTOGRAM_SUB_BUCKET_COUNT every nanosecond has its own bucket
+		FrameTimeHistogram histogram;
+		histogram.Record(::Seconds(126));
+		histogram.Record(::Seconds(127));
+		histogram.Record(::Seconds(200));
+		CHECK_EQUAL(126u, ::Nanoseconds(histogram.GetPercentile(1.0)));
+		CHECK_EQUAL(127u, ::Nanoseconds(histogram.GetPercentile(50.0)));
+
+		// Then two per bucket up to 256, four up to 512 and so on, the upper end of the bucket is returned
+		histogram.Reset();
+		histogram.Record(::Seconds(128));
+		histogram.Record(::Seconds(256));
+		histogram.Record(::Seconds(259));
+		histogram.Record(::Seconds(260));
+		histogram.Record(::Seconds(1000));
+		CHECK_EQUAL(129u, ::Nanoseconds(histogram.GetPercentile(20.0)));
+		CHECK_EQUAL(259u, ::Nanoseconds(histogram.GetPercentile(40.0)));
+		CHECK_EQUAL(259u, ::Nanoseconds(histogram.GetPercentile(60.0)));
+		CHECK_EQUAL(263u, ::Nanoseconds(histogram.GetPercentile(80.0)));
+		// Never more than the largest value recorded
+		CHECK_EQUAL(1000u, ::Nanoseconds(histogram.GetPercentile(100.0)));
+		CHECK_EQUAL(128u, ::Nanoseconds(histogram.GetMin()));
+		CHECK_EQUAL(1000u, ::Nanoseconds(histogram.GetMax()));
+
+		histogram.Reset();
+		CHECK_EQUAL(0u, histogram.GetCount());
+		CHECK_EQUAL(0.0, histogram.GetPercentile(99.0));
+	}
+
+	void TestNearestRank()
+	{
+		// 99 % of 1060 is 1049.4 values, the 1050th one is the first that 99 % do not exceed
+		FrameTimeHistogram histogram;
+		for (int i = 0; i < 1049; ++i)
+		{
+			histogram.Record(0.001);
+		}
+		for (int i = 0; i < 11; ++i)
+		{
+			histogram.Record(0.010);
+		}
+		CHECK(histogram.GetPercentile(99.0) > 0.009);
+		CHECK(histogram.GetPercentile(98.0) < 0.0011);
+
+		// With a few frames p99 is the slowest one
+		histogram.Reset();
+		for (int i = 1; i <= 10; ++i)
+		{
+			histogram.Record(i * 0.001);
+		}
+		CHECK(histogram.GetPercentile(99.0) > 0.0099);
+		CHECK(histogram.GetPercentile(50.0) < 0.0051);
+	}
+
+	void TestAgainstSorted()
+	{
+		std::mt19937 random(11);
+		std::lognormal_distribution<double> frame_time(std::log(0.016), 0.5);
+		const size_t counts[4] = { 1, 7, 100, 5000 };
+		const double percentiles[5] = { 1.0, 50.0, 95.0, 99.0, 100.0 };
+		for (size_t count : counts)
+		{
+			FrameTimeHistogram histogram;
+			std::vector<uint64_t> sorted;
+			for (size_t i = 0; i < count; ++i)
+			{
+				const uint64_t nanoseconds = (uint64_t)(frame_time(random) * 1e9);
+				histogram.Record(::Seconds(nanoseconds));
+				sorted.push_back(nanoseconds);
+			}
+			std::sort(sorted.begin(), sorted.end());
+			CHECK_EQUAL(count, histogram.GetCount());
+			CHECK_EQUAL(sorted.back(), ::Nanoseconds(histogram.GetMax()));
+			CHECK_EQUAL(sorted.front(), ::Nanoseconds(histogram.GetMin()));
+
+			for (double percentile : percentiles)
+			{
+				const size_t rank = (std::max)((size_t)1, (size_t)std::ceil(percentile * count / 100.0));
+				const uint64_t expected = sorted[rank - 1];
+				const uint64_t actual = ::Nanoseconds(histogram.GetPercentile(percentile));
+				// The upper end of the bucket of the expected value, a bucket is at most 1/64 of its values wide
+				CHECK(actual >= expected);
+				CHECK(actual <= expected + expected / 64);
+				CHECK(actual <= sorted.back());
+			}
+		}
+	}
+
+	void TestDump()
+	{
+		RenderStats stats;
+		for (uint64_t frame = 0; frame < 10; ++frame)
+		{
+			RenderFrameStats frame_stats;
+			frame_stats.frame = frame;
+			frame_stats.frameTime = (frame + 1) * 0.001;
+			frame_stats.renderTime = 0.0005;
+			frame_stats.draws = 100 + (unsigned int)frame;
+			stats.AddFrame(frame_stats);
+		}
+		CHECK_EQUAL(10u, stats.GetFrameCount());
+		CHECK_EQUAL(109u, stats.GetLastFrame().draws);
+		CHECK_EQUAL(105u, stats.GetAverage().draws);
+
+		CHECK(stats.WriteCsv(TEST_CSV_FILE));
+		const std::string csv = ::ReadFile(TEST_CSV_FILE);
+		CHECK_EQUAL(11, std::count(csv.begin(), csv.end(), '\n'));
+		CHECK_EQUAL(0u, csv.find("frame,frameTimeMs,renderTimeMs,draws,instances,"));
+		// Oldest frame first
+		CHECK(::Contains(csv, "\n0,1,0.5,100,"));
+		CHECK(::Contains(csv, "\n9,10,0.5,109,"));
+		std::remove(TEST_CSV_FILE);
+
+		CHECK(stats.WriteJson(TEST_JSON_FILE));
+		const std::string json = ::ReadFile(TEST_JSON_FILE);
+		CHECK(::Contains(json, "\"frames\":10,"));
+		CHECK(::Contains(json, "\"frameTimeMs\":{\"min\":1,"));
+		CHECK(::Contains(json, "\"p50\":5"));
+		CHECK(::Contains(json, "\"p99\":10,\"max\":10}"));
+		CHECK(::Contains(json, "\"last\":{\"draws\":109,"));
+		std::remove(TEST_JSON_FILE);
+
+		CHECK(!stats.WriteCsv(""));
+	}
+}
+
+int main()
+{
+	::TestBuckets();
+	::TestNearestRank();
+	::TestAgainstSorted();
+	::TestDump();
+	return TEST_RESULT();
+}
@@ -0,0 +1,199 @@
+#include "StateCache.h"
+#include "TestCheck.h"
+#include <stdint.h>
+
+namespace
+{
+	// Stands in for ID3D11DeviceContext1, only counts the calls that reach it
+	class RecordingContext
+	{
+	public:
+		unsigned int calls = 0;
+		unsigned int draws = 0;
+		UINT lastStartSlot = 0;
+		UINT lastCount = 0;
+
+		void IASetInputLayout(ID3D11InputLayout*) { this->calls++; }
+		void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) { this->calls++; }
+		void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const*, const UINT*, const UINT*) { this->Slots(startSlot, numBuffers); }
+		void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT) { this->calls++; }
+		void VSSetShader(ID3D11VertexShader*, ID3D11ClassInstance* const*, UINT) { this->calls++; }
+		void PSSetShader(ID3D11PixelShader*, ID3D11ClassInstance* const*, UINT) { this->calls++; }
+		void VSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const*) { this->Slots(startSlot, numBuffers); }
+		void VSSetConstantBuffers1(UINT startSlot, UINT numBuffers, ID3D11Buffer* const*, const UINT*, const UINT*) { this->Slots(startSlot, numBuffers); }
+		void PSSetConstantBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const*) { this->Slots(startSlot, numBuffers); }
+		void VSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const*) { this->Slots(startSlot, numViews); }
+		void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const*) { this->Slots(startSlot, numViews); }
+		void PSSetSamplers(UINT startSlot, UINT numSamplers, ID3D11SamplerState* const*) { this->Slots(startSlot, numSamplers); }
+		void RSSetState(ID3D11RasterizerState*) { this->calls++; }
+		void RSSetViewports(UINT, const D3D11_VIEWPORT*) { this->calls++; }
+		void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT) { this->calls++; }
+		void OMSetBlendState(ID3D11BlendState*, const FLOAT*, UINT) { this->calls++; }
+		void OMSetRenderTargets(UINT, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*) { this->calls++; }
+		void DrawIndexed(UINT, UINT, INT) { this->draws++; }
+		void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT) { this->draws++; }
+
+	private:
+		void Slots(UINT startSlot, UINT count)
+		{
+			this->calls++;
+			this->lastStartSlot = startSlot;
+			this->lastCount = count;
+		}
+	};
+
+	// The cache only compares the pointers, they are never dereferenced
+	template <class T>
+	T* FakeObject(uintptr_t id)
+	{
+		return reinterpret_cast<T*>(id * 16);
+	}
+
+	void TestSingleState()
+	{
+		RecordingContext context;
+		StateCache<RecordingContext> cache;
+		cache.SetContext(&context);
+
+		ID3D11InputLayout* p_layout = ::FakeObject<ID3D11InputLayout>(1);
+		cache.IASetInputLayout(p_layout);
+		cache.IASetInputLayout(p_layout);
+		cache.IASetInputLayout(::FakeObject<ID3D11InputLayout>(2));
+		cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cache.IASetIndexBuffer(::FakeObject<ID3D11Buffer>(3), DXGI_FORMAT_R32_UINT, 0);
+		cache.IASetIndexBuffer(::FakeObject<ID3D11Buffer>(3), DXGI_FORMAT_R32_UINT, 0);
+		// A different offset is a different binding
+		cache.IASetIndexBuffer(::FakeObject<ID3D11Buffer>(3), DXGI_FORMAT_R32_UINT, 64);
+		cache.RSSetState(nullptr);
+		cache.RSSetState(nullptr);
+
+		CHECK_EQUAL(6u, cache.GetStats().issuedCalls);
+		CHECK_EQUAL(4u, cache.GetStats().filteredCalls);
+		CHECK_EQUAL(cache.GetStats().issuedCalls, context.calls);
+	}
+
+	void TestSlots()
+	{
+		RecordingContext context;
+		StateCache<RecordingContext> cache;
+		cache.SetContext(&context);
+
+		ID3D11Buffer* buffers[2] = { ::FakeObject<ID3D11Buffer>(1), ::FakeObject<ID3D11Buffer>(2) };
+		cache.VSSetConstantBuffers(0, 2, buffers);
+		// Every slot of the range is already bound
+		cache.VSSetConstantBuffers(1, 1, &buffers[1]);
+		cache.VSSetConstantBuffers(0, 2, buffers);
+		CHECK_EQUAL(1u, context.calls);
+
+		// One new slot in the range issues the whole call
+		ID3D11Buffer* changed[2] = { buffers[0], ::FakeObject<ID3D11Buffer>(3) };
+		cache.VSSetConstantBuffers(0, 2, changed);
+		CHECK_EQUAL(2u, context.calls);
+		CHECK_EQUAL(0u, context.lastStartSlot);
+		CHECK_EQUAL(2u, context.lastCount);
+
+		// A null array unbinds, the second time it is redundant
+		cache.PSSetShaderResources(0, 1, nullptr);
+		cache.PSSetShaderResources(0, 1, nullptr);
+		CHECK_EQUAL(3u, context.calls);
+
+		// Slots past the tracked ones are always issued
+		ID3D11SamplerState* p_sampler = ::FakeObject<ID3D11SamplerState>(4);
+		cache.PSSetSamplers(STATE_CACHE_SAMPLER_SLOTS, 1, &p_sampler);
+		cache.PSSetSamplers(STATE_CACHE_SAMPLER_SLOTS, 1, &p_sampler);
+		CHECK_EQUAL(5u, context.calls);
+
+		// Binding a range forgets the whole buffer binding of the slot and the other way around
+		const UINT first = 16;
+		const UINT count = 16;
+		cache.VSSetConstantBuffers1(0, 1, buffers, &first, &count);
+		cache.VSSetConstantBuffers1(0, 1, buffers, &first, &count);
+		cache.VSSetConstantBuffers(0, 1, buffers);
+		cache.VSSetConstantBuffers1(0, 1, buffers, &first, &count);
+		CHECK_EQUAL(8u, context.calls);
+
+		const UINT strides[1] = { 32 };
+		const UINT offsets[1] = { 0 };
+		cache.IASetVertexBuffers(0, 1, buffers, strides, offsets);
+		cache.IASetVertexBuffers(0, 1, buffers, strides, offsets);
+		// Binding no buffers is dropped
+		cache.IASetVertexBuffers(0, 0, nullptr, nullptr, nullptr);
+		CHECK_EQUAL(9u, context.calls);
+
+		CHECK_EQUAL(context.calls, cache.GetStats().issuedCalls);
+		CHECK_EQUAL(6u, cache.GetStats().filteredCalls);
+	}
+
+	void TestOutputMerger()
+	{
+		RecordingContext context;
+		StateCache<RecordingContext> cache;
+		cache.SetContext(&context);
+
+		const D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 1200.0f, 800.0f, 0.0f, 1.0f };
+		cache.RSSetViewports(1, &viewport);
+		cache.RSSetViewports(1, &viewport);
+		// More than one viewport is not tracked
+		const D3D11_VIEWPORT viewports[2] = { viewport, viewport };
+		cache.RSSetViewports(2, viewports);
+		cache.RSSetViewports(1, &viewport);
+		CHECK_EQUAL(3u, context.calls);
+
+		// A null blend factor is the same as all ones
+		const FLOAT ones[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		cache.OMSetBlendState(nullptr, nullptr, 0xffffffff);
+		cache.OMSetBlendState(nullptr, ones, 0xffffffff);
+		cache.OMSetBlendState(nullptr, ones, 0x0000ffff);
+		cache.OMSetDepthStencilState(nullptr, 0);
+		cache.OMSetDepthStencilState(nullptr, 1);
+		CHECK_EQUAL(7u, context.calls);
+
+		ID3D11RenderTargetView* p_view = ::FakeObject<ID3D11RenderTargetView>(1);
+		ID3D11DepthStencilView* p_depth = ::FakeObject<ID3D11DepthStencilView>(2);
+		cache.OMSetRenderTargets(1, &p_view, p_depth);
+		cache.OMSetRenderTargets(1, &p_view, p_depth);
+		cache.OMSetRenderTargets(1, &p_view, nullptr);
+		CHECK_EQUAL(9u, context.calls);
+
+		// Draws are forwarded and not counted as state
+		cache.DrawIndexed(36, 0, 0);
+		cache.DrawIndexedInstanced(36, 10, 0, 0, 0);
+		CHECK_EQUAL(2u, context.draws);
+		CHECK_EQUAL(context.calls, cache.GetStats().issuedCalls);
+		CHECK_EQUAL(3u, cache.GetStats().filteredCalls);
+	}
+
+	void TestInvalidate()
+	{
+		RecordingContext context;
+		StateCache<RecordingContext> cache;
+		cache.SetContext(&context);
+
+		ID3D11VertexShader* p_shader = ::FakeObject<ID3D11VertexShader>(1);
+		cache.VSSetShader(p_shader, nullptr, 0);
+		cache.VSSetShader(p_shader, nullptr, 0);
+		cache.Invalidate();
+		cache.VSSetShader(p_shader, nullptr, 0);
+		// Class instances are always issued and leave the shader untracked
+		ID3D11ClassInstance* p_instance = ::FakeObject<ID3D11ClassInstance>(2);
+		cache.VSSetShader(p_shader, &p_instance, 1);
+		cache.VSSetShader(p_shader, nullptr, 0);
+		CHECK_EQUAL(4u, context.calls);
+		CHECK_EQUAL(4u, cache.GetStats().issuedCalls);
+		CHECK_EQUAL(1u, cache.GetStats().filteredCalls);
+
+		cache.ResetStats();
+		CHECK_EQUAL(0u, cache.GetStats().issuedCalls);
+		CHECK_EQUAL(0u, cache.GetStats().filteredCalls);
+	}
+}
+
+int main()
+{
+	::TestSingleState();
+	::TestSlots();
+	::TestOutputMerger();
+	::TestInvalidate();
+	return TEST_RESULT();
+}
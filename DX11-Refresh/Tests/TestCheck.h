@@ -0,0 +1,33 @@
+#pragma once
+#include <stdio.h>
+
+// Checks of the portable tests. A failed check prints where it failed and the test goes on, so one run lists
+// every failure, TEST_RESULT is then returned from main and makes ctest report the test as failed.
+namespace TestCheck
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			TestCheck::Failures()++; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+	do { \
+		if (!((expected) == (actual))) \
+		{ \
+			printf("%s(%d): CHECK_EQUAL(%s, %s) failed, got %lld\n", __FILE__, __LINE__, #expected, #actual, (long long)(actual)); \
+			TestCheck::Failures()++; \
+		} \
+	} while (0)
+
+#define TEST_RESULT() (TestCheck::Failures() == 0 ? 0 : 1)
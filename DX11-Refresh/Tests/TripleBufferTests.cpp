@@ -0,0 +1,114 @@
+#include "TripleBuffer.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <thread>
+
+// Values the producer publishes in the stress test
+#define TEST_PUBLISH_COUNT 200000
+// Words of every value, all set to its sequence number so a torn read shows as a mix
+#define TEST_VALUE_WORDS 32
+
+namespace
+{
+	struct TestValue
+	{
+		uint64_t sequence = 0;
+		uint64_t words[TEST_VALUE_WORDS] = {};
+	};
+
+	void Write(TripleBuffer<TestValue>* pBuffer, uint64_t sequence)
+	{
+		TestValue& value = pBuffer->GetWriteBuffer();
+		value.sequence = sequence;
+		for (uint64_t& word : value.words)
+		{
+			word = sequence;
+		}
+		pBuffer->Publish();
+	}
+
+	bool IsWhole(const TestValue& value)
+	{
+		for (uint64_t word : value.words)
+		{
+			if (word != value.sequence)
+				return false;
+		}
+		return true;
+	}
+
+	void TestSingleThread()
+	{
+		TripleBuffer<TestValue> buffer;
+		CHECK(!buffer.Acquire());
+
+		// Only the newest of three values is seen, the other two are counted as overwritten
+		::Write(&buffer, 1);
+		::Write(&buffer, 2);
+		::Write(&buffer, 3);
+		CHECK(buffer.Acquire());
+		CHECK_EQUAL(3u, buffer.GetReadBuffer().sequence);
+		CHECK_EQUAL(2u, buffer.GetOverwrittenCount());
+
+		// Nothing new, the read buffer stays as it was even while the producer writes
+		CHECK(!buffer.Acquire());
+		buffer.GetWriteBuffer().sequence = 99;
+		CHECK_EQUAL(3u, buffer.GetReadBuffer().sequence);
+		::Write(&buffer, 4);
+		CHECK_EQUAL(3u, buffer.GetReadBuffer().sequence);
+		CHECK(buffer.Acquire());
+		CHECK_EQUAL(4u, buffer.GetReadBuffer().sequence);
+		CHECK(::IsWhole(buffer.GetReadBuffer()));
+		CHECK_EQUAL(2u, buffer.GetOverwrittenCount());
+	}
+
+	void TestProducerConsumer()
+	{
+		TripleBuffer<TestValue> buffer;
+		std::atomic<bool> done(false);
+		std::thread producer([&]()
+		{
+			for (uint64_t sequence = 1; sequence <= TEST_PUBLISH_COUNT; ++sequence)
+			{
+				::Write(&buffer, sequence);
+			}
+			done = true;
+		});
+
+		uint64_t acquired = 0;
+		uint64_t last_sequence = 0;
+		unsigned int torn = 0;
+		unsigned int out_of_order = 0;
+		for (;;)
+		{
+			// Checked before the acquire, so the last value is acquired after the producer finished
+			const bool finished = done.load();
+			if (buffer.Acquire())
+			{
+				const TestValue& value = buffer.GetReadBuffer();
+				torn += ::IsWhole(value) ? 0 : 1;
+				out_of_order += value.sequence > last_sequence ? 0 : 1;
+				last_sequence = value.sequence;
+				acquired++;
+			}
+			if (finished)
+				break;
+			std::this_thread::yield();
+		}
+		producer.join();
+
+		CHECK_EQUAL(0u, torn);
+		CHECK_EQUAL(0u, out_of_order);
+		// The newest value always wins
+		CHECK_EQUAL(TEST_PUBLISH_COUNT, last_sequence);
+		// Every published value was either acquired or overwritten
+		CHECK_EQUAL(TEST_PUBLISH_COUNT, acquired + buffer.GetOverwrittenCount());
+	}
+}
+
+int main()
+{
+	::TestSingleThread();
+	::TestProducerConsumer();
+	return TEST_RESULT();
+}
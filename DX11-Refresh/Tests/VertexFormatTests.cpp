@@ -0,0 +1,142 @@
+#include "VertexFormat.h"
+#include "TestCheck.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Large enough to be split into jobs
+#define TEST_PARALLEL_COUNT (2 * VERTEX_PACK_PARALLEL_THRESHOLD + 5)
+
+using namespace DirectX;
+
+namespace
+{
+	// The layout of the renderer, every attribute stored as it comes
+	struct TestVertex
+	{
+		XMFLOAT3 position;
+		XMFLOAT3 normal;
+		XMFLOAT2 uv;
+	};
+	VERTEX_ATTRIBUTE(TestPosition, TestVertex, position, XMFLOAT3, "POSITION", 0);
+	VERTEX_ATTRIBUTE(TestNormal, TestVertex, normal, XMFLOAT3, "NORMAL", 0);
+	VERTEX_ATTRIBUTE(TestUV, TestVertex, uv, XMFLOAT2, "TEXCOORD", 0);
+	typedef VertexFormat::Layout<TestVertex, TestPosition, TestNormal, TestUV> TestLayout;
+
+	// Converted attributes, and a float3 at the end that has no room for a wide copy
+	struct QuantizedVertex
+	{
+		PackedVector::XMHALF2 uv;
+		XMFLOAT2 offset;
+		PackedVector::XMSHORTN4 normal;
+		XMFLOAT3 position;
+	};
+	VERTEX_ATTRIBUTE(QuantizedUV, QuantizedVertex, uv, XMFLOAT2, "TEXCOORD", 0);
+	VERTEX_ATTRIBUTE(QuantizedOffset, QuantizedVertex, offset, XMFLOAT2, "TEXCOORD", 1);
+	VERTEX_ATTRIBUTE(QuantizedNormal, QuantizedVertex, normal, XMFLOAT3, "NORMAL", 0);
+	VERTEX_ATTRIBUTE(QuantizedPosition, QuantizedVertex, position, XMFLOAT3, "POSITION", 0);
+	typedef VertexFormat::Layout<QuantizedVertex, QuantizedUV, QuantizedOffset, QuantizedNormal, QuantizedPosition> QuantizedLayout;
+
+	struct TestSources
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<XMFLOAT2> uvs;
+	};
+
+	// Sized exactly, so a copy that reads past the last element is caught by sanitizers
+	TestSources MakeSources(std::mt19937& random, size_t count)
+	{
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+		TestSources sources;
+		sources.positions.resize(count);
+		sources.normals.resize(count);
+		sources.uvs.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			sources.positions[i] = XMFLOAT3(value(random), value(random), value(random));
+			sources.normals[i] = XMFLOAT3(value(random), value(random), value(random));
+			sources.uvs[i] = XMFLOAT2(value(random), value(random));
+		}
+		return sources;
+	}
+
+	bool Equal(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	bool Equal(const XMFLOAT2& a, const XMFLOAT2& b)
+	{
+		return a.x == b.x && a.y == b.y;
+	}
+
+	void TestPack()
+	{
+		std::mt19937 random(17);
+		const size_t counts[6] = { 0, 1, 2, 3, 1000, TEST_PARALLEL_COUNT };
+		for (size_t count : counts)
+		{
+			const TestSources sources = ::MakeSources(random, count);
+			// One guard vertex behind the output, nothing may be written to it
+			std::vector<TestVertex> vertices(count + 1);
+			memset(vertices.data(), 0xcd, vertices.size() * sizeof(TestVertex));
+			const TestVertex guard = vertices[count];
+			TestLayout::Pack(vertices.data(), count, sources.positions.data(), sources.normals.data(), sources.uvs.data());
+
+			bool matches = true;
+			for (size_t i = 0; i < count; ++i)
+			{
+				matches = matches && ::Equal(sources.positions[i], vertices[i].position) &&
+					::Equal(sources.normals[i], vertices[i].normal) && ::Equal(sources.uvs[i], vertices[i].uv);
+			}
+			CHECK(matches);
+			CHECK(memcmp(&guard, &vertices[count], sizeof(TestVertex)) == 0);
+
+			// Missing attributes are zeroed, also behind an attribute copied wide
+			memset(vertices.data(), 0xcd, vertices.size() * sizeof(TestVertex));
+			TestLayout::Pack(vertices.data(), count, sources.positions.data(), nullptr, nullptr);
+			bool zeroed = true;
+			for (size_t i = 0; i < count; ++i)
+			{
+				zeroed = zeroed && ::Equal(sources.positions[i], vertices[i].position) &&
+					::Equal(XMFLOAT3(0.0f, 0.0f, 0.0f), vertices[i].normal) && ::Equal(XMFLOAT2(0.0f, 0.0f), vertices[i].uv);
+			}
+			CHECK(zeroed);
+		}
+	}
+
+	void TestConverted()
+	{
+		std::mt19937 random(19);
+		const size_t counts[3] = { 1, 7, TEST_PARALLEL_COUNT };
+		for (size_t count : counts)
+		{
+			const TestSources sources = ::MakeSources(random, count);
+			std::vector<QuantizedVertex> vertices(count);
+			QuantizedLayout::Pack(vertices.data(), count, sources.uvs.data(), sources.uvs.data(), sources.normals.data(), sources.positions.data());
+
+			// Against the converters one attribute at a time
+			bool matches = true;
+			for (size_t i = 0; i < count; ++i)
+			{
+				PackedVector::XMHALF2 uv;
+				VertexFormat::Converter<XMFLOAT2, PackedVector::XMHALF2>::Convert(sources.uvs[i], &uv);
+				PackedVector::XMSHORTN4 normal;
+				VertexFormat::Converter<XMFLOAT3, PackedVector::XMSHORTN4>::Convert(sources.normals[i], &normal);
+				matches = matches && memcmp(&uv, &vertices[i].uv, sizeof(uv)) == 0 && ::Equal(sources.uvs[i], vertices[i].offset) &&
+					memcmp(&normal, &vertices[i].normal, sizeof(normal)) == 0 && ::Equal(sources.positions[i], vertices[i].position);
+			}
+			CHECK(matches);
+		}
+	}
+}
+
+int main()
+{
+	JobSystem::Init(4);
+	::TestPack();
+	::TestConverted();
+	JobSystem::Shutdown();
+	return TEST_RESULT();
+}
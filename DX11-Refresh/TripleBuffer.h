@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+// Hands values from one producer thread to one consumer thread without locks or waiting.
+// The producer fills GetWriteBuffer and publishes it, the consumer calls Acquire and reads GetReadBuffer.
+// One buffer belongs to each side and the third is shared, Publish and Acquire swap their own buffer with the
+// shared one. A value that is published twice before the consumer gets to it is overwritten, so the consumer
+// always sees the newest value and neither side ever waits for the other.
+// The buffers are reused, a producer that keeps its vectors in T keeps their capacity.
+template <class T>
+class TripleBuffer
+{
+public:
+	// Owned by the producer until Publish
+	T& GetWriteBuffer()
+	{
+		return this->mBuffers[this->mWriteIndex];
+	}
+
+	// Makes the write buffer the newest value and continues with the buffer the consumer is not using
+	void Publish()
+	{
+		const uint32_t previous = this->mShared.exchange(this->mWriteIndex | TRIPLE_BUFFER_NEW, std::memory_order_acq_rel);
+		this->mWriteIndex = previous & TRIPLE_BUFFER_INDEX;
+		if (previous & TRIPLE_BUFFER_NEW)
+			this->mOverwritten.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Takes the newest published value if there is one the consumer has not seen, returns false otherwise.
+	// The read buffer stays valid until the next Acquire
+	bool Acquire()
+	{
+		if (!(this->mShared.load(std::memory_order_relaxed) & TRIPLE_BUFFER_NEW))
+			return false;
+		const uint32_t previous = this->mShared.exchange(this->mReadIndex, std::memory_order_acq_rel);
+		this->mReadIndex = previous & TRIPLE_BUFFER_INDEX;
+		return true;
+	}
+
+	// Owned by the consumer
+	const T& GetReadBuffer() const
+	{
+		return this->mBuffers[this->mReadIndex];
+	}
+
+	// Published values the consumer never acquired
+	uint64_t GetOverwrittenCount() const
+	{
+		return this->mOverwritten.load(std::memory_order_relaxed);
+	}
+
+private:
+	enum : uint32_t
+	{
+		TRIPLE_BUFFER_INDEX = 3,
+		TRIPLE_BUFFER_NEW = 4
+	};
+
+	T mBuffers[3];
+	uint32_t mWriteIndex = 0;
+	uint32_t mReadIndex = 1;
+	// Index of the shared buffer, TRIPLE_BUFFER_NEW is set while it holds a value the consumer has not acquired
+	std::atomic<uint32_t> mShared{ 2 };
+	std::atomic<uint64_t> mOverwritten{ 0 };
+};
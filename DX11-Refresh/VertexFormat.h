@@ -0,0 +1,238 @@
+#pragma once
+#ifdef _WIN32
+#include <d3d11.h>
+#endif
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <vector>
+#include "JobSystem.h"
+
+// Attributes that are stored as they come are copied with one move of this many bytes, see Layout::Pack
+#define VERTEX_PACK_WIDE_COPY 16
+// Vertices per job when a mesh is packed in parallel, meshes with fewer than twice this many are packed on the calling thread
+#define VERTEX_PACK_PARALLEL_THRESHOLD 65536
+// Input layouts need Direct3D, without it (the portable core library) layouts only pack vertices
+#ifdef _WIN32
+#define VERTEX_FORMAT_INPUT_LAYOUTS 1
+#else
+#define VERTEX_FORMAT_INPUT_LAYOUTS 0
+#endif
+
+// Declares an attribute of a vertex struct for VertexFormat::Layout.
+// SourceT is the type of the attribute in the mesh data that gets packed into the member, it is converted
+// with VertexFormat::Converter<SourceT, member type>.
+#define VERTEX_ATTRIBUTE(Name, VertexT, Member, SourceT, Semantic, SemanticIndex) \
+	struct Name : VertexFormat::Attribute<VertexT, decltype(VertexT::Member), SourceT, offsetof(VertexT, Member), SemanticIndex> \
+	{ \
+		static const char* SemanticName() { return Semantic; } \
+	}
+
+namespace VertexFormat
+{
+#if VERTEX_FORMAT_INPUT_LAYOUTS
+	// Maps an attribute type to the format used in the input layout, specialize it for new attribute types
+	template <class T> struct FormatOf;
+	template <> struct FormatOf<float> { static const DXGI_FORMAT value = DXGI_FORMAT_R32_FLOAT; };
+	template <> struct FormatOf<DirectX::XMFLOAT2> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32_FLOAT; };
+	template <> struct FormatOf<DirectX::XMFLOAT3> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32B32_FLOAT; };
+	template <> struct FormatOf<DirectX::XMFLOAT4> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32B32A32_FLOAT; };
+	template <> struct FormatOf<DirectX::XMINT4> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32B32A32_SINT; };
+	template <> struct FormatOf<DirectX::XMUINT4> { static const DXGI_FORMAT value = DXGI_FORMAT_R32G32B32A32_UINT; };
+	// Quantized attributes
+	template <> struct FormatOf<DirectX::PackedVector::XMHALF2> { static const DXGI_FORMAT value = DXGI_FORMAT_R16G16_FLOAT; };
+	template <> struct FormatOf<DirectX::PackedVector::XMHALF4> { static const DXGI_FORMAT value = DXGI_FORMAT_R16G16B16A16_FLOAT; };
+	template <> struct FormatOf<DirectX::PackedVector::XMSHORTN4> { static const DXGI_FORMAT value = DXGI_FORMAT_R16G16B16A16_SNORM; };
+	template <> struct FormatOf<DirectX::PackedVector::XMUBYTEN4> { static const DXGI_FORMAT value = DXGI_FORMAT_R8G8B8A8_UNORM; };
+	template <> struct FormatOf<DirectX::PackedVector::XMUBYTE4> { static const DXGI_FORMAT value = DXGI_FORMAT_R8G8B8A8_UINT; };
+#endif
+
+	// Converts one source value into an attribute, specialize it for new source/attribute pairs
+	template <class SourceT, class AttributeT> struct Converter;
+
+	template <class T> struct Converter<T, T>
+	{
+		static void Convert(const T& source, T* pAttribute) { *pAttribute = source; }
+	};
+
+	template <> struct Converter<DirectX::XMFLOAT2, DirectX::PackedVector::XMHALF2>
+	{
+		static void Convert(const DirectX::XMFLOAT2& source, DirectX::PackedVector::XMHALF2* pAttribute)
+		{
+			DirectX::PackedVector::XMStoreHalf2(pAttribute, DirectX::XMLoadFloat2(&source));
+		}
+	};
+
+	template <> struct Converter<DirectX::XMFLOAT4, DirectX::PackedVector::XMHALF4>
+	{
+		static void Convert(const DirectX::XMFLOAT4& source, DirectX::PackedVector::XMHALF4* pAttribute)
+		{
+			DirectX::PackedVector::XMStoreHalf4(pAttribute, DirectX::XMLoadFloat4(&source));
+		}
+	};
+
+	// Unit vectors such as normals, w is left at 0
+	template <> struct Converter<DirectX::XMFLOAT3, DirectX::PackedVector::XMSHORTN4>
+	{
+		static void Convert(const DirectX::XMFLOAT3& source, DirectX::PackedVector::XMSHORTN4* pAttribute)
+		{
+			DirectX::PackedVector::XMStoreShortN4(pAttribute, DirectX::XMLoadFloat3(&source));
+		}
+	};
+
+	template <> struct Converter<DirectX::XMFLOAT4, DirectX::PackedVector::XMUBYTEN4>
+	{
+		static void Convert(const DirectX::XMFLOAT4& source, DirectX::PackedVector::XMUBYTEN4* pAttribute)
+		{
+			DirectX::PackedVector::XMStoreUByteN4(pAttribute, DirectX::XMLoadFloat4(&source));
+		}
+	};
+
+	// Describes one member of a vertex struct, declare attributes with VERTEX_ATTRIBUTE
+	template <class VertexT, class AttributeT, class SourceT, size_t Offset, unsigned int SemanticIndex>
+	struct Attribute
+	{
+		typedef VertexT Vertex;
+		typedef AttributeT Type;
+		typedef SourceT Source;
+		static const size_t offset = Offset;
+		static const size_t size = sizeof(AttributeT);
+		static const unsigned int semanticIndex = SemanticIndex;
+#if VERTEX_FORMAT_INPUT_LAYOUTS
+		static const DXGI_FORMAT format = FormatOf<AttributeT>::value;
+#endif
+	};
+
+	namespace Detail
+	{
+		constexpr bool All(std::initializer_list<bool> values)
+		{
+			for (bool value : values)
+			{
+				if (!value)
+					return false;
+			}
+			return true;
+		}
+
+		// True if the attributes follow each other without gaps and cover the whole vertex
+		template <class VertexT>
+		constexpr bool IsTightlyPacked(size_t offset)
+		{
+			return offset == sizeof(VertexT);
+		}
+
+		template <class VertexT, class First, class... Rest>
+		constexpr bool IsTightlyPacked(size_t offset)
+		{
+			return First::offset == offset && IsTightlyPacked<VertexT, Rest...>(offset + First::size);
+		}
+	}
+
+	// A vertex struct described by its attributes in memory order. Generates the input layout and the packing code,
+	// a vertex struct that does not match its description fails to compile.
+	template <class VertexT, class... Attributes>
+	struct Layout
+	{
+		typedef VertexT Vertex;
+		static const size_t attributeCount = sizeof...(Attributes);
+
+		static_assert(Detail::All({ std::is_same<typename Attributes::Vertex, VertexT>::value... }),
+			"Every attribute of a vertex layout must belong to the same vertex struct");
+		static_assert(Detail::IsTightlyPacked<VertexT, Attributes...>(0),
+			"Vertex layout attributes must be listed in memory order and cover the vertex struct without gaps");
+		static_assert(Detail::All({ (Attributes::offset % 4 == 0)... }),
+			"Input layout elements must start on a 4 byte boundary");
+
+#if VERTEX_FORMAT_INPUT_LAYOUTS
+		// Per instance layouts pass D3D11_INPUT_PER_INSTANCE_DATA and a step rate of 1
+		static std::array<D3D11_INPUT_ELEMENT_DESC, sizeof...(Attributes)> InputElements(UINT inputSlot = 0,
+			D3D11_INPUT_CLASSIFICATION classification = D3D11_INPUT_PER_VERTEX_DATA,
+			UINT instanceStepRate = 0)
+		{
+			std::array<D3D11_INPUT_ELEMENT_DESC, sizeof...(Attributes)> elements = { {
+				{ Attributes::SemanticName(), Attributes::semanticIndex, Attributes::format, inputSlot, (UINT)Attributes::offset, classification, instanceStepRate }...
+			} };
+			return elements;
+		}
+#endif
+
+		// Interleaves vertexCount vertices into pOut, with one source array per attribute in layout order.
+		// A nullptr source leaves its attribute zeroed. Large meshes are split into jobs of VERTEX_PACK_PARALLEL_THRESHOLD vertices.
+		static void Pack(VertexT* pOut, size_t vertexCount, const typename Attributes::Source*... pSources)
+		{
+			// A wide copy reads up to 8 bytes past the source element, so the last vertex is packed exactly
+			const size_t wide_end = vertexCount > 0 ? vertexCount - 1 : 0;
+			if (vertexCount < 2 * VERTEX_PACK_PARALLEL_THRESHOLD)
+			{
+				PackRange(pOut, 0, vertexCount, wide_end, pSources...);
+				return;
+			}
+			JobSystem::ParallelFor((unsigned int)vertexCount, VERTEX_PACK_PARALLEL_THRESHOLD, [=](unsigned int begin, unsigned int end)
+			{
+				PackRange(pOut, begin, end, wide_end, pSources...);
+			});
+		}
+
+	private:
+		// An attribute stored as it comes with at least VERTEX_PACK_WIDE_COPY bytes of its vertex from its offset on.
+		// It is copied with a single vector sized move, the bytes written past it belong to later attributes of the same
+		// vertex and are overwritten right after, since the attributes of a vertex are packed in layout order
+		template <class AttributeT>
+		struct IsWide
+		{
+			static const bool value = std::is_same<typename AttributeT::Source, typename AttributeT::Type>::value &&
+				std::is_trivially_copyable<typename AttributeT::Type>::value &&
+				(AttributeT::size == 8 || AttributeT::size == 12) &&
+				AttributeT::offset + VERTEX_PACK_WIDE_COPY <= sizeof(VertexT);
+		};
+
+		// Vertex by vertex, so every vertex is written once from front to back
+		static void PackRange(VertexT* pOut, size_t begin, size_t end, size_t wideEnd, const typename Attributes::Source*... pSources)
+		{
+			unsigned char* p_out = reinterpret_cast<unsigned char*>(pOut);
+			const size_t split = (std::max)(begin, (std::min)(end, wideEnd));
+			for (size_t i = begin; i < split; ++i)
+			{
+				// Expands to one PackAttribute call per attribute, in layout order
+				int expand[] = { 0, (PackAttribute<Attributes, true>(p_out + i * sizeof(VertexT), i, pSources), 0)... };
+				(void)expand;
+			}
+			for (size_t i = split; i < end; ++i)
+			{
+				int expand[] = { 0, (PackAttribute<Attributes, false>(p_out + i * sizeof(VertexT), i, pSources), 0)... };
+				(void)expand;
+			}
+		}
+
+		template <class AttributeT, bool Wide>
+		static void PackAttribute(unsigned char* pVertex, size_t index, const typename AttributeT::Source* pSource)
+		{
+			typename AttributeT::Type* p_attribute = reinterpret_cast<typename AttributeT::Type*>(pVertex + AttributeT::offset);
+			if (!pSource)
+				*p_attribute = typename AttributeT::Type();
+			else if (Wide && IsWide<AttributeT>::value)
+				memcpy(pVertex + AttributeT::offset, &pSource[index], VERTEX_PACK_WIDE_COPY);
+			else
+				Converter<typename AttributeT::Source, typename AttributeT::Type>::Convert(pSource[index], p_attribute);
+		}
+	};
+
+#if VERTEX_FORMAT_INPUT_LAYOUTS
+	// True if two layouts produce the same input layout, so buffers of one can be drawn with the other
+	template <class LayoutA, class LayoutB> struct IsCompatible;
+
+	template <class VertexA, class... AttributesA, class VertexB, class... AttributesB>
+	struct IsCompatible<Layout<VertexA, AttributesA...>, Layout<VertexB, AttributesB...>>
+	{
+		static_assert(sizeof...(AttributesA) == sizeof...(AttributesB), "Compatible vertex layouts need the same number of attributes");
+		static const bool value = sizeof(VertexA) == sizeof(VertexB) &&
+			Detail::All({ (AttributesA::offset == AttributesB::offset && AttributesA::format == AttributesB::format)... });
+	};
+#endif
+}
@@ -1,6 +1,13 @@
-cbuffer wvp
+// Per object constants, a slice of the constant buffer ring
+cbuffer object : register(b0)
 {
-	float4x4 gWorldViewProj;
+	float4x4 gWorld;
+};
+
+// Per frame constants, bound once per frame
+cbuffer frame : register(b2)
+{
+	float4x4 gViewProj;
 };
 
 struct VSIn
@@ -21,7 +28,7 @@ struct VSOut
 VSOut VS(VSIn input)
 {
 	VSOut output;
-	output.Pos = mul(float4(input.Pos, 1.0f), gWorldViewProj);
+	output.Pos = mul(mul(float4(input.Pos, 1.0f), gWorld), gViewProj);
 	output.Color = float4(0.83f, 0.83f, 0.83f, 1.0f);
 	output.UV = input.UV;
 	// Used for normal testing purposes to assign colour in the pixel shader